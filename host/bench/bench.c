@@ -0,0 +1,478 @@
+/**
+ * @file bench.c
+ * @brief Benchmark suite of the filesystem core, on the host stand-in.
+ *
+ * Generates synthetic save, SD and backup trees of a configurable shape, then times
+ * the scans, the sort, the copies, the exports and the imports. Each operation runs
+ * several times on the same deterministic trees, the median and the min are printed,
+ * with the FS call counters which don't depend on the host load.
+ */
+#include <3ds.h>
+#include "host.h"
+#include "synth.h"
+
+#include "fs.h"
+#include "fsls.h"
+#include "fstree.h"
+#include "fsbuf.h"
+#include "fsdir.h"
+#include "console.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BENCH_MAX_RUNS (64)
+#define BENCH_TITLEID (0x0004000000055D00ULL)
+
+/// The shape of the synthetic trees, and of the runs.
+typedef struct
+{
+	synthShape tree;	///< The shape of the trees
+	u32 runs;			///< The count of the runs per operation
+	u32 seed;			///< The seed of the file sizes and contents
+} benchShape;
+
+/// The results of an operation.
+typedef struct
+{
+	u64 times[BENCH_MAX_RUNS];	///< The durations (us) of the runs
+	hostFsStats stats;			///< The FS counters of the last run
+	u64 bytes;					///< The bytes processed per run
+} benchResult;
+
+typedef Result (*benchFunc)(void* arg);
+
+static benchShape shape = { { 2, 4, 8, 0x4000 }, 5, 1 };
+static FILE* out = NULL;
+static const u16 rootPath[2] = { '/', '\0' };
+
+/**
+ * @brief Times an operation, once per run.
+ * @param prepare Called before each run, untimed (NULL if none).
+ * @param func The operation.
+ */
+static Result benchRun(benchResult* result, benchFunc prepare, benchFunc func, void* arg)
+{
+	Result ret = 0;
+
+	for (u32 i = 0; i < shape.runs && R_SUCCEEDED(ret); i++)
+	{
+		if (prepare) prepare(arg);
+
+		hostResetFsStats();
+		u64 tick = svcGetSystemTick();
+		ret = func(arg);
+		result->times[i] = (svcGetSystemTick() - tick) * 1000000 / SYSCLOCK_ARM11;
+		result->stats = *hostGetFsStats();
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Compares two durations, for qsort.
+ */
+static int benchCompare(const void* a, const void* b)
+{
+	u64 x = *(const u64*) a, y = *(const u64*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints the results of an operation.
+ */
+static void benchPrint(const char* name, benchResult* result, Result ret)
+{
+	if (R_FAILED(ret))
+	{
+		fprintf(out, "%-14s failed: %08lx\n", name, (unsigned long) ret);
+		return;
+	}
+
+	qsort(result->times, shape.runs, sizeof(u64), benchCompare);
+	u64 median = result->times[shape.runs / 2];
+	u64 min = result->times[0];
+
+	fprintf(out, "%-14s %10.2f %10.2f %8.1f %7llu %7llu %7llu %7llu %7llu\n", name,
+		median / 1000.0, min / 1000.0, (median > 0 ? result->bytes / (double) median : 0.0),
+		result->stats.opens, result->stats.reads, result->stats.writes, result->stats.flushes, result->stats.dirReads);
+}
+
+static const FS_Archive* saveArchive = NULL;
+static const FS_Archive* sdmcArchive = NULL;
+
+/**
+ * @brief Scans the save, without hashing.
+ */
+static Result benchScanSave(void* arg)
+{
+	fsTree tree;
+	memset(&tree, 0, sizeof(fsTree));
+	Result ret = fsTreeScan(&tree, rootPath, saveArchive, false);
+	fsTreeFree(&tree);
+	return ret;
+}
+
+/**
+ * @brief Scans the SD tree, without hashing.
+ */
+static Result benchScanSdmc(void* arg)
+{
+	static const u16 sdPath[] = { '/', 'b', 'e', 'n', 'c', 'h', '-', 's', 'd', '/', '\0' };
+
+	fsTree tree;
+	memset(&tree, 0, sizeof(fsTree));
+	Result ret = fsTreeScan(&tree, sdPath, sdmcArchive, false);
+	fsTreeFree(&tree);
+	return ret;
+}
+
+/**
+ * @brief Scans and hashes the save.
+ */
+static Result benchHashSave(void* arg)
+{
+	fsTree tree;
+	memset(&tree, 0, sizeof(fsTree));
+	Result ret = fsTreeScan(&tree, rootPath, saveArchive, true);
+	fsTreeFree(&tree);
+	return ret;
+}
+
+/// The shuffled tree to sort, rebuilt before each run.
+static fsTree sortTree;
+static fsTree scanTree;
+
+/**
+ * @brief Rebuilds the tree to sort, in a deterministic shuffled order.
+ */
+static Result benchShuffle(void* arg)
+{
+	fsTreeFree(&sortTree);
+	memset(&sortTree, 0, sizeof(fsTree));
+
+	u32 count = scanTree.fileCount + scanTree.dirCount;
+	fsTreeNode** nodes = (fsTreeNode**) malloc(count * sizeof(fsTreeNode*));
+	if (!nodes) return -2;
+
+	u32 i = 0;
+	for (fsTreeNode* node = scanTree.firstNode; node && i < count; node = node->nextNode) nodes[i++] = node;
+
+	u32 seed = shape.seed;
+	for (u32 j = count; j > 1; j--)
+	{
+		u32 k = synthRandom(&seed) % j;
+		fsTreeNode* tmp = nodes[j - 1];
+		nodes[j - 1] = nodes[k];
+		nodes[k] = tmp;
+	}
+
+	for (u32 j = 0; j < count; j++)
+	{
+		if (nodes[j]->isDirectory) fsTreeAddDir(&sortTree, nodes[j]->path);
+		else fsTreeAddFile(&sortTree, nodes[j]->path, nodes[j]->size, NULL);
+	}
+
+	free(nodes);
+	return 0;
+}
+
+/**
+ * @brief Sorts the shuffled tree.
+ */
+static Result benchSort(void* arg)
+{
+	fsTreeSort(&sortTree);
+	return 0;
+}
+
+/**
+ * @brief Deletes the copy of the save on the SD.
+ */
+static Result benchCleanCopy(void* arg)
+{
+	FSUSER_DeleteDirectoryRecursively(*sdmcArchive, fsMakePath(PATH_ASCII, "/bench-copy/"));
+	return FSUSER_CreateDirectory(*sdmcArchive, fsMakePath(PATH_ASCII, "/bench-copy/"), FS_ATTRIBUTE_DIRECTORY);
+}
+
+/**
+ * @brief Copies the save to the SD, file by file.
+ */
+static Result benchCopy(void* arg)
+{
+	static const u16 copyPath[] = { '/', 'b', 'e', 'n', 'c', 'h', '-', 'c', 'o', 'p', 'y', '/', '\0' };
+
+	Result ret = 0;
+	u16 srcPath[FS_MAX_PATH_LENGTH];
+	u16 dstPath[FS_MAX_PATH_LENGTH];
+
+	for (fsTreeNode* node = scanTree.firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeMakePath(srcPath, rootPath, node->path);
+		fsTreeMakePath(dstPath, copyPath, node->path);
+
+		if (node->isDirectory) ret = FSUSER_CreateDirectory(*sdmcArchive, fsMakePath(PATH_UTF16, dstPath), FS_ATTRIBUTE_DIRECTORY);
+		else ret = fsCopyFile(srcPath, saveArchive, dstPath, sdmcArchive, FS_ATTRIBUTE_NONE, NULL);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Deletes the backups of the title, so each export is a new one.
+ */
+static Result benchCleanBackups(void* arg)
+{
+	char path[64];
+	sprintf(path, "/backup/%016llx/", BENCH_TITLEID);
+
+	fsBackExit();
+	FSUSER_DeleteDirectoryRecursively(*sdmcArchive, fsMakePath(PATH_ASCII, path));
+	fsBackInit(BENCH_TITLEID);
+
+	return 0;
+}
+
+/**
+ * @brief Exports the save (forced, without verifying).
+ */
+static Result benchExport(void* arg)
+{
+	return fsBackExport(false, true);
+}
+
+/**
+ * @brief Selects the latest backup.
+ */
+static Result benchSelect(void* arg)
+{
+	fsBackPrintBackup();
+	return 0;
+}
+
+/**
+ * @brief Imports the selected backup.
+ * @param arg Whether the import is minimal.
+ */
+static Result benchImport(void* arg)
+{
+	return fsBackImport(arg != NULL);
+}
+
+/// The root dir of the backup imported the former way (see benchSelectCopy).
+static u16 copyRoot[FS_MAX_PATH_LENGTH];
+
+/**
+ * @brief Finds the backup of the title, for the former import.
+ */
+static Result benchSelectCopy(void* arg)
+{
+	char path8[64];
+	sprintf(path8, "/backup/%016llx/", BENCH_TITLEID);
+
+	fsEntry dir;
+	memset(&dir, 0, sizeof(fsEntry));
+	utf8_to_utf16(dir.name16, (u8*) path8, FS_MAX_PATH_LENGTH - 1);
+
+	Result ret = fsScanDir(&dir, sdmcArchive, false);
+
+	// The first backup dir (its digests and the index are files).
+	fsEntry* entry = dir.firstEntry;
+	while (entry && !entry->isDirectory) entry = entry->nextEntry;
+	if (R_SUCCEEDED(ret) && !entry) ret = -1;
+
+	if (R_SUCCEEDED(ret))
+	{
+		fsTreeMakePath(copyRoot, dir.name16, entry->name16);
+		copyRoot[str16len(copyRoot)] = '/';
+	}
+
+	fsFreeDir(&dir);
+	return ret;
+}
+
+/**
+ * @brief Imports the backup the former way: the save is deleted, then the backup
+ * is listed and copied file by file, without staging nor restore on failure.
+ */
+static Result benchImportCopy(void* arg)
+{
+	Result ret = FSUSER_DeleteDirectoryRecursively(*saveArchive, fsMakePath(PATH_UTF16, rootPath));
+
+	fsTree tree;
+	memset(&tree, 0, sizeof(fsTree));
+	if (R_SUCCEEDED(ret)) ret = fsTreeScan(&tree, copyRoot, sdmcArchive, false);
+
+	u16 srcPath[FS_MAX_PATH_LENGTH];
+	u16 dstPath[FS_MAX_PATH_LENGTH];
+
+	for (fsTreeNode* node = tree.firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeMakePath(srcPath, copyRoot, node->path);
+		fsTreeMakePath(dstPath, rootPath, node->path);
+
+		if (node->isDirectory) ret = FSUSER_CreateDirectory(*saveArchive, fsMakePath(PATH_UTF16, dstPath), FS_ATTRIBUTE_DIRECTORY);
+		else ret = fsCopyFile(srcPath, sdmcArchive, dstPath, saveArchive, FS_ATTRIBUTE_NONE, NULL);
+	}
+
+	fsTreeFree(&tree);
+
+	Result commitRet = FS_CommitArchive(saveArchive);
+	return (R_FAILED(ret) ? ret : commitRet);
+}
+
+/**
+ * @brief Prints the usage.
+ */
+static void benchUsage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-r root] [-d depth] [-w width] [-f files] [-s size] [-n runs] [-x seed] [-p flush]\n", name);
+	fprintf(stderr, "  -r root   The work directory (default: bench_root, wiped)\n");
+	fprintf(stderr, "  -d depth  The depth of the directories (default: %lu)\n", (unsigned long) shape.tree.depth);
+	fprintf(stderr, "  -w width  The subdirectories per directory (default: %lu)\n", (unsigned long) shape.tree.width);
+	fprintf(stderr, "  -f files  The files per directory (default: %lu)\n", (unsigned long) shape.tree.files);
+	fprintf(stderr, "  -s size   The mean size of the files (default: %lu)\n", (unsigned long) shape.tree.size);
+	fprintf(stderr, "  -n runs   The runs per operation (default: %lu, max %u)\n", (unsigned long) shape.runs, BENCH_MAX_RUNS);
+	fprintf(stderr, "  -x seed   The seed of the trees (default: %lu)\n", (unsigned long) shape.seed);
+	fprintf(stderr, "  -p flush  The flush policy: none, write or close (default: %s)\n", FS_GetFlushPolicyName(FS_GetFlushPolicy(NULL)));
+	fprintf(stderr, "Slow media: TVDS_HOST_LATENCY=us, TVDS_HOST_BANDWIDTH=read[,write] (bytes/s), TVDS_HOST_FREE=bytes\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* root = "bench_root";
+	int opt;
+
+	FS_FlushPolicy flush = FS_GetFlushPolicy(NULL);
+
+	while ((opt = getopt(argc, argv, "r:d:w:f:s:n:x:p:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': root = optarg; break;
+			case 'd': shape.tree.depth = strtoul(optarg, NULL, 0); break;
+			case 'w': shape.tree.width = strtoul(optarg, NULL, 0); break;
+			case 'f': shape.tree.files = strtoul(optarg, NULL, 0); break;
+			case 's': shape.tree.size = strtoul(optarg, NULL, 0); break;
+			case 'n': shape.runs = strtoul(optarg, NULL, 0); break;
+			case 'x': shape.seed = strtoul(optarg, NULL, 0); break;
+			case 'p':
+				if (R_FAILED(FS_ParseFlushPolicy(optarg, &flush)))
+				{
+					benchUsage(argv[0]);
+					return 1;
+				}
+				break;
+			default: benchUsage(argv[0]); return 1;
+		}
+	}
+
+	if (shape.runs == 0 || shape.runs > BENCH_MAX_RUNS)
+	{
+		benchUsage(argv[0]);
+		return 1;
+	}
+
+	// The core logs to the console (stdout), the results go to the real stdout.
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	if (!out || !freopen("/dev/null", "w", stdout)) return 1;
+
+	char path[0x400];
+	snprintf(path, sizeof(path), "rm -rf '%s'", root);
+	if (system(path) != 0) return 1;
+
+	mkdir(root, 0755);
+	hostSetRoot(root);
+
+	// The same trees for the save and the SD.
+	u32 seed = shape.seed;
+	snprintf(path, sizeof(path), "%s/save", root);
+	u64 totalSize = synthTree(path, &shape.tree, &seed);
+
+	snprintf(path, sizeof(path), "%s/sdmc", root);
+	mkdir(path, 0755);
+	seed = shape.seed;
+	snprintf(path, sizeof(path), "%s/sdmc/bench-sd", root);
+	synthTree(path, &shape.tree, &seed);
+
+	consoleInitDefault();
+	FS_Init();
+	fsBufferInit();
+	FS_SetFlushPolicy(flush);
+
+	// Without fsTuneInit, the default chunk sizes are used, whatever the host.
+	fsDirInit(BENCH_TITLEID);
+	fsBackInit(BENCH_TITLEID);
+
+	FS_AcquireArchive(&saveArchiveDesc, &saveArchive);
+	FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+
+	memset(&scanTree, 0, sizeof(fsTree));
+	memset(&sortTree, 0, sizeof(fsTree));
+	Result ret = fsTreeScan(&scanTree, rootPath, saveArchive, false);
+	if (R_FAILED(ret))
+	{
+		fprintf(out, "Couldn't scan the save: %08lx\n", (unsigned long) ret);
+		return 1;
+	}
+
+	fprintf(out, "tvds host bench: depth %lu, width %lu, files %lu, size %lu, runs %lu, seed %lu, flush %s\n",
+		(unsigned long) shape.tree.depth, (unsigned long) shape.tree.width, (unsigned long) shape.tree.files,
+		(unsigned long) shape.tree.size, (unsigned long) shape.runs, (unsigned long) shape.seed, FS_GetFlushPolicyName(flush));
+	fprintf(out, "tree: %lu files, %lu dirs, %llu bytes\n\n", (unsigned long) scanTree.fileCount, (unsigned long) scanTree.dirCount, totalSize);
+	fprintf(out, "%-14s %10s %10s %8s %7s %7s %7s %7s %7s\n", "operation", "median ms", "min ms", "MB/s", "opens", "reads", "writes", "flushes", "lists");
+
+	benchResult result;
+
+	memset(&result, 0, sizeof(result));
+	benchPrint("scan save", &result, benchRun(&result, NULL, benchScanSave, NULL));
+
+	memset(&result, 0, sizeof(result));
+	benchPrint("scan sd", &result, benchRun(&result, NULL, benchScanSdmc, NULL));
+
+	memset(&result, 0, sizeof(result));
+	benchPrint("sort", &result, benchRun(&result, benchShuffle, benchSort, NULL));
+
+	memset(&result, 0, sizeof(result));
+	result.bytes = totalSize;
+	benchPrint("hash save", &result, benchRun(&result, NULL, benchHashSave, NULL));
+
+	memset(&result, 0, sizeof(result));
+	result.bytes = totalSize;
+	benchPrint("copy save>sd", &result, benchRun(&result, benchCleanCopy, benchCopy, NULL));
+
+	memset(&result, 0, sizeof(result));
+	result.bytes = totalSize;
+	benchPrint("export", &result, benchRun(&result, benchCleanBackups, benchExport, NULL));
+
+	memset(&result, 0, sizeof(result));
+	result.bytes = totalSize;
+	benchPrint("import full", &result, benchRun(&result, benchSelect, benchImport, NULL));
+
+	memset(&result, 0, sizeof(result));
+	result.bytes = totalSize;
+	benchPrint("import minimal", &result, benchRun(&result, benchSelect, benchImport, (void*) 1));
+
+	memset(&result, 0, sizeof(result));
+	result.bytes = totalSize;
+	benchPrint("import copy", &result, benchRun(&result, benchSelectCopy, benchImportCopy, NULL));
+
+	fsTreeFree(&scanTree);
+	fsTreeFree(&sortTree);
+
+	FS_ReleaseArchive(sdmcArchive);
+	FS_ReleaseArchive(saveArchive);
+
+	fsBackExit();
+	fsDirExit();
+	fsBufferExit();
+	FS_Exit();
+
+	fclose(out);
+
+	return 0;
+}
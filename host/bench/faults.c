@@ -0,0 +1,471 @@
+/**
+ * @file faults.c
+ * @brief Fault checks of the filesystem core, on the host stand-in.
+ *
+ * Runs the exports and the imports with failed writes, failed reads and a full sdmc,
+ * then checks that no partial tree is left behind: a failed export leaves the backups
+ * as they were, a successful one is complete with its digests and its index entry,
+ * a failed import leaves the save as it was.
+ * An export with a short heap shall succeed, with smaller chunks.
+ * A bit flipped on the sdmc shall fail the verify of the export, and of the backup,
+ * and the corrupted backup shall never be the reference of an unchanged save.
+ */
+#include <3ds.h>
+#include "host.h"
+#include "synth.h"
+
+#include "fs.h"
+#include "fsls.h"
+#include "fstree.h"
+#include "fsindex.h"
+#include "fsbuf.h"
+#include "fsdir.h"
+#include "mem.h"
+#include "console.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FAULTS_TITLEID (0x0004000000055D00ULL)
+#define FAULTS_MAX_ENTRIES (64)
+#define FAULTS_NAME_LENGTH (64)
+#define FAULTS_SPARE_HEAP (0x50000) // bytes left on the heap for the short heap export
+
+/// An entry of the backup directory of the title.
+typedef struct
+{
+	char name[FAULTS_NAME_LENGTH];	///< The name
+	bool isDirectory;				///< If a directory
+	u64 size;						///< The size (files only)
+} faultsEntry;
+
+/// A listing of the backup directory of the title.
+typedef struct
+{
+	faultsEntry entries[FAULTS_MAX_ENTRIES];	///< The entries, sorted by name
+	u32 count;									///< The count of the entries
+} faultsListing;
+
+static synthShape shape = { 2, 3, 4, 0x3000 };
+static FILE* out = NULL;
+static const u16 rootPath[2] = { '/', '\0' };
+static const FS_Archive* saveArchive = NULL;
+static const FS_Archive* sdmcArchive = NULL;
+static u32 passCount = 0;
+static u32 failCount = 0;
+
+/**
+ * @brief Prints the result of a check.
+ */
+static void faultsReport(bool passed, const char* name, Result ret)
+{
+	fprintf(out, "%s  %-28s %08lx\n", passed ? "PASS" : "FAIL", name, (unsigned long) ret);
+	if (passed) passCount++;
+	else failCount++;
+}
+
+/**
+ * @brief Compares two entries by name, for qsort.
+ */
+static int faultsCompare(const void* a, const void* b)
+{
+	return strcmp(((const faultsEntry*) a)->name, ((const faultsEntry*) b)->name);
+}
+
+/**
+ * @brief Lists the backup directory of the title, on the host.
+ */
+static void faultsList(faultsListing* listing)
+{
+	char path[0x400];
+	snprintf(path, sizeof(path), "%s/sdmc/backup/%016llx", hostGetRoot(), FAULTS_TITLEID);
+
+	memset(listing, 0, sizeof(faultsListing));
+
+	DIR* dir = opendir(path);
+	if (!dir) return;
+
+	struct dirent* ent;
+	while ((ent = readdir(dir)) && listing->count < FAULTS_MAX_ENTRIES)
+	{
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+
+		char child[0x500];
+		snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+
+		struct stat st;
+		if (stat(child, &st) != 0) continue;
+
+		faultsEntry* entry = &listing->entries[listing->count++];
+		snprintf(entry->name, FAULTS_NAME_LENGTH, "%s", ent->d_name);
+		entry->isDirectory = S_ISDIR(st.st_mode);
+		entry->size = (entry->isDirectory ? 0 : st.st_size);
+	}
+	closedir(dir);
+
+	qsort(listing->entries, listing->count, sizeof(faultsEntry), faultsCompare);
+}
+
+/**
+ * @brief Scans and hashes a tree, sorted.
+ */
+static Result faultsScan(fsTree* tree, const u16* root, const FS_Archive* archive)
+{
+	memset(tree, 0, sizeof(fsTree));
+	Result ret = fsTreeScan(tree, root, archive, true);
+	if (R_SUCCEEDED(ret)) fsTreeSort(tree);
+	return ret;
+}
+
+/**
+ * @brief Compares two scanned trees, by paths, sizes and hashes.
+ */
+static bool faultsTreeEquals(const fsTree* a, const fsTree* b)
+{
+	if (a->fileCount != b->fileCount || a->dirCount != b->dirCount) return false;
+
+	const fsTreeNode* x = a->firstNode;
+	const fsTreeNode* y = b->firstNode;
+	for (; x && y; x = x->nextNode, y = y->nextNode)
+	{
+		if (str16cmp(x->path, y->path) != 0 || x->isDirectory != y->isDirectory) return false;
+		if (!x->isDirectory && (x->size != y->size || x->hash != y->hash)) return false;
+	}
+
+	return (!x && !y);
+}
+
+/**
+ * @brief Checks whether the save equals a scanned tree.
+ */
+static bool faultsSaveEquals(const fsTree* expected)
+{
+	fsTree tree;
+	Result ret = faultsScan(&tree, rootPath, saveArchive);
+	bool equals = (R_SUCCEEDED(ret) && faultsTreeEquals(&tree, expected));
+	fsTreeFree(&tree);
+	return equals;
+}
+
+/**
+ * @brief Checks that a backup has its digest file, and its digested entry in the index.
+ * @param[in] name The name of the backup.
+ */
+static bool faultsIndexed(const char* name)
+{
+	char path8[FS_MAX_PATH_LENGTH];
+	u16 path[FS_MAX_PATH_LENGTH];
+
+	fsManifest manifest;
+	memset(&manifest, 0, sizeof(fsManifest));
+	memset(path, 0, sizeof(path));
+	snprintf(path8, sizeof(path8), "/backup/%016llx/%s.sum", FAULTS_TITLEID, name);
+	utf8_to_utf16(path, (u8*) path8, FS_MAX_PATH_LENGTH - 1);
+	if (R_FAILED(fsManifestRead(&manifest, path, sdmcArchive)) || !manifest.isDigested) return false;
+
+	fsIndex index;
+	memset(&index, 0, sizeof(fsIndex));
+	memset(path, 0, sizeof(path));
+	snprintf(path8, sizeof(path8), "/backup/%016llx/index", FAULTS_TITLEID);
+	utf8_to_utf16(path, (u8*) path8, FS_MAX_PATH_LENGTH - 1);
+	bool indexed = R_SUCCEEDED(fsIndexRead(&index, path, sdmcArchive));
+
+	u16 name16[FS_MAX_FPATH_LENGTH];
+	memset(name16, 0, sizeof(name16));
+	utf8_to_utf16(name16, (u8*) name, FS_MAX_FPATH_LENGTH - 1);
+
+	fsManifest* entry = (indexed ? fsIndexFind(&index, name16) : NULL);
+	indexed = (entry && entry->isDigested && entry->digest == manifest.digest);
+
+	fsIndexFree(&index);
+	return indexed;
+}
+
+/**
+ * @brief Waits for the next second, so each export gets a new backup name.
+ */
+static void faultsNextSecond(void)
+{
+	time_t now = time(NULL);
+	while (time(NULL) == now) usleep(10000);
+}
+
+/**
+ * @brief Exports the save with a fault, then checks that the backups are either unchanged
+ * or that the new backup is complete (the fault hit after the copy).
+ * @param[in] save The scanned save.
+ * @param spareHeap The bytes left on the heap once the caches are released (0 if unlimited),
+ * the export shall then succeed.
+ */
+static void faultsExport(const char* name, const hostFsFault* fault, const hostFsMedia* media, size_t spareHeap, const fsTree* save)
+{
+	faultsListing before, after;
+
+	faultsNextSecond();
+	faultsList(&before);
+
+	if (spareHeap > 0)
+	{
+		memReclaim();
+		hostSetHeapLimit(hostGetHeapUsed() + spareHeap);
+	}
+
+	hostSetFsMedia(media);
+	hostSetFsFault(fault);
+	Result ret = fsBackExport(false, true);
+	hostSetFsFault(NULL);
+	hostSetFsMedia(NULL);
+	hostSetHeapLimit(-1);
+
+	faultsList(&after);
+
+	bool passed = (spareHeap == 0 || R_SUCCEEDED(ret));
+	if (R_FAILED(ret))
+	{
+		// The failed export shall leave the backups as they were.
+		passed = (before.count == after.count);
+		for (u32 i = 0; passed && i < before.count; i++)
+			passed = !memcmp(&before.entries[i], &after.entries[i], sizeof(faultsEntry));
+	}
+	else
+	{
+		// The new backup shall hold the whole save.
+		for (u32 i = 0; passed && i < after.count; i++)
+		{
+			if (!after.entries[i].isDirectory) continue;
+			if (bsearch(&after.entries[i], before.entries, before.count, sizeof(faultsEntry), faultsCompare)) continue;
+
+			char path8[FS_MAX_PATH_LENGTH];
+			u16 path[FS_MAX_PATH_LENGTH];
+			memset(path, 0, sizeof(path));
+			snprintf(path8, sizeof(path8), "/backup/%016llx/%s/", FAULTS_TITLEID, after.entries[i].name);
+			utf8_to_utf16(path, (u8*) path8, FS_MAX_PATH_LENGTH - 1);
+
+			fsTree tree;
+			passed = (R_SUCCEEDED(faultsScan(&tree, path, sdmcArchive)) && faultsTreeEquals(&tree, save));
+			fsTreeFree(&tree);
+
+			// Its digest file and its index entry shall be written too.
+			if (passed) passed = faultsIndexed(after.entries[i].name);
+		}
+	}
+
+	faultsReport(passed, name, ret);
+}
+
+/**
+ * @brief Imports the selected backup with a fault, then checks that the save is either
+ * the backup (success) or unchanged (failure).
+ * @param[in] save The scanned save before the import.
+ * @param[in] backup The scanned backup.
+ */
+static void faultsImport(const char* name, bool minimal, const hostFsFault* fault, const fsTree* save, const fsTree* backup)
+{
+	fsBackPrintBackup();
+
+	hostSetFsFault(fault);
+	Result ret = fsBackImport(minimal);
+	hostSetFsFault(NULL);
+
+	faultsReport(faultsSaveEquals(R_SUCCEEDED(ret) ? backup : save), name, ret);
+}
+
+/**
+ * @brief Prints the usage.
+ */
+static void faultsUsage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-r root] [-d depth] [-w width] [-f files] [-s size]\n", name);
+	fprintf(stderr, "  -r root   The work directory (default: faults_root, wiped)\n");
+	fprintf(stderr, "  -d depth  The depth of the directories (default: %lu)\n", (unsigned long) shape.depth);
+	fprintf(stderr, "  -w width  The subdirectories per directory (default: %lu)\n", (unsigned long) shape.width);
+	fprintf(stderr, "  -f files  The files per directory (default: %lu)\n", (unsigned long) shape.files);
+	fprintf(stderr, "  -s size   The mean size of the files (default: %lu)\n", (unsigned long) shape.size);
+}
+
+int main(int argc, char** argv)
+{
+	const char* root = "faults_root";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:d:w:f:s:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': root = optarg; break;
+			case 'd': shape.depth = strtoul(optarg, NULL, 0); break;
+			case 'w': shape.width = strtoul(optarg, NULL, 0); break;
+			case 'f': shape.files = strtoul(optarg, NULL, 0); break;
+			case 's': shape.size = strtoul(optarg, NULL, 0); break;
+			default: faultsUsage(argv[0]); return 1;
+		}
+	}
+
+	// The core logs to the console (stdout), the results go to the real stdout.
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	if (!out || !freopen("/dev/null", "w", stdout)) return 1;
+
+	char path[0x400];
+	snprintf(path, sizeof(path), "rm -rf '%s'", root);
+	if (system(path) != 0) return 1;
+
+	mkdir(root, 0755);
+	hostSetRoot(root);
+
+	// The injected faults only, whatever the environment.
+	hostSetFsMedia(NULL);
+	hostSetFsFault(NULL);
+
+	u32 seed = 1;
+	snprintf(path, sizeof(path), "%s/save", root);
+	u64 totalSize = synthTree(path, &shape, &seed);
+
+	snprintf(path, sizeof(path), "%s/sdmc", root);
+	mkdir(path, 0755);
+
+	consoleInitDefault();
+	FS_Init();
+	fsBufferInit();
+	fsDirInit(FAULTS_TITLEID);
+	fsBackInit(FAULTS_TITLEID);
+
+	FS_AcquireArchive(&saveArchiveDesc, &saveArchive);
+	FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+
+	fsTree backup;
+	Result ret = faultsScan(&backup, rootPath, saveArchive);
+
+	// The reference backup, and the count of its calls.
+	hostSetFsFault(NULL);
+	if (R_SUCCEEDED(ret)) ret = fsBackExport(false, true);
+	if (R_FAILED(ret))
+	{
+		fprintf(out, "Couldn't export the reference backup: %08lx\n", (unsigned long) ret);
+		return 1;
+	}
+
+	u32 writeCount = hostGetFsCallCount(HOST_FS_WRITE);
+	u32 readCount = hostGetFsCallCount(HOST_FS_READ);
+	u32 createCount = hostGetFsCallCount(HOST_FS_CREATE);
+
+	fprintf(out, "tvds host faults: %lu files, %lu dirs, %llu bytes; export: %lu writes, %lu reads, %lu creates\n\n",
+		(unsigned long) backup.fileCount, (unsigned long) backup.dirCount, totalSize,
+		(unsigned long) writeCount, (unsigned long) readCount, (unsigned long) createCount);
+
+	char name[64];
+	hostFsFault fault;
+	memset(&fault, 0, sizeof(fault));
+	fault.count = 1;
+
+	// Exports: the writes fail at the start, the middle and the end, a read fails, the sdmc gets full.
+	u32 points[4] = { 1, writeCount / 2, writeCount - 1, writeCount };
+	for (u32 i = 0; i < 4; i++)
+	{
+		if (points[i] == 0 || (i > 0 && points[i] == points[i-1])) continue;
+		fault.op = HOST_FS_WRITE;
+		fault.at = points[i];
+		sprintf(name, "export, write %lu/%lu fails", (unsigned long) points[i], (unsigned long) writeCount);
+		faultsExport(name, &fault, NULL, 0, &backup);
+	}
+
+	fault.op = HOST_FS_READ;
+	fault.at = (readCount + 1) / 2;
+	sprintf(name, "export, read %lu/%lu fails", (unsigned long) fault.at, (unsigned long) readCount);
+	faultsExport(name, &fault, NULL, 0, &backup);
+
+	fault.op = HOST_FS_CREATE;
+	fault.at = (createCount + 1) / 2;
+	sprintf(name, "export, create %lu/%lu fails", (unsigned long) fault.at, (unsigned long) createCount);
+	faultsExport(name, &fault, NULL, 0, &backup);
+
+	hostFsMedia media = { 0, 0, 0, totalSize / 2 };
+	faultsExport("export, sdmc full at 50%", NULL, &media, 0, &backup);
+
+	sprintf(name, "export, %lu KB heap left", (unsigned long) FAULTS_SPARE_HEAP / 1024);
+	faultsExport(name, NULL, NULL, FAULTS_SPARE_HEAP, &backup);
+
+	// Verifies: a bit flips on the sdmc, when written by the export then when read back by the verify.
+	fault.op = HOST_FS_WRITE;
+	fault.at = 1;
+	fault.flip = true;
+	faultsNextSecond();
+	hostSetFsFault(&fault);
+	ret = fsBackExport(true, true);
+	hostSetFsFault(NULL);
+	faultsReport(ret == FS_VERIFY_FAILED, "export, write 1 flips a bit", ret);
+
+	// The corrupted backup is flagged, the save is still exported.
+	faultsNextSecond();
+	ret = fsBackExport(false, false);
+	faultsReport(ret != FS_SAVE_UNCHANGED && R_SUCCEEDED(ret), "export after a failed verify", ret);
+
+	// The save is now the latest good backup, the new copy is removed.
+	faultsNextSecond();
+	ret = fsBackExport(false, false);
+	faultsReport(ret == FS_SAVE_UNCHANGED, "export of an unchanged save", ret);
+
+	fsBackPrintBackup(); // selects the reference backup
+	hostSetFsFault(NULL);
+	ret = fsBackVerify();
+	u32 verifyCount = hostGetFsCallCount(HOST_FS_READ);
+	faultsReport(ret == 0, "verify, no fault", ret);
+
+	fault.op = HOST_FS_READ;
+	fault.at = verifyCount;
+	hostSetFsFault(&fault);
+	ret = fsBackVerify();
+	hostSetFsFault(NULL);
+	sprintf(name, "verify, read %lu/%lu flips a bit", (unsigned long) fault.at, (unsigned long) verifyCount);
+	faultsReport(ret == FS_VERIFY_FAILED, name, ret);
+	fault.flip = false;
+
+	// Imports: the save differs from the backup, the writes fail.
+	snprintf(path, sizeof(path), "%s/save", root);
+	fsBackExit();
+	snprintf(name, sizeof(name), "rm -rf '%s'", path);
+	if (system(name) != 0) return 1;
+	seed = 2;
+	synthTree(path, &shape, &seed);
+	fsBackInit(FAULTS_TITLEID);
+
+	fsTree save;
+	faultsScan(&save, rootPath, saveArchive);
+
+	u32 fileCount = save.fileCount;
+	u32 importPoints[3] = { 1, fileCount / 2, fileCount };
+	for (u32 i = 0; i < 3; i++)
+	{
+		fault.op = HOST_FS_WRITE;
+		fault.at = (importPoints[i] > 0 ? importPoints[i] : 1);
+		sprintf(name, "import full, write %lu fails", (unsigned long) fault.at);
+		faultsImport(name, false, &fault, &save, &backup);
+
+		sprintf(name, "import minimal, write %lu fails", (unsigned long) fault.at);
+		faultsImport(name, true, &fault, &save, &backup);
+	}
+
+	faultsImport("import minimal, no fault", true, NULL, &save, &backup);
+
+	fprintf(out, "\n%lu passed, %lu failed\n", (unsigned long) passCount, (unsigned long) failCount);
+
+	fsTreeFree(&save);
+	fsTreeFree(&backup);
+
+	FS_ReleaseArchive(sdmcArchive);
+	FS_ReleaseArchive(saveArchive);
+
+	fsBackExit();
+	fsDirExit();
+	fsBufferExit();
+	FS_Exit();
+
+	fclose(out);
+
+	return (failCount > 0 ? 1 : 0);
+}
@@ -0,0 +1,509 @@
+/**
+ * @file fsreplay.c
+ * @brief Replay of a FS capture (see fscapture.h), on the host stand-in.
+ *
+ * Re-executes the calls of a capture against a copy of the archives, with the simulated
+ * media of the stand-in, and compares the durations to the captured ones. The strategies
+ * change the calls replayed (deferred flushes, batched directory reads), to measure them
+ * on the same real workload. The data written is synthetic, the data read is discarded.
+ */
+#include <3ds.h>
+#include "host.h"
+
+#include "fs.h"
+#include "fscapture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define REPLAY_MAX_RUNS (64)
+#define REPLAY_MAX_HANDLES (256)
+#define REPLAY_MAX_ENTRIES (256)
+
+/// The names of the captured calls.
+static const char* const opNames[FS_CAPTURE_OP_COUNT] = {
+	"OpenArchive", "CloseArchive", "ControlArchive", "GetFreeBytes",
+	"OpenFile", "CreateFile", "DeleteFile",
+	"OpenDirectory", "CreateDirectory", "DeleteDirectory", "DeleteRecursively",
+	"Read", "Write", "GetSize", "SetSize", "Flush", "Close",
+	"DirRead", "DirClose",
+};
+
+/// The strategies of the replay.
+typedef struct
+{
+	bool deferFlush;		///< The flushes are deferred to the close of the file
+	u32 dirBatch;			///< The entries read per directory read (0 as captured)
+	bool verbose;			///< The diverging calls are printed
+} replayStrategy;
+
+/// A handle of the capture, and its replay.
+typedef struct
+{
+	u32 captured;			///< The captured handle (0 if free)
+	Handle handle;			///< The replayed handle
+	bool isDirectory;		///< Whether a directory, else a file
+	bool isDirty;			///< Whether a flush was deferred (files)
+	u32 buffered;			///< The entries read ahead (directories)
+	bool isExhausted;		///< Whether the directory has no more entries
+} replayHandle;
+
+/// The results of a call type.
+typedef struct
+{
+	u32 count;				///< The captured calls
+	u32 calls;				///< The calls replayed
+	u32 diverged;			///< The calls of another result than captured
+	u64 capturedTicks;		///< The captured duration
+	u64 replayTicks;		///< The replayed duration
+} replayResult;
+
+static replayStrategy strategy = { false, 0, false };
+static replayHandle handles[REPLAY_MAX_HANDLES];
+static FS_Archive archives[4];
+static u32 archiveCount = 0;
+static u8* dataBuffer = NULL;
+static u32 dataSize = 0;
+static FS_DirectoryEntry entries[REPLAY_MAX_ENTRIES];
+
+/**
+ * @brief Gets the replay of a captured handle.
+ * @param add Whether to add the handle if not found.
+ */
+static replayHandle* replayFind(u32 captured, bool add)
+{
+	if (captured == 0) return NULL;
+
+	replayHandle* slot = NULL;
+	for (u32 i = 0; i < REPLAY_MAX_HANDLES; i++)
+	{
+		if (handles[i].captured == captured) return &handles[i];
+		if (!slot && handles[i].captured == 0) slot = &handles[i];
+	}
+
+	if (!add || !slot) return NULL;
+
+	memset(slot, 0, sizeof(replayHandle));
+	slot->captured = captured;
+	return slot;
+}
+
+/**
+ * @brief Gets the archive of an id, opened on the first use.
+ */
+static FS_Archive* replayArchive(u32 id)
+{
+	for (u32 i = 0; i < archiveCount; i++)
+	{
+		if (archives[i].id == id) return &archives[i];
+	}
+
+	if (archiveCount == sizeof(archives) / sizeof(archives[0])) return NULL;
+
+	FS_Archive* archive = &archives[archiveCount];
+	memset(archive, 0, sizeof(FS_Archive));
+	archive->id = id;
+	archive->lowPath = fsMakePath(PATH_EMPTY, "");
+	if (R_FAILED(FSUSER_OpenArchive(archive))) return NULL;
+
+	archiveCount++;
+	return archive;
+}
+
+/**
+ * @brief Gets a buffer of size bytes, for the reads and the writes.
+ */
+static u8* replayData(u32 size)
+{
+	if (size > dataSize)
+	{
+		u8* grown = (u8*) realloc(dataBuffer, size);
+		if (!grown) return NULL;
+
+		for (u32 i = dataSize; i < size; i++) grown[i] = (u8) (i * 31 + 7);
+		dataBuffer = grown;
+		dataSize = size;
+	}
+
+	return dataBuffer;
+}
+
+/**
+ * @brief Prints the path of a record (the ASCII part of an UTF-16 path).
+ */
+static void replayPrintPath(const fsCaptureRecord* record, const u8* path)
+{
+	for (u32 i = 0; i < record->pathSize; i++)
+	{
+		if (record->pathType == PATH_UTF16 && i % 2 == 1) continue;
+		if (path[i] == '\0') break;
+		putc(path[i] >= 0x20 && path[i] < 0x7F ? path[i] : '?', stderr);
+	}
+}
+
+/**
+ * @brief Replays a directory read, from the entries read ahead if batched.
+ * @return The result of the read (0 if no call was needed).
+ */
+static Result replayDirRead(replayHandle* dir, const fsCaptureRecord* record, replayResult* result)
+{
+	Result ret = 0;
+	u32 count = (record->size < REPLAY_MAX_ENTRIES ? record->size : REPLAY_MAX_ENTRIES);
+
+	if (strategy.dirBatch == 0)
+	{
+		u32 entriesRead = 0;
+		result->calls++;
+		return FSDIR_Read(dir->handle, &entriesRead, count, entries);
+	}
+
+	// Another read only if the entries read ahead don't cover this one.
+	if (dir->buffered < count && !dir->isExhausted)
+	{
+		u32 batch = (strategy.dirBatch > count ? strategy.dirBatch : count);
+		if (batch > REPLAY_MAX_ENTRIES) batch = REPLAY_MAX_ENTRIES;
+
+		u32 entriesRead = 0;
+		result->calls++;
+		ret = FSDIR_Read(dir->handle, &entriesRead, batch - dir->buffered, entries);
+		if (R_FAILED(ret) || entriesRead < batch - dir->buffered) dir->isExhausted = true;
+		dir->buffered += entriesRead;
+	}
+
+	dir->buffered -= (dir->buffered < count ? dir->buffered : count);
+	return ret;
+}
+
+/**
+ * @brief Replays a call.
+ * @param[in] path The path of the call (record->pathSize bytes).
+ */
+static void replayCall(const fsCaptureRecord* record, const u8* path, replayResult* result)
+{
+	Result ret = 0;
+	bool called = true;
+	FS_Path fsPath = { (FS_PathType) record->pathType, record->pathSize, path };
+	FS_Archive* archive = (record->archiveId ? replayArchive(record->archiveId) : NULL);
+	replayHandle* handle = replayFind(record->handle, false);
+
+	u64 start = svcGetSystemTick();
+
+	switch (record->op)
+	{
+		case FS_CAPTURE_OPEN_ARCHIVE:
+		case FS_CAPTURE_CLOSE_ARCHIVE:
+		{
+			// The archives stay open for the whole replay.
+			called = false;
+			break;
+		}
+		case FS_CAPTURE_CONTROL_ARCHIVE:
+		{
+			ret = (archive ? FSUSER_ControlArchive(*archive, (FS_ArchiveAction) record->offset, NULL, 0, NULL, 0) : -1);
+			break;
+		}
+		case FS_CAPTURE_GET_FREE_BYTES:
+		{
+			u64 freeBytes;
+			ret = (archive ? FSUSER_GetFreeBytes(&freeBytes, *archive) : -1);
+			break;
+		}
+		case FS_CAPTURE_OPEN_FILE:
+		case FS_CAPTURE_OPEN_DIRECTORY:
+		{
+			Handle opened = 0;
+			if (!archive) ret = -1;
+			else if (record->op == FS_CAPTURE_OPEN_FILE) ret = FSUSER_OpenFile(&opened, *archive, fsPath, (u32) record->offset, FS_ATTRIBUTE_NONE);
+			else ret = FSUSER_OpenDirectory(&opened, *archive, fsPath);
+
+			handle = (R_SUCCEEDED(ret) ? replayFind(record->handle, true) : NULL);
+			if (handle)
+			{
+				handle->handle = opened;
+				handle->isDirectory = (record->op == FS_CAPTURE_OPEN_DIRECTORY);
+			}
+			break;
+		}
+		case FS_CAPTURE_CREATE_FILE:
+		{
+			ret = (archive ? FSUSER_CreateFile(*archive, fsPath, FS_ATTRIBUTE_NONE, record->offset) : -1);
+			break;
+		}
+		case FS_CAPTURE_DELETE_FILE:
+		{
+			ret = (archive ? FSUSER_DeleteFile(*archive, fsPath) : -1);
+			break;
+		}
+		case FS_CAPTURE_CREATE_DIRECTORY:
+		{
+			ret = (archive ? FSUSER_CreateDirectory(*archive, fsPath, FS_ATTRIBUTE_DIRECTORY) : -1);
+			break;
+		}
+		case FS_CAPTURE_DELETE_DIRECTORY:
+		{
+			ret = (archive ? FSUSER_DeleteDirectory(*archive, fsPath) : -1);
+			break;
+		}
+		case FS_CAPTURE_DELETE_RECURSIVELY:
+		{
+			ret = (archive ? FSUSER_DeleteDirectoryRecursively(*archive, fsPath) : -1);
+			break;
+		}
+		case FS_CAPTURE_READ:
+		case FS_CAPTURE_WRITE:
+		{
+			u32 bytes = 0;
+			u8* data = replayData(record->size);
+			if (!handle || !data) ret = -1;
+			else if (record->op == FS_CAPTURE_READ) ret = FSFILE_Read(handle->handle, &bytes, record->offset, data, record->size);
+			else ret = FSFILE_Write(handle->handle, &bytes, record->offset, data, record->size, 0);
+			break;
+		}
+		case FS_CAPTURE_GET_SIZE:
+		{
+			u64 size;
+			ret = (handle ? FSFILE_GetSize(handle->handle, &size) : -1);
+			break;
+		}
+		case FS_CAPTURE_SET_SIZE:
+		{
+			ret = (handle ? FSFILE_SetSize(handle->handle, record->offset) : -1);
+			break;
+		}
+		case FS_CAPTURE_FLUSH:
+		{
+			if (handle && strategy.deferFlush)
+			{
+				handle->isDirty = true;
+				called = false;
+			}
+			else ret = (handle ? FSFILE_Flush(handle->handle) : -1);
+			break;
+		}
+		case FS_CAPTURE_CLOSE:
+		case FS_CAPTURE_DIR_CLOSE:
+		{
+			if (!handle)
+			{
+				ret = -1;
+				break;
+			}
+
+			// The deferred flushes, once.
+			if (handle->isDirty)
+			{
+				FSFILE_Flush(handle->handle);
+				result->calls++;
+			}
+
+			ret = (record->op == FS_CAPTURE_CLOSE ? FSFILE_Close(handle->handle) : FSDIR_Close(handle->handle));
+			handle->captured = 0;
+			break;
+		}
+		case FS_CAPTURE_DIR_READ:
+		{
+			called = false;
+			ret = (handle ? replayDirRead(handle, record, result) : -1);
+			break;
+		}
+		default: called = false; break;
+	}
+
+	result->replayTicks += svcGetSystemTick() - start;
+	result->capturedTicks += record->duration;
+	result->count++;
+	if (called) result->calls++;
+
+	if (R_SUCCEEDED(ret) != R_SUCCEEDED(record->result))
+	{
+		result->diverged++;
+		if (strategy.verbose)
+		{
+			fprintf(stderr, "%-18s %08lx (captured %08lx) ", opNames[record->op], (unsigned long) ret, (unsigned long) record->result);
+			replayPrintPath(record, path);
+			putc('\n', stderr);
+		}
+	}
+}
+
+/**
+ * @brief Replays a whole capture.
+ * @return The count of the records (0 if the capture is invalid).
+ */
+static u32 replayRun(const u8* capture, size_t size, replayResult* results)
+{
+	u32 count = 0;
+	size_t offset = strlen(FS_CAPTURE_MAGIC);
+
+	memset(handles, 0, sizeof(handles));
+	memset(archives, 0, sizeof(archives));
+	archiveCount = 0;
+
+	while (offset + sizeof(fsCaptureRecord) <= size)
+	{
+		fsCaptureRecord record;
+		memcpy(&record, capture + offset, sizeof(fsCaptureRecord));
+		offset += sizeof(fsCaptureRecord);
+
+		u32 pathSize = (record.pathSize + 3) & ~3;
+		if (record.op >= FS_CAPTURE_OP_COUNT || offset + pathSize > size) break;
+
+		replayCall(&record, capture + offset, &results[record.op]);
+		offset += pathSize;
+		count++;
+	}
+
+	// The handles left open by the capture.
+	for (u32 i = 0; i < REPLAY_MAX_HANDLES; i++)
+	{
+		if (handles[i].captured == 0) continue;
+		if (handles[i].isDirectory) FSDIR_Close(handles[i].handle);
+		else FSFILE_Close(handles[i].handle);
+	}
+
+	for (u32 i = 0; i < archiveCount; i++)
+		FSUSER_CloseArchive(&archives[i]);
+
+	return count;
+}
+
+/**
+ * @brief Compares two durations, for qsort.
+ */
+static int replayCompare(const void* a, const void* b)
+{
+	u64 x = *(const u64*) a, y = *(const u64*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Converts ticks to milliseconds.
+ */
+static double replayMillis(u64 ticks)
+{
+	return (double) ticks * 1000.0 / SYSCLOCK_ARM11;
+}
+
+/**
+ * @brief Prints the usage.
+ */
+static void replayUsage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-r root] [-t template] [-n runs] [-d] [-b entries] [-v] capture\n", name);
+	fprintf(stderr, "  -r root      The archives replayed against (default: host_root)\n");
+	fprintf(stderr, "  -t template  The archives copied to the root before each run\n");
+	fprintf(stderr, "  -n runs      The count of the runs (default: 1, max %u)\n", REPLAY_MAX_RUNS);
+	fprintf(stderr, "  -d           Defers the flushes to the close of the files\n");
+	fprintf(stderr, "  -b entries   Reads the directories by batches of entries (max %u)\n", REPLAY_MAX_ENTRIES);
+	fprintf(stderr, "  -v           Prints the calls of another result than captured\n");
+	fprintf(stderr, "Slow media: TVDS_HOST_LATENCY=us, TVDS_HOST_BANDWIDTH=read[,write] (bytes/s), TVDS_HOST_FREE=bytes\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* root = "host_root";
+	const char* template = NULL;
+	u32 runs = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:t:n:db:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': root = optarg; break;
+			case 't': template = optarg; break;
+			case 'n': runs = strtoul(optarg, NULL, 0); break;
+			case 'd': strategy.deferFlush = true; break;
+			case 'b': strategy.dirBatch = strtoul(optarg, NULL, 0); break;
+			case 'v': strategy.verbose = true; break;
+			default: replayUsage(argv[0]); return 1;
+		}
+	}
+
+	if (optind != argc - 1 || runs == 0 || runs > REPLAY_MAX_RUNS || strategy.dirBatch > REPLAY_MAX_ENTRIES || (runs > 1 && !template))
+	{
+		replayUsage(argv[0]);
+		return 1;
+	}
+
+	FILE* file = fopen(argv[optind], "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Couldn't open %s\n", argv[optind]);
+		return 1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size_t size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	u8* capture = (u8*) malloc(size + 1);
+	if (!capture || fread(capture, 1, size, file) != size || size < strlen(FS_CAPTURE_MAGIC) || memcmp(capture, FS_CAPTURE_MAGIC, strlen(FS_CAPTURE_MAGIC)) != 0)
+	{
+		fprintf(stderr, "Not a capture: %s\n", argv[optind]);
+		fclose(file);
+		free(capture);
+		return 1;
+	}
+	fclose(file);
+
+	hostSetRoot(root);
+
+	replayResult results[FS_CAPTURE_OP_COUNT];
+	u64 totals[REPLAY_MAX_RUNS];
+	u32 count = 0;
+
+	for (u32 run = 0; run < runs; run++)
+	{
+		if (template)
+		{
+			char command[0x400];
+			snprintf(command, sizeof(command), "rm -rf '%s' && cp -a '%s' '%s'", root, template, root);
+			if (system(command) != 0) return 1;
+		}
+
+		memset(results, 0, sizeof(results));
+		count = replayRun(capture, size, results);
+
+		totals[run] = 0;
+		for (u32 op = 0; op < FS_CAPTURE_OP_COUNT; op++)
+			totals[run] += results[op].replayTicks;
+	}
+
+	printf("tvds fs replay: %s, %lu record(s), %lu run(s)\n", argv[optind], (unsigned long) count, (unsigned long) runs);
+	printf("strategy: flushes %s, directory reads %s", (strategy.deferFlush ? "deferred" : "as captured"), (strategy.dirBatch ? "batched by " : "as captured"));
+	if (strategy.dirBatch) printf("%lu", (unsigned long) strategy.dirBatch);
+	printf("\n\n%-18s %8s %8s %12s %12s %8s\n", "call", "count", "calls", "captured ms", "replay ms", "diverged");
+
+	replayResult total;
+	memset(&total, 0, sizeof(total));
+
+	for (u32 op = 0; op < FS_CAPTURE_OP_COUNT; op++)
+	{
+		const replayResult* result = &results[op];
+		if (result->count == 0) continue;
+
+		printf("%-18s %8lu %8lu %12.3f %12.3f %8lu\n", opNames[op], (unsigned long) result->count, (unsigned long) result->calls,
+			replayMillis(result->capturedTicks), replayMillis(result->replayTicks), (unsigned long) result->diverged);
+
+		total.count += result->count;
+		total.calls += result->calls;
+		total.diverged += result->diverged;
+		total.capturedTicks += result->capturedTicks;
+		total.replayTicks += result->replayTicks;
+	}
+
+	printf("%-18s %8lu %8lu %12.3f %12.3f %8lu\n", "total", (unsigned long) total.count, (unsigned long) total.calls,
+		replayMillis(total.capturedTicks), replayMillis(total.replayTicks), (unsigned long) total.diverged);
+
+	qsort(totals, runs, sizeof(u64), replayCompare);
+	printf("\nreplay: median %.3f ms, min %.3f ms\n", replayMillis(totals[runs / 2]), replayMillis(totals[0]));
+
+	free(capture);
+	free(dataBuffer);
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file synth.c
+ * @brief Synthetic trees of the host tools.
+ */
+#include "synth.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+u32 synthRandom(u32* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+/**
+ * @brief Writes a level of a synthetic tree.
+ * @param depth The remaining depth.
+ */
+static u64 synthLevel(const char* path, const synthShape* shape, u32 depth, u32* seed)
+{
+	char child[0x400];
+	u64 total = 0;
+
+	mkdir(path, 0755);
+
+	for (u32 i = 0; i < shape->files; i++)
+	{
+		u32 size = shape->size / 2 + (shape->size > 0 ? synthRandom(seed) % (shape->size + 1) : 0);
+
+		snprintf(child, sizeof(child), "%s/file%03lu.bin", path, (unsigned long) i);
+		FILE* file = fopen(child, "wb");
+		if (!file) continue;
+
+		for (u32 j = 0; j < size; j++) fputc(synthRandom(seed) & 0xFF, file);
+		fclose(file);
+
+		total += size;
+	}
+
+	for (u32 i = 0; depth > 0 && i < shape->width; i++)
+	{
+		snprintf(child, sizeof(child), "%s/dir%02lu", path, (unsigned long) i);
+		total += synthLevel(child, shape, depth - 1, seed);
+	}
+
+	return total;
+}
+
+u64 synthTree(const char* path, const synthShape* shape, u32* seed)
+{
+	return synthLevel(path, shape, shape->depth, seed);
+}
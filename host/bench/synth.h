@@ -0,0 +1,31 @@
+#pragma once
+/**
+ * @file synth.h
+ * @brief Synthetic trees of the host tools.
+ */
+#include <3ds/types.h>
+
+/// The shape of a synthetic tree.
+typedef struct
+{
+	u32 depth;		///< The depth of the directories
+	u32 width;		///< The count of the subdirectories per directory
+	u32 files;		///< The count of the files per directory
+	u32 size;		///< The mean size in bytes of the files
+} synthShape;
+
+/**
+ * @brief Gets the next pseudo-random number.
+ * @param[in/out] seed The seed.
+ */
+u32 synthRandom(u32* seed);
+
+/**
+ * @brief Writes a synthetic tree to a host directory, recursively.
+ * The files are between half and one and a half of the mean size, of random content.
+ * @param[in] path The host directory (created if needed).
+ * @param[in] shape The shape of the tree.
+ * @param[in/out] seed The seed of the sizes and contents.
+ * @return The total size of the files.
+ */
+u64 synthTree(const char* path, const synthShape* shape, u32* seed);
@@ -0,0 +1,20 @@
+#pragma once
+/**
+ * @file 3ds.h
+ * @brief Host stand-in for the libctru umbrella header.
+ */
+#include <3ds/types.h>
+#include <3ds/result.h>
+#include <3ds/svc.h>
+#include <3ds/srv.h>
+#include <3ds/os.h>
+#include <3ds/gfx.h>
+#include <3ds/console.h>
+#include <3ds/thread.h>
+#include <3ds/synchronization.h>
+#include <3ds/services/fs.h>
+#include <3ds/services/am.h>
+#include <3ds/services/apt.h>
+#include <3ds/services/hid.h>
+#include <3ds/services/gspgpu.h>
+#include <3ds/util/utf.h>
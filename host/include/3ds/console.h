@@ -0,0 +1,20 @@
+#pragma once
+/**
+ * @file console.h
+ * @brief Host stand-in for the libctru text console.
+ */
+#include <3ds/types.h>
+#include <3ds/gfx.h>
+
+typedef struct PrintConsole
+{
+	int windowX, windowY;
+	int windowWidth, windowHeight;
+	gfxScreen_t screen;
+	bool consoleInitialised;
+} PrintConsole;
+
+PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console);
+void consoleSetWindow(PrintConsole* console, int x, int y, int width, int height);
+PrintConsole* consoleSelect(PrintConsole* console);
+void consoleClear(void);
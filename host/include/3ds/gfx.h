@@ -0,0 +1,17 @@
+#pragma once
+/**
+ * @file gfx.h
+ * @brief Host stand-in for the libctru graphics helpers.
+ */
+#include <3ds/types.h>
+
+typedef enum
+{
+	GFX_TOP = 0,
+	GFX_BOTTOM = 1,
+} gfxScreen_t;
+
+void gfxInitDefault(void);
+void gfxExit(void);
+void gfxFlushBuffers(void);
+void gfxSwapBuffers(void);
@@ -0,0 +1,6 @@
+#pragma once
+/**
+ * @file ipc.h
+ * @brief Host stand-in for the libctru IPC helpers.
+ */
+#include <3ds/types.h>
@@ -0,0 +1,24 @@
+#pragma once
+/**
+ * @file os.h
+ * @brief Host stand-in for the libctru OS helpers.
+ */
+#include <3ds/types.h>
+
+#define SYSCLOCK_SOC       (16756991)
+#define SYSCLOCK_SYS       (SYSCLOCK_SOC * 2)
+#define SYSCLOCK_SDMMC     (SYSCLOCK_SYS * 2)
+#define SYSCLOCK_ARM9      (SYSCLOCK_SOC * 8)
+#define SYSCLOCK_ARM11     (SYSCLOCK_ARM9 * 2)
+#define SYSCLOCK_ARM11_NEW (SYSCLOCK_ARM11 * 3)
+
+typedef enum
+{
+	MEMREGION_ALL = 0,
+	MEMREGION_APPLICATION = 1,
+	MEMREGION_SYSTEM = 2,
+	MEMREGION_BASE = 3,
+} MemRegion;
+
+u64 osGetTime(void);
+s64 osGetMemRegionFree(MemRegion region);
@@ -0,0 +1,11 @@
+#pragma once
+/**
+ * @file result.h
+ * @brief Host stand-in for the libctru result helpers.
+ */
+#define R_SUCCEEDED(res) ((res)>=0)
+#define R_FAILED(res) ((res)<0)
+#define R_LEVEL(res) (((res)>>27)&0x1F)
+#define R_SUMMARY(res) (((res)>>21)&0x3F)
+#define R_MODULE(res) (((res)>>10)&0xFF)
+#define R_DESCRIPTION(res) ((res)&0x3FF)
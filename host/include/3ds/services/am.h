@@ -0,0 +1,12 @@
+#pragma once
+/**
+ * @file am.h
+ * @brief Host stand-in for the libctru application manager service.
+ */
+#include <3ds/types.h>
+#include <3ds/services/fs.h>
+
+Result amInit(void);
+void amExit(void);
+Result AM_GetTitleCount(FS_MediaType mediatype, u32* count);
+Result AM_GetTitleList(u32* titlesRead, FS_MediaType mediatype, u32 titleCount, u64* titleIds);
@@ -0,0 +1,11 @@
+#pragma once
+/**
+ * @file apt.h
+ * @brief Host stand-in for the libctru applet service.
+ */
+#include <3ds/types.h>
+
+bool aptMainLoop(void);
+void aptOpenSession(void);
+void aptCloseSession(void);
+Result APT_GetProgramID(u64* pProgramID);
@@ -0,0 +1,143 @@
+#pragma once
+/**
+ * @file fs.h
+ * @brief Host stand-in for the libctru filesystem service.
+ */
+#include <3ds/types.h>
+
+/// Open flags.
+enum
+{
+	FS_OPEN_READ   = BIT(0),
+	FS_OPEN_WRITE  = BIT(1),
+	FS_OPEN_CREATE = BIT(2),
+};
+
+/// Write flags.
+enum
+{
+	FS_WRITE_FLUSH       = BIT(0),
+	FS_WRITE_UPDATE_TIME = BIT(8),
+};
+
+/// Attribute flags.
+enum
+{
+	FS_ATTRIBUTE_DIRECTORY = BIT(0),
+	FS_ATTRIBUTE_HIDDEN    = BIT(8),
+	FS_ATTRIBUTE_ARCHIVE   = BIT(16),
+	FS_ATTRIBUTE_READ_ONLY = BIT(24),
+};
+
+/// Media types.
+typedef enum
+{
+	MEDIATYPE_NAND      = 0,
+	MEDIATYPE_SD        = 1,
+	MEDIATYPE_GAME_CARD = 2,
+} FS_MediaType;
+
+/// Archive IDs.
+typedef enum
+{
+	ARCHIVE_ROMFS               = 0x00000003,
+	ARCHIVE_SAVEDATA            = 0x00000004,
+	ARCHIVE_EXTDATA             = 0x00000006,
+	ARCHIVE_SHARED_EXTDATA      = 0x00000007,
+	ARCHIVE_SYSTEM_SAVEDATA     = 0x00000008,
+	ARCHIVE_SDMC                = 0x00000009,
+	ARCHIVE_SDMC_WRITE_ONLY     = 0x0000000A,
+	ARCHIVE_USER_SAVEDATA       = 0x567890B2,
+} FS_ArchiveID;
+
+/// Path types.
+typedef enum
+{
+	PATH_INVALID = 0,
+	PATH_EMPTY   = 1,
+	PATH_BINARY  = 2,
+	PATH_ASCII   = 3,
+	PATH_UTF16   = 4,
+} FS_PathType;
+
+/// Archive actions.
+typedef enum
+{
+	ARCHIVE_ACTION_COMMIT_SAVE_DATA = 0,
+	ARCHIVE_ACTION_GET_TIMESTAMP    = 1,
+} FS_ArchiveAction;
+
+/// Secure save control actions.
+typedef enum
+{
+	SECURESAVE_ACTION_DELETE = 0,
+	SECURESAVE_ACTION_FORMAT = 1,
+} FS_SecureSaveAction;
+
+/// Secure value slot.
+typedef enum
+{
+	SECUREVALUE_SLOT_SD = 0x1000,
+} FS_SecureValueSlot;
+
+/// Directory entry.
+typedef struct
+{
+	u16 name[0x106];
+	char shortName[0x0A];
+	char shortExt[0x04];
+	u8 valid;
+	u8 reserved;
+	u32 attributes;
+	u64 fileSize;
+} FS_DirectoryEntry;
+
+/// Filesystem path data.
+typedef struct
+{
+	FS_PathType type;
+	u32 size;
+	const void* data;
+} FS_Path;
+
+/// Filesystem archive.
+typedef struct
+{
+	u32 id;
+	FS_Path lowPath;
+	u64 handle;
+} FS_Archive;
+
+Result fsInit(void);
+void fsExit(void);
+void fsUseSession(Handle session, bool sdmc);
+void fsEndUseSession(void);
+FS_Path fsMakePath(FS_PathType type, const void* path);
+Handle* fsGetSessionHandle(void);
+
+Result FSUSER_Initialize(Handle session);
+Result FSUSER_OpenFile(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes);
+Result FSUSER_DeleteFile(FS_Archive archive, FS_Path path);
+Result FSUSER_RenameFile(FS_Archive srcArchive, FS_Path srcPath, FS_Archive dstArchive, FS_Path dstPath);
+Result FSUSER_DeleteDirectory(FS_Archive archive, FS_Path path);
+Result FSUSER_DeleteDirectoryRecursively(FS_Archive archive, FS_Path path);
+Result FSUSER_CreateFile(FS_Archive archive, FS_Path path, u32 attributes, u64 fileSize);
+Result FSUSER_CreateDirectory(FS_Archive archive, FS_Path path, u32 attributes);
+Result FSUSER_RenameDirectory(FS_Archive srcArchive, FS_Path srcPath, FS_Archive dstArchive, FS_Path dstPath);
+Result FSUSER_OpenDirectory(Handle *out, FS_Archive archive, FS_Path path);
+Result FSUSER_OpenArchive(FS_Archive* archive);
+Result FSUSER_ControlArchive(FS_Archive archive, FS_ArchiveAction action, void* input, u32 inputSize, void* output, u32 outputSize);
+Result FSUSER_CloseArchive(FS_Archive* archive);
+Result FSUSER_GetFreeBytes(u64* freeBytes, FS_Archive archive);
+Result FSUSER_GetMediaType(FS_MediaType* mediaType);
+Result FSUSER_ControlSecureSave(FS_SecureSaveAction action, void* input, u32 inputSize, void* output, u32 outputSize);
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size);
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags);
+Result FSFILE_GetSize(Handle handle, u64* size);
+Result FSFILE_SetSize(Handle handle, u64 size);
+Result FSFILE_Flush(Handle handle);
+Result FSFILE_Close(Handle handle);
+
+Result FSDIR_Read(Handle handle, u32* entriesRead, u32 entryCount, FS_DirectoryEntry* entries);
+Result FSDIR_Close(Handle handle);
@@ -0,0 +1,8 @@
+#pragma once
+/**
+ * @file gspgpu.h
+ * @brief Host stand-in for the libctru GPU service.
+ */
+#include <3ds/types.h>
+
+void gspWaitForVBlank(void);
@@ -0,0 +1,8 @@
+#pragma once
+/**
+ * @file srv.h
+ * @brief Host stand-in for the libctru service manager.
+ */
+#include <3ds/types.h>
+
+Result srvGetServiceHandleDirect(Handle* out, const char* name);
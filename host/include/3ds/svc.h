@@ -0,0 +1,13 @@
+#pragma once
+/**
+ * @file svc.h
+ * @brief Host stand-in for the libctru syscalls.
+ */
+#include <3ds/types.h>
+
+u64 svcGetSystemTick(void);
+void svcSleepThread(s64 ns);
+Result svcCloseHandle(Handle handle);
+Result svcCreateSemaphore(Handle* semaphore, s32 initial_count, s32 max_count);
+Result svcReleaseSemaphore(s32* count, Handle semaphore, s32 release_count);
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds);
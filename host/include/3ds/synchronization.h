@@ -0,0 +1,15 @@
+#pragma once
+/**
+ * @file synchronization.h
+ * @brief Host stand-in for the libctru synchronization primitives.
+ */
+#include <3ds/types.h>
+
+#include <pthread.h>
+
+/// A lock, a mutex on the host (not recursive, as on the 3DS).
+typedef pthread_mutex_t LightLock;
+
+void LightLock_Init(LightLock* lock);
+void LightLock_Lock(LightLock* lock);
+void LightLock_Unlock(LightLock* lock);
@@ -0,0 +1,13 @@
+#pragma once
+/**
+ * @file thread.h
+ * @brief Host stand-in for the libctru threads.
+ */
+#include <3ds/types.h>
+
+typedef struct Thread_tag* Thread;
+
+Thread threadCreate(ThreadFunc entrypoint, void* arg, size_t stack_size, int prio, int affinity, bool detached);
+Result threadJoin(Thread thread, u64 timeout_ns);
+void threadFree(Thread thread);
+Thread threadGetCurrent(void);
@@ -0,0 +1,36 @@
+#pragma once
+/**
+ * @file types.h
+ * @brief Host stand-in for the libctru types.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+#define U64_MAX UINT64_MAX
+
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef signed long long s64;
+
+typedef volatile u8 vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+typedef volatile u64 vu64;
+
+typedef volatile s8 vs8;
+typedef volatile s16 vs16;
+typedef volatile s32 vs32;
+typedef volatile s64 vs64;
+
+typedef u32 Handle;
+typedef s32 Result;
+typedef void (*ThreadFunc)(void *);
+
+#define BIT(n) (1U<<(n))
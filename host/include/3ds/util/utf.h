@@ -0,0 +1,10 @@
+#pragma once
+/**
+ * @file utf.h
+ * @brief Host stand-in for the libctru UTF conversions.
+ */
+#include <stdint.h>
+#include <sys/types.h>
+
+ssize_t utf8_to_utf16(uint16_t* out, const uint8_t* in, size_t len);
+ssize_t utf16_to_utf8(uint8_t* out, const uint16_t* in, size_t len);
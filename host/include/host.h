@@ -0,0 +1,127 @@
+#pragma once
+/**
+ * @file host.h
+ * @brief Host stand-in controls (not part of libctru).
+ */
+#include <3ds/types.h>
+#include <3ds/services/fs.h>
+
+#include <stddef.h>
+
+/// Counters of the host FS stand-in.
+typedef struct
+{
+	u64 opens;		///< Files and directories opened.
+	u64 reads;		///< FSFILE_Read calls.
+	u64 writes;		///< FSFILE_Write calls.
+	u64 flushes;	///< Flushes (FS_WRITE_FLUSH and FSFILE_Flush).
+	u64 commits;	///< Save archive commits.
+	u64 dirReads;	///< FSDIR_Read calls.
+	u64 bytesRead;	///< Bytes read.
+	u64 bytesWritten;	///< Bytes written.
+	u64 faults;		///< Calls failed by an injected fault or the free space.
+} hostFsStats;
+
+/// The FS calls of the stand-in, as slowed down or failed.
+typedef enum
+{
+	HOST_FS_OPEN,		///< FSUSER_OpenFile, FSUSER_OpenDirectory
+	HOST_FS_READ,		///< FSFILE_Read
+	HOST_FS_WRITE,		///< FSFILE_Write
+	HOST_FS_CREATE,		///< FSUSER_CreateFile, FSUSER_CreateDirectory
+	HOST_FS_DELETE,		///< FSUSER_Delete*, FSUSER_Rename*
+	HOST_FS_DIR_READ,	///< FSDIR_Read
+	HOST_FS_OTHER,		///< The other calls (sizes, flushes, closes)
+	HOST_FS_OP_COUNT,
+} hostFsOp;
+
+/// The simulated media of the FS stand-in (default: $TVDS_HOST_LATENCY, $TVDS_HOST_BANDWIDTH, $TVDS_HOST_FREE).
+typedef struct
+{
+	u32 latency;		///< The latency of each call (us)
+	u32 readBandwidth;	///< The read bandwidth (bytes/s, 0 if unlimited)
+	u32 writeBandwidth;	///< The write bandwidth (bytes/s, 0 if unlimited)
+	s64 freeBytes;		///< The bytes which can still be allocated on the sdmc (-1 if unlimited, never reclaimed)
+} hostFsMedia;
+
+/// A fault injected in the FS stand-in (default: $TVDS_HOST_FAULT, as op:at[:count[:result|flip]]).
+typedef struct
+{
+	hostFsOp op;		///< The failed call
+	u32 at;				///< The first failed call, counted from 1 since the fault was set (0 if none)
+	u32 count;			///< The count of the consecutive failed calls (0 if all the next ones)
+	Result result;		///< The result of the failed calls
+	bool flip;			///< Whether the failed calls succeed with a bit of their data flipped (reads and writes only)
+} hostFsFault;
+
+/**
+ * @brief Sets the simulated media of the FS stand-in.
+ * @param[in] media The media (NULL for the default one, fast and unlimited).
+ */
+void hostSetFsMedia(const hostFsMedia* media);
+
+/**
+ * @brief Sets the fault injected in the FS stand-in, and restarts the counts of the calls.
+ * @param[in] fault The fault (NULL if none).
+ */
+void hostSetFsFault(const hostFsFault* fault);
+
+/**
+ * @brief Gets the count of the calls of a type since the fault was set.
+ */
+u32 hostGetFsCallCount(hostFsOp op);
+
+/**
+ * @brief Sets the directory which holds the archives (default: $TVDS_HOST_ROOT or ./host_root).
+ * @param[in] root The root directory.
+ */
+void hostSetRoot(const char* root);
+
+/**
+ * @brief Gets the directory which holds the archives.
+ */
+const char* hostGetRoot(void);
+
+/**
+ * @brief Resolves an archive to its host directory.
+ * @param[in] archive The archive to resolve.
+ * @param[out] dst The host directory.
+ * @param size The size of dst.
+ */
+Result hostArchivePath(const FS_Archive* archive, char* dst, size_t size);
+
+/**
+ * @brief Gets the counters of the FS stand-in.
+ */
+hostFsStats* hostGetFsStats(void);
+
+/**
+ * @brief Resets the counters of the FS stand-in.
+ */
+void hostResetFsStats(void);
+
+/**
+ * @brief Queues keys for the next hidScanInput calls (one frame per key set).
+ * @param keys The keys pressed during the frame.
+ */
+void hostPushKeys(u32 keys);
+
+/**
+ * @brief Sets whether aptMainLoop stops when no queued key is left,
+ * after $TVDS_HOST_FRAMES frames more (0 by default, as many as a replay needs).
+ * The keys held at launch are queued from $TVDS_HOST_KEYS (as "R" to replay /tvds/input, see input.h).
+ * @param headless Whether the host runs without an interactive user.
+ */
+void hostSetHeadless(bool headless);
+
+/**
+ * @brief Sets the size of the simulated heap: the allocations fail past it,
+ * and osGetMemRegionFree returns what is left (default: $TVDS_HOST_HEAP, or 64MB).
+ * @param bytes The size of the heap (-1 for the default).
+ */
+void hostSetHeapLimit(s64 bytes);
+
+/**
+ * @brief Gets the bytes allocated on the simulated heap, by the whole process.
+ */
+size_t hostGetHeapUsed(void);
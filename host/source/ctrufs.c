@@ -0,0 +1,786 @@
+#include "host.h"
+
+#include <3ds/types.h>
+#include <3ds/result.h>
+#include <3ds/services/fs.h>
+#include <3ds/util/utf.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_NOT_FOUND (0xC8804478)
+#define HOST_ALREADY_EXISTS (0xC82044BE)
+#define HOST_OUT_OF_RESOURCE (0xD8604664)
+#define HOST_OUT_OF_SPACE (0xC86044CD)
+#define HOST_NOT_A_DIRECTORY (0xC8804470)
+#define HOST_INVALID_HANDLE (0xD8E007F7)
+#define HOST_FAILURE (0xC8804464)
+#define HOST_FLIP (1) // a success, the data of the call is corrupted
+
+#define HOST_MAX_HANDLES (256)
+#define HOST_MAX_PATH (0x800)
+
+/// The type of a handle of the stand-in.
+typedef enum
+{
+	HANDLE_FREE,
+	HANDLE_FILE,
+	HANDLE_DIR,
+} hostHandleType;
+
+/// A file or directory handle of the stand-in.
+typedef struct
+{
+	hostHandleType type;		///< The type (HANDLE_FREE if unused)
+	int fd;						///< The host file (files only)
+	DIR* dir;					///< The host directory (directories only)
+	bool fixed;					///< Whether the size is fixed (extdata files)
+	u32 archiveId;				///< The archive id (files only)
+	char path[HOST_MAX_PATH];	///< The host path
+} hostHandle;
+
+static char hostRoot[HOST_MAX_PATH];
+static hostHandle handles[HOST_MAX_HANDLES];
+static hostFsStats stats;
+static pthread_mutex_t handleLock = PTHREAD_MUTEX_INITIALIZER;
+
+static hostFsMedia media = { 0, 0, 0, -1 };
+static hostFsFault fault;
+static u32 callCounts[HOST_FS_OP_COUNT];
+static pthread_mutex_t mediaLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mediaOnce = PTHREAD_ONCE_INIT;
+
+/// The names of the calls, for $TVDS_HOST_FAULT.
+static const char* const hostFsOpNames[HOST_FS_OP_COUNT] = { "open", "read", "write", "create", "delete", "dirread", "other" };
+
+void hostSetRoot(const char* root)
+{
+	snprintf(hostRoot, sizeof(hostRoot), "%s", root);
+}
+
+const char* hostGetRoot(void)
+{
+	if (!hostRoot[0])
+	{
+		const char* env = getenv("TVDS_HOST_ROOT");
+		hostSetRoot(env && env[0] ? env : "host_root");
+	}
+	return hostRoot;
+}
+
+hostFsStats* hostGetFsStats(void)
+{
+	return &stats;
+}
+
+void hostResetFsStats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * @brief Gets the result of a fault when none is given: out of space for the writes, a failure else.
+ */
+static Result hostFaultResult(hostFsOp op)
+{
+	switch (op)
+	{
+		case HOST_FS_WRITE: return HOST_OUT_OF_RESOURCE;
+		case HOST_FS_CREATE: return HOST_OUT_OF_SPACE;
+		default: return HOST_FAILURE;
+	}
+}
+
+/**
+ * @brief Loads the simulated media and the fault from the environment.
+ */
+static void hostLoadMedia(void)
+{
+	const char* env;
+
+	if ((env = getenv("TVDS_HOST_LATENCY"))) media.latency = strtoul(env, NULL, 0);
+	if ((env = getenv("TVDS_HOST_FREE"))) media.freeBytes = strtoll(env, NULL, 0);
+
+	// read[,write] in bytes/s.
+	if ((env = getenv("TVDS_HOST_BANDWIDTH")))
+	{
+		char* end;
+		media.readBandwidth = media.writeBandwidth = strtoul(env, &end, 0);
+		if (*end == ',') media.writeBandwidth = strtoul(end + 1, NULL, 0);
+	}
+
+	// op:at[:count[:result|flip]], e.g. write:10, read:1:0:c8804464 or read:5:1:flip.
+	if ((env = getenv("TVDS_HOST_FAULT")))
+	{
+		char name[16];
+		char last[16] = "";
+		unsigned long at = 0, count = 1, result = 0;
+		if (sscanf(env, "%15[a-z]:%lu:%lu:%15s", name, &at, &count, last) < 2) return;
+
+		bool flip = !strcmp(last, "flip");
+		if (!flip) result = strtoul(last, NULL, 16);
+
+		for (u32 i = 0; i < HOST_FS_OP_COUNT; i++)
+		{
+			if (strcmp(name, hostFsOpNames[i])) continue;
+			fault.op = i;
+			fault.at = at;
+			fault.count = count;
+			fault.result = (result ? (Result) result : hostFaultResult(i));
+			fault.flip = flip;
+		}
+	}
+}
+
+void hostSetFsMedia(const hostFsMedia* newMedia)
+{
+	static const hostFsMedia defaultMedia = { 0, 0, 0, -1 };
+
+	pthread_once(&mediaOnce, hostLoadMedia);
+	pthread_mutex_lock(&mediaLock);
+	media = (newMedia ? *newMedia : defaultMedia);
+	pthread_mutex_unlock(&mediaLock);
+}
+
+void hostSetFsFault(const hostFsFault* newFault)
+{
+	pthread_once(&mediaOnce, hostLoadMedia);
+	pthread_mutex_lock(&mediaLock);
+	memset(&fault, 0, sizeof(fault));
+	if (newFault) fault = *newFault;
+	if (!fault.result) fault.result = hostFaultResult(fault.op);
+	memset(callCounts, 0, sizeof(callCounts));
+	pthread_mutex_unlock(&mediaLock);
+}
+
+u32 hostGetFsCallCount(hostFsOp op)
+{
+	return (op < HOST_FS_OP_COUNT ? callCounts[op] : 0);
+}
+
+/**
+ * @brief Simulates the media for a call: counts it, fails it if injected, else waits its latency and transfer time.
+ * @param op The call.
+ * @param bytes The bytes transferred by the call.
+ * @return The injected result (0 if none, HOST_FLIP if its data shall be corrupted).
+ */
+static Result hostFsCall(hostFsOp op, u32 bytes)
+{
+	pthread_once(&mediaOnce, hostLoadMedia);
+
+	pthread_mutex_lock(&mediaLock);
+	u32 n = ++callCounts[op];
+	bool failed = (fault.at > 0 && op == fault.op && n >= fault.at && (fault.count == 0 || n - fault.at < fault.count));
+	if (failed) stats.faults++;
+
+	u64 delay = media.latency;
+	u32 bandwidth = (op == HOST_FS_READ ? media.readBandwidth : op == HOST_FS_WRITE ? media.writeBandwidth : 0);
+	if (bandwidth > 0) delay += (u64) bytes * 1000000 / bandwidth;
+	Result ret = (failed ? (fault.flip ? HOST_FLIP : fault.result) : 0);
+	pthread_mutex_unlock(&mediaLock);
+
+	if (delay > 0)
+	{
+		struct timespec ts = { delay / 1000000, (delay % 1000000) * 1000 };
+		nanosleep(&ts, NULL);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Allocates space on the sdmc, when the free space is limited.
+ * @return Whether the space was available.
+ */
+static bool hostAllocSpace(u32 archiveId, u64 bytes)
+{
+	if (archiveId != ARCHIVE_SDMC || bytes == 0) return true;
+
+	pthread_mutex_lock(&mediaLock);
+	bool available = (media.freeBytes < 0 || (u64) media.freeBytes >= bytes);
+	if (!available) stats.faults++;
+	else if (media.freeBytes >= 0) media.freeBytes -= bytes;
+	pthread_mutex_unlock(&mediaLock);
+
+	return available;
+}
+
+/**
+ * @brief Maps errno to the closest FS result code.
+ */
+static Result hostErrno(void)
+{
+	switch (errno)
+	{
+		case ENOENT: return HOST_NOT_FOUND;
+		case EEXIST: return HOST_ALREADY_EXISTS;
+		case ENOTDIR: return HOST_NOT_A_DIRECTORY;
+		case ENOSPC: return HOST_OUT_OF_RESOURCE;
+		default: return HOST_FAILURE;
+	}
+}
+
+/**
+ * @brief Creates a host directory and its missing parents.
+ */
+static int mkdirs(const char* path)
+{
+	char tmp[HOST_MAX_PATH];
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for (char* p = tmp + 1; *p; p++)
+	{
+		if (*p == '/')
+		{
+			*p = '\0';
+			mkdir(tmp, 0755);
+			*p = '/';
+		}
+	}
+	return mkdir(tmp, 0755);
+}
+
+Result hostArchivePath(const FS_Archive* archive, char* dst, size_t size)
+{
+	const char* root = hostGetRoot();
+
+	switch (archive->id)
+	{
+		case ARCHIVE_SDMC:
+			snprintf(dst, size, "%s/sdmc", root);
+			return 0;
+		case ARCHIVE_SAVEDATA:
+			snprintf(dst, size, "%s/save", root);
+			return 0;
+		case ARCHIVE_USER_SAVEDATA:
+		case ARCHIVE_EXTDATA:
+		{
+			if (archive->lowPath.type != PATH_BINARY || archive->lowPath.size < 12) return HOST_FAILURE;
+			const u32* data = (const u32*) archive->lowPath.data;
+			snprintf(dst, size, "%s/%s/%lu/%08lx%08lx", root,
+				archive->id == ARCHIVE_EXTDATA ? "extdata" : "title",
+				(unsigned long) data[0], (unsigned long) data[2], (unsigned long) data[1]);
+			return 0;
+		}
+		default:
+			return HOST_FAILURE;
+	}
+}
+
+/**
+ * @brief Resolves a path of an archive to its host path.
+ */
+static Result hostPath(const FS_Archive* archive, FS_Path path, char* dst, size_t size)
+{
+	char base[HOST_MAX_PATH];
+	char rel[HOST_MAX_PATH];
+	Result ret = hostArchivePath(archive, base, sizeof(base));
+	if (R_FAILED(ret)) return ret;
+
+	memset(rel, 0, sizeof(rel));
+	switch (path.type)
+	{
+		case PATH_EMPTY:
+			break;
+		case PATH_ASCII:
+			snprintf(rel, sizeof(rel), "%s", (const char*) path.data);
+			break;
+		case PATH_UTF16:
+		{
+			const u16* src = (const u16*) path.data;
+			size_t len = 0;
+			while (src[len]) len++;
+			utf16_to_utf8((u8*) rel, src, sizeof(rel) - 1);
+			break;
+		}
+		default:
+			return HOST_FAILURE;
+	}
+
+	// Collapse the duplicated slashes.
+	char* w = rel;
+	for (const char* r = rel; *r; r++)
+		if (!(*r == '/' && w > rel && w[-1] == '/')) *w++ = *r;
+	*w = '\0';
+
+	snprintf(dst, size, "%s%s%s", base, rel[0] == '/' ? "" : "/", rel);
+	return 0;
+}
+
+/**
+ * @brief Allocates a handle (the batch stage thread opens files concurrently).
+ * @return The handle (0 if none is free).
+ */
+static Handle allocHandle(hostHandleType type)
+{
+	Handle handle = 0;
+
+	pthread_mutex_lock(&handleLock);
+	for (Handle i = 0; i < HOST_MAX_HANDLES && !handle; i++)
+	{
+		if (handles[i].type == HANDLE_FREE)
+		{
+			handles[i].type = type;
+			handle = i + 1;
+		}
+	}
+	pthread_mutex_unlock(&handleLock);
+
+	return handle;
+}
+
+/**
+ * @brief Frees a handle.
+ */
+static void freeHandle(hostHandle* h)
+{
+	pthread_mutex_lock(&handleLock);
+	h->type = HANDLE_FREE;
+	pthread_mutex_unlock(&handleLock);
+}
+
+/**
+ * @brief Gets an open handle of a type (NULL if invalid).
+ */
+static hostHandle* getHandle(Handle handle, hostHandleType type)
+{
+	if (handle == 0 || handle > HOST_MAX_HANDLES) return NULL;
+	hostHandle* h = &handles[handle - 1];
+	return (h->type == type ? h : NULL);
+}
+
+Result fsInit(void) { return 0; }
+void fsExit(void) {}
+void fsUseSession(Handle session, bool sdmc) { (void) session; (void) sdmc; }
+void fsEndUseSession(void) {}
+
+static Handle fsSession = 1;
+Handle* fsGetSessionHandle(void) { return &fsSession; }
+
+FS_Path fsMakePath(FS_PathType type, const void* path)
+{
+	FS_Path p = { type, 0, path };
+	switch (type)
+	{
+		case PATH_ASCII:
+			p.size = strlen((const char*) path) + 1;
+			break;
+		case PATH_UTF16:
+		{
+			const u16* str = (const u16*) path;
+			u32 len = 0;
+			while (str[len]) len++;
+			p.size = (len + 1) * sizeof(u16);
+			break;
+		}
+		case PATH_EMPTY:
+			p.size = 1;
+			p.data = "";
+			break;
+		default:
+			break;
+	}
+	return p;
+}
+
+Result FSUSER_Initialize(Handle session)
+{
+	(void) session;
+	return 0;
+}
+
+Result FSUSER_OpenArchive(FS_Archive* archive)
+{
+	if (!archive) return HOST_FAILURE;
+
+	char base[HOST_MAX_PATH];
+	Result ret = hostArchivePath(archive, base, sizeof(base));
+	if (R_FAILED(ret)) return ret;
+
+	struct stat st;
+	if (stat(base, &st) != 0)
+	{
+		// The SD card and the current save are always there.
+		if (archive->id != ARCHIVE_SDMC && archive->id != ARCHIVE_SAVEDATA) return HOST_NOT_FOUND;
+		mkdirs(base);
+	}
+
+	archive->handle = 1;
+	return 0;
+}
+
+Result FSUSER_CloseArchive(FS_Archive* archive)
+{
+	if (!archive) return HOST_FAILURE;
+	archive->handle = 0;
+	return 0;
+}
+
+Result FSUSER_ControlArchive(FS_Archive archive, FS_ArchiveAction action, void* input, u32 inputSize, void* output, u32 outputSize)
+{
+	(void) archive; (void) input; (void) inputSize; (void) output; (void) outputSize;
+	if (action == ARCHIVE_ACTION_COMMIT_SAVE_DATA) stats.commits++;
+	return 0;
+}
+
+Result FSUSER_GetFreeBytes(u64* freeBytes, FS_Archive archive)
+{
+	pthread_once(&mediaOnce, hostLoadMedia);
+	bool limited = (archive.id == ARCHIVE_SDMC && media.freeBytes >= 0);
+	if (freeBytes) *freeBytes = (limited ? (u64) media.freeBytes : 0x40000000);
+	return 0;
+}
+
+Result FSUSER_GetMediaType(FS_MediaType* mediaType)
+{
+	if (mediaType) *mediaType = MEDIATYPE_SD;
+	return 0;
+}
+
+Result FSUSER_ControlSecureSave(FS_SecureSaveAction action, void* input, u32 inputSize, void* output, u32 outputSize)
+{
+	(void) action; (void) input; (void) inputSize;
+	if (output && outputSize) memset(output, 0, outputSize);
+	return 0;
+}
+
+Result FSUSER_OpenFile(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes)
+{
+	(void) attributes;
+	char full[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_OPEN, 0);
+	if (R_FAILED(ret)) return ret;
+
+	// The extdata files are created with their fixed size by FSUSER_CreateFile only.
+	struct stat st0;
+	if (archive.id == ARCHIVE_EXTDATA && (openFlags & FS_OPEN_CREATE) && stat(full, &st0) != 0) return 0xE0C046BE;
+
+	int flags = 0;
+	if ((openFlags & FS_OPEN_READ) && (openFlags & FS_OPEN_WRITE)) flags = O_RDWR;
+	else if (openFlags & FS_OPEN_WRITE) flags = O_RDWR;
+	else flags = O_RDONLY;
+	if (openFlags & FS_OPEN_CREATE) flags |= O_CREAT;
+
+	struct stat st;
+	if (stat(full, &st) == 0 && S_ISDIR(st.st_mode)) return HOST_NOT_FOUND;
+
+	int fd = open(full, flags, 0644);
+	if (fd < 0) return hostErrno();
+
+	Handle handle = allocHandle(HANDLE_FILE);
+	if (!handle)
+	{
+		close(fd);
+		return HOST_OUT_OF_RESOURCE;
+	}
+
+	handles[handle - 1].fd = fd;
+	handles[handle - 1].fixed = (archive.id == ARCHIVE_EXTDATA);
+	handles[handle - 1].archiveId = archive.id;
+	snprintf(handles[handle - 1].path, HOST_MAX_PATH, "%s", full);
+	stats.opens++;
+	*out = handle;
+	return 0;
+}
+
+Result FSUSER_DeleteFile(FS_Archive archive, FS_Path path)
+{
+	char full[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_DELETE, 0);
+	if (R_FAILED(ret)) return ret;
+	return (unlink(full) == 0 ? 0 : hostErrno());
+}
+
+Result FSUSER_RenameFile(FS_Archive srcArchive, FS_Path srcPath, FS_Archive dstArchive, FS_Path dstPath)
+{
+	char src[HOST_MAX_PATH], dst[HOST_MAX_PATH];
+	Result ret = hostPath(&srcArchive, srcPath, src, sizeof(src));
+	if (R_FAILED(ret)) return ret;
+	ret = hostPath(&dstArchive, dstPath, dst, sizeof(dst));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_DELETE, 0);
+	if (R_FAILED(ret)) return ret;
+	return (rename(src, dst) == 0 ? 0 : hostErrno());
+}
+
+Result FSUSER_RenameDirectory(FS_Archive srcArchive, FS_Path srcPath, FS_Archive dstArchive, FS_Path dstPath)
+{
+	return FSUSER_RenameFile(srcArchive, srcPath, dstArchive, dstPath);
+}
+
+Result FSUSER_DeleteDirectory(FS_Archive archive, FS_Path path)
+{
+	char full[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_DELETE, 0);
+	if (R_FAILED(ret)) return ret;
+	return (rmdir(full) == 0 ? 0 : hostErrno());
+}
+
+/**
+ * @brief Removes the content of a host directory, then the directory if removeSelf.
+ */
+static int removeTree(const char* path, bool removeSelf)
+{
+	DIR* dir = opendir(path);
+	if (!dir) return -1;
+
+	struct dirent* ent;
+	while ((ent = readdir(dir)))
+	{
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+
+		char child[HOST_MAX_PATH];
+		snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+
+		struct stat st;
+		if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode))
+			removeTree(child, true);
+		else
+			unlink(child);
+	}
+	closedir(dir);
+
+	return (removeSelf ? rmdir(path) : 0);
+}
+
+Result FSUSER_DeleteDirectoryRecursively(FS_Archive archive, FS_Path path)
+{
+	char full[HOST_MAX_PATH];
+	char base[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_DELETE, 0);
+	if (R_FAILED(ret)) return ret;
+	hostArchivePath(&archive, base, sizeof(base));
+
+	// The root of an archive is emptied, not removed.
+	size_t len = strlen(full);
+	while (len > 1 && full[len-1] == '/') full[--len] = '\0';
+	bool isRoot = !strcmp(full, base);
+
+	struct stat st;
+	if (stat(full, &st) != 0) return hostErrno();
+	return (removeTree(full, !isRoot) == 0 ? 0 : hostErrno());
+}
+
+Result FSUSER_CreateFile(FS_Archive archive, FS_Path path, u32 attributes, u64 fileSize)
+{
+	(void) attributes;
+	char full[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_CREATE, 0);
+	if (R_FAILED(ret)) return ret;
+
+	struct stat st;
+	if (stat(full, &st) == 0) return HOST_ALREADY_EXISTS;
+	if (!hostAllocSpace(archive.id, fileSize)) return HOST_OUT_OF_SPACE;
+
+	int fd = open(full, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) return hostErrno();
+	ret = (ftruncate(fd, fileSize) == 0 ? 0 : hostErrno());
+	close(fd);
+	return ret;
+}
+
+Result FSUSER_CreateDirectory(FS_Archive archive, FS_Path path, u32 attributes)
+{
+	(void) attributes;
+	char full[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_CREATE, 0);
+	if (R_FAILED(ret)) return ret;
+	return (mkdir(full, 0755) == 0 ? 0 : hostErrno());
+}
+
+Result FSUSER_OpenDirectory(Handle* out, FS_Archive archive, FS_Path path)
+{
+	char full[HOST_MAX_PATH];
+	Result ret = hostPath(&archive, path, full, sizeof(full));
+	if (R_SUCCEEDED(ret)) ret = hostFsCall(HOST_FS_OPEN, 0);
+	if (R_FAILED(ret)) return ret;
+
+	DIR* dir = opendir(full);
+	if (!dir) return hostErrno();
+
+	Handle handle = allocHandle(HANDLE_DIR);
+	if (!handle)
+	{
+		closedir(dir);
+		return HOST_OUT_OF_RESOURCE;
+	}
+
+	handles[handle - 1].dir = dir;
+	snprintf(handles[handle - 1].path, HOST_MAX_PATH, "%s", full);
+	stats.opens++;
+	*out = handle;
+	return 0;
+}
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size)
+{
+	hostHandle* h = getHandle(handle, HANDLE_FILE);
+	if (!h) return HOST_INVALID_HANDLE;
+
+	Result ret = hostFsCall(HOST_FS_READ, size);
+	if (R_FAILED(ret)) return ret;
+
+	u32 total = 0;
+	while (total < size)
+	{
+		ssize_t n = pread(h->fd, (u8*) buffer + total, size - total, offset + total);
+		if (n < 0) return hostErrno();
+		if (n == 0) break;
+		total += n;
+	}
+
+	// The media returned corrupted data.
+	if (ret == HOST_FLIP && total > 0) ((u8*) buffer)[total / 2] ^= 0x10;
+
+	stats.reads++;
+	stats.bytesRead += total;
+	if (bytesRead) *bytesRead = total;
+	return 0;
+}
+
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags)
+{
+	hostHandle* h = getHandle(handle, HANDLE_FILE);
+	if (!h) return HOST_INVALID_HANDLE;
+
+	Result ret = hostFsCall(HOST_FS_WRITE, size);
+	if (R_FAILED(ret)) return ret;
+
+	struct stat st;
+	if (fstat(h->fd, &st) != 0) return hostErrno();
+	if (h->fixed && offset + size > (u64) st.st_size) return 0xE0E046C1;
+
+	// Only the growth of the file takes space.
+	if (offset + size > (u64) st.st_size && !hostAllocSpace(h->archiveId, offset + size - st.st_size)) return HOST_OUT_OF_RESOURCE;
+
+	u32 total = 0;
+	while (total < size)
+	{
+		ssize_t n = pwrite(h->fd, (const u8*) buffer + total, size - total, offset + total);
+		if (n < 0) return hostErrno();
+		total += n;
+	}
+
+	// The media stored corrupted data, the buffer is untouched.
+	if (ret == HOST_FLIP && total > 0)
+	{
+		u8 byte = ((const u8*) buffer)[total / 2] ^ 0x10;
+		if (pwrite(h->fd, &byte, 1, offset + total / 2) != 1) return hostErrno();
+	}
+
+	if (flags & FS_WRITE_FLUSH)
+	{
+		fdatasync(h->fd);
+		stats.flushes++;
+	}
+
+	stats.writes++;
+	stats.bytesWritten += total;
+	if (bytesWritten) *bytesWritten = total;
+	return 0;
+}
+
+Result FSFILE_GetSize(Handle handle, u64* size)
+{
+	hostHandle* h = getHandle(handle, HANDLE_FILE);
+	if (!h) return HOST_INVALID_HANDLE;
+
+	Result ret = hostFsCall(HOST_FS_OTHER, 0);
+	if (R_FAILED(ret)) return ret;
+
+	struct stat st;
+	if (fstat(h->fd, &st) != 0) return hostErrno();
+	if (size) *size = st.st_size;
+	return 0;
+}
+
+Result FSFILE_SetSize(Handle handle, u64 size)
+{
+	hostHandle* h = getHandle(handle, HANDLE_FILE);
+	if (!h) return HOST_INVALID_HANDLE;
+
+	Result ret = hostFsCall(HOST_FS_OTHER, 0);
+	if (R_FAILED(ret)) return ret;
+	if (h->fixed) return 0xE0C046F8;
+
+	struct stat st;
+	if (fstat(h->fd, &st) != 0) return hostErrno();
+	if (size > (u64) st.st_size && !hostAllocSpace(h->archiveId, size - st.st_size)) return HOST_OUT_OF_RESOURCE;
+
+	return (ftruncate(h->fd, size) == 0 ? 0 : hostErrno());
+}
+
+Result FSFILE_Flush(Handle handle)
+{
+	hostHandle* h = getHandle(handle, HANDLE_FILE);
+	if (!h) return HOST_INVALID_HANDLE;
+
+	Result ret = hostFsCall(HOST_FS_OTHER, 0);
+	if (R_FAILED(ret)) return ret;
+	fdatasync(h->fd);
+	stats.flushes++;
+	return 0;
+}
+
+Result FSFILE_Close(Handle handle)
+{
+	hostHandle* h = getHandle(handle, HANDLE_FILE);
+	if (!h) return HOST_INVALID_HANDLE;
+	close(h->fd);
+	freeHandle(h);
+	return 0;
+}
+
+Result FSDIR_Read(Handle handle, u32* entriesRead, u32 entryCount, FS_DirectoryEntry* entries)
+{
+	hostHandle* h = getHandle(handle, HANDLE_DIR);
+	if (!h) return HOST_INVALID_HANDLE;
+
+	Result ret = hostFsCall(HOST_FS_DIR_READ, 0);
+	if (R_FAILED(ret)) return ret;
+
+	u32 count = 0;
+	struct dirent* ent;
+	while (count < entryCount && (ent = readdir(h->dir)))
+	{
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+
+		char child[HOST_MAX_PATH];
+		snprintf(child, sizeof(child), "%s/%s", h->path, ent->d_name);
+
+		struct stat st;
+		if (stat(child, &st) != 0) continue;
+
+		FS_DirectoryEntry* entry = &entries[count++];
+		memset(entry, 0, sizeof(FS_DirectoryEntry));
+		utf8_to_utf16(entry->name, (const u8*) ent->d_name, 0x105);
+		entry->attributes = S_ISDIR(st.st_mode) ? FS_ATTRIBUTE_DIRECTORY : 0;
+		entry->fileSize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+		entry->valid = 1;
+	}
+
+	stats.dirReads++;
+	if (entriesRead) *entriesRead = count;
+	return 0;
+}
+
+Result FSDIR_Close(Handle handle)
+{
+	hostHandle* h = getHandle(handle, HANDLE_DIR);
+	if (!h) return HOST_INVALID_HANDLE;
+	closedir(h->dir);
+	freeHandle(h);
+	return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file ctruheap.c
+ * @brief The simulated heap of the stand-in: the allocations of the process are counted,
+ * and fail past the size of the application region ($TVDS_HOST_HEAP, or hostSetHeapLimit).
+ *
+ * The malloc family of glibc is replaced (see "Replacing malloc" in its manual),
+ * forwarding to its __libc_ entrypoints. Unlike libctru, no heap is mapped at launch:
+ * the whole region is free until allocated (__ctru_heap_size and mallinfo are empty).
+ */
+#include <3ds/types.h>
+#include <3ds/os.h>
+#include "host.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HOST_HEAP_DEFAULT (64 * 1024 * 1024)
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+u32 __ctru_heap_size = 0;
+
+static size_t heapUsed = 0;
+static s64 heapLimit = -1; // -1 until read from the environment
+
+/**
+ * @brief Gets the size of the heap, read once from the environment.
+ */
+static size_t hostHeapLimit(void)
+{
+	s64 limit = __atomic_load_n(&heapLimit, __ATOMIC_RELAXED);
+	if (limit < 0)
+	{
+		const char* env = getenv("TVDS_HOST_HEAP");
+		limit = (env ? strtoll(env, NULL, 0) : HOST_HEAP_DEFAULT);
+		if (limit < 0) limit = 0;
+		__atomic_store_n(&heapLimit, limit, __ATOMIC_RELAXED);
+	}
+	return (size_t) limit;
+}
+
+/**
+ * @brief Reserves the bytes of a new allocation.
+ * @return Whether they fit in the heap.
+ */
+static bool hostHeapReserve(size_t size)
+{
+	size_t limit = hostHeapLimit();
+	size_t used = __atomic_add_fetch(&heapUsed, size, __ATOMIC_RELAXED);
+	if (used <= limit && used >= size) return true;
+
+	__atomic_sub_fetch(&heapUsed, size, __ATOMIC_RELAXED);
+	errno = ENOMEM;
+	return false;
+}
+
+/**
+ * @brief Counts an allocation, or gives its reservation back if it failed.
+ */
+static void* hostHeapTrack(void* ptr, size_t reserved)
+{
+	if (!ptr)
+	{
+		__atomic_sub_fetch(&heapUsed, reserved, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	// The usable size may exceed the size asked.
+	size_t usable = malloc_usable_size(ptr);
+	if (usable > reserved) __atomic_add_fetch(&heapUsed, usable - reserved, __ATOMIC_RELAXED);
+	else __atomic_sub_fetch(&heapUsed, reserved - usable, __ATOMIC_RELAXED);
+	return ptr;
+}
+
+void* malloc(size_t size)
+{
+	if (!hostHeapReserve(size)) return NULL;
+	return hostHeapTrack(__libc_malloc(size), size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	if (size && count > (size_t) -1 / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (!hostHeapReserve(count * size)) return NULL;
+	return hostHeapTrack(__libc_calloc(count, size), count * size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+	if (!hostHeapReserve(size)) return NULL;
+	return hostHeapTrack(__libc_memalign(alignment, size), size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+	if (alignment < sizeof(void*) || (alignment & (alignment - 1))) return EINVAL;
+
+	void* block = memalign(alignment, size);
+	if (!block) return ENOMEM;
+
+	*ptr = block;
+	return 0;
+}
+
+void* valloc(size_t size)
+{
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void* pvalloc(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+void free(void* ptr)
+{
+	if (!ptr) return;
+
+	__atomic_sub_fetch(&heapUsed, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	__libc_free(ptr);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	if (!ptr) return malloc(size);
+	if (size == 0)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	size_t previous = malloc_usable_size(ptr);
+	if (size > previous && !hostHeapReserve(size - previous)) return NULL;
+	size_t reserved = (size > previous ? size - previous : 0);
+
+	void* resized = __libc_realloc(ptr, size);
+	if (!resized)
+	{
+		__atomic_sub_fetch(&heapUsed, reserved, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	// The counts of the previous block, then of the resized one.
+	size_t usable = malloc_usable_size(resized);
+	__atomic_add_fetch(&heapUsed, usable, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&heapUsed, previous + reserved, __ATOMIC_RELAXED);
+	return resized;
+}
+
+struct mallinfo mallinfo(void)
+{
+	struct mallinfo info;
+	memset(&info, 0, sizeof(info));
+	return info;
+}
+
+s64 osGetMemRegionFree(MemRegion region)
+{
+	(void) region;
+	size_t limit = hostHeapLimit();
+	size_t used = __atomic_load_n(&heapUsed, __ATOMIC_RELAXED);
+	return (used < limit ? (s64) (limit - used) : 0);
+}
+
+void hostSetHeapLimit(s64 bytes)
+{
+	__atomic_store_n(&heapLimit, (bytes < 0 ? -1 : bytes), __ATOMIC_RELAXED);
+}
+
+size_t hostGetHeapUsed(void)
+{
+	return __atomic_load_n(&heapUsed, __ATOMIC_RELAXED);
+}
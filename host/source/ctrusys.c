@@ -0,0 +1,319 @@
+#include "host.h"
+
+#include <3ds/types.h>
+#include <3ds/result.h>
+#include <3ds/os.h>
+#include <3ds/srv.h>
+#include <3ds/svc.h>
+#include <3ds/thread.h>
+#include <3ds/synchronization.h>
+#include <3ds/services/am.h>
+#include <3ds/services/apt.h>
+#include <3ds/util/utf.h>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_MAX_SEMAPHORES (64)
+
+/// A thread, a pthread on the host.
+struct Thread_tag
+{
+	pthread_t thread;
+	ThreadFunc entrypoint;
+	void* arg;
+	bool detached;
+};
+
+static __thread Thread currentThread = NULL;
+static sem_t semaphores[HOST_MAX_SEMAPHORES];
+static bool semaphoreUsed[HOST_MAX_SEMAPHORES];
+
+/**
+ * @brief Gets the monotonic time in nanoseconds.
+ */
+static u64 nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+u64 svcGetSystemTick(void)
+{
+	return (u64) ((double) nowNs() * SYSCLOCK_ARM11 / 1000000000.0);
+}
+
+void svcSleepThread(s64 ns)
+{
+	if (ns <= 0)
+	{
+		sched_yield();
+		return;
+	}
+
+	struct timespec ts = { ns / 1000000000LL, ns % 1000000000LL };
+	nanosleep(&ts, NULL);
+}
+
+Result svcCreateSemaphore(Handle* semaphore, s32 initial_count, s32 max_count)
+{
+	(void) max_count;
+	for (u32 i = 0; i < HOST_MAX_SEMAPHORES; i++)
+	{
+		if (!semaphoreUsed[i])
+		{
+			semaphoreUsed[i] = true;
+			sem_init(&semaphores[i], 0, initial_count);
+			*semaphore = 0x1000 + i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Gets the semaphore of a handle (NULL if invalid).
+ */
+static sem_t* getSemaphore(Handle handle)
+{
+	if (handle < 0x1000 || handle >= 0x1000 + HOST_MAX_SEMAPHORES) return NULL;
+	return (semaphoreUsed[handle - 0x1000] ? &semaphores[handle - 0x1000] : NULL);
+}
+
+Result svcReleaseSemaphore(s32* count, Handle semaphore, s32 release_count)
+{
+	sem_t* sem = getSemaphore(semaphore);
+	if (!sem) return -1;
+
+	int value = 0;
+	sem_getvalue(sem, &value);
+	if (count) *count = value;
+	while (release_count-- > 0) sem_post(sem);
+	return 0;
+}
+
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds)
+{
+	sem_t* sem = getSemaphore(handle);
+	if (!sem) return -1;
+
+	if (nanoseconds < 0)
+	{
+		sem_wait(sem);
+		return 0;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	u64 end = (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec + nanoseconds;
+	ts.tv_sec = end / 1000000000ULL;
+	ts.tv_nsec = end % 1000000000ULL;
+	return (sem_timedwait(sem, &ts) == 0 ? 0 : 0x09401BFE);
+}
+
+Result svcCloseHandle(Handle handle)
+{
+	sem_t* sem = getSemaphore(handle);
+	if (sem)
+	{
+		sem_destroy(sem);
+		semaphoreUsed[handle - 0x1000] = false;
+	}
+	return 0;
+}
+
+u64 osGetTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	// Milliseconds since 1900-01-01.
+	return ((u64) ts.tv_sec + 2208988800ULL) * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Runs the entrypoint of a thread.
+ */
+static void* threadEntry(void* arg)
+{
+	Thread thread = (Thread) arg;
+	currentThread = thread;
+	thread->entrypoint(thread->arg);
+	if (thread->detached) free(thread);
+	return NULL;
+}
+
+Thread threadCreate(ThreadFunc entrypoint, void* arg, size_t stack_size, int prio, int affinity, bool detached)
+{
+	(void) stack_size; (void) prio; (void) affinity;
+
+	Thread thread = (Thread) malloc(sizeof(struct Thread_tag));
+	if (!thread) return NULL;
+
+	thread->entrypoint = entrypoint;
+	thread->arg = arg;
+	thread->detached = detached;
+
+	if (pthread_create(&thread->thread, NULL, threadEntry, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	if (detached) pthread_detach(thread->thread);
+	return thread;
+}
+
+Result threadJoin(Thread thread, u64 timeout_ns)
+{
+	(void) timeout_ns;
+	if (!thread) return -1;
+	pthread_join(thread->thread, NULL);
+	return 0;
+}
+
+void threadFree(Thread thread)
+{
+	free(thread);
+}
+
+Thread threadGetCurrent(void)
+{
+	return currentThread;
+}
+
+void LightLock_Init(LightLock* lock)
+{
+	pthread_mutex_init(lock, NULL);
+}
+
+void LightLock_Lock(LightLock* lock)
+{
+	pthread_mutex_lock(lock);
+}
+
+void LightLock_Unlock(LightLock* lock)
+{
+	pthread_mutex_unlock(lock);
+}
+
+ssize_t utf8_to_utf16(uint16_t* out, const uint8_t* in, size_t len)
+{
+	ssize_t rc = 0;
+
+	while (*in)
+	{
+		u32 code;
+		if (in[0] < 0x80) { code = in[0]; in += 1; }
+		else if ((in[0] & 0xE0) == 0xC0 && in[1]) { code = ((in[0] & 0x1F) << 6) | (in[1] & 0x3F); in += 2; }
+		else if ((in[0] & 0xF0) == 0xE0 && in[1] && in[2]) { code = ((in[0] & 0x0F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F); in += 3; }
+		else if ((in[0] & 0xF8) == 0xF0 && in[1] && in[2] && in[3]) { code = ((in[0] & 0x07) << 18) | ((in[1] & 0x3F) << 12) | ((in[2] & 0x3F) << 6) | (in[3] & 0x3F); in += 4; }
+		else return -1;
+
+		if (code >= 0x10000)
+		{
+			if ((size_t) rc + 2 <= len && out)
+			{
+				code -= 0x10000;
+				out[rc] = 0xD800 | (code >> 10);
+				out[rc + 1] = 0xDC00 | (code & 0x3FF);
+			}
+			rc += 2;
+		}
+		else
+		{
+			if ((size_t) rc + 1 <= len && out) out[rc] = code;
+			rc += 1;
+		}
+	}
+
+	return rc;
+}
+
+ssize_t utf16_to_utf8(uint8_t* out, const uint16_t* in, size_t len)
+{
+	ssize_t rc = 0;
+	u8 encoded[4];
+
+	while (*in)
+	{
+		u32 code = *in++;
+		if (code >= 0xD800 && code < 0xDC00 && *in >= 0xDC00 && *in < 0xE000)
+			code = 0x10000 + ((code & 0x3FF) << 10) + (*in++ & 0x3FF);
+
+		u32 units;
+		if (code < 0x80) { encoded[0] = code; units = 1; }
+		else if (code < 0x800) { encoded[0] = 0xC0 | (code >> 6); encoded[1] = 0x80 | (code & 0x3F); units = 2; }
+		else if (code < 0x10000) { encoded[0] = 0xE0 | (code >> 12); encoded[1] = 0x80 | ((code >> 6) & 0x3F); encoded[2] = 0x80 | (code & 0x3F); units = 3; }
+		else { encoded[0] = 0xF0 | (code >> 18); encoded[1] = 0x80 | ((code >> 12) & 0x3F); encoded[2] = 0x80 | ((code >> 6) & 0x3F); encoded[3] = 0x80 | (code & 0x3F); units = 4; }
+
+		if ((size_t) rc + units <= len && out)
+			memcpy(out + rc, encoded, units);
+		rc += units;
+	}
+
+	return rc;
+}
+
+Result srvGetServiceHandleDirect(Handle* out, const char* name)
+{
+	(void) name;
+	if (out) *out = 1;
+	return 0;
+}
+
+void aptOpenSession(void) {}
+void aptCloseSession(void) {}
+
+Result APT_GetProgramID(u64* pProgramID)
+{
+	const char* env = getenv("TVDS_HOST_TITLEID");
+	if (pProgramID) *pProgramID = (env ? strtoull(env, NULL, 16) : 0x0004000000055D00ULL);
+	return 0;
+}
+
+Result amInit(void) { return 0; }
+void amExit(void) {}
+
+/**
+ * @brief Lists the installed titles of a mediatype, the directories <root>/title/<mediatype>/<titleid>.
+ */
+static u32 listTitles(FS_MediaType mediatype, u32 max, u64* titleIds)
+{
+	char path[0x400];
+	snprintf(path, sizeof(path), "%s/title/%u", hostGetRoot(), (unsigned) mediatype);
+
+	DIR* dir = opendir(path);
+	if (!dir) return 0;
+
+	u32 count = 0;
+	struct dirent* ent;
+	while ((ent = readdir(dir)))
+	{
+		if (ent->d_name[0] == '.') continue;
+		if (titleIds && count < max) titleIds[count] = strtoull(ent->d_name, NULL, 16);
+		count++;
+	}
+	closedir(dir);
+
+	return count;
+}
+
+Result AM_GetTitleCount(FS_MediaType mediatype, u32* count)
+{
+	if (count) *count = listTitles(mediatype, 0, NULL);
+	return 0;
+}
+
+Result AM_GetTitleList(u32* titlesRead, FS_MediaType mediatype, u32 titleCount, u64* titleIds)
+{
+	u32 count = listTitles(mediatype, titleCount, titleIds);
+	if (titlesRead) *titlesRead = (count < titleCount ? count : titleCount);
+	return 0;
+}
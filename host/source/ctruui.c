@@ -0,0 +1,148 @@
+#include "host.h"
+
+#include <3ds/types.h>
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/console.h>
+#include <3ds/gfx.h>
+#include <3ds/services/apt.h>
+#include <3ds/services/gspgpu.h>
+#include <3ds/services/hid.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HOST_MAX_KEYS (1024)
+
+static u32 keyQueue[HOST_MAX_KEYS];
+static u32 keyHead = 0;
+static u32 keyTail = 0;
+static u32 keysDown = 0;
+static u32 keysHeld = 0;
+static u32 keysUp = 0;
+static bool headless = true;
+static u32 frameBudget = 0;		// The frames run headless after the queued keys.
+static bool isEnvLoaded = false;
+
+static PrintConsole* currentConsole = NULL;
+
+void hostPushKeys(u32 keys)
+{
+	if (keyTail - keyHead < HOST_MAX_KEYS)
+		keyQueue[keyTail++ % HOST_MAX_KEYS] = keys;
+}
+
+void hostSetHeadless(bool value)
+{
+	headless = value;
+}
+
+/**
+ * @brief Queues the keys held at launch ($TVDS_HOST_KEYS) and the frame budget ($TVDS_HOST_FRAMES), once.
+ * The keys are names joined by '+' (as "L" or "SELECT+R") or a mask (as "0x200").
+ */
+static void hostLoadEnv(void)
+{
+	if (isEnvLoaded) return;
+	isEnvLoaded = true;
+
+	static const struct { const char* name; u32 key; } names[] = {
+		{ "A", KEY_A }, { "B", KEY_B }, { "SELECT", KEY_SELECT }, { "START", KEY_START },
+		{ "RIGHT", KEY_DRIGHT }, { "LEFT", KEY_DLEFT }, { "UP", KEY_DUP }, { "DOWN", KEY_DDOWN },
+		{ "R", KEY_R }, { "L", KEY_L }, { "X", KEY_X }, { "Y", KEY_Y }, { "ZL", KEY_ZL }, { "ZR", KEY_ZR },
+	};
+
+	const char* env;
+	if ((env = getenv("TVDS_HOST_FRAMES"))) frameBudget = strtoul(env, NULL, 0);
+
+	if ((env = getenv("TVDS_HOST_KEYS")) && env[0])
+	{
+		u32 keys = 0;
+
+		if (env[0] >= '0' && env[0] <= '9') keys = strtoul(env, NULL, 0);
+		else
+		{
+			char copy[64];
+			snprintf(copy, sizeof(copy), "%s", env);
+
+			for (char* name = strtok(copy, "+"); name; name = strtok(NULL, "+"))
+			{
+				for (u32 i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+				{
+					if (strcmp(name, names[i].name) == 0) keys |= names[i].key;
+				}
+			}
+		}
+
+		hostPushKeys(keys);
+	}
+}
+
+void gfxInitDefault(void) {}
+void gfxExit(void) {}
+void gfxFlushBuffers(void) {}
+void gfxSwapBuffers(void) {}
+/**
+ * @brief Waits for the next vblank of a 59.831Hz screen.
+ */
+void gspWaitForVBlank(void)
+{
+	const u64 period = (u64) SYSCLOCK_ARM11 * 1000 / 59831;
+	u64 now = svcGetSystemTick();
+	u64 next = (now / period + 1) * period;
+	svcSleepThread((s64) ((next - now) * 1000000000ULL / SYSCLOCK_ARM11));
+}
+
+PrintConsole* consoleInit(gfxScreen_t screen, PrintConsole* console)
+{
+	if (!console) return NULL;
+	memset(console, 0, sizeof(PrintConsole));
+	console->screen = screen;
+	console->windowWidth = (screen == GFX_TOP ? 50 : 40);
+	console->windowHeight = 30;
+	console->consoleInitialised = true;
+	currentConsole = console;
+	return console;
+}
+
+void consoleSetWindow(PrintConsole* console, int x, int y, int width, int height)
+{
+	if (!console) return;
+	console->windowX = x;
+	console->windowY = y;
+	console->windowWidth = width;
+	console->windowHeight = height;
+}
+
+PrintConsole* consoleSelect(PrintConsole* console)
+{
+	PrintConsole* last = currentConsole;
+	currentConsole = console;
+	return last;
+}
+
+void consoleClear(void) {}
+
+bool aptMainLoop(void)
+{
+	hostLoadEnv();
+	if (!headless || keyHead != keyTail) return true;
+	if (frameBudget == 0) return false;
+
+	frameBudget--;
+	return true;
+}
+
+void hidScanInput(void)
+{
+	hostLoadEnv();
+	u32 keys = (keyHead != keyTail ? keyQueue[keyHead++ % HOST_MAX_KEYS] : 0);
+	keysDown = keys & ~keysHeld;
+	keysUp = keysHeld & ~keys;
+	keysHeld = keys;
+}
+
+u32 hidKeysDown(void) { return keysDown; }
+u32 hidKeysHeld(void) { return keysHeld; }
+u32 hidKeysUp(void) { return keysUp; }
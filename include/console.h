@@ -42,7 +42,7 @@ void consoleSelectDefault(void);
 void consoleSelectLast(void);
 
 /**
- * @brief Prints arguments to the log console, selects back the previous console.
+ * @brief Logs arguments (LOG_INFO), printed to the log console by the next logFlush (see log.h).
  * @param[in] format The text to print.
  */
 void consoleLog(const char* format, ...);
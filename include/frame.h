@@ -0,0 +1,77 @@
+#pragma once
+/**
+ * @file frame.h
+ * @brief Frame Timing Module
+ */
+
+#include <3ds/types.h>
+#include <3ds/os.h>
+
+#define FRAME_VBLANK_TICKS ((u64) SYSCLOCK_ARM11 * 1000 / 59831) // 59.831Hz
+#define FRAME_WINDOW (30) // frames per overlay refresh
+
+/// The phases of a frame of the main loop.
+typedef enum
+{
+	FRAME_INPUT,		///< The input scan
+	FRAME_LOGIC,		///< The handling of the keys, without the redraws
+	FRAME_RENDER,		///< The redraws of the consoles
+	FRAME_FLUSH,		///< The flush and swap of the framebuffers
+	FRAME_PHASE_COUNT,
+} framePhase;
+
+/// The timing of a phase, over the frames.
+typedef struct
+{
+	u64 minTicks;		///< The shortest phase
+	u64 maxTicks;		///< The longest phase
+	u64 totalTicks;		///< The total of the phases
+} frameTiming;
+
+/**
+ * @brief Begins a frame, right after the vblank (counts the vblanks missed since the previous one).
+ */
+void frameBegin(void);
+
+/**
+ * @brief Ends a phase (input, logic or flush), begun at the previous mark.
+ * The redraws timed meanwhile are counted as render, not as the phase.
+ * @param phase The phase.
+ */
+void frameMark(framePhase phase);
+
+/**
+ * @brief Ends a frame, and refreshes the overlay on the title line every FRAME_WINDOW frames.
+ */
+void frameEnd(void);
+
+/**
+ * @brief Begins a redraw.
+ * @return The start of the redraw.
+ */
+u64 frameRenderBegin(void);
+
+/**
+ * @brief Ends a redraw, counted as render and traced.
+ * @param[in] name The name of the redraw (a static string).
+ * @param start The start of the redraw, from frameRenderBegin.
+ */
+void frameRenderEnd(const char* name, u64 start);
+
+/**
+ * @brief Gets the timing of a phase, since the start.
+ * @param phase The phase.
+ * @param[out] timing The timing.
+ * @return The count of the frames.
+ */
+u32 frameGetTiming(framePhase phase, frameTiming* timing);
+
+/**
+ * @brief Gets the count of the vblanks missed since the start.
+ */
+u32 frameGetMissedCount(void);
+
+/**
+ * @brief Logs the min/avg/max of each phase and the missed vblanks.
+ */
+void frameLog(void);
@@ -12,12 +12,12 @@ extern "C" {
 
 #include <3ds/services/fs.h>
 
-/// The data of a user savedata archive's lowpath.
+/// The data of a user savedata (or extdata) archive's lowpath.
 typedef struct
 {
 	u32 mediatype;	///< The mediatype of the FS_Path.
-	u32 lowid;		///< The lower word of the saveid.
-	u32 highid;		///< The upper word of the saveid.
+	u32 lowid;		///< The lower word of the saveid (or extdata id).
+	u32 highid;		///< The upper word of the saveid (or extdata id).
 } FS_UserSaveData_LowPathData;
 
 /// Attribute flags extended.
@@ -26,17 +26,166 @@ enum
 	FS_ATTRIBUTE_NONE = 0,  ///< None.
 };
 
-extern FS_Archive sdmcArchive;
-extern FS_Archive saveArchive;
+#define FS_MAX_ARCHIVES (8)
 
+/// The descriptor of an archive, the key of the archive registry.
+typedef struct
+{
+	FS_ArchiveID id;			///< The archive id.
+	FS_MediaType mediatype;		///< The mediatype (user savedata and extdata only).
+	u64 titleid;				///< The title id (user savedata), or the extdata id (extdata).
+} FS_ArchiveDesc;
+
+extern const FS_ArchiveDesc sdmcArchiveDesc;
+extern const FS_ArchiveDesc saveArchiveDesc;
+
+/// Browses the sdmc archive when the save archive can't be opened, for #Citra use.
 #define FS_DEBUG_FIX_ARCHIVE
-#ifdef FS_DEBUG_FIX_ARCHIVE
+
 /**
- * @brief Redirects the saveArchive to the sdmcArchive for #Citra use
- * @return[in/out] Whether the archive fix is working.
+ * @brief Makes the descriptor of the extdata archive of a title.
+ * @param[out] desc The descriptor.
+ * @param titleid The title id.
  */
-bool FSDEBUG_FixArchive(const FS_Archive** archive);
-#endif
+void FS_MakeExtdataDesc(FS_ArchiveDesc* desc, u64 titleid);
+
+/**
+ * @brief Acquires an archive from the registry, opening it on the first use.
+ * When the registry is full, the least recently used unreferenced archive is closed.
+ * It can be called from any thread, the FS session is set for the calling thread.
+ * @param[in] desc The descriptor of the archive.
+ * @param[out] archive The open archive (valid until released).
+ */
+Result FS_AcquireArchive(const FS_ArchiveDesc* desc, const FS_Archive** archive);
+
+/**
+ * @brief Releases an archive acquired from the registry.
+ * The archive is kept open for a later use until the registry needs its slot.
+ * @param[in] archive The archive to release.
+ */
+void FS_ReleaseArchive(const FS_Archive* archive);
+
+#define FS_STREAM_EOF (1)
+
+/// When the writes to a file are flushed to the media.
+typedef enum
+{
+	FS_FLUSH_WRITE,		///< Every write to the file is flushed.
+	FS_FLUSH_CLOSE,		///< The file is flushed once, when closed.
+	FS_FLUSH_NONE,		///< The file is never flushed, the operation flushes or commits once at its end.
+} FS_FlushPolicy;
+
+/**
+ * @brief Sets the flush policy of the files written by the copies, the exports and the imports.
+ * The default is FS_FLUSH_NONE, the operations commit the save archive once at their end.
+ * The archives without a commit (sdmc, extdata) are still flushed on close (see FS_GetFlushPolicy).
+ * @param flush The flush policy.
+ */
+void FS_SetFlushPolicy(FS_FlushPolicy flush);
+
+/**
+ * @brief Gets the flush policy of the files written to an archive.
+ * FS_FLUSH_NONE only applies to the save archives, committed once at the end of an operation;
+ * the other archives are flushed on close at least, before a digest or an index refers to their files.
+ * @param[in] archive The written archive (NULL for the policy as set).
+ */
+FS_FlushPolicy FS_GetFlushPolicy(const FS_Archive* archive);
+
+/**
+ * @brief Gets the name of a flush policy ("none", "write" or "close").
+ * @param flush The flush policy.
+ */
+const char* FS_GetFlushPolicyName(FS_FlushPolicy flush);
+
+/**
+ * @brief Parses the name of a flush policy (see FS_GetFlushPolicyName).
+ * @param[in] name The name.
+ * @param[out] flush The flush policy.
+ * @return -4 if the name is unknown.
+ */
+Result FS_ParseFlushPolicy(const char* name, FS_FlushPolicy* flush);
+
+/// A file opened as a stream, with a read-ahead or write-behind buffer.
+typedef struct
+{
+	Handle handle;				///< The handle of the file.
+	u64 size;					///< The size of the file, with the pending writes.
+	u64 offset;					///< The position of the next sequential read or write.
+	u8* buffer;					///< The buffer (NULL if unbuffered).
+	u32 bufferSize;				///< The capacity of the buffer.
+	u32 bufferLength;			///< The count of bytes read ahead or pending in the buffer.
+	u64 bufferOffset;			///< The position of the buffer in the file.
+	FS_FlushPolicy flush;		///< The flush policy of the writes.
+	bool isWriting;				///< Whether the buffer holds pending writes.
+	bool isDirty;				///< Whether some writes weren't flushed yet.
+} FS_Stream;
+
+/**
+ * @brief Opens a file as a stream.
+ * @param[out] stream The stream.
+ * @param path The path of the file (PATH_ASCII or PATH_UTF16).
+ * @param[in] archive The archive of the file.
+ * @param openFlags The open flags of the file.
+ * @param bufferSize The size of the buffer (0 for an unbuffered stream).
+ * @param flush The flush policy of the writes.
+ */
+Result FS_StreamOpen(FS_Stream* stream, FS_Path path, const FS_Archive* archive, u32 openFlags, u32 bufferSize, FS_FlushPolicy flush);
+
+/**
+ * @brief Reads the next bytes of a stream, advancing it.
+ * @param[in/out] stream The stream.
+ * @param[out] dst The destination buffer.
+ * @param size The max count of bytes to read.
+ * @param[out] bytesRead The count of bytes read (0 at the end of the file).
+ */
+Result FS_StreamRead(FS_Stream* stream, void* dst, u32 size, u32* bytesRead);
+
+/**
+ * @brief Reads some bytes of a stream at an offset, without moving it.
+ * @param[in/out] stream The stream.
+ * @param offset The offset of the bytes in the file.
+ * @param[out] dst The destination buffer.
+ * @param size The max count of bytes to read.
+ * @param[out] bytesRead The count of bytes read.
+ */
+Result FS_StreamReadAt(FS_Stream* stream, u64 offset, void* dst, u32 size, u32* bytesRead);
+
+/**
+ * @brief Reads the next text line of a buffered stream, without its '\n'.
+ * The end of a line too long for dst is skipped.
+ * @param[in/out] stream The stream (buffered).
+ * @param[out] dst The null-terminated line.
+ * @param maxLength The size of dst.
+ * @return FS_STREAM_EOF at the end of the file.
+ */
+Result FS_StreamReadLine(FS_Stream* stream, char* dst, u32 maxLength);
+
+/**
+ * @brief Writes some bytes at the position of a stream, advancing it.
+ * The bytes are kept in the buffer until it is full, or until a flush or a close.
+ * @param[in/out] stream The stream.
+ * @param[in] src The source buffer.
+ * @param size The count of bytes to write.
+ */
+Result FS_StreamWrite(FS_Stream* stream, const void* src, u32 size);
+
+/**
+ * @brief Writes the pending bytes of a stream and flushes the file.
+ * @param[in/out] stream The stream.
+ */
+Result FS_StreamFlush(FS_Stream* stream);
+
+/**
+ * @brief Truncates the file of a stream at its position, dropping the remains of an overwritten file.
+ * @param[in/out] stream The stream.
+ */
+Result FS_StreamTruncate(FS_Stream* stream);
+
+/**
+ * @brief Closes a stream, writing its pending bytes and flushing it (see FS_FlushPolicy).
+ * @param[in/out] stream The stream.
+ */
+Result FS_StreamClose(FS_Stream* stream);
 
 /**
  * @brief Reads a file (path) to dst.
@@ -49,7 +198,7 @@ bool FSDEBUG_FixArchive(const FS_Archive** archive);
 Result FS_ReadFile(const char* path, void* dst, u64 maxSize, const FS_Archive* archive, u32* bytesRead);
 
 /**
- * @brief Writes src to a file (path).
+ * @brief Writes src to a file (path), flushed according to FS_GetFlushPolicy.
  * @param[in] path The path of the file to write.
  * @param[in] src The source buffer.
  * @param size The size in bytes to write.
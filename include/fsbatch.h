@@ -0,0 +1,19 @@
+#pragma once
+/**
+ * @file fsbatch.h
+ * @brief Filesystem Batch Module
+ */
+
+#include <3ds/types.h>
+
+#define FS_BATCH_MAX_TITLES (0x300)
+#define FS_BATCH_SLOTS (2)
+#define FS_BATCH_STACK_SIZE (0x10000)
+#define FS_BATCH_THREAD_PRIORITY (0x30)
+
+/**
+ * @brief Exports the saves of all the installed titles to /backup/<titleid>/.
+ * The save of the next title is opened, scanned and staged by a thread while
+ * the previous one is written. The unchanged saves (see fsBackExport) are skipped.
+ */
+Result fsBatchExportAll(void);
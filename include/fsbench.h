@@ -0,0 +1,45 @@
+#pragma once
+/**
+ * @file fsbench.h
+ * @brief Storage Benchmark Module
+ */
+
+#include <3ds/types.h>
+#include <3ds/services/fs.h>
+
+#define FS_BENCH_MAGIC "tvds-bench 1\n"
+#define FS_BENCH_PATH "/tvds/bench"
+#define FS_BENCH_DIR_PATH "/tvds-bench/"
+#define FS_BENCH_FILE_SIZE (0x100000) // 1MB
+#define FS_BENCH_MIN_FILE_SIZE (0x10000) // 64KB
+#define FS_BENCH_CHUNK_SIZE (0x10000) // 64KB
+#define FS_BENCH_RANDOM_SIZE (0x1000) // 4KB
+#define FS_BENCH_RANDOM_COUNT (64)
+#define FS_BENCH_OPEN_COUNT (32)
+#define FS_BENCH_DIR_ENTRIES (32)
+#define FS_BENCH_LINE_LENGTH (160)
+
+/// The results of the benchmark of an archive.
+typedef struct
+{
+	const char* name;		///< The name of the archive
+	Result ret;				///< The result of the benchmark
+	u32 fileSize;			///< The size of the scratch file
+	u32 seqWriteSpeed;		///< The sequential write speed (KB/s)
+	u32 seqReadSpeed;		///< The sequential read speed (KB/s)
+	u32 randWriteSpeed;		///< The random write speed (KB/s)
+	u32 randReadSpeed;		///< The random read speed (KB/s)
+	u32 openLatency;		///< The latency of an open and close (us)
+	u32 listRate;			///< The directory listing rate (entries/s)
+} fsBenchResult;
+
+/**
+ * @brief Benchmarks the sdmc and the save archives, then writes the results to FS_BENCH_PATH.
+ * The scratch area (FS_BENCH_DIR_PATH) is deleted afterwards, never committed to the save.
+ */
+Result fsBenchRun(void);
+
+/**
+ * @brief Prints the results of the latest benchmark to the save and sdmc panes.
+ */
+void fsBenchPrint(void);
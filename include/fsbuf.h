@@ -0,0 +1,74 @@
+#pragma once
+/**
+ * @file fsbuf.h
+ * @brief Filesystem Buffer Module
+ */
+
+#include <3ds/types.h>
+
+#define FS_BUFFER_ALIGNMENT (0x200) // SD sector
+#define FS_BUFFER_CLASS_COUNT (4)
+#define FS_BUFFER_MAX_SLOTS (8)
+#define FS_BUFFER_MIN_BUDGET (0x60000) // 384KB
+#define FS_BUFFER_MAX_BUDGET (0x200000) // 2MB
+#define FS_BUFFER_BUDGET_SHIFT (3) // 1/8 of the free memory
+#define FS_BUFFER_MIN_CHUNK (0x1000) // the smallest chunk of the heap fallback, under memory pressure
+
+/// The usage of a size class of the buffer pool.
+typedef struct
+{
+	u32 size;			///< The size in bytes of the buffers
+	u32 slotCount;		///< The max count of pooled buffers
+	u32 allocCount;		///< The count of pooled buffers allocated so far
+	u32 usedCount;		///< The count of pooled buffers in use
+	u32 peakCount;		///< The max count of pooled buffers used at once
+	u32 hitCount;		///< The count of requests served by the pool
+	u32 missCount;		///< The count of requests served by the heap
+} fsBufferUsage;
+
+/**
+ * @brief Initializes the buffer pool, its budget sized from the free memory.
+ * The pooled buffers are allocated on their first use, then reused.
+ * Under memory pressure, the idle ones are freed and the budget shrinks (see mem.h).
+ */
+void fsBufferInit(void);
+
+/**
+ * @brief Exits the buffer pool, freeing its buffers (they shall all be released).
+ */
+void fsBufferExit(void);
+
+/**
+ * @brief Acquires an aligned buffer of at least a size.
+ * It falls back to the heap when no pooled buffer is free (a miss).
+ * @param size The min size in bytes of the buffer.
+ * @return The buffer (NULL if out of memory).
+ */
+void* fsBufferAlloc(u32 size);
+
+/**
+ * @brief Acquires an aligned buffer for the chunked I/O, a smaller one if none of the size is free
+ * (down to FS_BUFFER_MIN_CHUNK if the heap is short).
+ * @param maxSize The preferred size in bytes of the buffer.
+ * @param[out] size The size in bytes of the buffer (may be less or more than maxSize).
+ * @return The buffer (NULL if out of memory).
+ */
+void* fsBufferAllocChunk(u32 maxSize, u32* size);
+
+/**
+ * @brief Releases a buffer acquired from the pool.
+ * @param[in] buffer The buffer to release (NULL is ignored).
+ */
+void fsBufferFree(void* buffer);
+
+/**
+ * @brief Gets the usage of the buffer pool.
+ * @param[out] usage The usage of the size classes (FS_BUFFER_CLASS_COUNT).
+ * @return The budget in bytes of the pool.
+ */
+u32 fsBufferGetUsage(fsBufferUsage* usage);
+
+/**
+ * @brief Prints the usage of the buffer pool to the log console.
+ */
+void fsBufferLogUsage(void);
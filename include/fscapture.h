@@ -0,0 +1,95 @@
+#pragma once
+/**
+ * @file fscapture.h
+ * @brief Filesystem Capture Module
+ *
+ * A binary log of the probed FS calls (see fsprobe.h), to replay the workload on the host (tvds-fsreplay).
+ * The records are appended to a preallocated buffer, written to the sdmc by a thread while the next one fills.
+ * A record which doesn't fit while both buffers are full is dropped (and counted), the calls never wait.
+ */
+
+#include <3ds/types.h>
+#include <3ds/services/fs.h>
+
+#define FS_CAPTURE_PATH "/tvds/fs.cap"
+#define FS_CAPTURE_MAGIC "tvdscap1" // 8 bytes, then the records
+#define FS_CAPTURE_BUFFER_SIZE (0x10000) // bytes, 2 buffers
+#define FS_CAPTURE_MAX_PATH (0x220) // bytes of a path kept
+#define FS_CAPTURE_STACK_SIZE (0x2000)
+#define FS_CAPTURE_THREAD_PRIORITY (0x30)
+
+/// The captured calls.
+typedef enum
+{
+	FS_CAPTURE_OPEN_ARCHIVE,		///< FSUSER_OpenArchive (path: the lowpath)
+	FS_CAPTURE_CLOSE_ARCHIVE,		///< FSUSER_CloseArchive
+	FS_CAPTURE_CONTROL_ARCHIVE,		///< FSUSER_ControlArchive (offset: the action)
+	FS_CAPTURE_GET_FREE_BYTES,		///< FSUSER_GetFreeBytes (offset: the free bytes)
+	FS_CAPTURE_OPEN_FILE,			///< FSUSER_OpenFile (offset: the open flags)
+	FS_CAPTURE_CREATE_FILE,			///< FSUSER_CreateFile (offset: the size)
+	FS_CAPTURE_DELETE_FILE,			///< FSUSER_DeleteFile
+	FS_CAPTURE_OPEN_DIRECTORY,		///< FSUSER_OpenDirectory
+	FS_CAPTURE_CREATE_DIRECTORY,	///< FSUSER_CreateDirectory
+	FS_CAPTURE_DELETE_DIRECTORY,	///< FSUSER_DeleteDirectory
+	FS_CAPTURE_DELETE_RECURSIVELY,	///< FSUSER_DeleteDirectoryRecursively
+	FS_CAPTURE_READ,				///< FSFILE_Read
+	FS_CAPTURE_WRITE,				///< FSFILE_Write (offset and size, done: the bytes written)
+	FS_CAPTURE_GET_SIZE,			///< FSFILE_GetSize (offset: the size)
+	FS_CAPTURE_SET_SIZE,			///< FSFILE_SetSize (offset: the size)
+	FS_CAPTURE_FLUSH,				///< FSFILE_Flush
+	FS_CAPTURE_CLOSE,				///< FSFILE_Close
+	FS_CAPTURE_DIR_READ,			///< FSDIR_Read (size: the entries asked, done: the entries read)
+	FS_CAPTURE_DIR_CLOSE,			///< FSDIR_Close
+	FS_CAPTURE_OP_COUNT,
+} fsCaptureOp;
+
+/// A captured call, followed by its path (pathSize bytes, padded to 4 bytes).
+typedef struct
+{
+	u8 op;				///< The call (fsCaptureOp)
+	u8 pathType;		///< The type of the path (FS_PathType)
+	u16 pathSize;		///< The size of the path (bytes)
+	u32 archiveId;		///< The archive of the path (0 for a handle)
+	u32 handle;			///< The handle opened or used
+	Result result;		///< The result of the call
+	u64 offset;			///< The offset of a read or write (see fsCaptureOp for the others)
+	u32 size;			///< The bytes or entries asked
+	u32 done;			///< The bytes or entries done
+	u32 start;			///< The start of the call (us since the start of the capture)
+	u32 duration;		///< The duration of the call (ticks)
+} fsCaptureRecord;
+
+/// Whether the probed calls are captured (see fsCaptureStart).
+extern bool fsCaptureEnabled;
+
+/**
+ * @brief Records a probed call.
+ * @param op The call.
+ * @param archiveId The archive of the path (0 for a handle).
+ * @param[in] path The path (NULL for a handle).
+ * @param handle The handle opened or used.
+ * @param offset The offset of a read or write (see fsCaptureOp).
+ * @param size The bytes or entries asked.
+ * @param done The bytes or entries done.
+ * @param result The result of the call.
+ * @param start The start of the call (ticks).
+ * @param ticks The duration of the call.
+ */
+void fsCaptureCall(fsCaptureOp op, u32 archiveId, const FS_Path* path, Handle handle, u64 offset, u32 size, u32 done, Result result, u64 start, u64 ticks);
+
+/**
+ * @brief Starts capturing to the sdmc (FS_CAPTURE_PATH, overwritten).
+ */
+Result fsCaptureStart(void);
+
+/**
+ * @brief Stops capturing, writes the remaining records and closes the capture.
+ */
+Result fsCaptureStop(void);
+
+/**
+ * @brief Gets the count of the records captured and dropped since the start.
+ * @param[out] dropped The count of the records dropped (optional).
+ * @return The count of the records captured.
+ */
+u32 fsCaptureGetCount(u32* dropped);
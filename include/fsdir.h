@@ -9,6 +9,8 @@
 #include <3ds/services/fs.h>
 
 #define FS_USER_INTERRUPT (0x8000DEAD)
+#define FS_VERIFY_FAILED (0x8000BAD1)
+#define FS_SAVE_UNCHANGED (2)
 
 /// A stack node for fsDir.
 typedef struct fsStackNode
@@ -48,7 +50,7 @@ typedef struct fsDir
 	fsStack entryStack;		///< The stack of parent folders.
 	s16 entryOffsetId;		///< The current entry offset.
 	s16 entrySelectedId;	///< The current entry selection.
-	FS_Archive* archive;	///< The archive of the dir.
+	const FS_Archive* archive;	///< The archive of the dir.
 } fsDir;
 
 /// The save fsDir for fsDir.
@@ -58,14 +60,21 @@ extern fsDir sdmcDir;
 
 /**
  * @brief Initializes fsDir.
+ * @param titleid The title id, for its extdata.
  */
-void fsDirInit(void);
+void fsDirInit(u64 titleid);
 
 /**
  * @brief Exits fsDir.
  */
 void fsDirExit(void);
 
+/**
+ * @brief Switches the save dir (and the backups) between the save and the extdata archive.
+ * Call fsBackInit again to reload the backups.
+ */
+Result fsDirSwitchData(void);
+
 /**
  * @brief Prints the save dir in its console.
  */
@@ -116,14 +125,23 @@ Result fsDirGotoSubDir(void);
 
 /**
  * @brief Copies the current entry to the other dir.
+ * @param overwrite Whether it shall overwrite without asking.
+ * @param verify Whether it shall read back and check the copied files.
  */
-Result fsDirCopyCurrentEntry(bool overwrite);
+Result fsDirCopyCurrentEntry(bool overwrite, bool verify);
 
 /**
  * @brief Copies the current directory to the other dir.
  */
 Result fsDirCopyCurrentFolder(bool overwrite);
 
+/**
+ * @brief Mirrors the current directory to the current directory of the other dir.
+ * Only the new and the changed files (by size, then hash) are written, after a dry-run summary.
+ * @param deleteExtra Whether it shall delete the entries missing from the current directory.
+ */
+Result fsDirMirrorCurrentFolder(bool deleteExtra);
+
 /**
  * @brief Deletes the current entry.
  */
@@ -159,16 +177,31 @@ void fsBackPrintBackup(void);
 void fsBackMove(s16 count);
 
 /**
- * @brief Exports a new backup. (save->sdmc)
+ * @brief Exports a new backup and its digests. (save->sdmc)
+ * The new copy is removed if its fingerprint matches the latest backup,
+ * unless that backup failed its verify (it is then flagged in the index).
+ * @param verify Whether it shall read back and check the backup.
+ * @param force Whether it shall export even if the save didn't change.
+ * @return FS_SAVE_UNCHANGED if the export was skipped.
  */
-Result fsBackExport(void);
+Result fsBackExport(bool verify, bool force);
 
 /**
  * @brief Imports the current backup. (sdmc->save)
+ * The entries to write are staged in memory first, then the save is
+ * written and committed once (the staged save is restored on failure).
+ * The extdata is streamed instead, without staging nor commit.
+ * @param minimal Whether it shall only write the files which differ
+ * (by size then by hash) and delete the extra ones, instead of rewriting the whole save.
  */
-Result fsBackImport(void);
+Result fsBackImport(bool minimal);
 
 /**
  * @brief Deletes the current backup.
  */ 
 Result fsBackDelete(void);
+
+/**
+ * @brief Verifies the current backup against its stored digests.
+ */
+Result fsBackVerify(void);
@@ -0,0 +1,119 @@
+#pragma once
+/**
+ * @file fsindex.h
+ * @brief Backup Index Module
+ */
+
+#include "fsls.h"
+#include "fstree.h"
+
+#include <3ds/services/fs.h>
+
+#include <time.h>
+
+#define FS_INDEX_LINE_LENGTH (FS_MAX_FPATH_LENGTH*3 + 96)
+
+/// The manifest of a backup.
+typedef struct fsManifest
+{
+	u16 name16[FS_MAX_FPATH_LENGTH];	///< The name of the backup directory
+	u64 created;						///< The creation time (seconds since 1970, 0 if unknown)
+	u64 totalSize;						///< The total size in bytes of the files
+	u32 fileCount;						///< The count of the files
+	u32 dirCount;						///< The count of the directories
+	u32 digest;							///< The root digest (see fsTreeDigest)
+	bool isDigested : 1;				///< If the root digest is known
+	bool isVerifyFailed : 1;			///< If the backup failed its verify (its digest is the one of the save)
+	unsigned : 6;
+} fsManifest;
+
+/// The index of the backups of a title.
+typedef struct fsIndex
+{
+	fsManifest* manifests;	///< The manifests, sorted by name
+	u32 count;				///< The count of the manifests
+	u32 capacity;			///< The allocated count of manifests
+} fsIndex;
+
+/**
+ * @brief Formats the name of a backup from its creation time.
+ * @param[out] dst The name, with the trailing '/' (FS_MAX_FPATH_LENGTH bytes at most).
+ * @param created The creation time.
+ */
+void fsManifestName(char* dst, time_t created);
+
+/**
+ * @brief Fills the counts and the root digest of a manifest from a tree.
+ * @param[out] manifest The manifest.
+ * @param[in/out] tree The tree of the backup (sorted by fsTreeDigest if digest).
+ * @param digest Whether it shall compute the root digest (the hashes shall be known).
+ */
+void fsManifestFromTree(fsManifest* manifest, fsTree* tree, bool digest);
+
+/**
+ * @brief Formats a manifest as a text line.
+ * @param[in] manifest The manifest.
+ * @param[out] dst The line (FS_INDEX_LINE_LENGTH bytes at most).
+ * @return The length of the line.
+ */
+u32 fsManifestFormat(const fsManifest* manifest, char* dst);
+
+/**
+ * @brief Reads the manifest stored in the header of a digest file.
+ * @param[out] manifest The manifest (its name is kept).
+ * @param[in] path The path of the digest file.
+ * @param[in] archive The archive of the digest file.
+ */
+Result fsManifestRead(fsManifest* manifest, const u16* path, const FS_Archive* archive);
+
+/**
+ * @brief Finds a manifest by its backup name.
+ * @param[in] index The index.
+ * @param[in] name The name of the backup (without the trailing '/').
+ * @return The manifest (NULL if not found).
+ */
+fsManifest* fsIndexFind(const fsIndex* index, const u16* name);
+
+/**
+ * @brief Finds the manifest of the latest backup.
+ * @param[in] index The index.
+ * @return The manifest (NULL if the index is empty).
+ */
+fsManifest* fsIndexLatest(const fsIndex* index);
+
+/**
+ * @brief Adds or replaces a manifest, keeping the index sorted.
+ * @param[in/out] index The index.
+ * @param[in] manifest The manifest to copy.
+ * @return The manifest in the index (NULL if out of memory).
+ */
+fsManifest* fsIndexAdd(fsIndex* index, const fsManifest* manifest);
+
+/**
+ * @brief Removes a manifest by its backup name.
+ * @param[in/out] index The index.
+ * @param[in] name The name of the backup (without the trailing '/').
+ */
+void fsIndexRemove(fsIndex* index, const u16* name);
+
+/**
+ * @brief Reads an index file, streamed line by line (see FS_StreamReadLine).
+ * @param[out] index The index to fill (must be empty).
+ * @param[in] path The path of the index file.
+ * @param[in] archive The archive of the index file.
+ */
+Result fsIndexRead(fsIndex* index, const u16* path, const FS_Archive* archive);
+
+/**
+ * @brief Writes an index file, streamed line by line and flushed on close.
+ * @param[in] index The index.
+ * @param[in] path The path of the index file.
+ * @param[in] archive The archive of the index file.
+ */
+Result fsIndexWrite(const fsIndex* index, const u16* path, const FS_Archive* archive);
+
+/**
+ * @brief Frees the manifests of an index.
+ * @param[in/out] index The index to free.
+ */
+void fsIndexFree(fsIndex* index);
@@ -9,6 +9,11 @@
 #define FS_MAX_FPATH_LENGTH (0x106) // 0x106
 #define FS_MAX_PATH_LENGTH (0x400) // 0x400
 
+#define FS_DIFF_BLOCK_SIZE (0x1000) // 4KB
+#define FS_DIFF_CHUNK_SIZE (0x10000) // 64KB
+#define FS_COPY_CHUNK_SIZE (0x40000) // 256KB
+#define FS_TEXT_BUFFER_SIZE (0x4000) // 16KB
+
 #define FS_OUT_OF_RESOURCE (0xD8604664)
 #define FS_OUT_OF_RESOURCE_2 (0xC86044CD)
 
@@ -18,6 +23,7 @@ typedef struct fsEntry
 	u16 name16[FS_MAX_PATH_LENGTH];	///< The name as UTF-16
 	char name[FS_MAX_PATH_LENGTH];	///< The name as char
 	u32 attributes;					///< The attributes (Is FS_DIRECTORY?)
+	u64 fileSize;					///< The size in bytes (files only)
 	bool isDirectory : 1;			///< If FS_DIRECTORY
 	bool isRealDirectory : 1;		///< If FS_REAL_DIRECTORY
 	bool isRootDirectory : 1;		///< If FS_ROOT_DIRECTORY
@@ -43,15 +49,53 @@ bool fsFileExists(const u16* path, const FS_Archive* archive);
  */
 bool fsDirExists(const u16* path, const FS_Archive* archive);
 
+/**
+ * @brief Opens a file to write it, with its final size already set.
+ * The files of the fixed-size archives (extdata) can't be created by an open nor resized,
+ * such a file is recreated (its content is lost) if its size differs.
+ * @param[out] handle The handle of the file, open for read and write.
+ * @param[in] path The path of the file.
+ * @param[in] archive The archive of the file.
+ * @param attributes The attributes of the file.
+ * @param size The size in bytes of the file.
+ * @param[out] keptSize The size in bytes of the previous content kept in the file (optional).
+ */
+Result fsOpenWriteFile(Handle* handle, const u16* path, const FS_Archive* archive, u32 attributes, u64 size, u64* keptSize);
+
 /**
  * @brief Copies a file from an archive to another archive.
+ * The file is streamed by chunks (FS_COPY_CHUNK_SIZE), whatever its size, and flushed once.
  * @param[in] srcPath The path of the source file/directory.
  * @param[in] srcArchive The archive of the source file/directory.
  * @param[in] dstPath The path of the destination file/directory.
  * @param[in] dstArchive The archive of the destination file/directory.
  * @param attributes The attributes of the file/directory.
+ * @param[out] hash The CRC-32 of the source data, computed while copying (optional).
+ */
+Result fsCopyFile(const u16* srcPath, const FS_Archive* srcArchive, const u16* dstPath, const FS_Archive* dstArchive, u32 attributes, u32* hash);
+
+/**
+ * @brief Overwrites a file with another file, writing only the blocks which differ.
+ * The blocks (FS_DIFF_BLOCK_SIZE) are compared by chunks (FS_DIFF_CHUNK_SIZE),
+ * the adjacent changed blocks are written at once and the file is flushed once at the end.
+ * @param[in] srcPath The path of the source file.
+ * @param[in] srcArchive The archive of the source file.
+ * @param[in] dstPath The path of the destination file.
+ * @param[in] dstArchive The archive of the destination file.
+ * @param attributes The attributes of the file.
+ * @param[out] hash The CRC-32 of the source data, computed while copying (optional).
+ * @param[out] bytesWritten The count of bytes written (optional).
+ */
+Result fsCopyFileDiff(const u16* srcPath, const FS_Archive* srcArchive, const u16* dstPath, const FS_Archive* dstArchive, u32 attributes, u32* hash, u64* bytesWritten);
+
+/**
+ * @brief Hashes the content of a file.
+ * @param[in] path The path of the file.
+ * @param[in] archive The archive of the file.
+ * @param[out] size The size in bytes of the file (optional).
+ * @param[out] hash The CRC-32 of the file content.
  */
-Result fsCopyFile(const u16* srcPath, const FS_Archive* srcArchive, const u16* dstPath, const FS_Archive* dstArchive, u32 attributes);
+Result fsHashFile(const u16* path, const FS_Archive* archive, u64* size, u32* hash);
 
 /**
  * @brief Scans a directory based on an archive.
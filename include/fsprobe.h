@@ -0,0 +1,85 @@
+#pragma once
+/**
+ * @file fsprobe.h
+ * @brief Probed FS calls
+ *
+ * Each FSUSER_*, FSFILE_* and FSDIR_* call of the including file is counted (see fsstats.h),
+ * becomes a span while tracing (see trace.h), and is logged while capturing (see fscapture.h).
+ * Include it last (the libctru declarations shall not be expanded), in the modules calling the FS service
+ * for the operations (fs.c, fsls.c, fstree.c, fsdir.c and fsbatch.c), not in the calibration of fstune.c.
+ * The macros don't expand recursively, so the libctru functions are still the ones called.
+ */
+
+#include "fsstats.h"
+#include "fscapture.h"
+#include "trace.h"
+
+#include <3ds/result.h>
+#include <3ds/svc.h>
+
+/// Times a call, records it, and evaluates to its result (bytes and capture are evaluated after the call).
+#define FS_PROBE(op, name, bytes, call, capture) ({ \
+	u64 probeStart_ = svcGetSystemTick(); \
+	Result probeRet_ = (call); \
+	u64 probeTicks_ = svcGetSystemTick() - probeStart_; \
+	fsStatsRecord(op, probeTicks_, (R_SUCCEEDED(probeRet_) ? (bytes) : 0), probeRet_); \
+	traceEnd(name, (traceEnabled ? probeStart_ : 0)); \
+	if (fsCaptureEnabled) capture; \
+	probeRet_; })
+
+/// Captures the probed call (within FS_PROBE, see fsCaptureCall).
+#define FS_CAPTURE(op, archiveId, path, handle, offset, size, done) \
+	fsCaptureCall(op, archiveId, path, handle, offset, size, done, probeRet_, probeStart_, probeTicks_)
+
+/// An output of the probed call (0 if it failed).
+#define FS_CAPTURE_OUT(value) (R_SUCCEEDED(probeRet_) ? (value) : 0)
+
+#define FSUSER_Initialize(...) FS_PROBE(FS_STATS_OTHER, "FSUSER_Initialize", 0, FSUSER_Initialize(__VA_ARGS__), (void) 0)
+#define FSUSER_OpenArchive(archive) FS_PROBE(FS_STATS_OPEN, "FSUSER_OpenArchive", 0, FSUSER_OpenArchive(archive), \
+	FS_CAPTURE(FS_CAPTURE_OPEN_ARCHIVE, (archive)->id, &(archive)->lowPath, 0, 0, 0, 0))
+#define FSUSER_CloseArchive(archive) FS_PROBE(FS_STATS_OTHER, "FSUSER_CloseArchive", 0, FSUSER_CloseArchive(archive), \
+	FS_CAPTURE(FS_CAPTURE_CLOSE_ARCHIVE, (archive)->id, NULL, 0, 0, 0, 0))
+#define FSUSER_ControlArchive(archive, action, input, inputSize, output, outputSize) FS_PROBE(FS_STATS_COMMIT, "FSUSER_ControlArchive", 0, \
+	FSUSER_ControlArchive(archive, action, input, inputSize, output, outputSize), \
+	FS_CAPTURE(FS_CAPTURE_CONTROL_ARCHIVE, (archive).id, NULL, 0, action, 0, 0))
+#define FSUSER_OpenFile(out, archive, path, openFlags, attributes) FS_PROBE(FS_STATS_OPEN, "FSUSER_OpenFile", 0, \
+	FSUSER_OpenFile(out, archive, path, openFlags, attributes), \
+	FS_CAPTURE(FS_CAPTURE_OPEN_FILE, (archive).id, (FS_Path[]) { path }, FS_CAPTURE_OUT(*(out)), openFlags, 0, 0))
+#define FSUSER_CreateFile(archive, path, attributes, fileSize) FS_PROBE(FS_STATS_CREATE, "FSUSER_CreateFile", 0, \
+	FSUSER_CreateFile(archive, path, attributes, fileSize), \
+	FS_CAPTURE(FS_CAPTURE_CREATE_FILE, (archive).id, (FS_Path[]) { path }, 0, fileSize, 0, 0))
+#define FSUSER_DeleteFile(archive, path) FS_PROBE(FS_STATS_DELETE, "FSUSER_DeleteFile", 0, FSUSER_DeleteFile(archive, path), \
+	FS_CAPTURE(FS_CAPTURE_DELETE_FILE, (archive).id, (FS_Path[]) { path }, 0, 0, 0, 0))
+#define FSUSER_OpenDirectory(out, archive, path) FS_PROBE(FS_STATS_OPEN, "FSUSER_OpenDirectory", 0, FSUSER_OpenDirectory(out, archive, path), \
+	FS_CAPTURE(FS_CAPTURE_OPEN_DIRECTORY, (archive).id, (FS_Path[]) { path }, FS_CAPTURE_OUT(*(out)), 0, 0, 0))
+#define FSUSER_CreateDirectory(archive, path, attributes) FS_PROBE(FS_STATS_CREATE, "FSUSER_CreateDirectory", 0, \
+	FSUSER_CreateDirectory(archive, path, attributes), \
+	FS_CAPTURE(FS_CAPTURE_CREATE_DIRECTORY, (archive).id, (FS_Path[]) { path }, 0, 0, 0, 0))
+#define FSUSER_DeleteDirectory(archive, path) FS_PROBE(FS_STATS_DELETE, "FSUSER_DeleteDirectory", 0, FSUSER_DeleteDirectory(archive, path), \
+	FS_CAPTURE(FS_CAPTURE_DELETE_DIRECTORY, (archive).id, (FS_Path[]) { path }, 0, 0, 0, 0))
+#define FSUSER_DeleteDirectoryRecursively(archive, path) FS_PROBE(FS_STATS_DELETE, "FSUSER_DeleteDirectoryRecursively", 0, \
+	FSUSER_DeleteDirectoryRecursively(archive, path), \
+	FS_CAPTURE(FS_CAPTURE_DELETE_RECURSIVELY, (archive).id, (FS_Path[]) { path }, 0, 0, 0, 0))
+#define FSUSER_GetFreeBytes(freeBytes, archive) FS_PROBE(FS_STATS_OTHER, "FSUSER_GetFreeBytes", 0, FSUSER_GetFreeBytes(freeBytes, archive), \
+	FS_CAPTURE(FS_CAPTURE_GET_FREE_BYTES, (archive).id, NULL, 0, FS_CAPTURE_OUT(*(freeBytes)), 0, 0))
+
+#define FSFILE_Read(handle, bytesRead, offset, buffer, size) FS_PROBE(FS_STATS_READ, "FSFILE_Read", *(bytesRead), \
+	FSFILE_Read(handle, bytesRead, offset, buffer, size), \
+	FS_CAPTURE(FS_CAPTURE_READ, 0, NULL, handle, offset, size, FS_CAPTURE_OUT(*(bytesRead))))
+#define FSFILE_Write(handle, bytesWritten, offset, buffer, size, flags) FS_PROBE(FS_STATS_WRITE, "FSFILE_Write", *(bytesWritten), \
+	FSFILE_Write(handle, bytesWritten, offset, buffer, size, flags), \
+	FS_CAPTURE(FS_CAPTURE_WRITE, 0, NULL, handle, offset, size, FS_CAPTURE_OUT(*(bytesWritten))))
+#define FSFILE_GetSize(handle, size) FS_PROBE(FS_STATS_OTHER, "FSFILE_GetSize", 0, FSFILE_GetSize(handle, size), \
+	FS_CAPTURE(FS_CAPTURE_GET_SIZE, 0, NULL, handle, FS_CAPTURE_OUT(*(size)), 0, 0))
+#define FSFILE_SetSize(handle, size) FS_PROBE(FS_STATS_OTHER, "FSFILE_SetSize", 0, FSFILE_SetSize(handle, size), \
+	FS_CAPTURE(FS_CAPTURE_SET_SIZE, 0, NULL, handle, size, 0, 0))
+#define FSFILE_Flush(handle) FS_PROBE(FS_STATS_OTHER, "FSFILE_Flush", 0, FSFILE_Flush(handle), \
+	FS_CAPTURE(FS_CAPTURE_FLUSH, 0, NULL, handle, 0, 0, 0))
+#define FSFILE_Close(handle) FS_PROBE(FS_STATS_OTHER, "FSFILE_Close", 0, FSFILE_Close(handle), \
+	FS_CAPTURE(FS_CAPTURE_CLOSE, 0, NULL, handle, 0, 0, 0))
+
+#define FSDIR_Read(handle, entriesRead, entryCount, entries) FS_PROBE(FS_STATS_DIR_READ, "FSDIR_Read", 0, \
+	FSDIR_Read(handle, entriesRead, entryCount, entries), \
+	FS_CAPTURE(FS_CAPTURE_DIR_READ, 0, NULL, handle, 0, entryCount, FS_CAPTURE_OUT(*(entriesRead))))
+#define FSDIR_Close(handle) FS_PROBE(FS_STATS_OTHER, "FSDIR_Close", 0, FSDIR_Close(handle), \
+	FS_CAPTURE(FS_CAPTURE_DIR_CLOSE, 0, NULL, handle, 0, 0, 0))
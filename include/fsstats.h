@@ -0,0 +1,65 @@
+#pragma once
+/**
+ * @file fsstats.h
+ * @brief Filesystem Statistics Module
+ */
+
+#include <3ds/types.h>
+
+#define FS_STATS_BUCKET_COUNT (20) // log2 of the latency in us: 1us .. 512ms and more
+
+/// The FS operation types.
+typedef enum
+{
+	FS_STATS_OPEN,		///< Files, directories and archives opened
+	FS_STATS_READ,		///< FSFILE_Read
+	FS_STATS_WRITE,		///< FSFILE_Write
+	FS_STATS_DIR_READ,	///< FSDIR_Read
+	FS_STATS_CREATE,	///< Files and directories created
+	FS_STATS_DELETE,	///< Files and directories deleted
+	FS_STATS_COMMIT,	///< Save archives committed
+	FS_STATS_OTHER,		///< Closes, sizes, flushes
+	FS_STATS_OP_COUNT,
+} fsStatsOp;
+
+/// The statistics of an operation type.
+typedef struct
+{
+	u32 count;								///< The count of the calls
+	u32 errorCount;							///< The count of the failed calls
+	u64 bytes;								///< The bytes moved (reads and writes)
+	u64 ticks;								///< The total latency (ticks)
+	u64 maxTicks;							///< The highest latency (ticks)
+	u32 buckets[FS_STATS_BUCKET_COUNT];		///< The calls per latency, bucket i from 2^i us
+} fsStatsCounters;
+
+/**
+ * @brief Initializes the statistics module (before FS_Init, to count its calls).
+ */
+void fsStatsInit(void);
+
+/**
+ * @brief Records a FS call.
+ * @param op The operation type.
+ * @param ticks The latency of the call.
+ * @param bytes The bytes moved by the call.
+ * @param ret The result of the call.
+ */
+void fsStatsRecord(fsStatsOp op, u64 ticks, u64 bytes, Result ret);
+
+/**
+ * @brief Resets the statistics, between two experiments.
+ */
+void fsStatsReset(void);
+
+/**
+ * @brief Gets the statistics of an operation type.
+ * @param op The operation type.
+ * @param[out] counters The statistics.
+ */
+void fsStatsGet(fsStatsOp op, fsStatsCounters* counters);
+
+/**
+ * @brief Prints the statistics and their histograms to the log console.
+ */
+void fsStatsPrint(void);
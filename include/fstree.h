@@ -0,0 +1,140 @@
+#pragma once
+/**
+ * @file fstree.h
+ * @brief Filesystem Tree Module
+ */
+
+#include "fsls.h"
+
+#include <3ds/services/fs.h>
+
+/// A node (file or directory) of a flat tree listing.
+typedef struct fsTreeNode
+{
+	u16 path[FS_MAX_PATH_LENGTH];	///< The path relative to the tree root
+	u64 size;						///< The size in bytes (files only)
+	u32 hash;						///< The CRC-32 of the content (files only)
+	bool isDirectory : 1;			///< If FS_DIRECTORY
+	bool isHashed : 1;				///< If the hash is known
+	unsigned : 6;
+	u8* data;						///< The staged content (files only, see fsTreeLoad)
+	struct fsTreeNode* nextNode;	///< The next node (linked list)
+} fsTreeNode;
+
+/// A flat listing of a directory tree, parents before children.
+typedef struct fsTree
+{
+	fsTreeNode* firstNode;	///< The first node (linked list)
+	fsTreeNode* lastNode;	///< The last node (linked list)
+	u32 fileCount;			///< The count of the files
+	u32 dirCount;			///< The count of the directories
+	u64 totalSize;			///< The total size in bytes of the files
+} fsTree;
+
+/**
+ * @brief Appends a file to a tree.
+ * @param[in/out] tree The tree.
+ * @param[in] path The path relative to the tree root.
+ * @param size The size in bytes of the file.
+ * @param[in] hash The CRC-32 of the file content (NULL if unknown).
+ * @return The new node (NULL if out of memory).
+ */
+fsTreeNode* fsTreeAddFile(fsTree* tree, const u16* path, u64 size, const u32* hash);
+
+/**
+ * @brief Appends a directory to a tree.
+ * @param[in/out] tree The tree.
+ * @param[in] path The path relative to the tree root.
+ * @return The new node (NULL if out of memory).
+ */
+fsTreeNode* fsTreeAddDir(fsTree* tree, const u16* path);
+
+/**
+ * @brief Finds a node of a sorted tree by its path, moving a cursor forward only.
+ * The paths shall be looked up in the sorted order too (see fsTreeSort), a whole walk is then linear.
+ * @param[in/out] cursor The node to start from (the first node of the tree for the first path).
+ * @param[in] path The path relative to the tree root.
+ * @return The node (NULL if not found).
+ */
+fsTreeNode* fsTreeSeek(fsTreeNode** cursor, const u16* path);
+
+/**
+ * @brief Makes the full path of a node.
+ * @param[out] dst The full path.
+ * @param[in] root The path of the root directory (with the trailing '/').
+ * @param[in] path The path of the node relative to the root.
+ */
+void fsTreeMakePath(u16* dst, const u16* root, const u16* path);
+
+/**
+ * @brief Sorts the nodes of a tree by path (parents still before children).
+ * @param[in/out] tree The tree to sort.
+ */
+void fsTreeSort(fsTree* tree);
+
+/**
+ * @brief Scans a directory tree recursively, parents before children.
+ * @param[out] tree The tree to fill (must be empty).
+ * @param[in] root The path of the root directory (with the trailing '/').
+ * @param[in] archive The archive of the directory.
+ * @param hash Whether it shall hash the content of the files.
+ */
+Result fsTreeScan(fsTree* tree, const u16* root, const FS_Archive* archive, bool hash);
+
+/**
+ * @brief Stages the content of the files of a tree in memory.
+ * The known sizes and hashes are checked, the unknown hashes are computed.
+ * @param[in/out] tree The tree to stage.
+ * @param[in] root The path of the root directory (with the trailing '/').
+ * @param[in] archive The archive of the directory.
+ */
+Result fsTreeLoad(fsTree* tree, const u16* root, const FS_Archive* archive);
+
+/**
+ * @brief Writes the staged directories and files of a tree.
+ * @param[in] tree The staged tree to write (see fsTreeLoad).
+ * @param[in] root The path of the root directory (with the trailing '/').
+ * @param[in] archive The archive of the directory.
+ */
+Result fsTreeStore(const fsTree* tree, const u16* root, const FS_Archive* archive);
+
+/**
+ * @brief Deletes the directories (recursively) and the files of a tree.
+ * The entries already deleted with their parent directory are skipped.
+ * @param[in] tree The tree to delete.
+ * @param[in] root The path of the root directory (with the trailing '/').
+ * @param[in] archive The archive of the directory.
+ */
+Result fsTreeRemove(const fsTree* tree, const u16* root, const FS_Archive* archive);
+
+/**
+ * @brief Frees the nodes of a tree.
+ * @param[in/out] tree The tree to free.
+ */
+Result fsTreeFree(fsTree* tree);
+
+/**
+ * @brief Writes a tree to a digest file.
+ * @param[in] tree The tree to write.
+ * @param[in] header Some lines to write before the nodes (optional, see fsManifestFormat).
+ * @param[in] path The path of the digest file.
+ * @param[in] archive The archive of the digest file.
+ */
+Result fsTreeWrite(const fsTree* tree, const char* header, const u16* path, const FS_Archive* archive);
+
+/**
+ * @brief Reads a tree from a digest file.
+ * @param[out] tree The tree to fill (must be empty).
+ * @param[in] path The path of the digest file.
+ * @param[in] archive The archive of the digest file.
+ * @return -2 if out of memory, the tree is then incomplete.
+ */
+Result fsTreeRead(fsTree* tree, const u16* path, const FS_Archive* archive);
+
+/**
+ * @brief Computes the root digest of a tree: the CRC-32 of its sorted (path, size, hash) records.
+ * The tree is sorted, the hashes of the files shall be known.
+ * @param[in/out] tree The tree.
+ * @return The root digest.
+ */
+u32 fsTreeDigest(fsTree* tree);
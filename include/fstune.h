@@ -0,0 +1,65 @@
+#pragma once
+/**
+ * @file fstune.h
+ * @brief Filesystem Tuning Module
+ */
+
+#include <3ds/types.h>
+#include <3ds/services/fs.h>
+
+#define FS_TUNE_MAGIC "tvds-tune 1\n"
+#define FS_TUNE_PATH "/tvds/tune"
+#define FS_TUNE_FILE_PATH "/tvds-tune.tmp"
+#define FS_TUNE_FILE_SIZE (0x80000) // 512KB
+#define FS_TUNE_UNALIGNED_OFFSET (0x100)
+#define FS_TUNE_MAX_ARCHIVES (8)
+#define FS_TUNE_CHUNK_COUNT (3)
+#define FS_TUNE_LINE_LENGTH (160)
+
+/// The calibration of an archive type.
+typedef struct
+{
+	u32 archiveId;							///< The archive id
+	u32 mediatype;							///< The mediatype of the archive
+	u32 readChunkSize;						///< The best chunk size to read
+	u32 writeChunkSize;						///< The best chunk size to write
+	u32 readSpeed[FS_TUNE_CHUNK_COUNT];		///< The read speeds (KB/s) per chunk size
+	u32 writeSpeed[FS_TUNE_CHUNK_COUNT];	///< The write speeds (KB/s) per chunk size
+	u32 unalignedReadSpeed;					///< The read speed (KB/s) of the best chunk size, unaligned
+	u32 unalignedWriteSpeed;				///< The write speed (KB/s) of the best chunk size, unaligned
+} fsTuneResult;
+
+/// The calibrated chunk sizes.
+extern const u32 fsTuneChunkSizes[FS_TUNE_CHUNK_COUNT];
+
+/**
+ * @brief Initializes the tuning module, loading the cached calibrations and the flush policy from the sdmc.
+ */
+void fsTuneInit(void);
+
+/**
+ * @brief Exits the tuning module.
+ */
+void fsTuneExit(void);
+
+/**
+ * @brief Calibrates the type of an archive, unless it is already cached (or the module not initialized).
+ * The reads and writes of a temporary file are timed at each chunk size, aligned then not.
+ * It shall be called from the main thread, before any concurrent copy.
+ * @param[in] archive The archive to calibrate (a temporary file is written to it).
+ * @param force Whether to calibrate even if cached.
+ */
+Result fsTuneArchive(const FS_Archive* archive, bool force);
+
+/**
+ * @brief Gets the chunk size to copy between two archives (the default if not calibrated).
+ * @param[in] srcArchive The archive read (NULL if none).
+ * @param[in] dstArchive The archive written (NULL if none).
+ * @return The chunk size in bytes.
+ */
+u32 fsTuneGetChunkSize(const FS_Archive* srcArchive, const FS_Archive* dstArchive);
+
+/**
+ * @brief Prints the calibrations to the log console.
+ */
+void fsTunePrint(void);
@@ -0,0 +1,19 @@
+#pragma once
+/**
+ * @file hash.h
+ * @brief Hash Module
+ */
+
+#include <3ds/types.h>
+
+/// The initial value of a CRC-32.
+#define HASH_CRC32_INIT (0)
+
+/**
+ * @brief Updates a CRC-32 (IEEE 802.3) with some data.
+ * @param crc The current CRC-32 (HASH_CRC32_INIT to start).
+ * @param[in] data The data to hash.
+ * @param size The size in bytes of the data.
+ * @return The updated CRC-32.
+ */
+u32 hashCrc32(u32 crc, const void* data, u32 size);
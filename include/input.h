@@ -0,0 +1,74 @@
+#pragma once
+/**
+ * @file input.h
+ * @brief Input Module
+ *
+ * The keys of the main loop and of key.h, live, recorded or replayed.
+ * A session is recorded when [L] is held at launch, and the recorded session is replayed
+ * when [R] is held at launch (from the same title, the same save and the same sdmc).
+ * The frames are the scans since the launch, so a replay doesn't depend on the speed of the build.
+ */
+
+#include <3ds/types.h>
+#include <3ds/services/hid.h>
+
+#define INPUT_MAGIC "tvds-input 1\n"
+#define INPUT_PATH "/tvds/input"
+#define INPUT_REPLAY_MAGIC "tvds-replay 1\n"
+#define INPUT_REPLAY_PATH "/tvds/replay" // the timings of the latest replay
+#define INPUT_RECORD_KEY (KEY_L)
+#define INPUT_REPLAY_KEY (KEY_R)
+#define INPUT_LINE_LENGTH (64)
+#define INPUT_EVENT_CHUNK (0x400) // events per allocation of a recording
+
+/// The source of the keys.
+typedef enum
+{
+	INPUT_LIVE,		///< The keys pressed
+	INPUT_RECORD,	///< The keys pressed, recorded
+	INPUT_REPLAY,	///< The keys recorded, replayed
+} inputMode;
+
+/// A change of the keys held.
+typedef struct
+{
+	u32 frame;		///< The frame of the change (the scans since the launch)
+	u32 keys;		///< The keys held from the frame
+} inputEvent;
+
+/**
+ * @brief Initializes the input module, with the keys held at launch (see INPUT_RECORD_KEY and INPUT_REPLAY_KEY).
+ * The keys held at launch are ignored until released.
+ */
+void inputInit(void);
+
+/**
+ * @brief Stores the recorded session (INPUT_PATH) and frees the events.
+ */
+void inputExit(void);
+
+/**
+ * @brief Scans the keys of the next frame (instead of hidScanInput).
+ * The end of a replay stores its timings (INPUT_REPLAY_PATH), and the next frames are live.
+ */
+void inputScan(void);
+
+/**
+ * @brief Gets the keys pressed at the latest scan (instead of hidKeysDown).
+ */
+u32 inputKeysDown(void);
+
+/**
+ * @brief Gets the keys held at the latest scan (instead of hidKeysHeld).
+ */
+u32 inputKeysHeld(void);
+
+/**
+ * @brief Gets the source of the keys.
+ */
+inputMode inputGetMode(void);
+
+/**
+ * @brief Gets the frame of the latest scan (the scans since the launch).
+ */
+u32 inputGetFrame(void);
@@ -13,6 +13,9 @@ extern "C" {
 #include <3ds/services/hid.h>
 #include <3ds/services/gspgpu.h>
 
+#include "input.h"
+#include "log.h"
+
 /**
  * @brief Key value.
  */
@@ -25,13 +28,14 @@ enum
  * @brief Blocks the running process until some keys are pressed.
  * @param key The key(s) to press.
  */
-inline void waitKey(u32 key)
+static inline void waitKey(u32 key)
 {
 	while (aptMainLoop())
 	{
 		gspWaitForVBlank();
-		hidScanInput();
-		if (hidKeysDown() & key) break;
+		logFlush();
+		inputScan();
+		if (inputKeysDown() & key) break;
 	}
 }
 
@@ -40,15 +44,16 @@ inline void waitKey(u32 key)
  * @param key The key(s) to check for a single press.
  * @return Whether the key(s) was pressed once.
  */
-inline bool doKey(u32 key)
+static inline bool doKey(u32 key)
 {
 	while (aptMainLoop())
 	{
 		gspWaitForVBlank();
-		hidScanInput();
-		if (hidKeysDown())
+		logFlush();
+		inputScan();
+		if (inputKeysDown())
 		{
-			if (hidKeysDown() & key) return true;
+			if (inputKeysDown() & key) return true;
 			else return false;
 		}
 	}
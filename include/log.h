@@ -0,0 +1,107 @@
+#pragma once
+/**
+ * @file log.h
+ * @brief Log Module
+ *
+ * The logs are formatted into a ring of records (lock-free, from any thread), then printed
+ * by logFlush to the log console (from the main loop, the consoles aren't thread-safe), and
+ * written to a rotating file on the sdmc by a thread while logFileEnabled.
+ * The levels under LOG_LEVEL are compiled out, their arguments are never evaluated.
+ * The ring also holds the history shown by the viewer (see logViewPrint).
+ */
+
+#include <3ds/types.h>
+
+#include <stdarg.h>
+
+#define LOG_DEBUG (0)
+#define LOG_INFO (1)
+#define LOG_WARN (2)
+#define LOG_ERROR (3)
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO // -DLOG_LEVEL=0 for the debug logs
+#endif
+
+#define LOG_CAPACITY (256) // records, a power of 2
+#define LOG_RECORD_LENGTH (128) // bytes of a record, longer ones are cut
+#define LOG_FLUSH_RECORDS (16) // pending records printed at once from the main thread
+#define LOG_VIEW_RECORDS (26) // records per page of the viewer
+#define LOG_PATH "/tvds/log.txt"
+#define LOG_OLD_PATH "/tvds/log.1.txt" // the previous file, once rotated
+#define LOG_FILE_MAX_SIZE (0x20000) // bytes before the rotation
+#define LOG_FILE_BUFFER_SIZE (0x2000)
+#define LOG_FILE_PERIOD (1000000000LL) // ns between two writes of the file
+#define LOG_STACK_SIZE (0x2000)
+#define LOG_THREAD_PRIORITY (0x30)
+
+#if LOG_LEVEL <= LOG_DEBUG
+#define logDebug(format, args...) logWrite(LOG_DEBUG, format, ##args)
+#else
+#define logDebug(format, args...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_INFO
+#define logInfo(format, args...) logWrite(LOG_INFO, format, ##args)
+#else
+#define logInfo(format, args...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_WARN
+#define logWarn(format, args...) logWrite(LOG_WARN, format, ##args)
+#else
+#define logWarn(format, args...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_ERROR
+#define logError(format, args...) logWrite(LOG_ERROR, format, ##args)
+#else
+#define logError(format, args...) do {} while (0)
+#endif
+
+/// Whether the records are written to the sdmc (see logFileStart).
+extern bool logFileEnabled;
+
+/**
+ * @brief Appends a record to the ring (use the level macros, as logDebug).
+ * @param level The level of the record.
+ * @param[in] format The text of the record (a line or a part of it).
+ */
+void logWrite(u32 level, const char* format, ...);
+
+/**
+ * @brief Appends a record to the ring, see logWrite.
+ */
+void logWriteV(u32 level, const char* format, va_list args);
+
+/**
+ * @brief Prints the pending records to the log console (from the main thread).
+ */
+void logFlush(void);
+
+/**
+ * @brief Starts writing the records to the sdmc (LOG_PATH, appended), the history first.
+ */
+Result logFileStart(void);
+
+/**
+ * @brief Stops writing the records, once the pending ones are written.
+ */
+Result logFileStop(void);
+
+/**
+ * @brief Prints a page of the history to the log console, the flushes are held until logViewClose.
+ * @param offset The count of the newest records after the page.
+ * @return The offset of the page (clamped to the history).
+ */
+u32 logViewPrint(u32 offset);
+
+/**
+ * @brief Closes the viewer, the held records are printed by the next flush.
+ */
+void logViewClose(void);
+
+/**
+ * @brief Stops the file and prints the pending records.
+ */
+void logExit(void);
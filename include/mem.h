@@ -0,0 +1,143 @@
+#pragma once
+/**
+ * @file mem.h
+ * @brief Memory Tracking Module
+ *
+ * The heap allocations of the core, tagged by call site: the live bytes, the peak bytes
+ * and the allocation count of each tag, and the list of the outstanding allocations.
+ * Each block is preceded by a small header (MEM_HEADER_SIZE), freed with memFree only.
+ *
+ * The governor polls the free memory of the application region: the consumers of the spare
+ * memory (as the buffer pool) size themselves with memGetBudget, and register an adapt callback
+ * which shrinks them under pressure. A failed allocation asks them with memReclaim before
+ * degrading (smaller chunks, fewer staged saves) rather than failing.
+ */
+
+#include <3ds/types.h>
+
+#include <stddef.h>
+
+#define MEM_MAX_TAGS (32)
+#define MEM_HEADER_SIZE (32) // bytes before each block, a multiple of the malloc alignment
+#define MEM_DUMP_BLOCKS (4) // outstanding blocks listed per tag
+#define MEM_MAX_CONSUMERS (8)
+#define MEM_PRESSURE_LOW_FREE (0x100000) // 1MB free or less
+#define MEM_PRESSURE_HIGH_FREE (0x40000) // 256KB free or less
+
+/// The pressure on the free memory.
+typedef enum
+{
+	MEM_PRESSURE_NONE,	///< The consumers may use their whole budget
+	MEM_PRESSURE_LOW,	///< The consumers shall release their idle memory
+	MEM_PRESSURE_HIGH,	///< The consumers shall release all they can
+} memPressure;
+
+/**
+ * @brief Adapts a consumer to the pressure: shrinks it, or lets it grow back.
+ * Called without any lock of the module, from any thread.
+ * @param pressure The current pressure.
+ * @return The bytes released.
+ */
+typedef u32 (*memAdaptFunc)(memPressure pressure);
+
+/// The statistics of a tag.
+typedef struct
+{
+	const char* tag;		///< The tag (a static string)
+	u32 liveCount;			///< The outstanding allocations
+	u32 liveBytes;			///< The outstanding bytes
+	u32 peakBytes;			///< The highest outstanding bytes (since the latest reset)
+	u32 allocCount;			///< The allocations (since the latest reset)
+} memTagStats;
+
+/**
+ * @brief Allocates a block (malloc).
+ * @param[in] tag The call site (a static string, as "fsScanDir").
+ * @param size The size of the block.
+ * @return The block (NULL if out of memory).
+ */
+void* memAlloc(const char* tag, size_t size);
+
+/**
+ * @brief Allocates an aligned block (memalign).
+ * @param[in] tag The call site (a static string).
+ * @param alignment The alignment of the block (a power of 2).
+ * @param size The size of the block.
+ * @return The block (NULL if out of memory).
+ */
+void* memAlign(const char* tag, size_t alignment, size_t size);
+
+/**
+ * @brief Resizes a block of memAlloc (realloc), the block keeps its tag if not NULL.
+ * @param[in] tag The call site (a static string), for a new block.
+ * @param[in] ptr The block (NULL for a new one).
+ * @param size The new size of the block.
+ * @return The resized block (NULL if out of memory, ptr is then kept).
+ */
+void* memRealloc(const char* tag, void* ptr, size_t size);
+
+/**
+ * @brief Frees a block of memAlloc, memAlign or memRealloc (free).
+ * @param[in] ptr The block (NULL is ignored).
+ */
+void memFree(void* ptr);
+
+/**
+ * @brief Gets the statistics of the tags.
+ * @param[out] stats The statistics (MEM_MAX_TAGS at most).
+ * @return The count of the tags.
+ */
+u32 memGetStats(memTagStats* stats);
+
+/**
+ * @brief Gets the outstanding and the peak bytes of all the tags.
+ * @param[out] peakBytes The highest outstanding bytes since the latest reset (optional).
+ * @return The outstanding bytes.
+ */
+u32 memGetLiveBytes(u32* peakBytes);
+
+/**
+ * @brief Resets the peaks and the allocation counts, between two operations.
+ */
+void memResetPeak(void);
+
+/**
+ * @brief Logs the tags with outstanding allocations, and their first blocks.
+ * @param[in] context The caller (as "fsDirExit").
+ */
+void memDump(const char* context);
+
+/**
+ * @brief Registers a consumer of the spare memory, once.
+ * @param[in] name The consumer (a static string, as "fsBuffer").
+ * @param adapt Its adapt callback.
+ */
+void memRegister(const char* name, memAdaptFunc adapt);
+
+/**
+ * @brief Gets the pressure on the free memory, polled now.
+ * @param[out] freeBytes The free bytes of the application region (optional).
+ */
+memPressure memGetPressure(u32* freeBytes);
+
+/**
+ * @brief Polls the free memory, and adapts the consumers when the pressure changed (from the main loop).
+ * @return The current pressure.
+ */
+memPressure memPoll(void);
+
+/**
+ * @brief Asks the consumers to release all they can, before retrying a failed allocation.
+ * @return Whether some memory was released (else a retry would fail again).
+ */
+bool memReclaim(void);
+
+/**
+ * @brief Gets the budget of a consumer, a part of the free memory.
+ * @param held The bytes the consumer already holds (counted as free).
+ * @param shift The part of the free memory (as 3 for 1/8).
+ * @param min The min budget (unless under high pressure).
+ * @param max The max budget.
+ * @return The budget in bytes.
+ */
+u32 memGetBudget(u32 held, u32 shift, u32 min, u32 max);
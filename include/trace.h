@@ -0,0 +1,76 @@
+#pragma once
+/**
+ * @file trace.h
+ * @brief Tracing Module
+ */
+
+#include <3ds/types.h>
+#include <3ds/svc.h>
+
+#define TRACE_PATH "/tvds/trace.json"
+#define TRACE_CAPACITY (0x4000) // spans, 384KB
+#define TRACE_LINE_LENGTH (160)
+
+/// A timed span of the trace.
+typedef struct
+{
+	const char* name;	///< The name (a static string)
+	u64 start;			///< The start (ticks)
+	u32 duration;		///< The duration (ticks)
+	u32 thread;			///< The thread (0 for the main thread)
+} traceSpan;
+
+/// Whether the spans are recorded (see traceStart).
+extern bool traceEnabled;
+
+/**
+ * @brief Records a span, ended now.
+ * @param[in] name The name of the span (a static string).
+ * @param start The start of the span (ticks).
+ */
+void traceRecord(const char* name, u64 start);
+
+/**
+ * @brief Begins a span.
+ * @return The start of the span (0 if not tracing).
+ */
+static inline u64 traceBegin(void)
+{
+	return (traceEnabled ? svcGetSystemTick() : 0);
+}
+
+/**
+ * @brief Ends a span, recorded if it began while tracing.
+ * @param[in] name The name of the span (a static string).
+ * @param start The start of the span, from traceBegin.
+ */
+static inline void traceEnd(const char* name, u64 start)
+{
+	if (start) traceRecord(name, start);
+}
+
+/**
+ * @brief Starts tracing, from an empty ring buffer (allocated on the first start).
+ */
+Result traceStart(void);
+
+/**
+ * @brief Stops tracing, the spans are kept until the next start.
+ */
+void traceStop(void);
+
+/**
+ * @brief Stops tracing and frees the ring buffer.
+ */
+void traceExit(void);
+
+/**
+ * @brief Gets the count of the spans in the ring buffer.
+ */
+u32 traceGetCount(void);
+
+/**
+ * @brief Dumps the ring buffer to the sdmc as Chrome trace-event JSON (TRACE_PATH).
+ * The spans of the dump itself are not recorded.
+ */
+Result traceDump(void);
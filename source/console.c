@@ -1,4 +1,5 @@
 #include "console.h"
+#include "log.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -55,9 +56,7 @@ void consoleLog(const char* format, ...)
 {
     va_list args;
     va_start(args, format);
-    consoleSelect(&logConsole);
-    vprintf(format, args);
-    consoleSelectDefault();
+    logWriteV(LOG_INFO, format, args);
     va_end(args);
 }
 
@@ -0,0 +1,149 @@
+#include "frame.h"
+#include "trace.h"
+#include "console.h"
+
+#include <3ds/svc.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/// The names of the phases (the trace spans and the log).
+static const char* const phaseNames[FRAME_PHASE_COUNT] = { "input", "logic", "render", "flush" };
+
+static frameTiming timings[FRAME_PHASE_COUNT];
+static u64 windowTicks[FRAME_PHASE_COUNT];	// The total of the phases of the current window.
+static u64 phaseTicks[FRAME_PHASE_COUNT];	// The phases of the current frame.
+static u64 frameStart = 0;
+static u64 markStart = 0;
+static u64 renderTicks = 0;		// The redraws since the previous mark.
+static u32 frameCount = 0;
+static u32 windowCount = 0;
+static u32 missedCount = 0;
+static u32 windowMissedCount = 0;
+
+void frameBegin(void)
+{
+	u64 now = svcGetSystemTick();
+
+	// A frame of more than one vblank period missed the others.
+	if (frameStart > 0)
+	{
+		u64 vblanks = (now - frameStart + FRAME_VBLANK_TICKS / 2) / FRAME_VBLANK_TICKS;
+		if (vblanks > 1)
+		{
+			missedCount += vblanks - 1;
+			windowMissedCount += vblanks - 1;
+		}
+	}
+
+	memset(phaseTicks, 0, sizeof(phaseTicks));
+	frameStart = now;
+	markStart = now;
+	renderTicks = 0;
+}
+
+void frameMark(framePhase phase)
+{
+	u64 now = svcGetSystemTick();
+	u64 ticks = now - markStart;
+
+	// The redraws of the phase are the render.
+	u64 render = (renderTicks < ticks ? renderTicks : ticks);
+	phaseTicks[FRAME_RENDER] += render;
+	phaseTicks[phase] += ticks - render;
+
+	traceEnd(phaseNames[phase], (traceEnabled ? markStart : 0));
+
+	markStart = now;
+	renderTicks = 0;
+}
+
+/**
+ * @brief Formats a duration in tenths of milliseconds.
+ */
+static void frameFormatTime(char* dst, u64 ticks)
+{
+	u64 tenths = ticks * 10000 / SYSCLOCK_ARM11;
+	sprintf(dst, "%llu.%llu", tenths / 10, tenths % 10);
+}
+
+/**
+ * @brief Prints the averages of the window at the right of the title line.
+ */
+static void framePrintOverlay(void)
+{
+	char times[FRAME_PHASE_COUNT][16];
+	for (u32 i = 0; i < FRAME_PHASE_COUNT; i++)
+		frameFormatTime(times[i], windowTicks[i] / FRAME_WINDOW);
+
+	// input/logic/render/flush (ms) and the vblanks missed in the window.
+	char overlay[32];
+	snprintf(overlay, sizeof(overlay), "%s/%s/%s/%s m%lu", times[0], times[1], times[2], times[3], windowMissedCount);
+
+	consoleSelect(&titleConsole);
+	printf("\x1B[0;29H%21.21s", overlay);
+	consoleSelectDefault();
+}
+
+void frameEnd(void)
+{
+	if (frameStart == 0) return;
+
+	for (u32 i = 0; i < FRAME_PHASE_COUNT; i++)
+	{
+		frameTiming* timing = &timings[i];
+		if (frameCount == 0 || phaseTicks[i] < timing->minTicks) timing->minTicks = phaseTicks[i];
+		if (phaseTicks[i] > timing->maxTicks) timing->maxTicks = phaseTicks[i];
+		timing->totalTicks += phaseTicks[i];
+		windowTicks[i] += phaseTicks[i];
+	}
+
+	traceEnd("frame", (traceEnabled ? frameStart : 0));
+
+	frameCount++;
+	if (++windowCount == FRAME_WINDOW)
+	{
+		framePrintOverlay();
+		memset(windowTicks, 0, sizeof(windowTicks));
+		windowCount = 0;
+		windowMissedCount = 0;
+	}
+}
+
+u64 frameRenderBegin(void)
+{
+	return svcGetSystemTick();
+}
+
+void frameRenderEnd(const char* name, u64 start)
+{
+	renderTicks += svcGetSystemTick() - start;
+	traceEnd(name, (traceEnabled ? start : 0));
+}
+
+u32 frameGetTiming(framePhase phase, frameTiming* timing)
+{
+	if (timing && phase < FRAME_PHASE_COUNT) *timing = timings[phase];
+	return frameCount;
+}
+
+u32 frameGetMissedCount(void)
+{
+	return missedCount;
+}
+
+void frameLog(void)
+{
+	consoleLog("Frames: %lu, %lu vblank(s) missed\n", frameCount, missedCount);
+	if (frameCount == 0) return;
+
+	for (u32 i = 0; i < FRAME_PHASE_COUNT; i++)
+	{
+		char min[16], avg[16], max[16];
+		frameFormatTime(min, timings[i].minTicks);
+		frameFormatTime(avg, timings[i].totalTicks / frameCount);
+		frameFormatTime(max, timings[i].maxTicks);
+
+		consoleLog("  %-6s min %s avg %s max %s ms\n", phaseNames[i], min, avg, max);
+	}
+}
@@ -1,13 +1,18 @@
 #include "fs.h"
+#include "fsbuf.h"
 
 #include <3ds/services/fs.h>
 #include <3ds/result.h>
 #include <3ds/ipc.h>
 #include <3ds/srv.h>
 #include <3ds/svc.h>
+#include <3ds/synchronization.h>
 
+#include <stdlib.h>
 #include <string.h>
 
+#include "fsprobe.h"
+
 // #define FS_DEBUG
 
 #ifdef FS_DEBUG
@@ -19,94 +24,509 @@
 #define debug_print(fmt, args ...)
 #endif
 
+/// An archive of the registry.
+typedef struct
+{
+	FS_ArchiveDesc desc;						///< The descriptor of the archive.
+	FS_Archive archive;							///< The open archive.
+	FS_UserSaveData_LowPathData lowPathData;	///< The lowpath data of the archive.
+	u32 refCount;								///< The count of the users.
+	u64 lastUse;								///< The last acquire (LRU).
+	bool isOpen;								///< Whether the archive is open.
+} FS_RegistryEntry;
+
 static Handle fsHandle;
-static bool sdmcInitialized = false;
-static bool saveInitialized = false;
-FS_Archive sdmcArchive;
-FS_Archive saveArchive;
+static FS_RegistryEntry registry[FS_MAX_ARCHIVES];
+static u64 registryClock = 0;
+static LightLock registryLock;
+static FS_FlushPolicy flushPolicy = FS_FLUSH_NONE;
+static const char* const flushPolicyNames[] = { "write", "close", "none" }; // by FS_FlushPolicy
+
+const FS_ArchiveDesc sdmcArchiveDesc = { ARCHIVE_SDMC, MEDIATYPE_SD, 0 };
+const FS_ArchiveDesc saveArchiveDesc = { ARCHIVE_SAVEDATA, MEDIATYPE_SD, 0 };
+
+/**
+ * @brief Closes an archive of the registry, committing the save archive.
+ * @param entry The entry to close.
+ */
+static Result FS_CloseRegistryEntry(FS_RegistryEntry* entry)
+{
+	Result ret;
+
+	if (entry->desc.id == ARCHIVE_SAVEDATA)
+	{
+		ret = FS_CommitArchive(&entry->archive);
+		r(" > FS_CommitArchive: %lx\n", ret);
+	}
+
+	ret = FSUSER_CloseArchive(&entry->archive);
+	r(" > FSUSER_CloseArchive: %lx\n", ret);
+
+	entry->isOpen = false;
+
+	return ret;
+}
+
+/**
+ * @brief Opens an archive of the registry.
+ * @param entry The entry to open, its descriptor set.
+ */
+static Result FS_OpenRegistryEntry(FS_RegistryEntry* entry)
+{
+	Result ret;
+	FS_Path lowPath = fsMakePath(PATH_EMPTY, NULL);
+
+	if (entry->desc.id == ARCHIVE_USER_SAVEDATA || entry->desc.id == ARCHIVE_EXTDATA)
+	{
+		entry->lowPathData.mediatype = entry->desc.mediatype;
+		entry->lowPathData.lowid = (u32) entry->desc.titleid;
+		entry->lowPathData.highid = (u32) (entry->desc.titleid >> 32);
+		lowPath = (FS_Path) { PATH_BINARY, sizeof(FS_UserSaveData_LowPathData), &entry->lowPathData };
+	}
+
+	entry->archive = (FS_Archive) { entry->desc.id, lowPath, fsHandle };
+
+	ret = FSUSER_OpenArchive(&entry->archive);
+	r(" > FSUSER_OpenArchive: %lx\n", ret);
+
+	entry->isOpen = R_SUCCEEDED(ret);
+
+	return ret;
+}
+
+void FS_MakeExtdataDesc(FS_ArchiveDesc* desc, u64 titleid)
+{
+	if (!desc) return;
+
+	memset(desc, 0, sizeof(FS_ArchiveDesc));
+
+	// The extdata id is the unique id of the title, and it is always on the SD card.
+	desc->id = ARCHIVE_EXTDATA;
+	desc->mediatype = MEDIATYPE_SD;
+	desc->titleid = ((u32) titleid >> 8) & 0xFFFFF;
+}
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-bool FSDEBUG_FixArchive(const FS_Archive** archive)
+Result FS_AcquireArchive(const FS_ArchiveDesc* desc, const FS_Archive** archive)
 {
-	debug_print("FSDEBUG_FixArchive:\n");
+	if (!desc || !archive) return -1;
+
+	Result ret = 0;
+	FS_RegistryEntry* entry = NULL;
+
+	debug_print("FS_AcquireArchive:\n");
 
-	if (!saveInitialized && *archive == &saveArchive)
+	// The session is per thread.
+	fsUseSession(fsHandle, false);
+
+	LightLock_Lock(&registryLock);
+
+	// Reuse the open archive.
+	for (u32 i = 0; i < FS_MAX_ARCHIVES && !entry; i++)
 	{
-		debug_print("   Save archive not initialized\n");
-		*archive = &sdmcArchive;
+		if (registry[i].isOpen && memcmp(&registry[i].desc, desc, sizeof(FS_ArchiveDesc)) == 0)
+			entry = &registry[i];
 	}
 
-	if (!sdmcInitialized && *archive == &sdmcArchive)
+	if (!entry)
+	{
+		// Take a free slot, or close the least recently used unreferenced archive.
+		FS_RegistryEntry* lru = NULL;
+
+		for (u32 i = 0; i < FS_MAX_ARCHIVES && !entry; i++)
+		{
+			if (!registry[i].isOpen) entry = &registry[i];
+			else if (registry[i].refCount == 0 && (!lru || registry[i].lastUse < lru->lastUse)) lru = &registry[i];
+		}
+
+		if (!entry && lru)
+		{
+			FS_CloseRegistryEntry(lru);
+			entry = lru;
+		}
+
+		if (entry)
+		{
+			memset(entry, 0, sizeof(FS_RegistryEntry));
+			entry->desc = *desc;
+			ret = FS_OpenRegistryEntry(entry);
+		}
+		else ret = -2;
+	}
+
+	if (R_SUCCEEDED(ret))
 	{
-		debug_print("   Sdmc archive not initialized\n");
-		*archive = NULL;
+		entry->refCount++;
+		entry->lastUse = ++registryClock;
+		*archive = &entry->archive;
 	}
+	else *archive = NULL;
 
-	return (*archive != NULL);
+	LightLock_Unlock(&registryLock);
+
+	return ret;
 }
-#endif
 
-Result FS_ReadFile(const char* path, void* dst, u64 maxSize, const FS_Archive* archive, u32* bytesRead)
+void FS_ReleaseArchive(const FS_Archive* archive)
 {
-	if (!path || !dst || !archive || !bytesRead) return -1;
+	if (!archive) return;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
+	debug_print("FS_ReleaseArchive:\n");
+
+	LightLock_Lock(&registryLock);
+
+	for (u32 i = 0; i < FS_MAX_ARCHIVES; i++)
+	{
+		if (registry[i].isOpen && &registry[i].archive == archive && registry[i].refCount > 0)
+			registry[i].refCount--;
+	}
+
+	LightLock_Unlock(&registryLock);
+}
+
+void FS_SetFlushPolicy(FS_FlushPolicy flush)
+{
+	flushPolicy = flush;
+}
+
+FS_FlushPolicy FS_GetFlushPolicy(const FS_Archive* archive)
+{
+	if (!archive) return flushPolicy;
+
+	bool isCommitted = (archive->id == ARCHIVE_SAVEDATA || archive->id == ARCHIVE_USER_SAVEDATA);
+	if (flushPolicy == FS_FLUSH_NONE && !isCommitted) return FS_FLUSH_CLOSE;
+
+	return flushPolicy;
+}
+
+const char* FS_GetFlushPolicyName(FS_FlushPolicy flush)
+{
+	if ((u32) flush >= sizeof(flushPolicyNames) / sizeof(flushPolicyNames[0])) return "?";
+
+	return flushPolicyNames[flush];
+}
+
+Result FS_ParseFlushPolicy(const char* name, FS_FlushPolicy* flush)
+{
+	if (!name || !flush) return -1;
+
+	for (u32 i = 0; i < sizeof(flushPolicyNames) / sizeof(flushPolicyNames[0]); i++)
+	{
+		if (strcmp(name, flushPolicyNames[i]) == 0)
+		{
+			*flush = (FS_FlushPolicy) i;
+			return 0;
+		}
+	}
+
+	return -4;
+}
+
+Result FS_StreamOpen(FS_Stream* stream, FS_Path path, const FS_Archive* archive, u32 openFlags, u32 bufferSize, FS_FlushPolicy flush)
+{
+	if (!stream || !archive) return -1;
 
 	Result ret;
-	u64 size;
-	Handle fileHandle;
 
-	debug_print("FS_ReadFile:\n");
+	debug_print("FS_StreamOpen:\n");
 
-	ret = FSUSER_OpenFile(&fileHandle, *archive, fsMakePath(PATH_ASCII, path), FS_OPEN_READ, FS_ATTRIBUTE_NONE);
+	memset(stream, 0, sizeof(FS_Stream));
+	stream->flush = flush;
+
+	if (bufferSize > 0)
+	{
+		stream->buffer = (u8*) fsBufferAlloc(bufferSize);
+		if (!stream->buffer) return -2;
+		stream->bufferSize = bufferSize;
+	}
+
+	ret = FSUSER_OpenFile(&stream->handle, *archive, path, openFlags, FS_ATTRIBUTE_NONE);
 	r(" > FSUSER_OpenFile: %lx\n", ret);
-	if (R_FAILED(ret)) return ret;
 
-	ret = FSFILE_GetSize(fileHandle, &size);
-	r(" > FSFILE_GetSize: %lx\n", ret);
-	if (R_FAILED(ret) || size > maxSize) ret = -2;
+	if (R_SUCCEEDED(ret))
+	{
+		ret = FSFILE_GetSize(stream->handle, &stream->size);
+		r(" > FSFILE_GetSize: %lx\n", ret);
+		if (R_FAILED(ret)) FSFILE_Close(stream->handle);
+	}
+
+	if (R_FAILED(ret))
+	{
+		fsBufferFree(stream->buffer);
+		memset(stream, 0, sizeof(FS_Stream));
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Writes the pending bytes of a stream, flushing them if FS_FLUSH_WRITE.
+ * @param[in/out] stream The stream.
+ */
+static Result FS_StreamWriteBack(FS_Stream* stream)
+{
+	Result ret = 0;
+
+	// The read-ahead bytes are kept.
+	if (!stream->isWriting) return ret;
+
+	if (stream->bufferLength > 0)
+	{
+		u32 bytesWritten = 0;
+
+		ret = FSFILE_Write(stream->handle, &bytesWritten, stream->bufferOffset, stream->buffer, stream->bufferLength, (stream->flush == FS_FLUSH_WRITE ? FS_WRITE_FLUSH : 0));
+		r(" > FSFILE_Write: %lx\n", ret);
+		if (R_SUCCEEDED(ret) && bytesWritten != stream->bufferLength) ret = -3;
+
+		stream->isDirty = (stream->flush != FS_FLUSH_WRITE);
+	}
+
+	stream->bufferLength = 0;
+	stream->isWriting = false;
+
+	return ret;
+}
+
+Result FS_StreamRead(FS_Stream* stream, void* dst, u32 size, u32* bytesRead)
+{
+	if (!stream || !dst || !bytesRead) return -1;
+
+	Result ret = FS_StreamWriteBack(stream);
+	u32 total = 0;
+
+	while (R_SUCCEEDED(ret) && total < size && stream->offset < stream->size)
+	{
+		u32 bytes = 0;
+
+		// Read ahead the small reads only, the big ones go straight to dst.
+		if (!stream->buffer || (stream->bufferLength == 0 && size - total >= stream->bufferSize))
+		{
+			ret = FSFILE_Read(stream->handle, &bytes, stream->offset, (u8*) dst + total, size - total);
+			r(" > FSFILE_Read: %lx\n", ret);
+		}
+		else if (stream->offset >= stream->bufferOffset && stream->offset < stream->bufferOffset + stream->bufferLength)
+		{
+			u32 available = stream->bufferOffset + stream->bufferLength - stream->offset;
+			bytes = (size - total < available ? size - total : available);
+			memcpy((u8*) dst + total, stream->buffer + (stream->offset - stream->bufferOffset), bytes);
+		}
+		else
+		{
+			stream->bufferOffset = stream->offset;
+			ret = FSFILE_Read(stream->handle, &stream->bufferLength, stream->offset, stream->buffer, stream->bufferSize);
+			r(" > FSFILE_Read: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && stream->bufferLength == 0) break;
+			continue;
+		}
+
+		if (R_SUCCEEDED(ret) && bytes == 0) break;
+
+		stream->offset += bytes;
+		total += bytes;
+	}
+
+	*bytesRead = total;
+
+	return ret;
+}
+
+Result FS_StreamReadAt(FS_Stream* stream, u64 offset, void* dst, u32 size, u32* bytesRead)
+{
+	if (!stream || !dst || !bytesRead) return -1;
+
+	Result ret = FS_StreamWriteBack(stream);
 
 	if (R_SUCCEEDED(ret))
 	{
-		ret = FSFILE_Read(fileHandle, bytesRead, 0x0, dst, size);
+		ret = FSFILE_Read(stream->handle, bytesRead, offset, dst, size);
 		r(" > FSFILE_Read: %lx\n", ret);
-		if (R_FAILED(ret) || *bytesRead < size) ret = -3;
 	}
 
-	ret = FSFILE_Close(fileHandle);
-	r(" > FSFILE_Close: %lx\n", ret);
+	return ret;
+}
+
+Result FS_StreamReadLine(FS_Stream* stream, char* dst, u32 maxLength)
+{
+	if (!stream || !stream->buffer || !dst || maxLength == 0) return -1;
+
+	Result ret = FS_StreamWriteBack(stream);
+	u32 len = 0;
+	bool isLine = false;
+
+	while (R_SUCCEEDED(ret) && !isLine && stream->offset < stream->size)
+	{
+		if (stream->offset < stream->bufferOffset || stream->offset >= stream->bufferOffset + stream->bufferLength)
+		{
+			stream->bufferOffset = stream->offset;
+			ret = FSFILE_Read(stream->handle, &stream->bufferLength, stream->offset, stream->buffer, stream->bufferSize);
+			r(" > FSFILE_Read: %lx\n", ret);
+			if (R_FAILED(ret) || stream->bufferLength == 0) break;
+		}
+
+		u8* start = stream->buffer + (stream->offset - stream->bufferOffset);
+		u32 available = stream->bufferOffset + stream->bufferLength - stream->offset;
+		u8* end = (u8*) memchr(start, '\n', available);
+		u32 count = (end ? end - start : available);
+
+		u32 copied = (count < maxLength - 1 - len ? count : maxLength - 1 - len);
+		memcpy(dst + len, start, copied);
+		len += copied;
+
+		stream->offset += count + (end ? 1 : 0);
+		isLine = (end != NULL);
+	}
+
+	dst[len] = '\0';
+
+	if (R_SUCCEEDED(ret) && !isLine && len == 0) ret = FS_STREAM_EOF;
 
 	return ret;
 }
 
-Result FS_WriteFile(const char* path, const void* src, u64 size, const FS_Archive* archive, u32* bytesWritten)
+Result FS_StreamWrite(FS_Stream* stream, const void* src, u32 size)
 {
-	if (!path || !src || !archive || !bytesWritten) return -1;
+	if (!stream || !src) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
+	Result ret = 0;
+	u32 total = 0;
+
+	// Write the pending bytes of another position, or drop the read-ahead bytes.
+	if (stream->isWriting && stream->bufferOffset + stream->bufferLength != stream->offset)
+		ret = FS_StreamWriteBack(stream);
+	else if (!stream->isWriting)
+		stream->bufferLength = 0;
+
+	while (R_SUCCEEDED(ret) && total < size)
+	{
+		u32 bytes = 0;
+
+		if (!stream->buffer || (stream->bufferLength == 0 && size - total >= stream->bufferSize))
+		{
+			ret = FSFILE_Write(stream->handle, &bytes, stream->offset, (const u8*) src + total, size - total, (stream->flush == FS_FLUSH_WRITE ? FS_WRITE_FLUSH : 0));
+			r(" > FSFILE_Write: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && bytes != size - total) ret = -3;
+
+			stream->isDirty = (stream->flush != FS_FLUSH_WRITE);
+		}
+		else
+		{
+			if (stream->bufferLength == 0)
+			{
+				stream->bufferOffset = stream->offset;
+				stream->isWriting = true;
+			}
+
+			u32 space = stream->bufferSize - stream->bufferLength;
+			bytes = (size - total < space ? size - total : space);
+			memcpy(stream->buffer + stream->bufferLength, (const u8*) src + total, bytes);
+			stream->bufferLength += bytes;
+
+			if (stream->bufferLength == stream->bufferSize) ret = FS_StreamWriteBack(stream);
+		}
+
+		stream->offset += bytes;
+		total += bytes;
+	}
+
+	if (stream->offset > stream->size) stream->size = stream->offset;
+
+	return ret;
+}
+
+Result FS_StreamFlush(FS_Stream* stream)
+{
+	if (!stream) return -1;
+
+	Result ret = FS_StreamWriteBack(stream);
+
+	if (R_SUCCEEDED(ret) && stream->isDirty)
+	{
+		ret = FSFILE_Flush(stream->handle);
+		r(" > FSFILE_Flush: %lx\n", ret);
+		stream->isDirty = false;
+	}
+
+	return ret;
+}
+
+Result FS_StreamTruncate(FS_Stream* stream)
+{
+	if (!stream) return -1;
+
+	Result ret = FS_StreamWriteBack(stream);
+
+	if (R_SUCCEEDED(ret) && stream->size != stream->offset)
+	{
+		ret = FSFILE_SetSize(stream->handle, stream->offset);
+		r(" > FSFILE_SetSize: %lx\n", ret);
+		if (R_SUCCEEDED(ret)) stream->size = stream->offset;
+	}
+
+	return ret;
+}
+
+Result FS_StreamClose(FS_Stream* stream)
+{
+	if (!stream) return -1;
 
 	Result ret;
-	Handle fileHandle;
 
-	debug_print("FS_WriteFile:\n");
+	debug_print("FS_StreamClose:\n");
 
-	ret = FSUSER_OpenFile(&fileHandle, *archive, fsMakePath(PATH_ASCII, path), FS_OPEN_WRITE | FS_OPEN_CREATE, FS_ATTRIBUTE_NONE);
-	r(" > FSUSER_OpenFile: %lx\n", ret);
+	if (stream->flush == FS_FLUSH_NONE) ret = FS_StreamWriteBack(stream);
+	else ret = FS_StreamFlush(stream);
+
+	Result closeRet = FSFILE_Close(stream->handle);
+	r(" > FSFILE_Close: %lx\n", closeRet);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
+
+	fsBufferFree(stream->buffer);
+	memset(stream, 0, sizeof(FS_Stream));
+
+	return ret;
+}
+
+Result FS_ReadFile(const char* path, void* dst, u64 maxSize, const FS_Archive* archive, u32* bytesRead)
+{
+	if (!path || !dst || !archive || !bytesRead) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	debug_print("FS_ReadFile:\n");
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, path), archive, FS_OPEN_READ, 0, FS_FLUSH_NONE);
 	if (R_FAILED(ret)) return ret;
 
+	if (stream.size > maxSize) ret = -2;
+
 	if (R_SUCCEEDED(ret))
 	{
-		ret = FSFILE_Write(fileHandle, bytesWritten, 0L, src, size, FS_WRITE_FLUSH);
-		r(" > FSFILE_Write: %lx\n", ret);
-		if (R_FAILED(ret) || *bytesWritten != size) ret = -2;
+		ret = FS_StreamRead(&stream, dst, stream.size, bytesRead);
+		if (R_SUCCEEDED(ret) && *bytesRead < stream.size) ret = -3;
 	}
 
-	ret = FSFILE_Close(fileHandle);
-	r(" > FSFILE_Close: %lx\n", ret);
+	FS_StreamClose(&stream);
+
+	return ret;
+}
+
+Result FS_WriteFile(const char* path, const void* src, u64 size, const FS_Archive* archive, u32* bytesWritten)
+{
+	if (!path || !src || !archive || !bytesWritten) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	debug_print("FS_WriteFile:\n");
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, path), archive, FS_OPEN_WRITE | FS_OPEN_CREATE, 0, FS_GetFlushPolicy(archive));
+	if (R_FAILED(ret)) return ret;
+
+	ret = FS_StreamWrite(&stream, src, size);
+	*bytesWritten = (R_SUCCEEDED(ret) ? size : 0);
+
+	Result closeRet = FS_StreamClose(&stream);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
 
 	return ret;
 }
@@ -115,10 +535,6 @@ Result FS_DeleteFile(const char* path, const FS_Archive* archive)
 {
 	if (!path || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 
 	debug_print("FS_DeleteFile:\n");
@@ -133,10 +549,6 @@ Result FS_CreateDirectory(const char* path, const FS_Archive* archive)
 {
 	if (!path || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 
 	debug_print("FS_CreateDirectory:\n");
@@ -151,10 +563,6 @@ Result FS_DeleteDirectory(const char* path, const FS_Archive* archive)
 {
 	if (!path || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 
 	debug_print("FS_DeleteDirectory:\n");
@@ -169,10 +577,6 @@ Result FS_DeleteDirectoryRecursively(const char* path, const FS_Archive* archive
 {
 	if (!path || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 
 	debug_print("FS_DeleteDirectoryRecursively:\n");
@@ -220,25 +624,9 @@ Result FS_Init(void)
 	fsUseSession(fsHandle, false);
 	debug_print(" > fsUseSession\n");
 
-	if (!sdmcInitialized)
-	{
-		sdmcArchive = (FS_Archive) { ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, NULL), fsHandle };
-
-		ret = FSUSER_OpenArchive(&sdmcArchive);
-		r(" > FSUSER_OpenArchive: %lx\n", ret);
-
-		sdmcInitialized = R_SUCCEEDED(ret);
-	}
-
-	if (!saveInitialized)
-	{
-		saveArchive = (FS_Archive) { ARCHIVE_SAVEDATA, fsMakePath(PATH_EMPTY, NULL), fsHandle };
-
-		ret = FSUSER_OpenArchive(&saveArchive);
-		r(" > FSUSER_OpenArchive: %lx\n", ret);
-
-		saveInitialized = R_SUCCEEDED(ret);
-	}
+	// The archives are opened on their first use (see FS_AcquireArchive).
+	memset(registry, 0, sizeof(registry));
+	LightLock_Init(&registryLock);
 
 	return ret;
 }
@@ -249,23 +637,10 @@ Result FS_Exit(void)
 
 	debug_print("FS_Exit:\n");
 
-	if (sdmcInitialized)
+	for (u32 i = 0; i < FS_MAX_ARCHIVES; i++)
 	{
-		ret = FSUSER_CloseArchive(&sdmcArchive);
-		r(" > FSUSER_CloseArchive: %lx\n", ret);
-
-		sdmcInitialized = false;
-	}
-
-	if (saveInitialized)
-	{
-		ret = FS_CommitArchive(&saveArchive);
-		r(" > FS_CommitArchive: %lx\n", ret);
-
-		ret = FSUSER_CloseArchive(&saveArchive);
-		r(" > FSUSER_CloseArchive: %lx\n", ret);
-
-		saveInitialized = false;
+		if (registry[i].isOpen)
+			ret = FS_CloseRegistryEntry(&registry[i]);
 	}
 
 	fsEndUseSession();
@@ -0,0 +1,357 @@
+#include "fsbatch.h"
+#include "fsdir.h"
+#include "fsindex.h"
+#include "fstree.h"
+#include "fsls.h"
+#include "fs.h"
+#include "mem.h"
+#include "utils.h"
+#include "console.h"
+#include "log.h"
+
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/thread.h>
+#include <3ds/result.h>
+#include <3ds/services/am.h>
+#include <3ds/util/utf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fsprobe.h"
+
+/// A title to export.
+typedef struct
+{
+	u64 titleid;			///< The title id
+	FS_MediaType mediatype;	///< The mediatype of the title
+} fsBatchTitle;
+
+/// A staged save, passed from the stage thread to the write loop.
+typedef struct
+{
+	const fsBatchTitle* title;	///< The title of the save
+	fsTree tree;				///< The staged save (see fsTreeLoad)
+	Result ret;					///< The result of the stage
+	u64 stageTime;				///< The time spent staging (ms)
+} fsBatchSlot;
+
+/// The state of a batch export.
+typedef struct
+{
+	fsBatchTitle* titles;					///< The titles to export
+	u32 titleCount;							///< The count of the titles
+	fsBatchSlot slots[FS_BATCH_SLOTS];		///< The staged saves (ring)
+	Handle freeSemaphore;					///< The count of the free slots
+	Handle fullSemaphore;					///< The count of the staged slots
+} fsBatch;
+
+/// The root dir of an archive.
+static const u16 rootPath[2] = { '/', '\0' };
+
+/// The name of the index file of a title.
+static const u16 indexName[6] = { 'i', 'n', 'd', 'e', 'x', '\0' };
+
+/// The extension of the digest file of a backup.
+static const u16 digestExtension[4] = { 's', 'u', 'm', '\0' };
+
+/**
+ * @brief Lists the installed applications of a mediatype.
+ * @param[in/out] batch The batch to append the titles to.
+ * @param mediatype The mediatype to list.
+ */
+static void fsBatchListTitles(fsBatch* batch, FS_MediaType mediatype)
+{
+	u32 count = 0;
+	if (R_FAILED(AM_GetTitleCount(mediatype, &count)) || count == 0) return;
+
+	u64* titleids = (u64*) memAlloc("fsBatchListTitles", count * sizeof(u64));
+	if (!titleids) return;
+
+	if (R_SUCCEEDED(AM_GetTitleList(&count, mediatype, count, titleids)))
+	{
+		for (u32 i = 0; i < count && batch->titleCount < FS_BATCH_MAX_TITLES; i++)
+		{
+			// The applications only (no system title, update or DLC).
+			if ((titleids[i] >> 32) != 0x00040000) continue;
+
+			batch->titles[batch->titleCount].titleid = titleids[i];
+			batch->titles[batch->titleCount].mediatype = mediatype;
+			batch->titleCount++;
+		}
+	}
+
+	memFree(titleids);
+}
+
+/**
+ * @brief Opens, scans and stages the save of a title.
+ * @param[out] slot The slot to fill.
+ */
+static void fsBatchStage(fsBatchSlot* slot)
+{
+	u64 startTime = osGetTime();
+
+	const FS_Archive* archive = NULL;
+	FS_ArchiveDesc desc = { ARCHIVE_USER_SAVEDATA, slot->title->mediatype, slot->title->titleid };
+
+	memset(&slot->tree, 0, sizeof(fsTree));
+
+	slot->ret = FS_AcquireArchive(&desc, &archive);
+	if (R_SUCCEEDED(slot->ret))
+	{
+		// The hashes are computed while staging.
+		slot->ret = fsTreeScan(&slot->tree, rootPath, archive, false);
+		if (R_SUCCEEDED(slot->ret)) slot->ret = fsTreeLoad(&slot->tree, rootPath, archive);
+
+		FS_ReleaseArchive(archive);
+	}
+
+	slot->stageTime = osGetTime() - startTime;
+}
+
+/**
+ * @brief Stages the saves of all the titles, one free slot after another.
+ * @param arg The batch.
+ */
+static void fsBatchStageThread(void* arg)
+{
+	fsBatch* batch = (fsBatch*) arg;
+	s32 count;
+
+	for (u32 i = 0; i < batch->titleCount; i++)
+	{
+		svcWaitSynchronization(batch->freeSemaphore, U64_MAX);
+
+		// Under memory pressure, one staged save at a time: the other slots are written first.
+		u32 heldSlots = 0;
+		if (i > 0 && memGetPressure(NULL) != MEM_PRESSURE_NONE)
+		{
+			for (; heldSlots < FS_BATCH_SLOTS - 1; heldSlots++)
+				svcWaitSynchronization(batch->freeSemaphore, U64_MAX);
+		}
+
+		fsBatchSlot* slot = &batch->slots[i % FS_BATCH_SLOTS];
+		slot->title = &batch->titles[i];
+		fsBatchStage(slot);
+
+		svcReleaseSemaphore(&count, batch->fullSemaphore, 1);
+		if (heldSlots > 0) svcReleaseSemaphore(&count, batch->freeSemaphore, heldSlots);
+	}
+}
+
+/**
+ * @brief Writes a staged save as a new backup of its title.
+ * @param[in/out] slot The staged save.
+ * @param[in] name The name of the backup (with the trailing '/').
+ * @param created The creation time of the backup.
+ * @param[in] sdmcArchive The sdmc archive.
+ * @return FS_SAVE_UNCHANGED if the save didn't change since the latest backup.
+ */
+static Result fsBatchWrite(fsBatchSlot* slot, const char* name, time_t created, const FS_Archive* sdmcArchive)
+{
+	Result ret;
+
+	u16 len;
+	u16 titlePath[FS_MAX_PATH_LENGTH];
+	u16 path[FS_MAX_PATH_LENGTH];
+	char path8[FS_MAX_PATH_LENGTH];
+
+	sprintf(path8, "/backup/%016llx/", slot->title->titleid);
+	memset(titlePath, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	utf8_to_utf16(titlePath, (u8*) path8, FS_MAX_PATH_LENGTH - 1);
+
+	// A new title dir has no backup, so a new index is complete.
+	bool newTitle = R_SUCCEEDED(FSUSER_CreateDirectory(*sdmcArchive, fsMakePath(PATH_UTF16, titlePath), FS_ATTRIBUTE_DIRECTORY));
+
+	fsIndex index;
+	memset(&index, 0, sizeof(fsIndex));
+
+	len = str16cpy(path, titlePath);
+	str16cpy(path + len, indexName);
+	bool hasIndex = newTitle || R_SUCCEEDED(fsIndexRead(&index, path, sdmcArchive));
+
+	// The manifest of the backup, also its fingerprint.
+	fsManifest manifest;
+	memset(&manifest, 0, sizeof(fsManifest));
+	utf8_to_utf16(manifest.name16, (u8*) name, strlen(name) - 1);
+	manifest.created = created;
+	fsManifestFromTree(&manifest, &slot->tree, true);
+
+	fsManifest* latest = fsIndexLatest(&index);
+	if (latest && latest->isDigested && !latest->isVerifyFailed && latest->digest == manifest.digest)
+	{
+		fsIndexFree(&index);
+		return FS_SAVE_UNCHANGED;
+	}
+
+	// The backup dir, and its digest file next to it.
+	u16 backupPath[FS_MAX_PATH_LENGTH];
+	memset(backupPath, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	len = str16cpy(backupPath, titlePath);
+	str16cpy(backupPath + len, manifest.name16);
+	len = str16len(backupPath);
+	backupPath[len++] = '/';
+
+	u16 digestPath[FS_MAX_PATH_LENGTH];
+	memset(digestPath, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	str16cpy(digestPath, backupPath);
+	digestPath[len-1] = '.';
+	str16cpy(digestPath + len, digestExtension);
+
+	// Write the backup.
+	ret = FSUSER_CreateDirectory(*sdmcArchive, fsMakePath(PATH_UTF16, backupPath), FS_ATTRIBUTE_DIRECTORY);
+	bool dirCreated = R_SUCCEEDED(ret);
+	if (dirCreated) ret = fsTreeStore(&slot->tree, backupPath, sdmcArchive);
+
+	// Write its manifest and digests, then the index.
+	if (R_SUCCEEDED(ret))
+	{
+		char header[FS_INDEX_LINE_LENGTH];
+		fsManifestFormat(&manifest, header);
+		ret = fsTreeWrite(&slot->tree, header, digestPath, sdmcArchive);
+	}
+
+	// Without index, the lazy rebuild will read the manifest (path is still the one of the index).
+	bool indexFailed = false;
+	if (R_SUCCEEDED(ret) && hasIndex)
+	{
+		fsIndexAdd(&index, &manifest);
+		ret = fsIndexWrite(&index, path, sdmcArchive);
+		indexFailed = R_FAILED(ret);
+	}
+
+	// A failed step removes what was written, else the next rebuild would list it as a backup.
+	if (R_FAILED(ret) && dirCreated)
+	{
+		FSUSER_DeleteDirectoryRecursively(*sdmcArchive, fsMakePath(PATH_UTF16, backupPath));
+		FSUSER_DeleteFile(*sdmcArchive, fsMakePath(PATH_UTF16, digestPath));
+
+		// The index may be half written, the lazy rebuild will replace it.
+		if (indexFailed) FSUSER_DeleteFile(*sdmcArchive, fsMakePath(PATH_UTF16, path));
+	}
+
+	fsIndexFree(&index);
+
+	return ret;
+}
+
+Result fsBatchExportAll(void)
+{
+	Result ret;
+	u64 startTime = osGetTime();
+
+	fsBatch batch;
+	memset(&batch, 0, sizeof(fsBatch));
+
+	const FS_Archive* sdmcArchive = NULL;
+	ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret)) return ret;
+
+	batch.titles = (fsBatchTitle*) memAlloc("fsBatchExportAll", FS_BATCH_MAX_TITLES * sizeof(fsBatchTitle));
+	if (!batch.titles)
+	{
+		FS_ReleaseArchive(sdmcArchive);
+		return -2;
+	}
+
+	ret = amInit();
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't list the titles: %lx\n", ret);
+		memFree(batch.titles);
+		FS_ReleaseArchive(sdmcArchive);
+		return ret;
+	}
+
+	fsBatchListTitles(&batch, MEDIATYPE_SD);
+	fsBatchListTitles(&batch, MEDIATYPE_GAME_CARD);
+	amExit();
+
+	consoleLog("Batch: %lu title(s)\n", batch.titleCount);
+
+	// The same backup name for the whole batch.
+	time_t t_time = time(NULL);
+
+	char name[FS_MAX_FPATH_LENGTH];
+	fsManifestName(name, t_time);
+
+	FS_CreateDirectory("/backup/", sdmcArchive);
+
+	svcCreateSemaphore(&batch.freeSemaphore, FS_BATCH_SLOTS, FS_BATCH_SLOTS);
+	svcCreateSemaphore(&batch.fullSemaphore, 0, FS_BATCH_SLOTS);
+
+	// Stage the next saves while writing the previous ones.
+	Thread thread = threadCreate(fsBatchStageThread, &batch, FS_BATCH_STACK_SIZE, FS_BATCH_THREAD_PRIORITY, -2, false);
+	if (!thread)
+	{
+		logError("Couldn't create the stage thread!\n");
+		batch.titleCount = 0;
+		ret = -3;
+	}
+
+	u32 exportCount = 0;
+	u32 unchangedCount = 0;
+	u32 skippedCount = 0;
+	u64 totalSize = 0;
+	s32 count;
+
+	for (u32 i = 0; i < batch.titleCount; i++)
+	{
+		svcWaitSynchronization(batch.fullSemaphore, U64_MAX);
+
+		fsBatchSlot* slot = &batch.slots[i % FS_BATCH_SLOTS];
+		u64 writeTime = osGetTime();
+
+		if (R_FAILED(slot->ret))
+		{
+			// No save (or no access to it).
+			skippedCount++;
+		}
+		else
+		{
+			Result writeRet = fsBatchWrite(slot, name, t_time, sdmcArchive);
+			writeTime = osGetTime() - writeTime;
+
+			if (writeRet == FS_SAVE_UNCHANGED)
+			{
+				consoleLog("%016llx: unchanged\n", slot->title->titleid);
+				unchangedCount++;
+			}
+			else if (R_FAILED(writeRet))
+			{
+				consoleLog("%016llx: failed %lx\n", slot->title->titleid, writeRet);
+				ret = writeRet;
+			}
+			else
+			{
+				u64 time = slot->stageTime + writeTime;
+				consoleLog("%016llx: %llu KB, %llu KB/s\n", slot->title->titleid, slot->tree.totalSize / 1024, (time > 0 ? slot->tree.totalSize * 1000 / 1024 / time : 0));
+				totalSize += slot->tree.totalSize;
+				exportCount++;
+			}
+		}
+
+		fsTreeFree(&slot->tree);
+		svcReleaseSemaphore(&count, batch.freeSemaphore, 1);
+	}
+
+	if (thread)
+	{
+		threadJoin(thread, U64_MAX);
+		threadFree(thread);
+	}
+
+	svcCloseHandle(batch.freeSemaphore);
+	svcCloseHandle(batch.fullSemaphore);
+	memFree(batch.titles);
+	FS_ReleaseArchive(sdmcArchive);
+
+	consoleLog("Batch: %lu exported, %lu unchanged, %lu without save\n", exportCount, unchangedCount, skippedCount);
+	consoleLog("  %llu KB in %llums\n", totalSize / 1024, osGetTime() - startTime);
+
+	return ret;
+}
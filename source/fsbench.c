@@ -0,0 +1,348 @@
+#include "fsbench.h"
+#include "fsbuf.h"
+#include "fs.h"
+#include "console.h"
+
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/result.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// #define r(format, args...) consoleLog(format, ##args)
+#define r(format, args...)
+
+/// The results of the latest benchmark (save, sdmc).
+static fsBenchResult results[2];
+static time_t benchTime = 0;
+static bool hasResults = false;
+
+/**
+ * @brief Converts system ticks to microseconds.
+ */
+static inline u64 fsBenchMicros(u64 ticks)
+{
+	return ticks * 1000000 / SYSCLOCK_ARM11;
+}
+
+/**
+ * @brief Gets a speed (KB/s) from a size and a duration.
+ */
+static inline u32 fsBenchSpeed(u64 bytes, u64 ticks)
+{
+	return (ticks > 0 ? (u32) (bytes * SYSCLOCK_ARM11 / ticks / 1024) : 0);
+}
+
+/**
+ * @brief Gets the next pseudo-random number (the same sequence on every run).
+ */
+static inline u32 fsBenchRandom(u32* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+/**
+ * @brief Times the sequential and random reads and writes of the scratch file.
+ * @param fileHandle The scratch file, created at its size.
+ * @param[in/out] buffer The buffer (FS_BENCH_CHUNK_SIZE bytes).
+ * @param[in/out] result The results.
+ */
+static Result fsBenchFile(Handle fileHandle, u8* buffer, fsBenchResult* result)
+{
+	Result ret = 0;
+	u32 bytes;
+	u64 tick;
+
+	// Sequential, flushed once at the end.
+	tick = svcGetSystemTick();
+	for (u32 offset = 0; R_SUCCEEDED(ret) && offset < result->fileSize; offset += FS_BENCH_CHUNK_SIZE)
+	{
+		ret = FSFILE_Write(fileHandle, &bytes, offset, buffer, FS_BENCH_CHUNK_SIZE, 0);
+		if (R_SUCCEEDED(ret) && bytes != FS_BENCH_CHUNK_SIZE) ret = -3;
+	}
+	if (R_SUCCEEDED(ret)) ret = FSFILE_Flush(fileHandle);
+	result->seqWriteSpeed = fsBenchSpeed(result->fileSize, svcGetSystemTick() - tick);
+	r(" > sequential write: %lx\n", ret);
+
+	tick = svcGetSystemTick();
+	for (u32 offset = 0; R_SUCCEEDED(ret) && offset < result->fileSize; offset += FS_BENCH_CHUNK_SIZE)
+	{
+		ret = FSFILE_Read(fileHandle, &bytes, offset, buffer, FS_BENCH_CHUNK_SIZE);
+		if (R_SUCCEEDED(ret) && bytes != FS_BENCH_CHUNK_SIZE) ret = -3;
+	}
+	result->seqReadSpeed = fsBenchSpeed(result->fileSize, svcGetSystemTick() - tick);
+	r(" > sequential read: %lx\n", ret);
+
+	// Random, at aligned offsets.
+	u32 blockCount = result->fileSize / FS_BENCH_RANDOM_SIZE;
+	u32 seed = 1;
+
+	tick = svcGetSystemTick();
+	for (u32 i = 0; R_SUCCEEDED(ret) && i < FS_BENCH_RANDOM_COUNT; i++)
+	{
+		u64 offset = (u64) (fsBenchRandom(&seed) % blockCount) * FS_BENCH_RANDOM_SIZE;
+		ret = FSFILE_Write(fileHandle, &bytes, offset, buffer, FS_BENCH_RANDOM_SIZE, 0);
+		if (R_SUCCEEDED(ret) && bytes != FS_BENCH_RANDOM_SIZE) ret = -3;
+	}
+	if (R_SUCCEEDED(ret)) ret = FSFILE_Flush(fileHandle);
+	result->randWriteSpeed = fsBenchSpeed(FS_BENCH_RANDOM_COUNT * FS_BENCH_RANDOM_SIZE, svcGetSystemTick() - tick);
+	r(" > random write: %lx\n", ret);
+
+	tick = svcGetSystemTick();
+	for (u32 i = 0; R_SUCCEEDED(ret) && i < FS_BENCH_RANDOM_COUNT; i++)
+	{
+		u64 offset = (u64) (fsBenchRandom(&seed) % blockCount) * FS_BENCH_RANDOM_SIZE;
+		ret = FSFILE_Read(fileHandle, &bytes, offset, buffer, FS_BENCH_RANDOM_SIZE);
+		if (R_SUCCEEDED(ret) && bytes != FS_BENCH_RANDOM_SIZE) ret = -3;
+	}
+	result->randReadSpeed = fsBenchSpeed(FS_BENCH_RANDOM_COUNT * FS_BENCH_RANDOM_SIZE, svcGetSystemTick() - tick);
+	r(" > random read: %lx\n", ret);
+
+	return ret;
+}
+
+/**
+ * @brief Times the listing of a directory of FS_BENCH_DIR_ENTRIES empty files.
+ * @param[in] archive The archive.
+ * @param[out] result The results.
+ */
+static Result fsBenchList(const FS_Archive* archive, fsBenchResult* result)
+{
+	Result ret = 0;
+	char path[32];
+
+	for (u32 i = 0; R_SUCCEEDED(ret) && i < FS_BENCH_DIR_ENTRIES; i++)
+	{
+		sprintf(path, FS_BENCH_DIR_PATH "l/%02lu", i);
+		ret = FSUSER_CreateFile(*archive, fsMakePath(PATH_ASCII, path), FS_ATTRIBUTE_NONE, 0);
+	}
+	if (R_FAILED(ret)) return ret;
+
+	Handle dirHandle;
+	FS_DirectoryEntry entries[8];
+	u32 entriesRead = 0, entryCount = 0;
+
+	u64 tick = svcGetSystemTick();
+
+	ret = FSUSER_OpenDirectory(&dirHandle, *archive, fsMakePath(PATH_ASCII, FS_BENCH_DIR_PATH "l/"));
+	r(" > FSUSER_OpenDirectory: %lx\n", ret);
+	if (R_FAILED(ret)) return ret;
+
+	do
+	{
+		ret = FSDIR_Read(dirHandle, &entriesRead, 8, entries);
+		entryCount += entriesRead;
+	}
+	while (R_SUCCEEDED(ret) && entriesRead > 0);
+
+	FSDIR_Close(dirHandle);
+
+	u64 micros = fsBenchMicros(svcGetSystemTick() - tick);
+	result->listRate = (micros > 0 ? (u32) (entryCount * 1000000ULL / micros) : entryCount * 1000000);
+
+	return ret;
+}
+
+/**
+ * @brief Benchmarks an archive in its scratch area, then deletes it.
+ * @param[in] archive The archive.
+ * @param[out] result The results.
+ */
+static Result fsBenchArchive(const FS_Archive* archive, fsBenchResult* result)
+{
+	Result ret;
+	Handle fileHandle;
+	FS_Path dirPath = fsMakePath(PATH_ASCII, FS_BENCH_DIR_PATH);
+	FS_Path filePath = fsMakePath(PATH_ASCII, FS_BENCH_DIR_PATH "f");
+
+	consoleLog("Benchmarking the %s archive...\n", result->name);
+
+	// A small save can't hold the whole scratch file.
+	u64 freeBytes = 0;
+	result->fileSize = FS_BENCH_FILE_SIZE;
+	if (R_SUCCEEDED(FSUSER_GetFreeBytes(&freeBytes, *archive)))
+	{
+		while (result->fileSize > FS_BENCH_MIN_FILE_SIZE && result->fileSize > freeBytes / 2)
+			result->fileSize /= 2;
+	}
+
+	// A previous benchmark may have been interrupted.
+	FSUSER_DeleteDirectoryRecursively(*archive, dirPath);
+
+	ret = FSUSER_CreateDirectory(*archive, dirPath, FS_ATTRIBUTE_DIRECTORY);
+	r(" > FSUSER_CreateDirectory: %lx\n", ret);
+	if (R_SUCCEEDED(ret)) ret = FSUSER_CreateDirectory(*archive, fsMakePath(PATH_ASCII, FS_BENCH_DIR_PATH "l/"), FS_ATTRIBUTE_DIRECTORY);
+
+	// Created at its size, as on the extdata.
+	if (R_SUCCEEDED(ret)) ret = FSUSER_CreateFile(*archive, filePath, FS_ATTRIBUTE_NONE, result->fileSize);
+	r(" > FSUSER_CreateFile: %lx\n", ret);
+
+	if (R_SUCCEEDED(ret))
+	{
+		ret = FSUSER_OpenFile(&fileHandle, *archive, filePath, FS_OPEN_READ | FS_OPEN_WRITE, FS_ATTRIBUTE_NONE);
+		r(" > FSUSER_OpenFile: %lx\n", ret);
+	}
+
+	if (R_SUCCEEDED(ret))
+	{
+		u8* buffer = (u8*) fsBufferAlloc(FS_BENCH_CHUNK_SIZE);
+		if (!buffer) ret = -2;
+
+		if (R_SUCCEEDED(ret))
+		{
+			memset(buffer, 0x5A, FS_BENCH_CHUNK_SIZE);
+			ret = fsBenchFile(fileHandle, buffer, result);
+		}
+
+		fsBufferFree(buffer);
+
+		FSFILE_Close(fileHandle);
+		r(" > FSFILE_Close\n");
+	}
+
+	if (R_SUCCEEDED(ret))
+	{
+		u64 tick = svcGetSystemTick();
+
+		for (u32 i = 0; R_SUCCEEDED(ret) && i < FS_BENCH_OPEN_COUNT; i++)
+		{
+			ret = FSUSER_OpenFile(&fileHandle, *archive, filePath, FS_OPEN_READ, FS_ATTRIBUTE_NONE);
+			if (R_SUCCEEDED(ret)) FSFILE_Close(fileHandle);
+		}
+
+		result->openLatency = (u32) (fsBenchMicros(svcGetSystemTick() - tick) / FS_BENCH_OPEN_COUNT);
+		r(" > open/close: %lx\n", ret);
+	}
+
+	if (R_SUCCEEDED(ret)) ret = fsBenchList(archive, result);
+
+	// Never committed, the save keeps its content.
+	Result deleteRet = FSUSER_DeleteDirectoryRecursively(*archive, dirPath);
+	r(" > FSUSER_DeleteDirectoryRecursively: %lx\n", deleteRet);
+	if (R_SUCCEEDED(ret)) ret = deleteRet;
+
+	result->ret = ret;
+
+	return ret;
+}
+
+/**
+ * @brief Writes the results of the latest benchmark, one line per archive.
+ */
+static Result fsBenchStore(const FS_Archive* sdmcArchive)
+{
+	Result ret;
+	FS_Stream stream;
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, FS_BENCH_PATH), sdmcArchive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_BENCH_LINE_LENGTH * 4, FS_FLUSH_CLOSE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[FS_BENCH_LINE_LENGTH];
+
+	ret = FS_StreamWrite(&stream, FS_BENCH_MAGIC, strlen(FS_BENCH_MAGIC));
+
+	// name result time file-size seq-write seq-read rand-write rand-read (KB/s) open (us) list (entries/s)
+	for (u32 i = 0; i < 2 && R_SUCCEEDED(ret); i++)
+	{
+		const fsBenchResult* result = &results[i];
+
+		u32 len = sprintf(line, "r %s %08lx %llu %lu %lu %lu %lu %lu %lu %lu\n",
+			result->name, result->ret, (u64) benchTime, result->fileSize,
+			result->seqWriteSpeed, result->seqReadSpeed, result->randWriteSpeed, result->randReadSpeed,
+			result->openLatency, result->listRate);
+
+		ret = FS_StreamWrite(&stream, line, len);
+	}
+
+	if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+	Result closeRet = FS_StreamClose(&stream);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
+
+	return ret;
+}
+
+Result fsBenchRun(void)
+{
+	Result ret;
+	const FS_Archive* saveArchive = NULL;
+	const FS_Archive* sdmcArchive = NULL;
+
+	memset(results, 0, sizeof(results));
+	results[0].name = "save";
+	results[1].name = "sdmc";
+	benchTime = time(NULL);
+	hasResults = true;
+
+	ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret)) return ret;
+
+	results[0].ret = FS_AcquireArchive(&saveArchiveDesc, &saveArchive);
+	if (R_SUCCEEDED(results[0].ret))
+	{
+		fsBenchArchive(saveArchive, &results[0]);
+		FS_ReleaseArchive(saveArchive);
+	}
+
+	fsBenchArchive(sdmcArchive, &results[1]);
+
+	ret = fsBenchStore(sdmcArchive);
+	if (R_SUCCEEDED(ret)) ret = (R_FAILED(results[0].ret) ? results[0].ret : results[1].ret);
+
+	FS_ReleaseArchive(sdmcArchive);
+
+	return ret;
+}
+
+/**
+ * @brief Prints the results of an archive to the current console.
+ */
+static void fsBenchPrintResult(const fsBenchResult* result, const char* data)
+{
+	consoleClear();
+
+	consoleResetColor();
+	printf("\x1B[0;0H%s bench:", data);
+
+	if (!hasResults)
+	{
+		consoleForegroundColor(TEAL);
+		printf("\x1B[1;0H[A] to run it");
+		consoleResetColor();
+		return;
+	}
+
+	if (R_FAILED(result->ret))
+	{
+		consoleForegroundColor(RED);
+		printf("\x1B[2;0HFailed: %08lx", result->ret);
+		consoleResetColor();
+	}
+
+	consoleForegroundColor(TEAL);
+	printf("\x1B[1;0H%lu KB scratch", result->fileSize / 1024);
+	consoleResetColor();
+
+	printf("\x1B[3;0HSeq write  %8lu KB/s", result->seqWriteSpeed);
+	printf("\x1B[4;0HSeq read   %8lu KB/s", result->seqReadSpeed);
+	printf("\x1B[5;0H4K write   %8lu KB/s", result->randWriteSpeed);
+	printf("\x1B[6;0H4K read    %8lu KB/s", result->randReadSpeed);
+	printf("\x1B[7;0HOpen+close %8lu us", result->openLatency);
+	printf("\x1B[8;0HListing    %8lu /s", result->listRate);
+}
+
+void fsBenchPrint(void)
+{
+	consoleSelectNew(&saveConsole);
+	fsBenchPrintResult(&results[0], "Save");
+	consoleSelectLast();
+
+	consoleSelectNew(&sdmcConsole);
+	fsBenchPrintResult(&results[1], "Sdmc");
+	consoleSelectLast();
+}
@@ -0,0 +1,340 @@
+#include "fsbuf.h"
+#include "mem.h"
+
+#include <3ds/os.h>
+#include <3ds/synchronization.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+
+/// A size class of the buffer pool.
+typedef struct
+{
+	fsBufferUsage usage;					///< The usage of the class
+	void* buffers[FS_BUFFER_MAX_SLOTS];		///< The pooled buffers (allocated on first use)
+	bool isUsed[FS_BUFFER_MAX_SLOTS];		///< Whether the pooled buffers are in use
+} fsBufferClass;
+
+/// The sizes of the classes, and their slot counts with the full budget.
+static const u32 classSizes[FS_BUFFER_CLASS_COUNT] = { 0x1000, 0x4000, 0x10000, 0x40000 };
+static const u32 classSlots[FS_BUFFER_CLASS_COUNT] = { 4, 4, 4, 2 };
+
+static fsBufferClass classes[FS_BUFFER_CLASS_COUNT];
+static u32 budget = 0;
+static LightLock poolLock;
+static bool isInit = false;
+
+/**
+ * @brief Gets the total size of the slots of the classes.
+ */
+static u32 fsBufferPoolSize(void)
+{
+	u32 size = 0;
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+		size += classes[i].usage.slotCount * classes[i].usage.size;
+	return size;
+}
+
+/**
+ * @brief Acquires a slot of a class, allocating its buffer on first use.
+ * @return The buffer (NULL if no free slot).
+ */
+static void* fsBufferTake(fsBufferClass* class)
+{
+	for (u32 i = 0; i < class->usage.slotCount; i++)
+	{
+		if (class->isUsed[i]) continue;
+
+		if (!class->buffers[i])
+		{
+			class->buffers[i] = memAlign("fsBufferPool", FS_BUFFER_ALIGNMENT, class->usage.size);
+			if (!class->buffers[i]) return NULL;
+			class->usage.allocCount++;
+		}
+
+		class->isUsed[i] = true;
+		class->usage.usedCount++;
+		class->usage.hitCount++;
+		if (class->usage.usedCount > class->usage.peakCount) class->usage.peakCount = class->usage.usedCount;
+
+		return class->buffers[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Sizes the slots of the classes from the budget (with poolLock).
+ * The slots over the count keep their buffers until released (see fsBufferAdapt).
+ */
+static void fsBufferPlan(void)
+{
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+		classes[i].usage.slotCount = classSlots[i];
+
+	// Low memory: the biggest classes shrink first, the chunked I/O then uses smaller chunks.
+	for (s32 i = FS_BUFFER_CLASS_COUNT - 1; i >= 0; i--)
+	{
+		while (classes[i].usage.slotCount > 1 && fsBufferPoolSize() > budget)
+			classes[i].usage.slotCount--;
+	}
+
+	for (s32 i = FS_BUFFER_CLASS_COUNT - 1; i > 0 && fsBufferPoolSize() > budget; i--)
+		classes[i].usage.slotCount = 0;
+
+	// Spare memory: more buffers of the biggest class, for the concurrent copies.
+	fsBufferClass* biggest = &classes[FS_BUFFER_CLASS_COUNT - 1];
+	while (biggest->usage.slotCount < FS_BUFFER_MAX_SLOTS && fsBufferPoolSize() + biggest->usage.size <= budget)
+		biggest->usage.slotCount++;
+}
+
+/**
+ * @brief Adapts the pool to the memory pressure (see memAdaptFunc):
+ * frees the idle buffers (the biggest class only under low pressure), then sizes it again.
+ */
+static u32 fsBufferAdapt(memPressure pressure)
+{
+	if (!isInit) return 0;
+
+	u32 released = 0;
+
+	LightLock_Lock(&poolLock);
+
+	for (s32 i = FS_BUFFER_CLASS_COUNT - 1; i >= 0 && pressure != MEM_PRESSURE_NONE; i--)
+	{
+		fsBufferClass* class = &classes[i];
+
+		for (u32 j = 0; j < FS_BUFFER_MAX_SLOTS; j++)
+		{
+			if (!class->buffers[j] || class->isUsed[j]) continue;
+
+			memFree(class->buffers[j]);
+			class->buffers[j] = NULL;
+			released += class->usage.size;
+		}
+
+		if (pressure == MEM_PRESSURE_LOW && released > 0) break;
+	}
+
+	// The pooled buffers still held are part of the budget.
+	u32 held = 0;
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+	{
+		for (u32 j = 0; j < FS_BUFFER_MAX_SLOTS; j++)
+			if (classes[i].buffers[j]) held += classes[i].usage.size;
+	}
+
+	budget = memGetBudget(held, FS_BUFFER_BUDGET_SHIFT, FS_BUFFER_MIN_BUDGET, FS_BUFFER_MAX_BUDGET);
+	fsBufferPlan();
+
+	LightLock_Unlock(&poolLock);
+
+	return released;
+}
+
+void fsBufferInit(void)
+{
+	if (isInit) return;
+
+	LightLock_Init(&poolLock);
+	memset(classes, 0, sizeof(classes));
+
+	budget = memGetBudget(0, FS_BUFFER_BUDGET_SHIFT, FS_BUFFER_MIN_BUDGET, FS_BUFFER_MAX_BUDGET);
+
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+		classes[i].usage.size = classSizes[i];
+
+	fsBufferPlan();
+
+	isInit = true;
+
+	memRegister("fsBuffer", fsBufferAdapt);
+}
+
+void fsBufferExit(void)
+{
+	if (!isInit) return;
+
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+	{
+		for (u32 j = 0; j < FS_BUFFER_MAX_SLOTS; j++)
+			memFree(classes[i].buffers[j]);
+	}
+
+	memset(classes, 0, sizeof(classes));
+	budget = 0;
+	isInit = false;
+}
+
+void* fsBufferAlloc(u32 size)
+{
+	if (size == 0) return NULL;
+	if (!isInit) return memAlign("fsBufferAlloc", FS_BUFFER_ALIGNMENT, size);
+
+	void* buffer = NULL;
+	fsBufferClass* missClass = NULL;
+
+	LightLock_Lock(&poolLock);
+
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT && !buffer; i++)
+	{
+		if (classes[i].usage.size < size) continue;
+		if (!missClass) missClass = &classes[i];
+
+		buffer = fsBufferTake(&classes[i]);
+	}
+
+	if (!buffer)
+	{
+		if (missClass) missClass->usage.missCount++;
+		else classes[FS_BUFFER_CLASS_COUNT - 1].usage.missCount++;
+	}
+
+	LightLock_Unlock(&poolLock);
+
+	if (!buffer) buffer = memAlign("fsBufferAlloc", FS_BUFFER_ALIGNMENT, size);
+	if (!buffer && memReclaim()) buffer = memAlign("fsBufferAlloc", FS_BUFFER_ALIGNMENT, size);
+
+	return buffer;
+}
+
+/**
+ * @brief Allocates a chunk on the heap, halved down to FS_BUFFER_MIN_CHUNK while the heap is short,
+ * once the consumers of the spare memory released what they could.
+ */
+static void* fsBufferAllocHeap(u32 maxSize, u32* size)
+{
+	bool reclaimed = false;
+	u32 chunkSize = maxSize;
+
+	while (true)
+	{
+		void* buffer = memAlign("fsBufferAllocChunk", FS_BUFFER_ALIGNMENT, chunkSize);
+		if (!buffer && !reclaimed)
+		{
+			reclaimed = true;
+			if (memReclaim()) continue;
+		}
+
+		if (buffer)
+		{
+			*size = chunkSize;
+			return buffer;
+		}
+
+		if (chunkSize <= FS_BUFFER_MIN_CHUNK) return NULL;
+
+		chunkSize = (chunkSize / 2 > FS_BUFFER_MIN_CHUNK ? chunkSize / 2 : FS_BUFFER_MIN_CHUNK);
+	}
+}
+
+void* fsBufferAllocChunk(u32 maxSize, u32* size)
+{
+	if (!size) return NULL;
+
+	*size = 0;
+	if (maxSize == 0) return NULL;
+
+	if (!isInit) return fsBufferAllocHeap(maxSize, size);
+
+	void* buffer = NULL;
+
+	LightLock_Lock(&poolLock);
+
+	// The smallest free buffer holding the whole chunk.
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT && !buffer; i++)
+	{
+		if (classes[i].usage.size < maxSize) continue;
+
+		buffer = fsBufferTake(&classes[i]);
+		if (buffer) *size = classes[i].usage.size;
+	}
+
+	// Else the biggest smaller one, a smaller chunk beats a heap allocation.
+	for (s32 i = FS_BUFFER_CLASS_COUNT - 1; i >= 0 && !buffer; i--)
+	{
+		if (classes[i].usage.size >= maxSize) continue;
+
+		buffer = fsBufferTake(&classes[i]);
+		if (buffer) *size = classes[i].usage.size;
+	}
+
+	if (!buffer)
+	{
+		u32 i = 0;
+		while (i < FS_BUFFER_CLASS_COUNT - 1 && classes[i].usage.size < maxSize) i++;
+		classes[i].usage.missCount++;
+	}
+
+	LightLock_Unlock(&poolLock);
+
+	if (!buffer) buffer = fsBufferAllocHeap(maxSize, size);
+
+	return buffer;
+}
+
+void fsBufferFree(void* buffer)
+{
+	if (!buffer) return;
+
+	if (isInit)
+	{
+		LightLock_Lock(&poolLock);
+
+		for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+		{
+			for (u32 j = 0; j < FS_BUFFER_MAX_SLOTS; j++)
+			{
+				if (classes[i].buffers[j] == buffer && classes[i].isUsed[j])
+				{
+					classes[i].isUsed[j] = false;
+					classes[i].usage.usedCount--;
+
+					LightLock_Unlock(&poolLock);
+					return;
+				}
+			}
+		}
+
+		LightLock_Unlock(&poolLock);
+	}
+
+	// A heap fallback.
+	memFree(buffer);
+}
+
+u32 fsBufferGetUsage(fsBufferUsage* usage)
+{
+	if (!isInit)
+	{
+		if (usage) memset(usage, 0, FS_BUFFER_CLASS_COUNT * sizeof(fsBufferUsage));
+		return 0;
+	}
+
+	LightLock_Lock(&poolLock);
+
+	if (usage)
+	{
+		for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+			usage[i] = classes[i].usage;
+	}
+
+	LightLock_Unlock(&poolLock);
+
+	return budget;
+}
+
+void fsBufferLogUsage(void)
+{
+	fsBufferUsage usage[FS_BUFFER_CLASS_COUNT];
+	u32 poolBudget = fsBufferGetUsage(usage);
+
+	consoleLog("Buffers: %lu KB budget\n", poolBudget / 1024);
+
+	for (u32 i = 0; i < FS_BUFFER_CLASS_COUNT; i++)
+	{
+		consoleLog("  %3lu KB: %lu/%lu used, %lu peak, %lu hit, %lu miss\n", usage[i].size / 1024, usage[i].usedCount, usage[i].slotCount, usage[i].peakCount, usage[i].hitCount, usage[i].missCount);
+	}
+}
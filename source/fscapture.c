@@ -0,0 +1,291 @@
+#include "fscapture.h"
+#include "fs.h"
+#include "mem.h"
+#include "console.h"
+
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/thread.h>
+#include <3ds/result.h>
+#include <3ds/synchronization.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// #define r(format, args...) consoleLog(format, ##args)
+#define r(format, args...)
+
+bool fsCaptureEnabled = false;
+
+/// The two buffers, one filled by the calls while the other is written by the thread.
+static u8* buffers[2] = { NULL, NULL };
+static u32 bufferLengths[2];
+static bool bufferBusy[2];		// Whether the buffer is passed to the thread.
+static u32 current = 0;			// The buffer filled.
+static u32 pending = 0;			// The buffer passed to the thread.
+static bool isStopping = false;
+static LightLock captureLock;
+
+static Handle fullSemaphore = 0;
+static Thread thread = NULL;
+static Handle fileHandle = 0;
+static u64 fileOffset = 0;
+static Result writeRet = 0;
+static const FS_Archive* sdmcArchive = NULL;
+
+static u64 startTick = 0;
+static u32 recordCount = 0;
+static u32 droppedCount = 0;
+
+/**
+ * @brief Writes the buffers passed by the calls, until the stop.
+ */
+static void fsCaptureThread(void* arg)
+{
+	(void) arg;
+
+	while (true)
+	{
+		svcWaitSynchronization(fullSemaphore, U64_MAX);
+
+		LightLock_Lock(&captureLock);
+		u32 index = pending;
+		bool busy = bufferBusy[index];
+		bool stopping = isStopping;
+		LightLock_Unlock(&captureLock);
+
+		if (busy)
+		{
+			u32 bytesWritten = 0;
+			Result ret = FSFILE_Write(fileHandle, &bytesWritten, fileOffset, buffers[index], bufferLengths[index], 0);
+			r(" > FSFILE_Write: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && bytesWritten != bufferLengths[index]) ret = -3;
+			if (R_FAILED(ret) && R_SUCCEEDED(writeRet)) writeRet = ret;
+			fileOffset += bytesWritten;
+
+			LightLock_Lock(&captureLock);
+			bufferLengths[index] = 0;
+			bufferBusy[index] = false;
+			LightLock_Unlock(&captureLock);
+		}
+
+		if (stopping) break;
+	}
+}
+
+/**
+ * @brief Passes the filled buffer to the thread, and fills the other (with captureLock).
+ * @return Whether the other buffer was free.
+ */
+static bool fsCaptureSwap(void)
+{
+	u32 other = current ^ 1;
+	if (bufferBusy[other]) return false;
+
+	bufferBusy[current] = true;
+	pending = current;
+	current = other;
+
+	s32 count;
+	svcReleaseSemaphore(&count, fullSemaphore, 1);
+	return true;
+}
+
+void fsCaptureCall(fsCaptureOp op, u32 archiveId, const FS_Path* path, Handle handle, u64 offset, u32 size, u32 done, Result result, u64 start, u64 ticks)
+{
+	if (!fsCaptureEnabled) return;
+
+	u32 pathSize = (path && path->data ? path->size : 0);
+	if (pathSize > FS_CAPTURE_MAX_PATH) pathSize = FS_CAPTURE_MAX_PATH;
+	u32 recordSize = sizeof(fsCaptureRecord) + ((pathSize + 3) & ~3);
+
+	LightLock_Lock(&captureLock);
+
+	if (!fsCaptureEnabled)
+	{
+		LightLock_Unlock(&captureLock);
+		return;
+	}
+
+	if (bufferLengths[current] + recordSize > FS_CAPTURE_BUFFER_SIZE && !fsCaptureSwap())
+	{
+		droppedCount++;
+		LightLock_Unlock(&captureLock);
+		return;
+	}
+
+	u8* dst = buffers[current] + bufferLengths[current];
+	fsCaptureRecord* record = (fsCaptureRecord*) dst;
+	record->op = op;
+	record->pathType = (path ? path->type : PATH_EMPTY);
+	record->pathSize = pathSize;
+	record->archiveId = archiveId;
+	record->handle = handle;
+	record->result = result;
+	record->offset = offset;
+	record->size = size;
+	record->done = done;
+	record->start = (u32) ((start - startTick) * 1000000 / SYSCLOCK_ARM11);
+	record->duration = (ticks > UINT32_MAX ? UINT32_MAX : (u32) ticks);
+
+	if (pathSize > 0) memcpy(dst + sizeof(fsCaptureRecord), path->data, pathSize);
+	memset(dst + sizeof(fsCaptureRecord) + pathSize, 0, recordSize - sizeof(fsCaptureRecord) - pathSize);
+
+	bufferLengths[current] += recordSize;
+	recordCount++;
+
+	LightLock_Unlock(&captureLock);
+}
+
+/**
+ * @brief Frees the capture, after its thread.
+ */
+static void fsCaptureFree(void)
+{
+	if (fileHandle)
+	{
+		FSFILE_Close(fileHandle);
+		fileHandle = 0;
+	}
+
+	if (fullSemaphore)
+	{
+		svcCloseHandle(fullSemaphore);
+		fullSemaphore = 0;
+	}
+
+	if (sdmcArchive)
+	{
+		FS_ReleaseArchive(sdmcArchive);
+		sdmcArchive = NULL;
+	}
+
+	memFree(buffers[0]);
+	buffers[0] = NULL;
+	buffers[1] = NULL;
+}
+
+Result fsCaptureStart(void)
+{
+	static bool isInit = false;
+	if (!isInit)
+	{
+		LightLock_Init(&captureLock);
+		isInit = true;
+	}
+
+	if (fsCaptureEnabled) return 0;
+
+	Result ret;
+
+	buffers[0] = (u8*) memAlloc("fsCaptureStart", FS_CAPTURE_BUFFER_SIZE * 2);
+	if (!buffers[0]) return -2;
+	buffers[1] = buffers[0] + FS_CAPTURE_BUFFER_SIZE;
+
+	ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret))
+	{
+		sdmcArchive = NULL;
+		fsCaptureFree();
+		return ret;
+	}
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	ret = FSUSER_OpenFile(&fileHandle, *sdmcArchive, fsMakePath(PATH_ASCII, FS_CAPTURE_PATH), FS_OPEN_WRITE | FS_OPEN_CREATE, FS_ATTRIBUTE_NONE);
+	r(" > FSUSER_OpenFile: %lx\n", ret);
+	if (R_FAILED(ret))
+	{
+		fileHandle = 0;
+		fsCaptureFree();
+		return ret;
+	}
+
+	u32 bytesWritten = 0;
+	ret = FSFILE_SetSize(fileHandle, 0);
+	if (R_SUCCEEDED(ret)) ret = FSFILE_Write(fileHandle, &bytesWritten, 0, FS_CAPTURE_MAGIC, 8, 0);
+	if (R_FAILED(ret))
+	{
+		fsCaptureFree();
+		return ret;
+	}
+
+	fileOffset = bytesWritten;
+	writeRet = 0;
+	memset(bufferLengths, 0, sizeof(bufferLengths));
+	memset(bufferBusy, 0, sizeof(bufferBusy));
+	current = 0;
+	pending = 0;
+	isStopping = false;
+	recordCount = 0;
+	droppedCount = 0;
+
+	svcCreateSemaphore(&fullSemaphore, 0, 2);
+
+	thread = threadCreate(fsCaptureThread, NULL, FS_CAPTURE_STACK_SIZE, FS_CAPTURE_THREAD_PRIORITY, -2, false);
+	if (!thread)
+	{
+		fsCaptureFree();
+		return -3;
+	}
+
+	startTick = svcGetSystemTick();
+	fsCaptureEnabled = true;
+
+	return 0;
+}
+
+Result fsCaptureStop(void)
+{
+	if (!fsCaptureEnabled) return -1;
+
+	LightLock_Lock(&captureLock);
+	fsCaptureEnabled = false;
+	LightLock_Unlock(&captureLock);
+
+	// The partial buffer, once the thread wrote the previous one.
+	while (true)
+	{
+		LightLock_Lock(&captureLock);
+		bool swapped = (bufferLengths[current] == 0 || fsCaptureSwap());
+		LightLock_Unlock(&captureLock);
+
+		if (swapped) break;
+		svcSleepThread(1000000);
+	}
+
+	while (true)
+	{
+		LightLock_Lock(&captureLock);
+		bool busy = bufferBusy[0] || bufferBusy[1];
+		if (!busy) isStopping = true;
+		LightLock_Unlock(&captureLock);
+
+		if (!busy) break;
+		svcSleepThread(1000000);
+	}
+
+	s32 count;
+	svcReleaseSemaphore(&count, fullSemaphore, 1);
+
+	threadJoin(thread, U64_MAX);
+	threadFree(thread);
+	thread = NULL;
+
+	Result ret = writeRet;
+	if (R_SUCCEEDED(ret)) ret = FSFILE_Flush(fileHandle);
+
+	fsCaptureFree();
+
+	consoleLog("Capture: %lu record(s), %lu dropped, %llu KB\n", recordCount, droppedCount, fileOffset / 1024);
+
+	return ret;
+}
+
+u32 fsCaptureGetCount(u32* dropped)
+{
+	if (dropped) *dropped = droppedCount;
+	return recordCount;
+}
@@ -1,9 +1,15 @@
 #include "fsdir.h"
 #include "fsls.h"
+#include "fstree.h"
+#include "fsindex.h"
+#include "fstune.h"
 #include "fs.h"
+#include "mem.h"
 #include "key.h"
+#include "frame.h"
 #include "utils.h"
 #include "console.h"
+#include "log.h"
 
 #include <3ds/os.h>
 #include <3ds/result.h>
@@ -14,11 +20,15 @@
 #include <string.h>
 #include <time.h>
 
+#include "fsprobe.h"
+
 Result fsStackPush(fsStack* stack, s16 offsetId, s16 selectedId)
 {
 	if (!stack) return -1;
 
-	fsStackNode* last = (fsStackNode*) malloc(sizeof(fsStackNode));
+	fsStackNode* last = (fsStackNode*) memAlloc("fsStackPush", sizeof(fsStackNode));
+	if (!last) return -2;
+
 	last->offsetId = offsetId;
 	last->selectedId = selectedId;
 	last->prev = stack->last;
@@ -35,7 +45,7 @@ Result fsStackPop(fsStack* stack, s16* offsetId, s16* selectedId)
 	if (offsetId) *offsetId = stack->last->offsetId;
 	if (selectedId) *selectedId = stack->last->selectedId;
 	fsStackNode* prev = stack->last->prev;
-	free(stack->last);
+	memFree(stack->last);
 	stack->last = prev;
 
 	return stack->last != NULL;
@@ -48,7 +58,16 @@ static fsDir* currentDir;
 static fsDir* dickDir;
 static u32 entryPrintCount = 20;
 
-void fsDirInit(void)
+/// The archives acquired by fsDirInit (NULL if unavailable).
+static const FS_Archive* sdmcArchive = NULL;
+static const FS_Archive* saveArchive = NULL;
+static const FS_Archive* extdataArchive = NULL;
+
+/// The archive of the save dir and of the backups: the save or the extdata archive.
+static const FS_Archive* dataArchive = NULL;
+static bool useExtdata = false;
+
+void fsDirInit(u64 titleid)
 {
 	memset(&saveDir, 0, sizeof(fsDir));
 	memset(&sdmcDir, 0, sizeof(fsDir));
@@ -60,8 +79,32 @@ void fsDirInit(void)
 	strcpy(saveDir.entry.name, "/");
 	strcpy(sdmcDir.entry.name, "/");
 
-	saveDir.archive = &saveArchive;
-	sdmcDir.archive = &sdmcArchive;
+	Result ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret)) logError("Couldn't open the sdmc archive: %lx\n", ret);
+
+	ret = FS_AcquireArchive(&saveArchiveDesc, &saveArchive);
+	if (R_FAILED(ret)) logError("Couldn't open the save archive: %lx\n", ret);
+
+	// Most of the titles have no extdata.
+	FS_ArchiveDesc extdataDesc;
+	FS_MakeExtdataDesc(&extdataDesc, titleid);
+	FS_AcquireArchive(&extdataDesc, &extdataArchive);
+
+	// Calibrated once, on the first run.
+	if (sdmcArchive) fsTuneArchive(sdmcArchive, false);
+	if (saveArchive) fsTuneArchive(saveArchive, false);
+	if (extdataArchive) fsTuneArchive(extdataArchive, false);
+
+	dataArchive = saveArchive;
+	useExtdata = false;
+
+	saveDir.archive = saveArchive;
+	sdmcDir.archive = sdmcArchive;
+
+#ifdef FS_DEBUG_FIX_ARCHIVE
+	// Browse the sdmc archive instead, the backups still need the save archive.
+	if (!saveArchive) saveDir.archive = sdmcArchive;
+#endif
 
 	fsDirRefreshDir(&saveDir, true);
 	fsDirRefreshDir(&sdmcDir, true);
@@ -75,8 +118,47 @@ void fsDirExit(void)
 	fsFreeDir(&saveDir.entry);
 	fsFreeDir(&sdmcDir.entry);
 
-	while (fsStackPop(&saveDir.entryStack, NULL, NULL) == 0);
-	while (fsStackPop(&sdmcDir.entryStack, NULL, NULL) == 0);
+	while (fsStackPop(&saveDir.entryStack, NULL, NULL) == 1);
+	while (fsStackPop(&sdmcDir.entryStack, NULL, NULL) == 1);
+
+	FS_ReleaseArchive(extdataArchive);
+	FS_ReleaseArchive(saveArchive);
+	FS_ReleaseArchive(sdmcArchive);
+	extdataArchive = NULL;
+	saveArchive = NULL;
+	sdmcArchive = NULL;
+	dataArchive = NULL;
+
+	memDump("fsDirExit");
+}
+
+Result fsDirSwitchData(void)
+{
+	if (!useExtdata && !extdataArchive)
+	{
+		consoleLog("This title has no extdata.\n");
+		return -1;
+	}
+
+	useExtdata = !useExtdata;
+	dataArchive = (useExtdata ? extdataArchive : saveArchive);
+	consoleLog("Switched to %s\n", (useExtdata ? "extdata" : "save"));
+
+	// Back to the root of the new archive.
+	saveDir.entry.name16[0] = '/';
+	saveDir.entry.name16[1] = '\0';
+	strcpy(saveDir.entry.name, "/");
+	while (fsStackPop(&saveDir.entryStack, NULL, NULL) == 1);
+
+	saveDir.archive = dataArchive;
+
+#ifdef FS_DEBUG_FIX_ARCHIVE
+	if (!saveDir.archive) saveDir.archive = sdmcArchive;
+#endif
+
+	fsDirRefreshDir(&saveDir, true);
+
+	return 0;
 }
 
 /**
@@ -89,6 +171,7 @@ static void fsDirPrint(fsDir* dir, const char* data)
 	s32 i = 0;
 	u8 row = 3;
 	fsEntry* next = dir->entry.firstEntry;
+	u64 renderStart = frameRenderBegin();
 
 	// Skip the first off-screen entries
 	for (; next && i < dir->entryOffsetId; i++)
@@ -130,12 +213,14 @@ static void fsDirPrint(fsDir* dir, const char* data)
 		// Iterate through linked list
 		next = next->nextEntry;
 	}
+
+	frameRenderEnd("fsDirPrint", renderStart);
 }
 
 void fsDirPrintSave(void)
 {
 	consoleSelectNew(&saveConsole);
-	fsDirPrint(&saveDir, "Save");
+	fsDirPrint(&saveDir, (useExtdata ? "Extdata" : "Save"));
 	consoleSelectLast();
 }
 
@@ -177,13 +262,13 @@ void fsDirSwitch(fsDir* dir)
 {
 	if ((dir == NULL && currentDir == &sdmcDir) || dir == &saveDir)
 	{
-		consoleLog("Switched to save div\n");
+		logDebug("Switched to save div\n");
 		currentDir = &saveDir;
 		dickDir = &sdmcDir;
 	}
 	else if ((dir == NULL && currentDir == &saveDir) || dir == &sdmcDir)
 	{
-		consoleLog("Switched to sdmc div\n");
+		logDebug("Switched to sdmc div\n");
 		currentDir = &sdmcDir;
 		dickDir = &saveDir;
 	}
@@ -266,6 +351,17 @@ Result fsDirGotoSubDir(void)
 	return ret;
 }
 
+/**
+ * @brief Logs the path of a prompt or of a failure, cut to fit a record.
+ * @param path The path.
+ */
+static void fsLogPath(const u16* path)
+{
+	char path8[FS_MAX_PATH_LENGTH];
+	unicodeToChar(path8, path, FS_MAX_PATH_LENGTH);
+	consoleLog("[path=%.*s]\n", LOG_RECORD_LENGTH - 9, path8);
+}
+
 /**
  * @brief Displays the overwrite warning and wait for any key.
  * @param path The path which causes the warning.
@@ -273,14 +369,10 @@ Result fsDirGotoSubDir(void)
  */
 static bool fsWaitOverwrite(const u16* path)
 {
-	consoleSelect(&logConsole);
-	printf("[path=");
-	for (u16 i = 0; path[i] && i < FS_MAX_PATH_LENGTH; i++)
-		printf("%c", (u8) path[i]);
-	printf("]\n");
-	printf("Overwrite detected!\n");
-	printf("Press [Select] to confirm the overwrite.\n");
-	consoleSelectDefault();
+	fsLogPath(path);
+	consoleLog("Overwrite detected!\n");
+	consoleLog("Press [Select] to confirm the overwrite.\n");
+	logFlush();
 
 	return doKey(KEY_SELECT);
 }
@@ -292,14 +384,10 @@ static bool fsWaitOverwrite(const u16* path)
  */
 static bool fsWaitDelete(const u16* path)
 {
-	consoleSelect(&logConsole);
-	printf("[path=");
-	for (u16 i = 0; path[i] && i < FS_MAX_PATH_LENGTH; i++)
-		printf("%c", (u8) path[i]);
-	printf("]\n");
-	printf("Delete asked!\n");
-	printf("Press [Select] to confirm the delete.\n");
-	consoleSelectDefault();
+	fsLogPath(path);
+	consoleLog("Delete asked!\n");
+	consoleLog("Press [Select] to confirm the delete.\n");
+	logFlush();
 
 	return doKey(KEY_SELECT);
 }
@@ -311,82 +399,153 @@ static bool fsWaitDelete(const u16* path)
  */
 static bool fsWaitOutOfResource(const u16* path)
 {
-	consoleSelect(&logConsole);
-	printf("[path=");
-	for (u16 i = 0; path[i] && i < FS_MAX_PATH_LENGTH; i++)
-		printf("%c", (u8) path[i]);
-	printf("]\n");
-	printf("The file was too big for the archive!\n");
-	printf("Press any key to continue.\n");
-	consoleSelectDefault();
+	fsLogPath(path);
+	logError("The file was too big for the archive!\n");
+	consoleLog("Press any key to continue.\n");
+	logFlush();
 
 	return doKey(KEY_ANY);
 }
 
 /**
- * @brief Copy an entry from a dir to another dir with overwrite option.
- * @param srcEntry The source entry to copy.
+ * @brief Displays the mirror plan and wait for any key.
+ * @return Whether the waited key was pressed.
+ */
+static bool fsWaitMirror(void)
+{
+	consoleLog("Mirror asked!\n");
+	consoleLog("Press [Select] to confirm the mirror.\n");
+	logFlush();
+
+	return doKey(KEY_SELECT);
+}
+
+/// The options and the report of a copy.
+typedef struct fsCopyContext
+{
+	bool overwrite;		///< Whether it shall overwrite the data without asking.
+	bool verify;		///< Whether it shall read back and check the written files.
+	bool diff;			///< Whether it shall only write the changed blocks of the existing files.
+	fsTree* tree;		///< The tree to record the copied entries to (optional).
+	u32 fileCount;		///< The count of the copied files.
+	u32 errorCount;		///< The count of the files which failed to verify.
+	u64 totalSize;		///< The total size in bytes of the copied files.
+	u64 bytesWritten;	///< The count of bytes actually written.
+	u64 copyTime;		///< The time spent copying the files (ms).
+} fsCopyContext;
+
+/**
+ * @brief Displays the verify failure of a file.
+ * @param path The path of the file which failed to verify.
+ */
+static void fsLogVerifyFailed(const u16* path)
+{
+	fsLogPath(path);
+	logError("Verify failed!\n");
+}
+
+/**
+ * @brief Ends a write operation on a dir, committing the save archive once.
+ * The save files are not flushed one by one by default (see FS_GetFlushPolicy), the commit is the boundary.
+ * @param dir The written dir.
+ */
+static Result fsDirCommit(fsDir* dir)
+{
+	if (!saveArchive || dir->archive != saveArchive) return 0;
+
+	Result ret = FS_CommitArchive(saveArchive);
+	if (R_FAILED(ret)) logError("Couldn't commit the save: %lx\n", ret);
+
+	return ret;
+}
+
+/**
+ * @brief Copy an entry from a dir to another dir.
+ * @param srcEntry The source entry to copy, its name is relative to srcDir (empty if it is srcDir itself).
  * @param srcDir The source dir.
  * @param dstDir The destination dir.
- * @param overwrite Whether it shall overwrite the data.
+ * @param ctx The options and the report of the copy.
  */
-static Result fsDirCopy(fsEntry* srcEntry, fsDir* srcDir, fsDir* dstDir, bool overwrite)
+static Result fsDirCopy(fsEntry* srcEntry, fsDir* srcDir, fsDir* dstDir, fsCopyContext* ctx)
 {
 	// TODO: UTF-16
 	u16 len;
 
+	// The path of the entry relative to the dirs.
+	static const u16 rootPath[1] = { '\0' };
+	const u16* relPath = (srcEntry->isRootDirectory ? rootPath : srcEntry->name16);
+
 	if (srcEntry->isDirectory)
 	{
 		if (!srcEntry->isRealDirectory) return 1;
 
 		fsEntry srcPath;
-		// Create another fsEntry for the scan only.
-		srcPath.attributes = srcEntry->attributes;
-		srcPath.isDirectory = srcEntry->isDirectory;
-		srcPath.isRealDirectory = srcEntry->isRealDirectory;
-		srcPath.isRootDirectory = srcEntry->isRootDirectory;
+		memset(&srcPath, 0, sizeof(fsEntry));
 
 		memset(srcPath.name16, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
 		len = str16cpy(srcPath.name16, dstDir->entry.name16);
-		if (!srcPath.isRootDirectory) str16cpy(srcPath.name16 + len, srcEntry->name16);
+		str16cpy(srcPath.name16 + len, relPath);
 
-		if (fsDirExists(srcPath.name16, dstDir->archive) && !overwrite)
+		if (fsDirExists(srcPath.name16, dstDir->archive))
 		{
-			if (!fsWaitOverwrite(srcPath.name16)) return FS_USER_INTERRUPT;
-			consoleLog("Overwrite validated!\n");
+			if (!ctx->overwrite)
+			{
+				if (!fsWaitOverwrite(srcPath.name16)) return FS_USER_INTERRUPT;
+				consoleLog("Overwrite validated!\n");
+			}
 		}
-		else if (!srcPath.isRootDirectory)
+		else
 		{
-			FSUSER_CreateDirectory(*dstDir->archive, fsMakePath(PATH_UTF16, srcPath.name16), FS_ATTRIBUTE_DIRECTORY);
+			Result ret = FSUSER_CreateDirectory(*dstDir->archive, fsMakePath(PATH_UTF16, srcPath.name16), FS_ATTRIBUTE_DIRECTORY);
+			if (R_FAILED(ret)) return ret;
 		}
 
+		// A digest without all the entries would let them be dropped later.
+		if (ctx->tree && relPath[0] && !fsTreeAddDir(ctx->tree, relPath)) return -2;
+
 		memset(srcPath.name16, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
-		if (!srcPath.isRootDirectory) len = str16cpy(srcPath.name16, srcDir->entry.name16); else len = 0;
-		str16cpy(srcPath.name16 + len, srcEntry->name16);
+		len = str16cpy(srcPath.name16, srcDir->entry.name16);
+		str16cpy(srcPath.name16 + len, relPath);
+
+		// Never copy a partial listing (out of memory).
+		Result scanRet = fsScanDir(&srcPath, srcDir->archive, false);
+		if (R_FAILED(scanRet))
+		{
+			fsFreeDir(&srcPath);
+			return scanRet;
+		}
 
-		fsScanDir(&srcPath, srcDir->archive, false);
 		fsEntry* next = srcPath.firstEntry;
 
 		while (next)
 		{
-			srcPath.attributes = next->attributes;
-			srcPath.isDirectory = next->isDirectory;
-			srcPath.isRealDirectory = next->isRealDirectory;
-			srcPath.isRootDirectory = next->isRootDirectory;
-
-			memset(srcPath.name16, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
-			len = str16cpy(srcPath.name16, srcEntry->name16);
-			srcPath.name16[len++] = '/'; srcPath.name16[len] = '\0';
-			str16cpy(srcPath.name16 + len, next->name16);
-
-			fsDirCopy(&srcPath, srcDir, dstDir, overwrite);
+			// Create another fsEntry for the child only.
+			fsEntry childPath;
+			childPath.attributes = next->attributes;
+			childPath.fileSize = next->fileSize;
+			childPath.isDirectory = next->isDirectory;
+			childPath.isRealDirectory = next->isRealDirectory;
+			childPath.isRootDirectory = false;
+
+			memset(childPath.name16, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+			len = str16cpy(childPath.name16, relPath);
+			if (len > 0) childPath.name16[len++] = '/';
+			str16cpy(childPath.name16 + len, next->name16);
+
+			// Stop at the first failure, but verify all the files.
+			Result ret = fsDirCopy(&childPath, srcDir, dstDir, ctx);
+			if (R_FAILED(ret) && ret != FS_VERIFY_FAILED)
+			{
+				fsFreeDir(&srcPath);
+				return ret;
+			}
 
 			next = next->nextEntry;
 		}
 
 		fsFreeDir(&srcPath);
 
-		return 1;
+		return (ctx->errorCount > 0 ? FS_VERIFY_FAILED : 1);
 	}
 	else
 	{
@@ -395,24 +554,57 @@ static Result fsDirCopy(fsEntry* srcEntry, fsDir* srcDir, fsDir* dstDir, bool ov
 
 		memset(srcPath, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
 		len = str16cpy(srcPath, srcDir->entry.name16);
-		str16cpy(srcPath + len, srcEntry->name16);
+		str16cpy(srcPath + len, relPath);
 
 		memset(dstPath, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
 		len = str16cpy(dstPath, dstDir->entry.name16);
-		str16cpy(dstPath + len, srcEntry->name16);
+		str16cpy(dstPath + len, relPath);
 
-		if (fsFileExists(dstPath, dstDir->archive) && !overwrite)
+		bool exists = fsFileExists(dstPath, dstDir->archive);
+
+		if (exists && !ctx->overwrite)
 		{
 			if (!fsWaitOverwrite(dstPath)) return FS_USER_INTERRUPT;
 			consoleLog("Overwrite validated!\n");
 		}
 
-		Result ret = fsCopyFile(srcPath, srcDir->archive, dstPath, dstDir->archive, srcEntry->attributes);
+		u32 srcHash = 0;
+		u64 bytesWritten = srcEntry->fileSize;
+		u64 startTime = osGetTime();
 
-		if (ret == FS_OUT_OF_RESOURCE || ret == FS_OUT_OF_RESOURCE_2)
-		{
-			fsWaitOutOfResource(dstPath);
+		Result ret;
+		if (exists && ctx->diff) ret = fsCopyFileDiff(srcPath, srcDir->archive, dstPath, dstDir->archive, srcEntry->attributes, &srcHash, &bytesWritten);
+		else ret = fsCopyFile(srcPath, srcDir->archive, dstPath, dstDir->archive, srcEntry->attributes, &srcHash);
+
+		ctx->copyTime += osGetTime() - startTime;
+
+		bool outOfResource = (ret == FS_OUT_OF_RESOURCE || ret == FS_OUT_OF_RESOURCE_2);
+		if (outOfResource) fsWaitOutOfResource(dstPath);
+
+		// Never leave a partial file behind (an existing one is kept, unless it didn't fit).
+		if (R_FAILED(ret) && (!exists || outOfResource))
 			FSUSER_DeleteFile(*dstDir->archive, fsMakePath(PATH_UTF16, dstPath));
+
+		if (R_FAILED(ret)) return ret;
+
+		ctx->fileCount++;
+		ctx->totalSize += srcEntry->fileSize;
+		ctx->bytesWritten += bytesWritten;
+		if (ctx->tree && !fsTreeAddFile(ctx->tree, relPath, srcEntry->fileSize, &srcHash)) return -2;
+
+		// Read back the destination only, the source was hashed during the copy.
+		if (ctx->verify)
+		{
+			u64 dstSize = 0;
+			u32 dstHash = 0;
+
+			ret = fsHashFile(dstPath, dstDir->archive, &dstSize, &dstHash);
+			if (R_FAILED(ret) || dstSize != srcEntry->fileSize || dstHash != srcHash)
+			{
+				fsLogVerifyFailed(dstPath);
+				ctx->errorCount++;
+				return FS_VERIFY_FAILED;
+			}
 		}
 
 		return ret;
@@ -421,9 +613,19 @@ static Result fsDirCopy(fsEntry* srcEntry, fsDir* srcDir, fsDir* dstDir, bool ov
 	return 1;
 }
 
-Result fsDirCopyCurrentEntry(bool overwrite)
+Result fsDirCopyCurrentEntry(bool overwrite, bool verify)
 {
-	Result ret = fsDirCopy(currentDir->entrySelected, currentDir, dickDir, overwrite);
+	fsCopyContext ctx;
+	memset(&ctx, 0, sizeof(fsCopyContext));
+	ctx.overwrite = overwrite;
+	ctx.verify = verify;
+	ctx.diff = true;
+
+	Result ret = fsDirCopy(currentDir->entrySelected, currentDir, dickDir, &ctx);
+	fsDirCommit(dickDir);
+	consoleLog("Copied %lu file(s), %llu/%llu bytes written in %llums\n", ctx.fileCount, ctx.bytesWritten, ctx.totalSize, ctx.copyTime);
+	if (verify) consoleLog("Verified %lu file(s), %lu failed\n", ctx.fileCount, ctx.errorCount);
+
 	fsDirRefreshDir(dickDir, true);
 	return ret;
 }
@@ -431,14 +633,208 @@ Result fsDirCopyCurrentEntry(bool overwrite)
 Result fsDirCopyCurrentFolder(bool overwrite)
 {
 	fsEntry entry;
-	memset(entry.name, 0, FS_MAX_PATH_LENGTH);
-	memset(entry.name16, 0, FS_MAX_PATH_LENGTH);
+	memset(&entry, 0, sizeof(fsEntry));
 	entry.attributes = currentDir->entry.attributes;
 	entry.isDirectory = true;
 	entry.isRealDirectory = true;
 	entry.isRootDirectory = false;
 
-	Result ret = fsDirCopy(&entry, currentDir, dickDir, overwrite);
+	fsCopyContext ctx;
+	memset(&ctx, 0, sizeof(fsCopyContext));
+	ctx.overwrite = overwrite;
+	ctx.diff = true;
+
+	Result ret = fsDirCopy(&entry, currentDir, dickDir, &ctx);
+	fsDirCommit(dickDir);
+	consoleLog("Copied %lu file(s), %llu/%llu bytes written in %llums\n", ctx.fileCount, ctx.bytesWritten, ctx.totalSize, ctx.copyTime);
+	fsDirRefreshDir(dickDir, true);
+	return ret;
+}
+
+/**
+ * @brief Appends a copy of a listed entry to a plan.
+ * @param[in/out] tree The plan.
+ * @param[in] node The entry, a file or a directory.
+ * @return False if out of memory.
+ */
+static bool fsDirPlanAdd(fsTree* tree, const fsTreeNode* node)
+{
+	if (node->isDirectory) return fsTreeAddDir(tree, node->path) != NULL;
+	return fsTreeAddFile(tree, node->path, node->size, NULL) != NULL;
+}
+
+Result fsDirMirrorCurrentFolder(bool deleteExtra)
+{
+	Result ret;
+	u64 startTime = osGetTime();
+
+	const u16* srcRoot = currentDir->entry.name16;
+	const u16* dstRoot = dickDir->entry.name16;
+	u16 srcPath[FS_MAX_PATH_LENGTH];
+	u16 dstPath[FS_MAX_PATH_LENGTH];
+
+	fsTree srcTree;		// The source listing.
+	fsTree dstTree;		// The destination listing.
+	fsTree copyTree;	// The new and the changed entries.
+	fsTree deleteTree;	// The extra entries of the destination.
+	fsTree skipTree;	// The entries which conflict with the kept extras.
+	memset(&srcTree, 0, sizeof(fsTree));
+	memset(&dstTree, 0, sizeof(fsTree));
+	memset(&copyTree, 0, sizeof(fsTree));
+	memset(&deleteTree, 0, sizeof(fsTree));
+	memset(&skipTree, 0, sizeof(fsTree));
+
+	u32 newCount = 0;
+	u32 changedCount = 0;
+	u32 unchangedCount = 0;
+
+	ret = fsTreeScan(&srcTree, srcRoot, currentDir->archive, false);
+	if (R_SUCCEEDED(ret)) ret = fsTreeScan(&dstTree, dstRoot, dickDir->archive, false);
+
+	fsTreeSort(&srcTree);
+	fsTreeSort(&dstTree);
+
+	// Merge the sorted listings.
+	fsTreeNode* srcNode = srcTree.firstNode;
+	fsTreeNode* dstNode = dstTree.firstNode;
+
+	while (R_SUCCEEDED(ret) && (srcNode || dstNode))
+	{
+		s32 cmp = (!srcNode ? 1 : (!dstNode ? -1 : str16cmp(srcNode->path, dstNode->path)));
+
+		if (cmp < 0)
+		{
+			// Only in the source.
+			if (!fsDirPlanAdd(&copyTree, srcNode)) ret = -2;
+			if (!srcNode->isDirectory) newCount++;
+			srcNode = srcNode->nextNode;
+			continue;
+		}
+
+		if (cmp > 0)
+		{
+			// Only in the destination.
+			if (!fsDirPlanAdd(&deleteTree, dstNode)) ret = -2;
+			dstNode = dstNode->nextNode;
+			continue;
+		}
+
+		if (srcNode->isDirectory != dstNode->isDirectory && !deleteExtra)
+		{
+			// A file replaced by a directory (or the opposite) needs the extra to be deleted.
+			if (!fsTreeAddDir(&skipTree, srcNode->path)) ret = -2;
+		}
+		else if (srcNode->isDirectory != dstNode->isDirectory)
+		{
+			// A file replaced by a directory (or the opposite) is an extra and a new entry.
+			if (!fsDirPlanAdd(&deleteTree, dstNode) || !fsDirPlanAdd(&copyTree, srcNode)) ret = -2;
+			if (!srcNode->isDirectory) changedCount++;
+		}
+		else if (!srcNode->isDirectory)
+		{
+			bool changed = (srcNode->size != dstNode->size);
+
+			// Same size, compare the hashes.
+			if (!changed)
+			{
+				fsTreeMakePath(srcPath, srcRoot, srcNode->path);
+				ret = fsHashFile(srcPath, currentDir->archive, NULL, &srcNode->hash);
+
+				if (R_SUCCEEDED(ret))
+				{
+					fsTreeMakePath(dstPath, dstRoot, dstNode->path);
+					ret = fsHashFile(dstPath, dickDir->archive, NULL, &dstNode->hash);
+				}
+
+				changed = (srcNode->hash != dstNode->hash);
+			}
+
+			if (changed)
+			{
+				if (!fsTreeAddFile(&copyTree, srcNode->path, srcNode->size, NULL)) ret = -2;
+				changedCount++;
+			}
+			else
+			{
+				unchangedCount++;
+			}
+		}
+
+		srcNode = srcNode->nextNode;
+		dstNode = dstNode->nextNode;
+	}
+
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't compare the folders: %lx\n", ret);
+	}
+	else
+	{
+		u32 extraCount = deleteTree.fileCount + deleteTree.dirCount;
+
+		// Dry-run summary.
+		consoleLog("Mirror: %lu new, %lu changed, %lu unchanged\n", newCount, changedCount, unchangedCount);
+		consoleLog("  %lu extra %s, %llu bytes to write\n", extraCount, (deleteExtra ? "to delete" : "kept"), copyTree.totalSize);
+		if (skipTree.dirCount > 0) consoleLog("  %lu conflict(s) skipped\n", skipTree.dirCount);
+
+		if (copyTree.firstNode == NULL && (!deleteExtra || extraCount == 0))
+		{
+			consoleLog("Already in sync!\n");
+		}
+		else if (!fsWaitMirror())
+		{
+			ret = FS_USER_INTERRUPT;
+		}
+		else
+		{
+			u64 bytesWritten = 0;
+
+			if (deleteExtra) ret = fsTreeRemove(&deleteTree, dstRoot, dickDir->archive);
+
+			for (fsTreeNode* node = copyTree.firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+			{
+				// Skip the entries which conflict with the kept extras, and their children.
+				bool skip = false;
+				for (fsTreeNode* skipNode = skipTree.firstNode; skipNode && !skip; skipNode = skipNode->nextNode)
+				{
+					u16 len = str16len(skipNode->path);
+					skip = (str16ncmp(node->path, skipNode->path, len) == 0 && (node->path[len] == '\0' || node->path[len] == '/'));
+				}
+				if (skip) continue;
+
+				fsTreeMakePath(dstPath, dstRoot, node->path);
+
+				if (node->isDirectory)
+				{
+					ret = FSUSER_CreateDirectory(*dickDir->archive, fsMakePath(PATH_UTF16, dstPath), FS_ATTRIBUTE_DIRECTORY);
+					continue;
+				}
+
+				u64 written = 0;
+				fsTreeMakePath(srcPath, srcRoot, node->path);
+				ret = fsCopyFileDiff(srcPath, currentDir->archive, dstPath, dickDir->archive, FS_ATTRIBUTE_NONE, NULL, &written);
+				bytesWritten += written;
+
+				if (ret == FS_OUT_OF_RESOURCE || ret == FS_OUT_OF_RESOURCE_2)
+				{
+					fsWaitOutOfResource(dstPath);
+					FSUSER_DeleteFile(*dickDir->archive, fsMakePath(PATH_UTF16, dstPath));
+				}
+			}
+
+			fsDirCommit(dickDir);
+
+			if (R_FAILED(ret)) logError("Couldn't mirror the folder: %lx\n", ret);
+			consoleLog("Mirror: %llu bytes written in %llums\n", bytesWritten, osGetTime() - startTime);
+		}
+	}
+
+	fsTreeFree(&srcTree);
+	fsTreeFree(&dstTree);
+	fsTreeFree(&copyTree);
+	fsTreeFree(&deleteTree);
+	fsTreeFree(&skipTree);
+
 	fsDirRefreshDir(dickDir, true);
 	return ret;
 }
@@ -461,6 +857,7 @@ Result fsDirDeleteCurrentEntry(void)
 			consoleLog("Delete validated!\n");
 
 			ret = FSUSER_DeleteDirectoryRecursively(*currentDir->archive, fsMakePath(PATH_UTF16, path));
+			fsDirCommit(currentDir);
 
 			fsDirRefreshDir(currentDir, true);
 		}
@@ -471,6 +868,7 @@ Result fsDirDeleteCurrentEntry(void)
 		consoleLog("Delete validated!\n");
 
 		ret = FSUSER_DeleteFile(*currentDir->archive, fsMakePath(PATH_UTF16, path));
+		fsDirCommit(currentDir);
 
 		fsDirRefreshDir(currentDir, true);
 	}
@@ -480,29 +878,233 @@ Result fsDirDeleteCurrentEntry(void)
 
 fsDir backDir;
 
+/**
+ * @brief Makes the path of the digest file of a backup.
+ * @param[out] dst The path of the digest file.
+ * @param[in] name The name of the backup (with or without the trailing '/').
+ */
+static void fsBackDigestPath(u16* dst, const u16* name)
+{
+	u16 len;
+	memset(dst, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	len = str16cpy(dst, backDir.entry.name16);
+	len += str16cpy(dst + len, name);
+	if (len > 0 && dst[len-1] == '/') len--;
+	dst[len++] = '.';
+	dst[len++] = 's';
+	dst[len++] = 'u';
+	dst[len++] = 'm';
+	dst[len] = '\0';
+}
+
+/// The manifests of the backups of the title (see fsBackLoadIndex).
+static fsIndex backIndex;
+
+/**
+ * @brief Makes the path of the index file of the backups.
+ * @param[out] dst The path of the index file.
+ */
+static void fsBackIndexPath(u16* dst)
+{
+	u16 len;
+	memset(dst, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	len = str16cpy(dst, backDir.entry.name16);
+	dst[len++] = 'i';
+	dst[len++] = 'n';
+	dst[len++] = 'd';
+	dst[len++] = 'e';
+	dst[len++] = 'x';
+	dst[len] = '\0';
+}
+
+/**
+ * @brief Writes the index file of the backups.
+ */
+static Result fsBackWriteIndex(void)
+{
+	u16 path[FS_MAX_PATH_LENGTH];
+	fsBackIndexPath(path);
+
+	Result ret = fsIndexWrite(&backIndex, path, backDir.archive);
+	if (R_FAILED(ret)) logError("Couldn't write the backup index: %lx\n", ret);
+
+	return ret;
+}
+
+/**
+ * @brief Drops the digests of an overwritten backup, which no longer matches them.
+ * @param[in] name The name of the backup.
+ */
+static void fsBackDropDigests(const u16* name)
+{
+	u16 path[FS_MAX_PATH_LENGTH];
+	fsBackDigestPath(path, name);
+	FSUSER_DeleteFile(*backDir.archive, fsMakePath(PATH_UTF16, path));
+
+	fsManifest* manifest = fsIndexFind(&backIndex, name);
+	if (manifest && manifest->isDigested)
+	{
+		manifest->isDigested = false;
+		fsBackWriteIndex();
+	}
+}
+
+/**
+ * @brief Fills the entries of the backup dir from the index, without scanning.
+ */
+static void fsBackRefresh(void)
+{
+	fsFreeDir(&backDir.entry);
+
+	fsEntry* lastEntry = NULL;
+
+	for (u32 i = 0; i < backIndex.count; i++)
+	{
+		fsEntry* entry = (fsEntry*) memAlloc("fsBackRefresh", sizeof(fsEntry));
+		if (!entry) break;
+
+		memset(entry, 0, sizeof(fsEntry));
+
+		str16ncpy(entry->name16, backIndex.manifests[i].name16, FS_MAX_FPATH_LENGTH);
+
+		// TODO: Remove when native UTF-16 font.
+		unicodeToChar(entry->name, entry->name16, FS_MAX_FPATH_LENGTH);
+
+		entry->attributes = FS_ATTRIBUTE_DIRECTORY;
+		entry->fileSize = backIndex.manifests[i].totalSize;
+		entry->isDirectory = true;
+		entry->isRealDirectory = true;
+		entry->isRootDirectory = false;
+
+		if (lastEntry) lastEntry->nextEntry = entry;
+		else backDir.entry.firstEntry = entry;
+		lastEntry = entry;
+
+		backDir.entry.entryCount++;
+	}
+
+	backDir.entryOffsetId = 0;
+	backDir.entrySelectedId = 0;
+	backDir.entrySelected = NULL;
+}
+
+/**
+ * @brief Rebuilds the index of the backups from the backup dir.
+ * The manifests are read from the digest files, the backups without one are scanned.
+ */
+static void fsBackRebuildIndex(void)
+{
+	fsIndexFree(&backIndex);
+
+	u16 path[FS_MAX_PATH_LENGTH];
+
+	fsScanDir(&backDir.entry, backDir.archive, false);
+
+	for (fsEntry* entry = backDir.entry.firstEntry; entry; entry = entry->nextEntry)
+	{
+		// Skip the digest and the index files stored next to the backups.
+		if (!entry->isDirectory) continue;
+
+		fsManifest manifest;
+		memset(&manifest, 0, sizeof(fsManifest));
+		str16ncpy(manifest.name16, entry->name16, FS_MAX_FPATH_LENGTH);
+
+		fsBackDigestPath(path, entry->name16);
+
+		if (R_FAILED(fsManifestRead(&manifest, path, backDir.archive)))
+		{
+			// An older backup, without manifest.
+			u16 len;
+			memset(path, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+			len = str16cpy(path, backDir.entry.name16);
+			len += str16cpy(path + len, entry->name16);
+			path[len++] = '/';
+
+			fsTree tree;
+			memset(&tree, 0, sizeof(fsTree));
+
+			if (R_SUCCEEDED(fsTreeScan(&tree, path, backDir.archive, false)))
+				fsManifestFromTree(&manifest, &tree, false);
+
+			fsTreeFree(&tree);
+		}
+
+		fsIndexAdd(&backIndex, &manifest);
+	}
+
+	fsFreeDir(&backDir.entry);
+
+	consoleLog("Rebuilt the backup index (%lu)\n", backIndex.count);
+	fsBackWriteIndex();
+}
+
+/**
+ * @brief Loads the index of the backups, rebuilding it if missing.
+ */
+static void fsBackLoadIndex(void)
+{
+	u16 path[FS_MAX_PATH_LENGTH];
+	fsBackIndexPath(path);
+
+	fsIndexFree(&backIndex);
+
+	if (R_FAILED(fsIndexRead(&backIndex, path, backDir.archive)))
+		fsBackRebuildIndex();
+
+	fsBackRefresh();
+}
+
+/**
+ * @brief Checks that the selected backup still exists, rebuilding the stale index if not.
+ * @return Whether the selected backup exists.
+ */
+static bool fsBackCheckSelected(void)
+{
+	if (!backDir.entrySelected) return false;
+
+	u16 len;
+	u16 path[FS_MAX_PATH_LENGTH];
+	memset(path, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	len = str16cpy(path, backDir.entry.name16);
+	str16cpy(path + len, backDir.entrySelected->name16);
+
+	if (fsDirExists(path, backDir.archive)) return true;
+
+	consoleLog("The backup is missing, the index is stale.\n");
+	fsBackRebuildIndex();
+	fsBackRefresh();
+
+	return false;
+}
+
 void fsBackInit(u64 titleid)
 {
 	memset(&backDir, 0, sizeof(fsDir));
 	
-	sprintf(backDir.entry.name, "/backup/%016llx/", titleid);
+	// The backups of the extdata are kept apart from the ones of the save.
+	sprintf(backDir.entry.name, (useExtdata ? "/backup/extdata/%016llx/" : "/backup/%016llx/"), titleid);
 
 	// TODO: UTF-16
 	utf8_to_utf16(backDir.entry.name16, (u8*) backDir.entry.name, strlen(backDir.entry.name));
 
-	backDir.archive = &sdmcArchive;
+	backDir.archive = sdmcArchive;
 
 	FS_CreateDirectory("/backup/", backDir.archive);
+	if (useExtdata) FS_CreateDirectory("/backup/extdata/", backDir.archive);
 	FSUSER_CreateDirectory(*backDir.archive, fsMakePath(PATH_UTF16, backDir.entry.name16), FS_ATTRIBUTE_DIRECTORY);
 
-	fsDirRefreshDir(&backDir, false);
-	fsDirRefreshDir(&sdmcDir, false);
+	fsBackLoadIndex();
+	fsDirRefreshDir(&sdmcDir, true);
 }
 
 void fsBackExit(void)
 {
 	fsFreeDir(&backDir.entry);
+	fsIndexFree(&backIndex);
+
+	while (fsStackPop(&backDir.entryStack, NULL, NULL) == 1);
 
-	while (fsStackPop(&backDir.entryStack, NULL, NULL) == 0);
+	memDump("fsBackExit");
 }
 
 /**
@@ -515,6 +1117,7 @@ static void fsBackPrint(fsDir* dir, const char* data)
 	s32 i = 0;
 	u8 row = 3;
 	fsEntry* next = dir->entry.firstEntry;
+	u64 renderStart = frameRenderBegin();
 
 	// Skip the first off-screen entries
 	for (; next && i < dir->entryOffsetId; i++)
@@ -556,6 +1159,8 @@ static void fsBackPrint(fsDir* dir, const char* data)
 		// Iterate though linked list
 		next = next->nextEntry;
 	}
+
+	frameRenderEnd("fsBackPrint", renderStart);
 }
 
 void fsBackPrintSave(void)
@@ -569,7 +1174,7 @@ void fsBackPrintSave(void)
 	// TODO: Remove when native UTF-16 font.
 	strcpy(saveDir.entry.name, "/");
 
-	saveDir.archive = &saveArchive;
+	saveDir.archive = dataArchive;
 	saveDir.entryOffsetId = 0;
 	saveDir.entrySelectedId = -1;
 	saveDir.entry.isDirectory = true;
@@ -579,7 +1184,7 @@ void fsBackPrintSave(void)
 	fsScanDir(&saveDir.entry, saveDir.archive, false);
 
 	consoleSelectNew(&saveConsole);
-	fsBackPrint(&saveDir, "Save");
+	fsBackPrint(&saveDir, (useExtdata ? "Extdata" : "Save"));
 	consoleSelectLast();
 
 	fsFreeDir(&saveDir.entry);
@@ -589,6 +1194,23 @@ void fsBackPrintBackup(void)
 {
 	consoleSelectNew(&sdmcConsole);
 	fsBackPrint(&backDir, "Backup");
+
+	// The manifest of the selected backup, from the index.
+	fsManifest* manifest = (backDir.entrySelected ? fsIndexFind(&backIndex, backDir.entrySelected->name16) : NULL);
+	if (manifest)
+	{
+		consoleForegroundColor(GRAY);
+		printf("\x1B[2;0H%lu file(s), %llu KB", manifest->fileCount, (manifest->totalSize + 1023) / 1024);
+		consoleResetColor();
+
+		if (manifest->isVerifyFailed)
+		{
+			consoleForegroundColor(RED);
+			printf(", verify failed");
+			consoleResetColor();
+		}
+	}
+
 	consoleSelectLast();
 }
 
@@ -621,29 +1243,23 @@ void fsBackMove(s16 count)
 	}
 }
 
-Result fsBackExport(void)
+/// The root dir of the save archive.
+static const u16 saveRoot[2] = { '/', '\0' };
+
+Result fsBackExport(bool verify, bool force)
 {
 	// (save->sdmc)
-	// TODO: Create the new entry backup.
-	// TODO: Copy the whole save archive content to the new entry.
+	if (!dataArchive || !sdmcArchive) return -1;
 
 	Result ret;
 
 	// The current time for the backup name.
 	time_t t_time = time(NULL);
-	struct tm* tm_time = gmtime(&t_time);
 
 	// The backup folder name.
 	char path8[FS_MAX_PATH_LENGTH];
 	memset(path8, 0, FS_MAX_PATH_LENGTH);
-	sprintf(path8, "%04u-%02u-%02u--%02u-%02u-%02u/",
-		tm_time->tm_year+1900,
-		tm_time->tm_mon+1,
-		tm_time->tm_yday,
-		tm_time->tm_hour,
-		tm_time->tm_min+tm_time->tm_sec/60,
-		tm_time->tm_sec%60
-	);
+	fsManifestName(path8, t_time);
 
 	// TODO: UTF-16
 	u16 path[FS_MAX_PATH_LENGTH];
@@ -653,7 +1269,7 @@ Result fsBackExport(void)
 	// The root dir of the save archive.
 	fsDir saveDir;
 	memset(&saveDir, 0, sizeof(fsDir));
-	saveDir.archive = &saveArchive;
+	saveDir.archive = dataArchive;
 	saveDir.entry.isDirectory = true;
 	saveDir.entry.isRealDirectory = true;
 	saveDir.entry.isRootDirectory = true;
@@ -664,72 +1280,522 @@ Result fsBackExport(void)
 	// TODO: Remove when native UTF-16 font.
 	strcpy(saveDir.entry.name, "/");
 
-	// Create the backup directory.
-	ret = FSUSER_CreateDirectory(sdmcArchive, fsMakePath(PATH_UTF16, backDir.entry.name16), FS_ATTRIBUTE_DIRECTORY);
+	// The full path of the backup, only removed on failure if it is a new one.
+	u16 backupPath[FS_MAX_PATH_LENGTH];
+	memset(backupPath, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	str16cpy(backupPath + str16cpy(backupPath, backDir.entry.name16), path);
+	bool backupExists = fsDirExists(backupPath, backDir.archive);
 
 	// Go to the backup directory.
 	fsFreeDir(&backDir.entry);
 	fsGotoSubDir(&backDir.entry, path);
 
-	// Copy the current save directory to the sdmc archive
-	ret = fsDirCopy(&saveDir.entry, &saveDir, &backDir, true);
+	// The digests of the save, computed while copying.
+	fsTree tree;
+	memset(&tree, 0, sizeof(fsTree));
+
+	fsCopyContext ctx;
+	memset(&ctx, 0, sizeof(fsCopyContext));
+	ctx.overwrite = true;
+	ctx.verify = verify;
+	ctx.tree = &tree;
+
+	// Copy the current save directory to the sdmc archive (creates the backup directory).
+	ret = fsDirCopy(&saveDir.entry, &saveDir, &backDir, &ctx);
+	if (verify) consoleLog("Verified %lu file(s), %lu failed\n", ctx.fileCount, ctx.errorCount);
 
 	// Reset the current directory to default.
 	fsGotoParentDir(&backDir.entry);
-	fsScanDir(&backDir.entry, backDir.archive, false);
+
+	// Store the manifest and the digests next to the backup, for a later verify.
+	u16 digestPath[FS_MAX_PATH_LENGTH];
+	fsBackDigestPath(digestPath, path);
+
+	// Never keep nor index a partial backup, the previous ones are untouched.
+	if (R_FAILED(ret) && ret != FS_VERIFY_FAILED)
+	{
+		logError("Couldn't export the save: %lx\n", ret);
+
+		if (!backupExists)
+		{
+			Result deleteRet = FSUSER_DeleteDirectoryRecursively(*backDir.archive, fsMakePath(PATH_UTF16, backupPath));
+			if (R_SUCCEEDED(deleteRet)) consoleLog("The partial backup was removed.\n");
+			else logError("Couldn't remove the partial backup: %lx\n", deleteRet);
+		}
+		else
+		{
+			fsBackDropDigests(path);
+		}
+
+		fsTreeFree(&tree);
+		fsBackRefresh();
+		return ret;
+	}
+
+	// The manifest of the backup, for the index.
+	fsManifest manifest;
+	memset(&manifest, 0, sizeof(fsManifest));
+	str16ncpy(manifest.name16, path, str16len(path));
+	manifest.created = t_time;
+	fsManifestFromTree(&manifest, &tree, true);
+	manifest.isVerifyFailed = (ret == FS_VERIFY_FAILED);
+	consoleLog("Fingerprint: %08lx\n", manifest.digest);
+
+	// Remove the new backup if the save didn't change since the latest one (unless it is corrupted).
+	// The fingerprint is the digest of the copy, the save is read once.
+	fsManifest* latest = fsIndexLatest(&backIndex);
+	if (!force && R_SUCCEEDED(ret) && !backupExists && latest && latest->isDigested && !latest->isVerifyFailed && latest->digest == manifest.digest)
+	{
+		char name8[FS_MAX_FPATH_LENGTH];
+		unicodeToChar(name8, latest->name16, FS_MAX_FPATH_LENGTH);
+		consoleLog("The save didn't change since %s.\n", name8);
+
+		Result deleteRet = FSUSER_DeleteDirectoryRecursively(*backDir.archive, fsMakePath(PATH_UTF16, backupPath));
+		if (R_FAILED(deleteRet)) logError("Couldn't remove the new backup: %lx\n", deleteRet);
+		consoleLog("Export skipped, [Select]+[Y] to force it.\n");
+
+		fsTreeFree(&tree);
+		fsBackRefresh();
+		return FS_SAVE_UNCHANGED;
+	}
+
+	char header[FS_INDEX_LINE_LENGTH];
+	fsManifestFormat(&manifest, header);
+
+	Result digestRet = fsTreeWrite(&tree, header, digestPath, backDir.archive);
+	if (R_FAILED(digestRet)) logError("Couldn't write the digests: %lx\n", digestRet);
+
+	fsTreeFree(&tree);
+
+	// A backup is indexed with its digests only, an overwritten one without them keeps its entry undigested.
+	Result indexRet = digestRet;
+	if (R_SUCCEEDED(digestRet))
+	{
+		fsIndexAdd(&backIndex, &manifest);
+		indexRet = fsBackWriteIndex();
+	}
+	else if (backupExists)
+	{
+		fsBackDropDigests(path);
+	}
+
+	// Without its digests or its index entry, the new backup is removed as a failed one.
+	if (R_FAILED(indexRet) && !backupExists)
+	{
+		Result deleteRet = FSUSER_DeleteDirectoryRecursively(*backDir.archive, fsMakePath(PATH_UTF16, backupPath));
+		FSUSER_DeleteFile(*backDir.archive, fsMakePath(PATH_UTF16, digestPath));
+		if (R_SUCCEEDED(deleteRet)) consoleLog("The new backup was removed.\n");
+		else logError("Couldn't remove the new backup: %lx\n", deleteRet);
+
+		// The index file may be half written: rewritten without the backup, else rebuilt on the next load.
+		if (R_SUCCEEDED(digestRet))
+		{
+			fsIndexRemove(&backIndex, manifest.name16);
+			if (R_FAILED(fsBackWriteIndex()))
+			{
+				u16 indexPath[FS_MAX_PATH_LENGTH];
+				fsBackIndexPath(indexPath);
+				FSUSER_DeleteFile(*backDir.archive, fsMakePath(PATH_UTF16, indexPath));
+			}
+		}
+	}
+
+	fsBackRefresh();
+
+	if (R_FAILED(digestRet)) return digestRet;
+	if (R_FAILED(indexRet)) return indexRet;
 
 	return ret;
 }
 
-Result fsBackImport(void)
+/**
+ * @brief Rewrites the whole save archive with a backup.
+ * @param backupTree The plan of the backup to import.
+ * @param backupRoot The root dir of the backup.
+ */
+static Result fsBackImportFull(fsTree* backupTree, const u16* backupRoot)
 {
-	// (sdmc->save)
-	// TODO: Delete the whole save archive content.
-	// TODO: Copy the selected entry content to the save archive.
+	Result ret;
+	u64 startTime = osGetTime();
+
+	fsTree saveTree;
+	memset(&saveTree, 0, sizeof(fsTree));
+
+	// Stage the whole backup in memory, checking its sizes and digests.
+	ret = fsTreeLoad(backupTree, backupRoot, backDir.archive);
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't stage the backup: %lx\n", ret);
+		consoleLog("The save was not modified.\n");
+		return ret;
+	}
+
+	// Stage the current save too, to restore it if the import fails.
+	ret = fsTreeScan(&saveTree, saveRoot, dataArchive, false);
+	if (R_SUCCEEDED(ret)) ret = fsTreeLoad(&saveTree, saveRoot, dataArchive);
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't stage the save: %lx\n", ret);
+		consoleLog("The save was not modified.\n");
+		fsTreeFree(&saveTree);
+		return ret;
+	}
+
+	u64 stageTime = osGetTime();
+
+	// Write the save archive content in one pass.
+	ret = FSUSER_DeleteDirectoryRecursively(*dataArchive, fsMakePath(PATH_UTF16, saveRoot));
+	if (R_SUCCEEDED(ret)) ret = fsTreeStore(backupTree, saveRoot, dataArchive);
 
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't write the save: %lx\n", ret);
+
+		// Restore the previous save archive content.
+		Result restoreRet = FSUSER_DeleteDirectoryRecursively(*dataArchive, fsMakePath(PATH_UTF16, saveRoot));
+		if (R_SUCCEEDED(restoreRet)) restoreRet = fsTreeStore(&saveTree, saveRoot, dataArchive);
+
+		if (R_SUCCEEDED(restoreRet)) consoleLog("The previous save was restored.\n");
+		else logError("Couldn't restore the save: %lx\n", restoreRet);
+	}
+
+	u64 writeTime = osGetTime();
+
+	// Commit once, whatever content is now in the save archive.
+	Result commitRet = FS_CommitArchive(dataArchive);
+	if (R_SUCCEEDED(ret)) ret = commitRet;
+
+	u64 endTime = osGetTime();
+
+	consoleLog("Import: %lu file(s), %llu bytes\n", backupTree->fileCount, backupTree->totalSize);
+	consoleLog("  stage %llums, write %llums, commit %llums\n", stageTime - startTime, writeTime - stageTime, endTime - writeTime);
+
+	fsTreeFree(&saveTree);
+
+	return ret;
+}
+
+/**
+ * @brief Rewrites the files of the save archive which differ from a backup.
+ * The files are compared by size first, then by hash.
+ * @param backupTree The plan of the backup to import.
+ * @param backupRoot The root dir of the backup.
+ */
+static Result fsBackImportMinimal(fsTree* backupTree, const u16* backupRoot)
+{
 	Result ret;
+	u64 startTime = osGetTime();
 
-	// The root dir of the save archive.
-	fsDir saveDir;
-	memset(&saveDir, 0, sizeof(fsDir));
-	saveDir.archive = &saveArchive;
-	saveDir.entry.isDirectory = true;
-	saveDir.entry.isRealDirectory = true;
-	saveDir.entry.isRootDirectory = false;
+	u16 path[FS_MAX_PATH_LENGTH];
 
-	saveDir.entry.name16[0] = '/';
-	saveDir.entry.name16[1] = '\0';
+	fsTree saveTree;	// The current save.
+	fsTree writeTree;	// The entries to write from the backup.
+	fsTree createTree;	// The entries which don't exist in the save yet.
+	fsTree deleteTree;	// The extra entries of the save.
+	fsTree undoTree;	// The entries of the save to restore on failure.
+	memset(&saveTree, 0, sizeof(fsTree));
+	memset(&writeTree, 0, sizeof(fsTree));
+	memset(&createTree, 0, sizeof(fsTree));
+	memset(&deleteTree, 0, sizeof(fsTree));
+	memset(&undoTree, 0, sizeof(fsTree));
 
-	// TODO: Remove when native UTF-16 font.
-	strcpy(saveDir.entry.name, "/");
+	u32 unchangedCount = 0;
 
-	// Delete the save archive content.
-	ret = FSUSER_DeleteDirectoryRecursively(*saveDir.archive, fsMakePath(PATH_UTF16, saveDir.entry.name16));
+	ret = fsTreeScan(&saveTree, saveRoot, dataArchive, false);
 
-	// Go to the backup directory.
-	fsFreeDir(&backDir.entry);
-	fsGotoSubDir(&backDir.entry, backDir.entrySelected->name16);
+	// Sorted, each tree is walked once against the other.
+	fsTreeSort(&saveTree);
+	fsTreeSort(backupTree);
 
-	// The fake entry to copy the current directory to.
-	fsEntry entry;
-	memset(entry.name, 0, FS_MAX_PATH_LENGTH);
-	entry.attributes = backDir.entry.attributes;
-	entry.isDirectory = true; // backDir.entry.isDirectory
-	entry.isRealDirectory = true; // backDir.entry.isRealDirectory
-	entry.isRootDirectory = false; // backDir.entry.isRootDirectory
+	// Plan the writes: the missing and the different entries of the backup.
+	fsTreeNode* saveCursor = saveTree.firstNode;
+	for (fsTreeNode* node = backupTree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeNode* saveNode = fsTreeSeek(&saveCursor, node->path);
+		bool exists = (saveNode && saveNode->isDirectory == node->isDirectory);
 
-	// Copy the current directory content to the save archive.
-	ret = fsDirCopy(&entry, &backDir, &saveDir, true);
+		if (node->isDirectory)
+		{
+			if (!exists && (!fsTreeAddDir(&writeTree, node->path) || !fsTreeAddDir(&createTree, node->path)))
+				ret = -2;
+			continue;
+		}
 
-	// Reset the current directory to default.
-	fsGotoParentDir(&backDir.entry);
-	fsScanDir(&backDir.entry, backDir.archive, false);
+		if (exists && saveNode->size == node->size)
+		{
+			// Same size, compare the hashes (the backup one is often in the digests).
+			if (!node->isHashed)
+			{
+				memset(path, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+				str16cpy(path + str16cpy(path, backupRoot), node->path);
+				ret = fsHashFile(path, backDir.archive, NULL, &node->hash);
+				node->isHashed = R_SUCCEEDED(ret);
+			}
+
+			if (R_SUCCEEDED(ret))
+			{
+				memset(path, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+				str16cpy(path + str16cpy(path, saveRoot), saveNode->path);
+				ret = fsHashFile(path, dataArchive, NULL, &saveNode->hash);
+				saveNode->isHashed = R_SUCCEEDED(ret);
+			}
+
+			if (R_SUCCEEDED(ret) && saveNode->hash == node->hash)
+			{
+				unchangedCount++;
+				continue;
+			}
+		}
+
+		if (!fsTreeAddFile(&writeTree, node->path, node->size, node->isHashed ? &node->hash : NULL))
+			ret = -2;
+		else if (exists && !fsTreeAddFile(&undoTree, saveNode->path, saveNode->size, NULL))
+			ret = -2;
+		else if (!exists && !fsTreeAddFile(&createTree, node->path, node->size, NULL))
+			ret = -2;
+	}
+
+	// Plan the deletes: the extra entries of the save.
+	fsTreeNode* backupCursor = backupTree->firstNode;
+	for (fsTreeNode* node = saveTree.firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeNode* backupNode = fsTreeSeek(&backupCursor, node->path);
+		if (backupNode && backupNode->isDirectory == node->isDirectory) continue;
+
+		if (node->isDirectory)
+		{
+			if (!fsTreeAddDir(&deleteTree, node->path) || !fsTreeAddDir(&undoTree, node->path))
+				ret = -2;
+		}
+		else
+		{
+			if (!fsTreeAddFile(&deleteTree, node->path, node->size, NULL) || !fsTreeAddFile(&undoTree, node->path, node->size, NULL))
+				ret = -2;
+		}
+	}
+
+	// Stage the entries to write and the entries to restore on failure.
+	if (R_SUCCEEDED(ret)) ret = fsTreeLoad(&writeTree, backupRoot, backDir.archive);
+	if (R_SUCCEEDED(ret)) ret = fsTreeLoad(&undoTree, saveRoot, dataArchive);
+
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't stage the import: %lx\n", ret);
+		consoleLog("The save was not modified.\n");
+	}
+	else
+	{
+		u64 stageTime = osGetTime();
+
+		// Write the differences only.
+		ret = fsTreeRemove(&deleteTree, saveRoot, dataArchive);
+		if (R_SUCCEEDED(ret)) ret = fsTreeStore(&writeTree, saveRoot, dataArchive);
+
+		if (R_FAILED(ret))
+		{
+			logError("Couldn't write the save: %lx\n", ret);
+
+			// Restore the previous save archive content.
+			Result restoreRet = fsTreeRemove(&createTree, saveRoot, dataArchive);
+			if (R_SUCCEEDED(restoreRet)) restoreRet = fsTreeStore(&undoTree, saveRoot, dataArchive);
+
+			if (R_SUCCEEDED(restoreRet)) consoleLog("The previous save was restored.\n");
+			else logError("Couldn't restore the save: %lx\n", restoreRet);
+		}
+
+		u64 writeTime = osGetTime();
+
+		// Commit once, whatever content is now in the save archive.
+		Result commitRet = FS_CommitArchive(dataArchive);
+		if (R_SUCCEEDED(ret)) ret = commitRet;
+
+		u64 endTime = osGetTime();
+
+		consoleLog("Import: %lu written, %lu deleted, %lu unchanged\n", writeTree.fileCount, deleteTree.fileCount + deleteTree.dirCount, unchangedCount);
+		consoleLog("  %llu bytes written\n", writeTree.totalSize);
+		consoleLog("  compare+stage %llums, write %llums, commit %llums\n", stageTime - startTime, writeTime - stageTime, endTime - writeTime);
+	}
+
+	fsTreeFree(&saveTree);
+	fsTreeFree(&writeTree);
+	fsTreeFree(&createTree);
+	fsTreeFree(&deleteTree);
+	fsTreeFree(&undoTree);
+
+	return ret;
+}
+
+/**
+ * @brief Writes a backup to the extdata archive, streaming the files one after another.
+ * The extdata can't be staged in memory and has no commit, the import can't be undone:
+ * the backup is checked against its digests first, and a corrupted one is never written.
+ * The extra entries are deleted, then the files are copied (the differing blocks only if minimal).
+ * @param backupTree The plan of the backup to import.
+ * @param backupRoot The root dir of the backup.
+ * @param minimal Whether it shall only write the blocks which differ.
+ */
+static Result fsBackImportStream(fsTree* backupTree, const u16* backupRoot, bool minimal)
+{
+	Result ret;
+	u64 startTime = osGetTime();
+
+	u16 srcPath[FS_MAX_PATH_LENGTH];
+	u16 dstPath[FS_MAX_PATH_LENGTH];
+
+	fsTree saveTree;	// The current extdata.
+	fsTree deleteTree;	// The extra entries of the extdata.
+	memset(&saveTree, 0, sizeof(fsTree));
+	memset(&deleteTree, 0, sizeof(fsTree));
+
+	u32 errorCount = 0;
+	u64 bytesWritten = 0;
+
+	// Verify the backup against its digests before the first write (see fsBackVerify).
+	for (fsTreeNode* node = backupTree->firstNode; node; node = node->nextNode)
+	{
+		if (node->isDirectory || !node->isHashed) continue;
+
+		fsTreeMakePath(srcPath, backupRoot, node->path);
+
+		u64 size = 0;
+		u32 hash = 0;
+
+		Result hashRet = fsHashFile(srcPath, backDir.archive, &size, &hash);
+		if (R_FAILED(hashRet) || size != node->size || hash != node->hash)
+		{
+			fsLogVerifyFailed(srcPath);
+			errorCount++;
+		}
+	}
+
+	if (errorCount > 0)
+	{
+		logError("The backup is corrupted, %lu file(s) failed\n", errorCount);
+		consoleLog("The extdata was not modified.\n");
+		return FS_VERIFY_FAILED;
+	}
+
+	ret = fsTreeScan(&saveTree, saveRoot, dataArchive, false);
+
+	// Sorted, each tree is walked once against the other.
+	fsTreeSort(&saveTree);
+	fsTreeSort(backupTree);
+
+	fsTreeNode* backupCursor = backupTree->firstNode;
+	for (fsTreeNode* node = saveTree.firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeNode* backupNode = fsTreeSeek(&backupCursor, node->path);
+		if (backupNode && backupNode->isDirectory == node->isDirectory) continue;
+
+		if (node->isDirectory && !fsTreeAddDir(&deleteTree, node->path)) ret = -2;
+		else if (!node->isDirectory && !fsTreeAddFile(&deleteTree, node->path, node->size, NULL)) ret = -2;
+	}
+
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't plan the import: %lx\n", ret);
+		consoleLog("The extdata was not modified.\n");
+		fsTreeFree(&saveTree);
+		fsTreeFree(&deleteTree);
+		return ret;
+	}
+
+	ret = fsTreeRemove(&deleteTree, saveRoot, dataArchive);
+
+	for (fsTreeNode* node = backupTree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeMakePath(dstPath, saveRoot, node->path);
+
+		if (node->isDirectory)
+		{
+			if (!fsDirExists(dstPath, dataArchive))
+				ret = FSUSER_CreateDirectory(*dataArchive, fsMakePath(PATH_UTF16, dstPath), FS_ATTRIBUTE_DIRECTORY);
+			continue;
+		}
+
+		fsTreeMakePath(srcPath, backupRoot, node->path);
+
+		u32 hash = 0;
+		u64 written = node->size;
+
+		if (minimal) ret = fsCopyFileDiff(srcPath, backDir.archive, dstPath, dataArchive, FS_ATTRIBUTE_NONE, &hash, &written);
+		else ret = fsCopyFile(srcPath, backDir.archive, dstPath, dataArchive, FS_ATTRIBUTE_NONE, &hash);
+
+		// The backup is hashed again while copied, a file changed since the verify is reported.
+		if (R_SUCCEEDED(ret) && node->isHashed && hash != node->hash)
+		{
+			fsLogVerifyFailed(srcPath);
+			errorCount++;
+		}
+
+		bytesWritten += written;
+	}
+
+	if (R_FAILED(ret)) logError("Couldn't write the extdata: %lx\n", ret);
+
+	u64 time = osGetTime() - startTime;
+
+	consoleLog("Import: %lu file(s), %lu deleted, %lu corrupted\n", backupTree->fileCount, deleteTree.fileCount + deleteTree.dirCount, errorCount);
+	consoleLog("  %llu/%llu bytes written in %llums\n", bytesWritten, backupTree->totalSize, time);
+
+	fsTreeFree(&saveTree);
+	fsTreeFree(&deleteTree);
+
+	if (R_SUCCEEDED(ret) && errorCount > 0) ret = FS_VERIFY_FAILED;
+
+	return ret;
+}
+
+Result fsBackImport(bool minimal)
+{
+	// (sdmc->save)
+	if (!dataArchive || !fsBackCheckSelected()) return -1;
+
+	Result ret;
+
+	// The root dir of the selected backup.
+	u16 len;
+	u16 backupRoot[FS_MAX_PATH_LENGTH];
+	memset(backupRoot, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	len = str16cpy(backupRoot, backDir.entry.name16);
+	len += str16cpy(backupRoot + len, backDir.entrySelected->name16);
+	backupRoot[len++] = '/';
+
+	fsTree backupTree;
+	memset(&backupTree, 0, sizeof(fsTree));
+
+	// Plan the import from the stored digests, or from a scan of the backup.
+	u16 digestPath[FS_MAX_PATH_LENGTH];
+	fsBackDigestPath(digestPath, backDir.entrySelected->name16);
+
+	// A plan cut short (out of memory) would drop the missing files, the import is aborted.
+	ret = fsTreeRead(&backupTree, digestPath, backDir.archive);
+	if (R_FAILED(ret) && ret != -2)
+	{
+		fsTreeFree(&backupTree);
+		ret = fsTreeScan(&backupTree, backupRoot, backDir.archive, false);
+	}
+
+	if (R_SUCCEEDED(ret))
+	{
+		if (useExtdata) ret = fsBackImportStream(&backupTree, backupRoot, minimal);
+		else if (minimal) ret = fsBackImportMinimal(&backupTree, backupRoot);
+		else ret = fsBackImportFull(&backupTree, backupRoot);
+	}
+	else
+	{
+		logError("Couldn't read the backup: %lx\n", ret);
+	}
+
+	fsTreeFree(&backupTree);
 
 	return ret;
 }
 
 Result fsBackDelete(void)
 {
+	if (!fsBackCheckSelected()) return -1;
+
 	Result ret = -3;
 
 	u16 len;
@@ -741,9 +1807,87 @@ Result fsBackDelete(void)
 	if (!fsWaitDelete(path)) return FS_USER_INTERRUPT;
 	consoleLog("Delete validated!\n");
 
-	ret = FSUSER_DeleteDirectory(*backDir.archive, fsMakePath(PATH_UTF16, path));
+	ret = FSUSER_DeleteDirectoryRecursively(*backDir.archive, fsMakePath(PATH_UTF16, path));
+
+	if (R_FAILED(ret))
+	{
+		// Keep the digests and the index entry of what is left of the backup.
+		logError("Couldn't delete the backup: %lx\n", ret);
+	}
+	else
+	{
+		// Delete the digests of the backup too.
+		fsBackDigestPath(path, backDir.entrySelected->name16);
+		FSUSER_DeleteFile(*backDir.archive, fsMakePath(PATH_UTF16, path));
+
+		fsIndexRemove(&backIndex, backDir.entrySelected->name16);
+		fsBackWriteIndex();
+	}
 
-	fsDirRefreshDir(&backDir, false);
+	fsBackRefresh();
 
 	return ret;
 }
+
+Result fsBackVerify(void)
+{
+	if (!fsBackCheckSelected()) return -1;
+
+	Result ret;
+
+	u16 len;
+	u16 path[FS_MAX_PATH_LENGTH];
+	fsBackDigestPath(path, backDir.entrySelected->name16);
+
+	fsTree tree;
+	memset(&tree, 0, sizeof(fsTree));
+
+	ret = fsTreeRead(&tree, path, backDir.archive);
+	if (R_FAILED(ret))
+	{
+		consoleLog("No digest for this backup: %lx\n", ret);
+		fsTreeFree(&tree);
+		return ret;
+	}
+
+	u32 fileCount = 0;
+	u32 errorCount = 0;
+
+	// Only the backup is read, the digests of the save were stored on export.
+	for (fsTreeNode* node = tree.firstNode; node; node = node->nextNode)
+	{
+		if (node->isDirectory || !node->isHashed) continue;
+
+		memset(path, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+		len = str16cpy(path, backDir.entry.name16);
+		len += str16cpy(path + len, backDir.entrySelected->name16);
+		path[len++] = '/';
+		str16cpy(path + len, node->path);
+
+		u64 size = 0;
+		u32 hash = 0;
+
+		ret = fsHashFile(path, backDir.archive, &size, &hash);
+		if (R_FAILED(ret) || size != node->size || hash != node->hash)
+		{
+			fsLogVerifyFailed(path);
+			errorCount++;
+		}
+
+		fileCount++;
+	}
+
+	consoleLog("Verified %lu file(s), %lu failed\n", fileCount, errorCount);
+
+	fsTreeFree(&tree);
+
+	// Keep the result in the index, a corrupted backup is never the reference of a fingerprint.
+	fsManifest* manifest = fsIndexFind(&backIndex, backDir.entrySelected->name16);
+	if (manifest && manifest->isVerifyFailed != (errorCount > 0))
+	{
+		manifest->isVerifyFailed = (errorCount > 0);
+		fsBackWriteIndex();
+	}
+
+	return (errorCount > 0 ? FS_VERIFY_FAILED : 0);
+}
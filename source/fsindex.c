@@ -0,0 +1,256 @@
+#include "fsindex.h"
+#include "fs.h"
+#include "mem.h"
+#include "utils.h"
+
+#include <3ds/result.h>
+#include <3ds/util/utf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FS_INDEX_MAGIC "tvds-index 1\n"
+
+void fsManifestName(char* dst, time_t created)
+{
+	struct tm* tm_time = gmtime(&created);
+
+	sprintf(dst, "%04u-%02u-%02u--%02u-%02u-%02u/",
+		tm_time->tm_year+1900,
+		tm_time->tm_mon+1,
+		tm_time->tm_mday,
+		tm_time->tm_hour,
+		tm_time->tm_min,
+		tm_time->tm_sec
+	);
+}
+
+void fsManifestFromTree(fsManifest* manifest, fsTree* tree, bool digest)
+{
+	if (!manifest || !tree) return;
+
+	manifest->totalSize = tree->totalSize;
+	manifest->fileCount = tree->fileCount;
+	manifest->dirCount = tree->dirCount;
+	manifest->digest = (digest ? fsTreeDigest(tree) : 0);
+	manifest->isDigested = digest;
+}
+
+u32 fsManifestFormat(const fsManifest* manifest, char* dst)
+{
+	char name8[FS_MAX_FPATH_LENGTH*3];
+	memset(name8, 0, sizeof(name8));
+	utf16_to_utf8((u8*) name8, manifest->name16, sizeof(name8) - 1);
+
+	// A failed verify is marked before the digest, as "!0123abcd".
+	char digest[10] = "-";
+	if (manifest->isDigested) sprintf(digest, "%s%08lx", (manifest->isVerifyFailed ? "!" : ""), manifest->digest);
+
+	return sprintf(dst, "b %llu %lu %lu %llu %s %s\n",
+		manifest->created,
+		manifest->fileCount,
+		manifest->dirCount,
+		manifest->totalSize,
+		digest,
+		name8
+	);
+}
+
+/**
+ * @brief Parses a manifest line.
+ * @param[out] manifest The manifest.
+ * @param[in] line The line to parse (null-terminated, without '\\n').
+ * @param withName Whether the line name shall be parsed (else the name is kept).
+ * @return Whether the line is a manifest.
+ */
+static bool fsManifestParse(fsManifest* manifest, char* line, bool withName)
+{
+	if (line[0] != 'b' || line[1] != ' ') return false;
+
+	char* p = line + 2;
+	manifest->created = strtoull(p, &p, 10);
+	manifest->fileCount = strtoul(p, &p, 10);
+	manifest->dirCount = strtoul(p, &p, 10);
+	manifest->totalSize = strtoull(p, &p, 10);
+	if (*p++ != ' ') return false;
+
+	manifest->isVerifyFailed = (*p == '!');
+	if (manifest->isVerifyFailed) p++;
+
+	manifest->isDigested = (*p != '-');
+	manifest->digest = (manifest->isDigested ? strtoul(p, &p, 16) : 0);
+	if (!manifest->isDigested) p++;
+	if (*p++ != ' ') return false;
+
+	if (withName)
+	{
+		memset(manifest->name16, 0, FS_MAX_FPATH_LENGTH*sizeof(u16));
+		utf8_to_utf16(manifest->name16, (u8*) p, FS_MAX_FPATH_LENGTH - 1);
+	}
+
+	return true;
+}
+
+Result fsManifestRead(fsManifest* manifest, const u16* path, const FS_Archive* archive)
+{
+	if (!manifest || !path || !archive) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	// The manifest is the first line after the magic, don't read the digests.
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_UTF16, path), archive, FS_OPEN_READ, FS_INDEX_LINE_LENGTH, FS_FLUSH_NONE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[FS_INDEX_LINE_LENGTH];
+
+	ret = FS_StreamReadLine(&stream, line, sizeof(line));
+	if (ret == 0) ret = FS_StreamReadLine(&stream, line, sizeof(line));
+
+	if (ret == FS_STREAM_EOF || (R_SUCCEEDED(ret) && !fsManifestParse(manifest, line, false)))
+		ret = -4;
+
+	FS_StreamClose(&stream);
+
+	return ret;
+}
+
+fsManifest* fsIndexFind(const fsIndex* index, const u16* name)
+{
+	if (!index || !name) return NULL;
+
+	for (u32 i = 0; i < index->count; i++)
+	{
+		if (str16cmp(index->manifests[i].name16, name) == 0)
+			return &index->manifests[i];
+	}
+
+	return NULL;
+}
+
+fsManifest* fsIndexLatest(const fsIndex* index)
+{
+	if (!index) return NULL;
+
+	fsManifest* latest = NULL;
+
+	for (u32 i = 0; i < index->count; i++)
+	{
+		if (!latest || index->manifests[i].created >= latest->created)
+			latest = &index->manifests[i];
+	}
+
+	return latest;
+}
+
+fsManifest* fsIndexAdd(fsIndex* index, const fsManifest* manifest)
+{
+	if (!index || !manifest) return NULL;
+
+	fsManifest* existing = fsIndexFind(index, manifest->name16);
+	if (existing)
+	{
+		memcpy(existing, manifest, sizeof(fsManifest));
+		return existing;
+	}
+
+	if (index->count == index->capacity)
+	{
+		u32 capacity = (index->capacity ? index->capacity * 2 : 8);
+		fsManifest* manifests = (fsManifest*) memRealloc("fsIndexAdd", index->manifests, capacity * sizeof(fsManifest));
+		if (!manifests) return NULL;
+
+		index->manifests = manifests;
+		index->capacity = capacity;
+	}
+
+	// Insert sorted by name.
+	u32 i = index->count;
+	while (i > 0 && str16cmp(index->manifests[i-1].name16, manifest->name16) > 0) i--;
+
+	memmove(&index->manifests[i+1], &index->manifests[i], (index->count - i) * sizeof(fsManifest));
+	memcpy(&index->manifests[i], manifest, sizeof(fsManifest));
+	index->count++;
+
+	return &index->manifests[i];
+}
+
+void fsIndexRemove(fsIndex* index, const u16* name)
+{
+	fsManifest* manifest = fsIndexFind(index, name);
+	if (!manifest) return;
+
+	u32 i = manifest - index->manifests;
+	memmove(&index->manifests[i], &index->manifests[i+1], (index->count - i - 1) * sizeof(fsManifest));
+	index->count--;
+}
+
+Result fsIndexRead(fsIndex* index, const u16* path, const FS_Archive* archive)
+{
+	if (!index || !path || !archive) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_UTF16, path), archive, FS_OPEN_READ, FS_TEXT_BUFFER_SIZE, FS_FLUSH_NONE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[FS_INDEX_LINE_LENGTH];
+
+	ret = FS_StreamReadLine(&stream, line, sizeof(line));
+	if (ret == FS_STREAM_EOF || (R_SUCCEEDED(ret) && strncmp(line, FS_INDEX_MAGIC, strlen(FS_INDEX_MAGIC) - 1) != 0))
+		ret = -4;
+
+	while (ret == 0)
+	{
+		ret = FS_StreamReadLine(&stream, line, sizeof(line));
+		if (ret != 0) break;
+
+		fsManifest manifest;
+		memset(&manifest, 0, sizeof(fsManifest));
+		if (fsManifestParse(&manifest, line, true)) fsIndexAdd(index, &manifest);
+	}
+
+	if (ret == FS_STREAM_EOF) ret = 0;
+
+	FS_StreamClose(&stream);
+
+	return ret;
+}
+
+Result fsIndexWrite(const fsIndex* index, const u16* path, const FS_Archive* archive)
+{
+	if (!index || !path || !archive) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_UTF16, path), archive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_TEXT_BUFFER_SIZE, FS_FLUSH_CLOSE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[FS_INDEX_LINE_LENGTH];
+
+	ret = FS_StreamWrite(&stream, FS_INDEX_MAGIC, strlen(FS_INDEX_MAGIC));
+
+	for (u32 i = 0; i < index->count && R_SUCCEEDED(ret); i++)
+	{
+		u32 len = fsManifestFormat(&index->manifests[i], line);
+		ret = FS_StreamWrite(&stream, line, len);
+	}
+
+	if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+	Result closeRet = FS_StreamClose(&stream);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
+
+	return ret;
+}
+
+void fsIndexFree(fsIndex* index)
+{
+	if (!index) return;
+
+	memFree(index->manifests);
+	memset(index, 0, sizeof(fsIndex));
+}
@@ -1,7 +1,12 @@
 #include "fsls.h"
+#include "fsbuf.h"
+#include "fstune.h"
 #include "fs.h"
+#include "mem.h"
+#include "hash.h"
 #include "utils.h"
 #include "console.h"
+#include "log.h"
 
 #include <3ds/result.h>
 
@@ -9,6 +14,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "fsprobe.h"
+
 // #define r(format, args...) consoleLog(format, ##args)
 #define r(format, args...)
 
@@ -34,10 +41,6 @@ bool fsFileExists(const u16* path, const FS_Archive* archive)
 {
 	if (!path || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 	Handle fileHandle;
 
@@ -57,10 +60,6 @@ bool fsDirExists(const u16* path, const FS_Archive* archive)
 {
 	if (!path || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 	Handle dirHandle;
 
@@ -76,53 +75,304 @@ bool fsDirExists(const u16* path, const FS_Archive* archive)
 	return R_SUCCEEDED(ret);
 }
 
-Result fsCopyFile(const u16* srcPath, const FS_Archive* srcArchive, const u16* dstPath, const FS_Archive* dstArchive, u32 attributes)
+Result fsOpenWriteFile(Handle* handle, const u16* path, const FS_Archive* archive, u32 attributes, u64 size, u64* keptSize)
 {
-	if (!srcPath || !srcArchive || !dstPath || !dstArchive) return -1;
+	if (!handle || !path || !archive) return -1;
+
+	Result ret;
+	u64 fileSize = 0;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&srcArchive)) return -1;
-#endif
+	if (archive->id == ARCHIVE_EXTDATA)
+	{
+		// Keep the file if it already has the right size.
+		ret = FSUSER_OpenFile(handle, *archive, fsMakePath(PATH_UTF16, path), FS_OPEN_READ | FS_OPEN_WRITE, attributes);
+		r(" > FSUSER_OpenFile: %lx\n", ret);
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&dstArchive)) return -1;
-#endif
+		if (R_SUCCEEDED(ret))
+		{
+			ret = FSFILE_GetSize(*handle, &fileSize);
+			r(" > FSFILE_GetSize: %lx\n", ret);
+
+			if (R_SUCCEEDED(ret) && fileSize == size)
+			{
+				if (keptSize) *keptSize = fileSize;
+				return ret;
+			}
+
+			FSFILE_Close(*handle);
+			r(" > FSFILE_Close\n");
+
+			ret = FSUSER_DeleteFile(*archive, fsMakePath(PATH_UTF16, path));
+			r(" > FSUSER_DeleteFile: %lx\n", ret);
+			if (R_FAILED(ret)) return ret;
+		}
+
+		ret = FSUSER_CreateFile(*archive, fsMakePath(PATH_UTF16, path), attributes, size);
+		r(" > FSUSER_CreateFile: %lx\n", ret);
+		if (R_FAILED(ret)) return ret;
+
+		ret = FSUSER_OpenFile(handle, *archive, fsMakePath(PATH_UTF16, path), FS_OPEN_READ | FS_OPEN_WRITE, attributes);
+		r(" > FSUSER_OpenFile: %lx\n", ret);
+
+		if (keptSize) *keptSize = 0;
+		return ret;
+	}
+
+	ret = FSUSER_OpenFile(handle, *archive, fsMakePath(PATH_UTF16, path), FS_OPEN_READ | FS_OPEN_WRITE | FS_OPEN_CREATE, attributes);
+	r(" > FSUSER_OpenFile: %lx\n", ret);
+	if (R_FAILED(ret)) return ret;
+
+	ret = FSFILE_GetSize(*handle, &fileSize);
+	r(" > FSFILE_GetSize: %lx\n", ret);
+
+	// Truncate the remains of a bigger file, or reserve the space of a smaller one.
+	if (R_SUCCEEDED(ret) && fileSize != size)
+	{
+		ret = FSFILE_SetSize(*handle, size);
+		r(" > FSFILE_SetSize: %lx\n", ret);
+	}
+
+	if (R_FAILED(ret))
+	{
+		FSFILE_Close(*handle);
+		r(" > FSFILE_Close\n");
+		return ret;
+	}
+
+	if (keptSize) *keptSize = (fileSize < size ? fileSize : size);
+
+	return ret;
+}
+
+Result fsCopyFile(const u16* srcPath, const FS_Archive* srcArchive, const u16* dstPath, const FS_Archive* dstArchive, u32 attributes, u32* hash)
+{
+	if (!srcPath || !srcArchive || !dstPath || !dstArchive) return -1;
 
 	Result ret;
 	Handle srcHandle, dstHandle;
+	u64 size = 0;
+	FS_FlushPolicy flush = FS_GetFlushPolicy(dstArchive);
 
-	ret = FSUSER_OpenFile(&dstHandle, *dstArchive, fsMakePath(PATH_UTF16, dstPath), FS_OPEN_WRITE | FS_OPEN_CREATE, attributes);
+	ret = FSUSER_OpenFile(&srcHandle, *srcArchive, fsMakePath(PATH_UTF16, srcPath), FS_OPEN_READ, attributes);
 	r(" > FSUSER_OpenFile: %lx\n", ret);
 	if (R_FAILED(ret)) return ret;
 
+	ret = FSFILE_GetSize(srcHandle, &size);
+	r(" > FSFILE_GetSize: %lx\n", ret);
+
+	if (R_SUCCEEDED(ret))
+	{
+		ret = fsOpenWriteFile(&dstHandle, dstPath, dstArchive, attributes, size, NULL);
+
+		if (R_SUCCEEDED(ret))
+		{
+			// One chunk at most in memory, whatever the size of the file.
+			u32 bufferSize = 0;
+			u8* buffer = NULL;
+
+			if (size > 0)
+			{
+				u32 chunkSize = fsTuneGetChunkSize(srcArchive, dstArchive);
+				buffer = (u8*) fsBufferAllocChunk(size < chunkSize ? size : chunkSize, &bufferSize);
+				if (!buffer) ret = -2;
+			}
+
+			if (hash) *hash = HASH_CRC32_INIT;
+
+			for (u64 offset = 0; R_SUCCEEDED(ret) && offset < size; offset += bufferSize)
+			{
+				u32 bytes = 0;
+				u32 chunk = (size - offset < bufferSize ? size - offset : bufferSize);
+
+				ret = FSFILE_Read(srcHandle, &bytes, offset, buffer, chunk);
+				r(" > FSFILE_Read: %lx\n", ret);
+				if (R_SUCCEEDED(ret) && bytes != chunk) ret = -3;
+
+				// Hash the source while it is in memory, so it is never read twice.
+				if (R_SUCCEEDED(ret) && hash) *hash = hashCrc32(*hash, buffer, chunk);
+
+				if (R_SUCCEEDED(ret))
+				{
+					ret = FSFILE_Write(dstHandle, &bytes, offset, buffer, chunk, (flush == FS_FLUSH_WRITE ? FS_WRITE_FLUSH : 0));
+					r(" > FSFILE_Write: %lx\n", ret);
+					if (R_SUCCEEDED(ret) && bytes != chunk) ret = -3;
+				}
+			}
+
+			// Flush once for the whole file, else the operation commits at its end.
+			if (R_SUCCEEDED(ret) && flush == FS_FLUSH_CLOSE)
+			{
+				ret = FSFILE_Flush(dstHandle);
+				r(" > FSFILE_Flush: %lx\n", ret);
+			}
+
+			fsBufferFree(buffer);
+
+			FSFILE_Close(dstHandle);
+			r(" > FSFILE_Close\n");
+		}
+	}
+
+	FSFILE_Close(srcHandle);
+	r(" > FSFILE_Close\n");
+
+	return ret;
+}
+
+Result fsCopyFileDiff(const u16* srcPath, const FS_Archive* srcArchive, const u16* dstPath, const FS_Archive* dstArchive, u32 attributes, u32* hash, u64* bytesWritten)
+{
+	if (!srcPath || !srcArchive || !dstPath || !dstArchive) return -1;
+
+	Result ret;
+	Handle srcHandle, dstHandle;
+	u64 srcSize = 0, dstSize = 0;
+	u64 written = 0;
+	FS_FlushPolicy flush = FS_GetFlushPolicy(dstArchive);
+
 	ret = FSUSER_OpenFile(&srcHandle, *srcArchive, fsMakePath(PATH_UTF16, srcPath), FS_OPEN_READ, attributes);
 	r(" > FSUSER_OpenFile: %lx\n", ret);
+	if (R_FAILED(ret)) return ret;
+
+	ret = FSFILE_GetSize(srcHandle, &srcSize);
+	r(" > FSFILE_GetSize: %lx\n", ret);
+
+	// Only the kept content of the destination is compared.
+	if (R_SUCCEEDED(ret)) ret = fsOpenWriteFile(&dstHandle, dstPath, dstArchive, attributes, srcSize, &dstSize);
 
 	if (R_SUCCEEDED(ret))
 	{
-		u8* buffer;
-		u32 bytes = 0;
-		u64 size = 0;
+		u8* srcBuffer = (u8*) fsBufferAlloc(FS_DIFF_CHUNK_SIZE);
+		u8* dstBuffer = (u8*) fsBufferAlloc(FS_DIFF_CHUNK_SIZE);
+		if (!srcBuffer || !dstBuffer) ret = -2;
 
-		ret = FSFILE_GetSize(srcHandle, &size);
-		r(" > FSFILE_GetSize: %lx\n", ret);
+		if (hash) *hash = HASH_CRC32_INIT;
 
-		buffer = (u8*) malloc(size);
+		for (u64 offset = 0; R_SUCCEEDED(ret) && offset < srcSize; offset += FS_DIFF_CHUNK_SIZE)
+		{
+			u32 bytes = 0;
+			u32 chunk = (srcSize - offset < FS_DIFF_CHUNK_SIZE ? srcSize - offset : FS_DIFF_CHUNK_SIZE);
+			u32 dstChunk = (dstSize > offset ? (dstSize - offset < chunk ? dstSize - offset : chunk) : 0);
 
-		ret = FSFILE_Read(srcHandle, &bytes, 0, buffer, size);
-		r(" > FSFILE_Read: %lx\n", ret);
+			ret = FSFILE_Read(srcHandle, &bytes, offset, srcBuffer, chunk);
+			r(" > FSFILE_Read: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && bytes != chunk) ret = -3;
 
-		ret = FSFILE_Write(dstHandle, &bytes, 0, buffer, size, FS_WRITE_FLUSH);
-		r(" > FSFILE_Read: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && dstChunk > 0)
+			{
+				ret = FSFILE_Read(dstHandle, &bytes, offset, dstBuffer, dstChunk);
+				r(" > FSFILE_Read: %lx\n", ret);
+				if (R_SUCCEEDED(ret) && bytes != dstChunk) ret = -3;
+			}
+
+			if (R_FAILED(ret)) break;
+
+			if (hash) *hash = hashCrc32(*hash, srcBuffer, chunk);
+
+			// Write the runs of changed blocks of the chunk, without flushing.
+			u32 runStart = 0;
+			bool inRun = false;
+
+			for (u32 block = 0; (block < chunk || inRun) && R_SUCCEEDED(ret); block += FS_DIFF_BLOCK_SIZE)
+			{
+				bool changed = false;
+
+				if (block < chunk)
+				{
+					u32 blockSize = (chunk - block < FS_DIFF_BLOCK_SIZE ? chunk - block : FS_DIFF_BLOCK_SIZE);
+					changed = (block + blockSize > dstChunk || memcmp(srcBuffer + block, dstBuffer + block, blockSize) != 0);
+				}
 
-		free(buffer);
+				if (changed && !inRun)
+				{
+					runStart = block;
+					inRun = true;
+				}
+				else if (!changed && inRun)
+				{
+					u32 runEnd = (block < chunk ? block : chunk);
+
+					ret = FSFILE_Write(dstHandle, &bytes, offset + runStart, srcBuffer + runStart, runEnd - runStart, (flush == FS_FLUSH_WRITE ? FS_WRITE_FLUSH : 0));
+					r(" > FSFILE_Write: %lx\n", ret);
+					if (R_SUCCEEDED(ret) && bytes != runEnd - runStart) ret = -3;
+
+					written += runEnd - runStart;
+					inRun = false;
+				}
+			}
+		}
+
+		// Flush once for the whole file, else the operation commits at its end.
+		if (R_SUCCEEDED(ret) && written > 0 && flush == FS_FLUSH_CLOSE)
+		{
+			ret = FSFILE_Flush(dstHandle);
+			r(" > FSFILE_Flush: %lx\n", ret);
+		}
+
+		fsBufferFree(srcBuffer);
+		fsBufferFree(dstBuffer);
+
+		FSFILE_Close(dstHandle);
+		r(" > FSFILE_Close\n");
 	}
 
 	FSFILE_Close(srcHandle);
 	r(" > FSFILE_Close\n");
-	FSFILE_Close(dstHandle);
+
+	if (bytesWritten) *bytesWritten = written;
+
+	return ret;
+}
+
+Result fsHashFile(const u16* path, const FS_Archive* archive, u64* size, u32* hash)
+{
+	if (!path || !archive || !hash) return -1;
+
+	Result ret;
+	Handle fileHandle;
+	u64 fileSize = 0;
+
+	ret = FSUSER_OpenFile(&fileHandle, *archive, fsMakePath(PATH_UTF16, path), FS_OPEN_READ, FS_ATTRIBUTE_NONE);
+	r(" > FSUSER_OpenFile: %lx\n", ret);
+	if (R_FAILED(ret)) return ret;
+
+	ret = FSFILE_GetSize(fileHandle, &fileSize);
+	r(" > FSFILE_GetSize: %lx\n", ret);
+
+	u32 chunkSize = 0;
+	u8* buffer = NULL;
+
+	if (R_SUCCEEDED(ret) && fileSize > 0)
+	{
+		u32 tunedSize = fsTuneGetChunkSize(archive, NULL);
+		buffer = (u8*) fsBufferAllocChunk(fileSize < tunedSize ? fileSize : tunedSize, &chunkSize);
+		if (!buffer) ret = -2;
+	}
+
+	*hash = HASH_CRC32_INIT;
+
+	for (u64 offset = 0; R_SUCCEEDED(ret) && offset < fileSize; )
+	{
+		u32 bytes = 0;
+		u32 chunk = (fileSize - offset < chunkSize ? fileSize - offset : chunkSize);
+
+		ret = FSFILE_Read(fileHandle, &bytes, offset, buffer, chunk);
+		r(" > FSFILE_Read: %lx\n", ret);
+		if (R_SUCCEEDED(ret) && bytes != chunk) ret = -3;
+
+		if (R_SUCCEEDED(ret))
+		{
+			*hash = hashCrc32(*hash, buffer, chunk);
+			offset += chunk;
+		}
+	}
+
+	fsBufferFree(buffer);
+
+	FSFILE_Close(fileHandle);
 	r(" > FSFILE_Close\n");
 
+	if (size) *size = fileSize;
+
 	return ret;
 }
 
@@ -130,21 +380,22 @@ Result fsScanDir(fsEntry* dir, const FS_Archive* archive, bool rec)
 {
 	if (!dir || !archive) return -1;
 
-#ifdef FS_DEBUG_FIX_ARCHIVE
-	if (!FSDEBUG_FixArchive(&archive)) return -1;
-#endif
-
 	Result ret;
 	Handle dirHandle;
+	u64 traceStart = traceBegin();
 
-	consoleLog("fsScanDir(\"%s\", %li)\n", dir->name, archive->id);
+	logDebug("fsScanDir(\"%s\", %li)\n", dir->name, archive->id);
 
 	dir->firstEntry = NULL;
 	dir->entryCount = 0;
 
 	ret = FSUSER_OpenDirectory(&dirHandle, *archive, fsMakePath(PATH_UTF16, dir->name16));
 	r(" > FSUSER_OpenDirectory: %lx\n", ret);
-	if (R_FAILED(ret)) return ret;
+	if (R_FAILED(ret))
+	{
+		traceEnd("fsScanDir", traceStart);
+		return ret;
+	}
 
 	u32 entriesRead;
 	fsEntry* lastEntry = NULL;
@@ -162,7 +413,13 @@ Result fsScanDir(fsEntry* dir, const FS_Archive* archive, bool rec)
 
 		if (entriesRead > 0)
 		{
-			fsEntry* entry = (fsEntry*) malloc(sizeof(fsEntry));
+			fsEntry* entry = (fsEntry*) memAlloc("fsScanDir", sizeof(fsEntry));
+			if (!entry)
+			{
+				ret = -2;
+				break;
+			}
+
 			memset(entry, 0, sizeof(fsEntry));
 
 			str16ncpy(entry->name16, dirEntry.name, FS_MAX_FPATH_LENGTH);
@@ -170,9 +427,10 @@ Result fsScanDir(fsEntry* dir, const FS_Archive* archive, bool rec)
 			// TODO: Remove when native UTF-16 font.
 			unicodeToChar(entry->name, entry->name16, FS_MAX_FPATH_LENGTH);
 
-			consoleLog("Entry: %s (%i)\n", entry->name, dir->entryCount+1);
+			logDebug("Entry: %s (%i)\n", entry->name, dir->entryCount+1);
 
 			entry->attributes = dirEntry.attributes;
+			entry->fileSize = dirEntry.fileSize;
 			entry->isDirectory = entry->attributes & FS_ATTRIBUTE_DIRECTORY;
 			entry->isRealDirectory = true;
 			entry->isRootDirectory = false;
@@ -190,7 +448,8 @@ Result fsScanDir(fsEntry* dir, const FS_Archive* archive, bool rec)
 				str16cpy(entry->name16 + len, dirEntry.name);
 				entry->name16[len++] = '/';
 
-				fsScanDir(entry, archive, rec);
+				Result recRet = fsScanDir(entry, archive, rec);
+				if (R_FAILED(recRet)) ret = recRet;
 
 				str16ncpy(entry->name16, dirEntry.name, FS_MAX_FPATH_LENGTH);
 				
@@ -292,13 +551,14 @@ Result fsScanDir(fsEntry* dir, const FS_Archive* archive, bool rec)
 		}
 		else if (dir->entryCount == 0)
 		{
-			consoleLog("Empty folder!\n\n");
+			logDebug("Empty folder!\n\n");
 		}
-	} while (entriesRead > 0);
+	} while (entriesRead > 0 && R_SUCCEEDED(ret));
 
 	FSDIR_Close(dirHandle);
 	r(" > FSDIR_Close\n");
 
+	traceEnd("fsScanDir", traceStart);
 	return ret;
 }
 
@@ -318,7 +578,7 @@ Result fsFreeDir(fsEntry* dir)
 			fsFreeDir(line);
 		}
 
-		free(line);
+		memFree(line);
 		line = next;
 	}
 
@@ -339,7 +599,9 @@ Result fsAddParentDir(fsEntry* dir)
 		if (dir->firstEntry && !dir->firstEntry->isRealDirectory)
 			return 2;
 
-		fsEntry* root = (fsEntry*) malloc(sizeof(fsEntry));
+		fsEntry* root = (fsEntry*) memAlloc("fsAddParentDir", sizeof(fsEntry));
+		if (!root) return -2;
+
 		memset(root, 0, sizeof(fsEntry));
 		root->attributes = dir->attributes | FS_ATTRIBUTE_DIRECTORY;
 		root->isDirectory = true;
@@ -365,7 +627,9 @@ Result fsAddParentDir(fsEntry* dir)
 		if (dir->firstEntry && !dir->firstEntry->isRealDirectory)
 			return 2;
 
-		fsEntry* root = (fsEntry*) malloc(sizeof(fsEntry));
+		fsEntry* root = (fsEntry*) memAlloc("fsAddParentDir", sizeof(fsEntry));
+		if (!root) return -2;
+
 		memset(root, 0, sizeof(fsEntry));
 		root->attributes = dir->attributes | FS_ATTRIBUTE_DIRECTORY;
 		root->isDirectory = true;
@@ -393,7 +657,7 @@ Result fsAddParentDir(fsEntry* dir)
 
 Result fsGotoParentDir(fsEntry* dir)
 {
-	consoleLog("fsGotoParentDir\n");
+	logDebug("fsGotoParentDir\n");
 	if (!dir) return -1;
 
 	u16* path = dir->name16;
@@ -409,7 +673,7 @@ Result fsGotoParentDir(fsEntry* dir)
 
 Result fsGotoSubDir(fsEntry* dir, const u16* subDir)
 {
-	consoleLog("fsGotoSubDir\n");
+	logDebug("fsGotoSubDir\n");
 	if (!dir || !subDir) return -1;
 
 	u16* path = dir->name16;
@@ -0,0 +1,141 @@
+#include "fsstats.h"
+#include "console.h"
+
+#include <3ds/os.h>
+#include <3ds/result.h>
+#include <3ds/synchronization.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/// The names of the operation types.
+static const char* const opNames[FS_STATS_OP_COUNT] = { "open", "read", "write", "dirread", "create", "delete", "commit", "other" };
+
+/// The histogram levels, from empty to the fullest bucket.
+static const char levels[] = " .:-=+*#%@";
+
+static fsStatsCounters counters[FS_STATS_OP_COUNT];
+static u64 resetTime = 0;
+static LightLock statsLock;
+static bool isInit = false;
+
+void fsStatsInit(void)
+{
+	if (isInit) return;
+
+	LightLock_Init(&statsLock);
+	memset(counters, 0, sizeof(counters));
+	resetTime = osGetTime();
+	isInit = true;
+}
+
+void fsStatsRecord(fsStatsOp op, u64 ticks, u64 bytes, Result ret)
+{
+	if (!isInit || op >= FS_STATS_OP_COUNT) return;
+
+	// The bucket of the latency, log2 of the microseconds.
+	u64 us = ticks * 1000000 / SYSCLOCK_ARM11;
+	u32 bucket = (us > 1 ? 63 - __builtin_clzll(us) : 0);
+	if (bucket >= FS_STATS_BUCKET_COUNT) bucket = FS_STATS_BUCKET_COUNT - 1;
+
+	LightLock_Lock(&statsLock);
+
+	fsStatsCounters* op_ = &counters[op];
+	op_->count++;
+	if (R_FAILED(ret)) op_->errorCount++;
+	op_->bytes += bytes;
+	op_->ticks += ticks;
+	if (ticks > op_->maxTicks) op_->maxTicks = ticks;
+	op_->buckets[bucket]++;
+
+	LightLock_Unlock(&statsLock);
+}
+
+void fsStatsReset(void)
+{
+	if (!isInit) return;
+
+	LightLock_Lock(&statsLock);
+	memset(counters, 0, sizeof(counters));
+	resetTime = osGetTime();
+	LightLock_Unlock(&statsLock);
+}
+
+void fsStatsGet(fsStatsOp op, fsStatsCounters* dst)
+{
+	if (!dst || op >= FS_STATS_OP_COUNT) return;
+
+	if (!isInit)
+	{
+		memset(dst, 0, sizeof(fsStatsCounters));
+		return;
+	}
+
+	LightLock_Lock(&statsLock);
+	*dst = counters[op];
+	LightLock_Unlock(&statsLock);
+}
+
+/**
+ * @brief Formats a latency in 5 characters at most (us, ms or s).
+ */
+static void fsStatsFormatTime(char* dst, u64 ticks)
+{
+	u64 us = ticks * 1000000 / SYSCLOCK_ARM11;
+
+	if (us < 1000) sprintf(dst, "%lluu", us);
+	else if (us < 100000) sprintf(dst, "%llu.%llum", us / 1000, us % 1000 / 100);
+	else if (us < 1000000) sprintf(dst, "%llum", us / 1000);
+	else sprintf(dst, "%llu.%llus", us / 1000000, us % 1000000 / 100000);
+}
+
+/**
+ * @brief Gets the bit length of a count.
+ */
+static inline u32 fsStatsBits(u32 count)
+{
+	return (count > 0 ? 32 - __builtin_clz(count) : 0);
+}
+
+void fsStatsPrint(void)
+{
+	fsStatsCounters stats[FS_STATS_OP_COUNT];
+	for (u32 i = 0; i < FS_STATS_OP_COUNT; i++) fsStatsGet(i, &stats[i]);
+
+	consoleSelect(&logConsole);
+	consoleClear();
+
+	printf("FS stats, %llus since reset\n", (osGetTime() - resetTime) / 1000);
+	printf("%-7s %7s %4s %6s %5s %5s\n", "op", "count", "err", "KB", "avg", "max");
+
+	for (u32 i = 0; i < FS_STATS_OP_COUNT; i++)
+	{
+		const fsStatsCounters* op = &stats[i];
+
+		char avg[16], max[16];
+		fsStatsFormatTime(avg, (op->count > 0 ? op->ticks / op->count : 0));
+		fsStatsFormatTime(max, op->maxTicks);
+
+		printf("%-7s %7lu %4lu %6llu %5s %5s\n", opNames[i], op->count, op->errorCount, op->bytes / 1024, avg, max);
+
+		// The buckets, scaled by bit length to the fullest one.
+		u32 maxBucket = 0;
+		for (u32 j = 0; j < FS_STATS_BUCKET_COUNT; j++)
+			if (op->buckets[j] > maxBucket) maxBucket = op->buckets[j];
+
+		char histogram[FS_STATS_BUCKET_COUNT + 1];
+		for (u32 j = 0; j < FS_STATS_BUCKET_COUNT; j++)
+		{
+			u32 level = (op->buckets[j] > 0 ? 1 + fsStatsBits(op->buckets[j]) * (sizeof(levels) - 3) / fsStatsBits(maxBucket) : 0);
+			histogram[j] = levels[level];
+		}
+		histogram[FS_STATS_BUCKET_COUNT] = '\0';
+
+		printf("        |%s|\n", histogram);
+	}
+
+	printf("         1us  32us 1ms  32ms\n");
+	printf("\n> [Select]+[L] Hide  [Select]+[R] Reset\n");
+
+	consoleSelectDefault();
+}
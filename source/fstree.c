@@ -0,0 +1,506 @@
+#include "fstree.h"
+#include "fs.h"
+#include "mem.h"
+#include "hash.h"
+#include "utils.h"
+
+#include <3ds/result.h>
+#include <3ds/util/utf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsprobe.h"
+
+// #define r(format, args...) consoleLog(format, ##args)
+#define r(format, args...)
+
+#define FS_TREE_MAGIC "tvds-tree 1\n"
+#define FS_TREE_LINE_LENGTH (FS_MAX_PATH_LENGTH*3 + 32)
+
+/**
+ * @brief Appends a new node to a tree.
+ * @param[in/out] tree The tree.
+ * @param[in] path The path of the node.
+ * @return The new node (NULL if out of memory).
+ */
+static fsTreeNode* fsTreeAddNode(fsTree* tree, const u16* path)
+{
+	if (!tree || !path) return NULL;
+
+	fsTreeNode* node = (fsTreeNode*) memAlloc("fsTreeAddNode", sizeof(fsTreeNode));
+	if (!node) return NULL;
+	memset(node, 0, sizeof(fsTreeNode));
+
+	str16ncpy(node->path, path, FS_MAX_PATH_LENGTH);
+	node->nextNode = NULL;
+
+	if (tree->lastNode) tree->lastNode->nextNode = node;
+	else tree->firstNode = node;
+	tree->lastNode = node;
+
+	return node;
+}
+
+fsTreeNode* fsTreeAddFile(fsTree* tree, const u16* path, u64 size, const u32* hash)
+{
+	fsTreeNode* node = fsTreeAddNode(tree, path);
+	if (!node) return NULL;
+
+	node->isDirectory = false;
+	node->size = size;
+	node->isHashed = (hash != NULL);
+	node->hash = (hash ? *hash : 0);
+
+	tree->fileCount++;
+	tree->totalSize += size;
+
+	return node;
+}
+
+fsTreeNode* fsTreeAddDir(fsTree* tree, const u16* path)
+{
+	fsTreeNode* node = fsTreeAddNode(tree, path);
+	if (!node) return NULL;
+
+	node->isDirectory = true;
+
+	tree->dirCount++;
+
+	return node;
+}
+
+fsTreeNode* fsTreeSeek(fsTreeNode** cursor, const u16* path)
+{
+	if (!cursor || !path) return NULL;
+
+	// Both sides are sorted, the nodes before the path are never looked up again.
+	while (*cursor && str16cmp((*cursor)->path, path) < 0)
+		*cursor = (*cursor)->nextNode;
+
+	return (*cursor && str16cmp((*cursor)->path, path) == 0 ? *cursor : NULL);
+}
+
+/**
+ * @brief Merges two sorted lists of nodes.
+ * @param a The first sorted list.
+ * @param b The second sorted list.
+ * @return The head of the merged list.
+ */
+static fsTreeNode* fsTreeMerge(fsTreeNode* a, fsTreeNode* b)
+{
+	fsTreeNode head;
+	fsTreeNode* tail = &head;
+
+	while (a && b)
+	{
+		if (str16cmp(a->path, b->path) <= 0)
+		{
+			tail->nextNode = a;
+			a = a->nextNode;
+		}
+		else
+		{
+			tail->nextNode = b;
+			b = b->nextNode;
+		}
+		tail = tail->nextNode;
+	}
+
+	tail->nextNode = (a ? a : b);
+	return head.nextNode;
+}
+
+void fsTreeSort(fsTree* tree)
+{
+	if (!tree || !tree->firstNode) return;
+
+	// Bottom-up merge sort of the linked list, with sorted runs of 2^n nodes.
+	fsTreeNode* runs[32];
+	memset(runs, 0, sizeof(runs));
+
+	fsTreeNode* node = tree->firstNode;
+	while (node)
+	{
+		fsTreeNode* next = node->nextNode;
+		node->nextNode = NULL;
+
+		u8 ii;
+		for (ii = 0; ii < 31 && runs[ii]; ii++)
+		{
+			node = fsTreeMerge(runs[ii], node);
+			runs[ii] = NULL;
+		}
+		runs[ii] = node;
+
+		node = next;
+	}
+
+	node = NULL;
+	for (u8 ii = 0; ii < 32; ii++)
+		node = fsTreeMerge(runs[ii], node);
+
+	tree->firstNode = node;
+	while (node->nextNode) node = node->nextNode;
+	tree->lastNode = node;
+}
+
+void fsTreeMakePath(u16* dst, const u16* root, const u16* path)
+{
+	u16 len;
+	memset(dst, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+	len = str16ncpy(dst, root, FS_MAX_PATH_LENGTH);
+	str16ncpy(dst + len, path, FS_MAX_PATH_LENGTH - len);
+}
+
+/**
+ * @brief Appends the entries of a directory to a tree.
+ * @param[in/out] tree The tree.
+ * @param[in] root The path of the root directory.
+ * @param[in] dirPath The path of the directory relative to the root (empty for the root).
+ * @param[in] archive The archive of the directory.
+ * @param hash Whether it shall hash the content of the files.
+ */
+static Result fsTreeScanDir(fsTree* tree, const u16* root, const u16* dirPath, const FS_Archive* archive, bool hash)
+{
+	Result ret;
+	u16 len;
+	u16 path[FS_MAX_PATH_LENGTH];
+
+	fsEntry dir;
+	memset(&dir, 0, sizeof(fsEntry));
+	fsTreeMakePath(dir.name16, root, dirPath);
+
+	ret = fsScanDir(&dir, archive, false);
+	if (R_FAILED(ret)) return ret;
+
+	for (fsEntry* next = dir.firstEntry; next && R_SUCCEEDED(ret); next = next->nextEntry)
+	{
+		memset(path, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+		len = str16cpy(path, dirPath);
+		if (len > 0) path[len++] = '/';
+		str16cpy(path + len, next->name16);
+
+		if (next->isDirectory)
+		{
+			if (!fsTreeAddDir(tree, path)) ret = -2;
+		}
+		else if (hash)
+		{
+			u16 fullPath[FS_MAX_PATH_LENGTH];
+			u64 size = 0;
+			u32 crc = 0;
+
+			fsTreeMakePath(fullPath, root, path);
+			ret = fsHashFile(fullPath, archive, &size, &crc);
+			if (R_SUCCEEDED(ret) && !fsTreeAddFile(tree, path, size, &crc)) ret = -2;
+		}
+		else
+		{
+			if (!fsTreeAddFile(tree, path, next->fileSize, NULL)) ret = -2;
+		}
+	}
+
+	fsFreeDir(&dir);
+
+	return ret;
+}
+
+Result fsTreeScan(fsTree* tree, const u16* root, const FS_Archive* archive, bool hash)
+{
+	if (!tree || !root || !archive) return -1;
+
+	static const u16 rootPath[1] = { '\0' };
+
+	Result ret = fsTreeScanDir(tree, root, rootPath, archive, hash);
+
+	// The sub-directories are appended while walking, so the walk goes through them too.
+	for (fsTreeNode* node = tree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		if (node->isDirectory)
+			ret = fsTreeScanDir(tree, root, node->path, archive, hash);
+	}
+
+	return ret;
+}
+
+Result fsTreeLoad(fsTree* tree, const u16* root, const FS_Archive* archive)
+{
+	if (!tree || !root || !archive) return -1;
+
+	Result ret = 0;
+	Handle fileHandle;
+	u16 path[FS_MAX_PATH_LENGTH];
+
+	for (fsTreeNode* node = tree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		if (node->isDirectory || node->data) continue;
+
+		fsTreeMakePath(path, root, node->path);
+
+		ret = FSUSER_OpenFile(&fileHandle, *archive, fsMakePath(PATH_UTF16, path), FS_OPEN_READ, FS_ATTRIBUTE_NONE);
+		r(" > FSUSER_OpenFile: %lx\n", ret);
+		if (R_FAILED(ret)) break;
+
+		u64 size = 0;
+
+		ret = FSFILE_GetSize(fileHandle, &size);
+		r(" > FSFILE_GetSize: %lx\n", ret);
+		if (R_SUCCEEDED(ret) && size != node->size) ret = -4;
+
+		if (R_SUCCEEDED(ret) && size > 0)
+		{
+			node->data = (u8*) memAlloc("fsTreeLoad", size);
+			if (!node->data && memReclaim()) node->data = (u8*) memAlloc("fsTreeLoad", size);
+			if (!node->data) ret = -2;
+		}
+
+		if (R_SUCCEEDED(ret) && size > 0)
+		{
+			u32 bytesRead = 0;
+
+			ret = FSFILE_Read(fileHandle, &bytesRead, 0, node->data, size);
+			r(" > FSFILE_Read: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && bytesRead != size) ret = -3;
+		}
+
+		FSFILE_Close(fileHandle);
+		r(" > FSFILE_Close\n");
+
+		if (R_SUCCEEDED(ret))
+		{
+			u32 hash = hashCrc32(HASH_CRC32_INIT, node->data, size);
+
+			if (node->isHashed && node->hash != hash) ret = -5;
+
+			node->hash = hash;
+			node->isHashed = true;
+		}
+	}
+
+	return ret;
+}
+
+Result fsTreeStore(const fsTree* tree, const u16* root, const FS_Archive* archive)
+{
+	if (!tree || !root || !archive) return -1;
+
+	Result ret = 0;
+	Handle fileHandle;
+	u16 path[FS_MAX_PATH_LENGTH];
+	FS_FlushPolicy flush = FS_GetFlushPolicy(archive);
+
+	for (fsTreeNode* node = tree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeMakePath(path, root, node->path);
+
+		if (node->isDirectory)
+		{
+			if (!fsDirExists(path, archive))
+			{
+				ret = FSUSER_CreateDirectory(*archive, fsMakePath(PATH_UTF16, path), FS_ATTRIBUTE_DIRECTORY);
+				r(" > FSUSER_CreateDirectory: %lx\n", ret);
+			}
+			continue;
+		}
+
+		if (!node->data && node->size > 0)
+		{
+			ret = -1;
+			break;
+		}
+
+		ret = fsOpenWriteFile(&fileHandle, path, archive, FS_ATTRIBUTE_NONE, node->size, NULL);
+		if (R_FAILED(ret)) break;
+
+		if (node->size > 0)
+		{
+			u32 bytesWritten = 0;
+
+			// The file is written at once, a flush per write is a flush per file.
+			ret = FSFILE_Write(fileHandle, &bytesWritten, 0, node->data, node->size, (flush != FS_FLUSH_NONE ? FS_WRITE_FLUSH : 0));
+			r(" > FSFILE_Write: %lx\n", ret);
+			if (R_SUCCEEDED(ret) && bytesWritten != node->size) ret = -3;
+		}
+
+		FSFILE_Close(fileHandle);
+		r(" > FSFILE_Close\n");
+	}
+
+	return ret;
+}
+
+Result fsTreeRemove(const fsTree* tree, const u16* root, const FS_Archive* archive)
+{
+	if (!tree || !root || !archive) return -1;
+
+	Result ret = 0;
+	u16 path[FS_MAX_PATH_LENGTH];
+
+	for (fsTreeNode* node = tree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		fsTreeMakePath(path, root, node->path);
+
+		if (node->isDirectory)
+		{
+			ret = FSUSER_DeleteDirectoryRecursively(*archive, fsMakePath(PATH_UTF16, path));
+			r(" > FSUSER_DeleteDirectoryRecursively: %lx\n", ret);
+			if (R_FAILED(ret) && !fsDirExists(path, archive)) ret = 0;
+		}
+		else
+		{
+			ret = FSUSER_DeleteFile(*archive, fsMakePath(PATH_UTF16, path));
+			r(" > FSUSER_DeleteFile: %lx\n", ret);
+			if (R_FAILED(ret) && !fsFileExists(path, archive)) ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+Result fsTreeFree(fsTree* tree)
+{
+	if (!tree) return -1;
+
+	fsTreeNode* node = tree->firstNode;
+	fsTreeNode* next = NULL;
+
+	while (node)
+	{
+		next = node->nextNode;
+		memFree(node->data);
+		memFree(node);
+		node = next;
+	}
+
+	memset(tree, 0, sizeof(fsTree));
+
+	return 0;
+}
+
+Result fsTreeWrite(const fsTree* tree, const char* header, const u16* path, const FS_Archive* archive)
+{
+	if (!tree || !path || !archive) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_UTF16, path), archive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_TEXT_BUFFER_SIZE, FS_FLUSH_CLOSE);
+	if (R_FAILED(ret)) return ret;
+
+	// Format the tree line by line, the stream writes them by buffers.
+	char line[FS_TREE_LINE_LENGTH];
+	char path8[FS_MAX_PATH_LENGTH*3];
+
+	ret = FS_StreamWrite(&stream, FS_TREE_MAGIC, strlen(FS_TREE_MAGIC));
+	if (R_SUCCEEDED(ret) && header) ret = FS_StreamWrite(&stream, header, strlen(header));
+
+	for (fsTreeNode* node = tree->firstNode; node && R_SUCCEEDED(ret); node = node->nextNode)
+	{
+		u32 len;
+
+		memset(path8, 0, sizeof(path8));
+		utf16_to_utf8((u8*) path8, node->path, sizeof(path8) - 1);
+
+		if (node->isDirectory)
+			len = sprintf(line, "d %s\n", path8);
+		else if (node->isHashed)
+			len = sprintf(line, "f %08lx %llu %s\n", node->hash, node->size, path8);
+		else
+			len = sprintf(line, "f - %llu %s\n", node->size, path8);
+
+		ret = FS_StreamWrite(&stream, line, len);
+	}
+
+	// Drop the remains of an older digest file.
+	if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+	Result closeRet = FS_StreamClose(&stream);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
+
+	return ret;
+}
+
+/**
+ * @brief Parses a line of a digest file and appends its node to a tree.
+ * @param[in/out] tree The tree.
+ * @param[in] line The line to parse (null-terminated, without '\\n').
+ * @return -2 if the node couldn't be allocated, the tree is then incomplete.
+ */
+static Result fsTreeParseLine(fsTree* tree, char* line)
+{
+	u16 path16[FS_MAX_PATH_LENGTH];
+	memset(path16, 0, FS_MAX_PATH_LENGTH*sizeof(u16));
+
+	if (line[0] == 'd' && line[1] == ' ')
+	{
+		utf8_to_utf16(path16, (u8*) line + 2, FS_MAX_PATH_LENGTH - 1);
+		if (!fsTreeAddDir(tree, path16)) return -2;
+	}
+	else if (line[0] == 'f' && line[1] == ' ')
+	{
+		char* p = line + 2;
+		bool isHashed = (*p != '-');
+		u32 hash = (isHashed ? strtoul(p, &p, 16) : 0);
+		if (!isHashed) p++;
+		u64 size = strtoull(p, &p, 10);
+		if (*p++ != ' ') return 0;
+
+		utf8_to_utf16(path16, (u8*) p, FS_MAX_PATH_LENGTH - 1);
+		if (!fsTreeAddFile(tree, path16, size, isHashed ? &hash : NULL)) return -2;
+	}
+
+	// Any other line is ignored (comments and later extensions).
+	return 0;
+}
+
+Result fsTreeRead(fsTree* tree, const u16* path, const FS_Archive* archive)
+{
+	if (!tree || !path || !archive) return -1;
+
+	Result ret;
+	FS_Stream stream;
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_UTF16, path), archive, FS_OPEN_READ, FS_TEXT_BUFFER_SIZE, FS_FLUSH_NONE);
+	if (R_FAILED(ret)) return ret;
+
+	// Parse the file line by line, it is never loaded whole.
+	char line[FS_TREE_LINE_LENGTH];
+
+	ret = FS_StreamReadLine(&stream, line, sizeof(line));
+	if (ret == FS_STREAM_EOF || (R_SUCCEEDED(ret) && strncmp(line, FS_TREE_MAGIC, strlen(FS_TREE_MAGIC) - 1) != 0))
+		ret = -4;
+
+	while (ret == 0)
+	{
+		ret = FS_StreamReadLine(&stream, line, sizeof(line));
+		if (ret == 0) ret = fsTreeParseLine(tree, line);
+	}
+
+	if (ret == FS_STREAM_EOF) ret = 0;
+
+	FS_StreamClose(&stream);
+
+	return ret;
+}
+
+u32 fsTreeDigest(fsTree* tree)
+{
+	if (!tree) return 0;
+
+	fsTreeSort(tree);
+
+	// The digest of the sorted (path, size, hash) records.
+	u32 digest = HASH_CRC32_INIT;
+	for (fsTreeNode* node = tree->firstNode; node; node = node->nextNode)
+	{
+		digest = hashCrc32(digest, node->path, (str16len(node->path) + 1) * sizeof(u16));
+		if (node->isDirectory) continue;
+
+		digest = hashCrc32(digest, &node->size, sizeof(u64));
+		digest = hashCrc32(digest, &node->hash, sizeof(u32));
+	}
+
+	return digest;
+}
@@ -0,0 +1,397 @@
+#include "fstune.h"
+#include "fsbuf.h"
+#include "fsls.h"
+#include "fs.h"
+#include "console.h"
+#include "log.h"
+
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/result.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// #define r(format, args...) consoleLog(format, ##args)
+#define r(format, args...)
+
+const u32 fsTuneChunkSizes[FS_TUNE_CHUNK_COUNT] = { 0x4000, 0x10000, 0x40000 };
+
+static fsTuneResult results[FS_TUNE_MAX_ARCHIVES];
+static u32 resultCount = 0;
+static bool isInit = false;
+static FS_MediaType saveMediatype = MEDIATYPE_SD; // The mediatype of the running title (see fsTuneInit).
+
+/**
+ * @brief Gets the type of an archive, the key of its calibration.
+ * The user savedata and extdata lowpaths start with their mediatype,
+ * the save archive (empty lowpath) is on the media of the running title.
+ */
+static void fsTuneKey(const FS_Archive* archive, u32* archiveId, u32* mediatype)
+{
+	*archiveId = archive->id;
+	*mediatype = (archive->id == ARCHIVE_SAVEDATA ? saveMediatype : MEDIATYPE_SD);
+
+	if (archive->lowPath.type == PATH_BINARY && archive->lowPath.size >= sizeof(u32))
+		*mediatype = *(const u32*) archive->lowPath.data;
+}
+
+/**
+ * @brief Finds the calibration of the type of an archive.
+ * @return The calibration (NULL if none).
+ */
+static fsTuneResult* fsTuneFind(const FS_Archive* archive)
+{
+	if (!archive) return NULL;
+
+	u32 archiveId, mediatype;
+	fsTuneKey(archive, &archiveId, &mediatype);
+
+	for (u32 i = 0; i < resultCount; i++)
+	{
+		if (results[i].archiveId == archiveId && results[i].mediatype == mediatype)
+			return &results[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Loads the cached calibrations.
+ */
+static Result fsTuneLoad(const FS_Archive* sdmcArchive)
+{
+	Result ret;
+	FS_Stream stream;
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, FS_TUNE_PATH), sdmcArchive, FS_OPEN_READ, FS_TEXT_BUFFER_SIZE, FS_FLUSH_NONE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[FS_TUNE_LINE_LENGTH];
+
+	ret = FS_StreamReadLine(&stream, line, sizeof(line));
+	if (ret == FS_STREAM_EOF || (R_SUCCEEDED(ret) && strncmp(line, FS_TUNE_MAGIC, strlen(FS_TUNE_MAGIC) - 1) != 0))
+		ret = -4;
+
+	while (ret == 0 && resultCount < FS_TUNE_MAX_ARCHIVES)
+	{
+		ret = FS_StreamReadLine(&stream, line, sizeof(line));
+		if (ret != 0) break;
+
+		// The flush policy setting, kept with the calibrations.
+		FS_FlushPolicy flush;
+		if (strncmp(line, "flush ", 6) == 0)
+		{
+			if (R_SUCCEEDED(FS_ParseFlushPolicy(line + 6, &flush))) FS_SetFlushPolicy(flush);
+			else logWarn("Unknown flush policy: %s\n", line + 6);
+			continue;
+		}
+
+		fsTuneResult* result = &results[resultCount];
+		memset(result, 0, sizeof(fsTuneResult));
+
+		int count = sscanf(line, "a %lx %lu %lx %lx %lu %lu %lu %lu %lu %lu %lu %lu",
+			&result->archiveId, &result->mediatype, &result->readChunkSize, &result->writeChunkSize,
+			&result->readSpeed[0], &result->readSpeed[1], &result->readSpeed[2],
+			&result->writeSpeed[0], &result->writeSpeed[1], &result->writeSpeed[2],
+			&result->unalignedReadSpeed, &result->unalignedWriteSpeed);
+
+		if (count == 12 && result->readChunkSize > 0 && result->writeChunkSize > 0) resultCount++;
+	}
+
+	if (ret == FS_STREAM_EOF) ret = 0;
+
+	FS_StreamClose(&stream);
+
+	return ret;
+}
+
+/**
+ * @brief Stores the calibrations.
+ */
+static Result fsTuneStore(const FS_Archive* sdmcArchive)
+{
+	Result ret;
+	FS_Stream stream;
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, FS_TUNE_PATH), sdmcArchive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_TEXT_BUFFER_SIZE, FS_FLUSH_CLOSE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[FS_TUNE_LINE_LENGTH];
+
+	ret = FS_StreamWrite(&stream, FS_TUNE_MAGIC, strlen(FS_TUNE_MAGIC));
+
+	if (R_SUCCEEDED(ret))
+	{
+		u32 len = sprintf(line, "flush %s\n", FS_GetFlushPolicyName(FS_GetFlushPolicy(NULL)));
+		ret = FS_StreamWrite(&stream, line, len);
+	}
+
+	for (u32 i = 0; i < resultCount && R_SUCCEEDED(ret); i++)
+	{
+		const fsTuneResult* result = &results[i];
+
+		u32 len = sprintf(line, "a %lx %lu %lx %lx %lu %lu %lu %lu %lu %lu %lu %lu\n",
+			result->archiveId, result->mediatype, result->readChunkSize, result->writeChunkSize,
+			result->readSpeed[0], result->readSpeed[1], result->readSpeed[2],
+			result->writeSpeed[0], result->writeSpeed[1], result->writeSpeed[2],
+			result->unalignedReadSpeed, result->unalignedWriteSpeed);
+
+		ret = FS_StreamWrite(&stream, line, len);
+	}
+
+	if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+	Result closeRet = FS_StreamClose(&stream);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
+
+	return ret;
+}
+
+/**
+ * @brief Times a pass over the temporary file, by chunks.
+ * @param fileHandle The temporary file.
+ * @param[in/out] buffer The buffer (chunkSize bytes at least).
+ * @param chunkSize The size of the chunks.
+ * @param offset The offset of the first chunk (unaligned if not 0).
+ * @param write Whether to write, else read.
+ * @param[out] speed The speed (KB/s).
+ */
+static Result fsTunePass(Handle fileHandle, u8* buffer, u32 chunkSize, u32 offset, bool write, u32* speed)
+{
+	Result ret = 0;
+	u64 bytes = 0;
+
+	u64 startTick = svcGetSystemTick();
+
+	for (u64 pos = offset; R_SUCCEEDED(ret) && pos < FS_TUNE_FILE_SIZE; pos += chunkSize)
+	{
+		u32 done = 0;
+		u32 chunk = (FS_TUNE_FILE_SIZE - pos < chunkSize ? FS_TUNE_FILE_SIZE - pos : chunkSize);
+
+		if (write) ret = FSFILE_Write(fileHandle, &done, pos, buffer, chunk, 0);
+		else ret = FSFILE_Read(fileHandle, &done, pos, buffer, chunk);
+		r(" > FSFILE_%s: %lx\n", (write ? "Write" : "Read"), ret);
+		if (R_SUCCEEDED(ret) && done != chunk) ret = -3;
+
+		bytes += done;
+	}
+
+	// The writes count once on the media.
+	if (R_SUCCEEDED(ret) && write)
+	{
+		ret = FSFILE_Flush(fileHandle);
+		r(" > FSFILE_Flush: %lx\n", ret);
+	}
+
+	u64 ticks = svcGetSystemTick() - startTick;
+	*speed = (ticks > 0 ? (u32) (bytes * SYSCLOCK_ARM11 / ticks / 1024) : 0);
+
+	return ret;
+}
+
+/**
+ * @brief Gets the best chunk size of speeds, a smaller one if within 5%.
+ */
+static u32 fsTuneBest(const u32* speeds)
+{
+	u32 best = 0;
+
+	for (u32 i = 1; i < FS_TUNE_CHUNK_COUNT; i++)
+	{
+		if ((u64) speeds[i] * 100 > (u64) speeds[best] * 105) best = i;
+	}
+
+	return best;
+}
+
+void fsTuneInit(void)
+{
+	memset(results, 0, sizeof(results));
+	resultCount = 0;
+	isInit = true;
+
+	// A cartridge save isn't calibrated as a digital one.
+	Result ret = FSUSER_GetMediaType(&saveMediatype);
+	if (R_FAILED(ret))
+	{
+		logWarn("Couldn't get the mediatype: %lx\n", ret);
+		saveMediatype = MEDIATYPE_SD;
+	}
+
+	const FS_Archive* sdmcArchive = NULL;
+	if (R_FAILED(FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive))) return;
+
+	// No cache yet, each archive type will be calibrated on its first use.
+	fsTuneLoad(sdmcArchive);
+
+	FS_ReleaseArchive(sdmcArchive);
+}
+
+void fsTuneExit(void)
+{
+	resultCount = 0;
+	isInit = false;
+}
+
+Result fsTuneArchive(const FS_Archive* archive, bool force)
+{
+	if (!archive) return -1;
+	if (!isInit) return 0;
+
+	fsTuneResult* result = fsTuneFind(archive);
+	if (result && !force) return 0;
+
+	if (!result)
+	{
+		if (resultCount >= FS_TUNE_MAX_ARCHIVES) return -2;
+		result = &results[resultCount];
+	}
+
+	Result ret;
+	Handle fileHandle;
+	fsTuneResult tune;
+
+	memset(&tune, 0, sizeof(fsTuneResult));
+	fsTuneKey(archive, &tune.archiveId, &tune.mediatype);
+
+	consoleLog("Calibrating the archive %lx (%lu)...\n", tune.archiveId, tune.mediatype);
+
+	// Created at its size, as the extdata files can't grow.
+	FS_Path path = fsMakePath(PATH_ASCII, FS_TUNE_FILE_PATH);
+	FSUSER_DeleteFile(*archive, path);
+
+	ret = FSUSER_CreateFile(*archive, path, FS_ATTRIBUTE_NONE, FS_TUNE_FILE_SIZE);
+	r(" > FSUSER_CreateFile: %lx\n", ret);
+	if (R_FAILED(ret)) return ret;
+
+	ret = FSUSER_OpenFile(&fileHandle, *archive, path, FS_OPEN_READ | FS_OPEN_WRITE, FS_ATTRIBUTE_NONE);
+	r(" > FSUSER_OpenFile: %lx\n", ret);
+
+	if (R_SUCCEEDED(ret))
+	{
+		u32 bufferSize = fsTuneChunkSizes[FS_TUNE_CHUNK_COUNT - 1];
+		u8* buffer = (u8*) fsBufferAlloc(bufferSize);
+		if (!buffer) ret = -2;
+
+		if (R_SUCCEEDED(ret)) memset(buffer, 0xA5, bufferSize);
+
+		// Written first, so the reads aren't of a sparse file.
+		for (u32 i = 0; i < FS_TUNE_CHUNK_COUNT && R_SUCCEEDED(ret); i++)
+		{
+			ret = fsTunePass(fileHandle, buffer, fsTuneChunkSizes[i], 0, true, &tune.writeSpeed[i]);
+			if (R_SUCCEEDED(ret)) ret = fsTunePass(fileHandle, buffer, fsTuneChunkSizes[i], 0, false, &tune.readSpeed[i]);
+		}
+
+		if (R_SUCCEEDED(ret))
+		{
+			tune.readChunkSize = fsTuneChunkSizes[fsTuneBest(tune.readSpeed)];
+			tune.writeChunkSize = fsTuneChunkSizes[fsTuneBest(tune.writeSpeed)];
+
+			ret = fsTunePass(fileHandle, buffer, tune.writeChunkSize, FS_TUNE_UNALIGNED_OFFSET, true, &tune.unalignedWriteSpeed);
+			if (R_SUCCEEDED(ret)) ret = fsTunePass(fileHandle, buffer, tune.readChunkSize, FS_TUNE_UNALIGNED_OFFSET, false, &tune.unalignedReadSpeed);
+		}
+
+		fsBufferFree(buffer);
+
+		FSFILE_Close(fileHandle);
+		r(" > FSFILE_Close\n");
+	}
+
+	// Never committed, the save keeps its content.
+	FSUSER_DeleteFile(*archive, path);
+
+	if (R_FAILED(ret))
+	{
+		logError("Couldn't calibrate: %lx\n", ret);
+		return ret;
+	}
+
+	if (result == &results[resultCount]) resultCount++;
+	*result = tune;
+
+	consoleLog("  read %lu KB, write %lu KB chunks\n", tune.readChunkSize / 1024, tune.writeChunkSize / 1024);
+
+	const FS_Archive* sdmcArchive = NULL;
+	ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+
+	if (R_SUCCEEDED(ret))
+	{
+		ret = fsTuneStore(sdmcArchive);
+		FS_ReleaseArchive(sdmcArchive);
+	}
+
+	return ret;
+}
+
+u32 fsTuneGetChunkSize(const FS_Archive* srcArchive, const FS_Archive* dstArchive)
+{
+	u32 chunkSize = FS_COPY_CHUNK_SIZE;
+
+	const fsTuneResult* src = fsTuneFind(srcArchive);
+	const fsTuneResult* dst = fsTuneFind(dstArchive);
+
+	// One buffer for both, the smaller chunk suits both archives.
+	if (src && dst) chunkSize = (src->readChunkSize < dst->writeChunkSize ? src->readChunkSize : dst->writeChunkSize);
+	else if (src) chunkSize = src->readChunkSize;
+	else if (dst) chunkSize = dst->writeChunkSize;
+
+	return chunkSize;
+}
+
+/**
+ * @brief Gets the display name of an archive type.
+ */
+static const char* fsTuneName(u32 archiveId)
+{
+	switch (archiveId)
+	{
+		case ARCHIVE_SDMC: return "Sdmc";
+		case ARCHIVE_SAVEDATA: return "Save";
+		case ARCHIVE_USER_SAVEDATA: return "User save";
+		case ARCHIVE_EXTDATA: return "Extdata";
+		default: return "Archive";
+	}
+}
+
+/**
+ * @brief Gets the display name of a mediatype.
+ */
+static const char* fsTuneMedia(u32 mediatype)
+{
+	switch (mediatype)
+	{
+		case MEDIATYPE_NAND: return "NAND";
+		case MEDIATYPE_SD: return "SD";
+		case MEDIATYPE_GAME_CARD: return "Card";
+		default: return "?";
+	}
+}
+
+void fsTunePrint(void)
+{
+	consoleSelect(&logConsole);
+	consoleClear();
+
+	printf("I/O calibration (KB/s):\n");
+	if (resultCount == 0) printf("  None yet.\n");
+
+	for (u32 i = 0; i < resultCount; i++)
+	{
+		const fsTuneResult* result = &results[i];
+
+		printf("\n%s (%s): read %lu KB, write %lu KB\n", fsTuneName(result->archiveId), fsTuneMedia(result->mediatype), result->readChunkSize / 1024, result->writeChunkSize / 1024);
+
+		for (u32 j = 0; j < FS_TUNE_CHUNK_COUNT; j++)
+			printf("  %3lu KB: read %6lu, write %6lu\n", fsTuneChunkSizes[j] / 1024, result->readSpeed[j], result->writeSpeed[j]);
+
+		printf("  +%u B: read %6lu, write %6lu\n", FS_TUNE_UNALIGNED_OFFSET, result->unalignedReadSpeed, result->unalignedWriteSpeed);
+	}
+
+	printf("\nFlush: %s (flush none|write|close in %s)\n", FS_GetFlushPolicyName(FS_GetFlushPolicy(NULL)), FS_TUNE_PATH);
+	printf("Delete %s to calibrate again.\n", FS_TUNE_PATH);
+
+	consoleSelectDefault();
+}
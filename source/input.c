@@ -0,0 +1,322 @@
+#include "input.h"
+#include "frame.h"
+#include "fsstats.h"
+#include "fsls.h"
+#include "fs.h"
+#include "mem.h"
+#include "console.h"
+#include "log.h"
+
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/result.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// #define r(format, args...) consoleLog(format, ##args)
+#define r(format, args...)
+
+static inputMode mode = INPUT_LIVE;
+static u32 scanCount = 0;		// The scans since the launch.
+static u32 keysDown = 0;
+static u32 keysHeld = 0;
+static u32 launchKeys = 0;		// The keys held at launch, not released yet.
+
+/// The events of the session recorded or replayed.
+static inputEvent* events = NULL;
+static u32 eventCount = 0;
+static u32 eventCapacity = 0;
+static u32 eventIndex = 0;		// The next event replayed.
+
+/// The start of the replay.
+static u64 replayTicks = 0;
+static u32 replayMissedCount = 0;
+static u32 replayCallCount = 0;
+
+/**
+ * @brief Gets the count of the FS calls since the start (or the latest reset).
+ */
+static u32 inputGetCallCount(void)
+{
+	u32 count = 0;
+
+	for (u32 op = 0; op < FS_STATS_OP_COUNT; op++)
+	{
+		fsStatsCounters counters;
+		fsStatsGet(op, &counters);
+		count += counters.count;
+	}
+
+	return count;
+}
+
+/**
+ * @brief Appends an event to the session.
+ * @return Whether the event was appended (false if out of memory).
+ */
+static bool inputAppendEvent(u32 frame, u32 keys)
+{
+	if (eventCount == eventCapacity)
+	{
+		inputEvent* grown = (inputEvent*) memRealloc("inputAppendEvent", events, (eventCapacity + INPUT_EVENT_CHUNK) * sizeof(inputEvent));
+		if (!grown) return false;
+
+		events = grown;
+		eventCapacity += INPUT_EVENT_CHUNK;
+	}
+
+	events[eventCount].frame = frame;
+	events[eventCount].keys = keys;
+	eventCount++;
+	return true;
+}
+
+/**
+ * @brief Loads the recorded session.
+ */
+static Result inputLoad(const FS_Archive* sdmcArchive)
+{
+	Result ret;
+	FS_Stream stream;
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, INPUT_PATH), sdmcArchive, FS_OPEN_READ, FS_TEXT_BUFFER_SIZE, FS_FLUSH_NONE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[INPUT_LINE_LENGTH];
+
+	ret = FS_StreamReadLine(&stream, line, sizeof(line));
+	if (ret == FS_STREAM_EOF || (R_SUCCEEDED(ret) && strncmp(line, INPUT_MAGIC, strlen(INPUT_MAGIC) - 1) != 0))
+		ret = -4;
+
+	while (ret == 0)
+	{
+		ret = FS_StreamReadLine(&stream, line, sizeof(line));
+		if (ret != 0) break;
+
+		u32 frame, keys;
+		if (sscanf(line, "%lu %lx", &frame, &keys) != 2) continue;
+
+		// The frames shall increase, else the replay would differ from the session.
+		if (eventCount > 0 && frame <= events[eventCount - 1].frame)
+		{
+			ret = -4;
+			break;
+		}
+
+		if (!inputAppendEvent(frame, keys)) ret = -2;
+	}
+
+	if (ret == FS_STREAM_EOF) ret = 0;
+
+	FS_StreamClose(&stream);
+
+	return ret;
+}
+
+/**
+ * @brief Stores the recorded session.
+ */
+static Result inputStore(const FS_Archive* sdmcArchive)
+{
+	Result ret;
+	FS_Stream stream;
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, INPUT_PATH), sdmcArchive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_TEXT_BUFFER_SIZE, FS_FLUSH_CLOSE);
+	if (R_FAILED(ret)) return ret;
+
+	char line[INPUT_LINE_LENGTH];
+
+	ret = FS_StreamWrite(&stream, INPUT_MAGIC, strlen(INPUT_MAGIC));
+
+	for (u32 i = 0; i < eventCount && R_SUCCEEDED(ret); i++)
+	{
+		u32 len = sprintf(line, "%lu %08lx\n", events[i].frame, events[i].keys);
+		ret = FS_StreamWrite(&stream, line, len);
+	}
+
+	if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+	Result closeRet = FS_StreamClose(&stream);
+	if (R_SUCCEEDED(ret)) ret = closeRet;
+
+	return ret;
+}
+
+/**
+ * @brief Stores the timings of the replay, to compare the builds.
+ */
+static Result inputStoreReplay(u32 frames, u64 ticks, u32 missedCount, u32 callCount)
+{
+	Result ret;
+	const FS_Archive* sdmcArchive = NULL;
+
+	ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret)) return ret;
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	FS_Stream stream;
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, INPUT_REPLAY_PATH), sdmcArchive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_TEXT_BUFFER_SIZE, FS_FLUSH_CLOSE);
+	if (R_SUCCEEDED(ret))
+	{
+		char text[INPUT_LINE_LENGTH * 4];
+		u32 len = sprintf(text, INPUT_REPLAY_MAGIC "frames %lu\nticks %llu\nms %llu\nmissed %lu\ncalls %lu\n",
+			frames, ticks, ticks * 1000 / SYSCLOCK_ARM11, missedCount, callCount);
+
+		ret = FS_StreamWrite(&stream, text, len);
+		if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+		Result closeRet = FS_StreamClose(&stream);
+		if (R_SUCCEEDED(ret)) ret = closeRet;
+	}
+
+	FS_ReleaseArchive(sdmcArchive);
+
+	return ret;
+}
+
+/**
+ * @brief Ends the replay, logs and stores its timings.
+ */
+static void inputEndReplay(void)
+{
+	u64 ticks = svcGetSystemTick() - replayTicks;
+	u32 missedCount = frameGetMissedCount() - replayMissedCount;
+	u32 callCount = inputGetCallCount() - replayCallCount;
+
+	mode = INPUT_LIVE;
+	launchKeys = 0;
+
+	consoleLog("Replay: %lu frames in %llu ms\n", scanCount, ticks * 1000 / SYSCLOCK_ARM11);
+	consoleLog("  %lu vblank(s) missed, %lu FS call(s)\n", missedCount, callCount);
+
+	Result ret = inputStoreReplay(scanCount, ticks, missedCount, callCount);
+	r(" > inputStoreReplay: %lx\n", ret);
+	if (R_FAILED(ret)) logError("Couldn't store the replay: %lx\n", ret);
+}
+
+void inputInit(void)
+{
+	mode = INPUT_LIVE;
+	scanCount = 0;
+	keysDown = 0;
+	keysHeld = 0;
+	eventCount = 0;
+	eventIndex = 0;
+
+	hidScanInput();
+	launchKeys = hidKeysHeld();
+
+	if (launchKeys & INPUT_RECORD_KEY)
+	{
+		mode = INPUT_RECORD;
+		consoleLog("Recording the session to %s\n", INPUT_PATH);
+	}
+	else if (launchKeys & INPUT_REPLAY_KEY)
+	{
+		const FS_Archive* sdmcArchive = NULL;
+		Result ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+		if (R_SUCCEEDED(ret))
+		{
+			ret = inputLoad(sdmcArchive);
+			r(" > inputLoad: %lx\n", ret);
+			FS_ReleaseArchive(sdmcArchive);
+		}
+
+		if (R_FAILED(ret) || eventCount == 0)
+		{
+			logError("Couldn't load %s: %lx\n", INPUT_PATH, ret);
+			eventCount = 0;
+			return;
+		}
+
+		mode = INPUT_REPLAY;
+		consoleLog("Replaying %lu event(s) of %s\n", eventCount, INPUT_PATH);
+
+		replayTicks = svcGetSystemTick();
+		replayMissedCount = frameGetMissedCount();
+		replayCallCount = inputGetCallCount();
+	}
+}
+
+void inputExit(void)
+{
+	if (mode == INPUT_RECORD)
+	{
+		const FS_Archive* sdmcArchive = NULL;
+		Result ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+		if (R_SUCCEEDED(ret))
+		{
+			ret = inputStore(sdmcArchive);
+			FS_ReleaseArchive(sdmcArchive);
+		}
+
+		consoleLog("  > inputStore: %lx (%lu event(s))\n", ret, eventCount);
+	}
+
+	memFree(events);
+	events = NULL;
+	eventCount = 0;
+	eventCapacity = 0;
+	eventIndex = 0;
+	mode = INPUT_LIVE;
+}
+
+void inputScan(void)
+{
+	u32 frame = scanCount++;
+	u32 keys;
+
+	hidScanInput();
+
+	if (mode == INPUT_REPLAY)
+	{
+		// The keys pressed meanwhile are ignored.
+		keys = keysHeld;
+		while (eventIndex < eventCount && events[eventIndex].frame <= frame)
+			keys = events[eventIndex++].keys;
+	}
+	else
+	{
+		// The keys held at launch are ignored until released.
+		keys = hidKeysHeld();
+		launchKeys &= keys;
+		keys &= ~launchKeys;
+
+		if (mode == INPUT_RECORD && keys != keysHeld && !inputAppendEvent(frame, keys))
+		{
+			consoleLog("Recording stopped: out of memory\n");
+			mode = INPUT_LIVE;
+		}
+	}
+
+	keysDown = keys & ~keysHeld;
+	keysHeld = keys;
+
+	if (mode == INPUT_REPLAY && eventIndex == eventCount)
+		inputEndReplay();
+}
+
+u32 inputKeysDown(void)
+{
+	return keysDown;
+}
+
+u32 inputKeysHeld(void)
+{
+	return keysHeld;
+}
+
+inputMode inputGetMode(void)
+{
+	return mode;
+}
+
+u32 inputGetFrame(void)
+{
+	return (scanCount > 0 ? scanCount - 1 : 0);
+}
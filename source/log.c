@@ -0,0 +1,414 @@
+#include "log.h"
+#include "fs.h"
+#include "console.h"
+
+#include <3ds/os.h>
+#include <3ds/svc.h>
+#include <3ds/thread.h>
+#include <3ds/result.h>
+#include <3ds/services/fs.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// #define r(format, args...) consoleLog(format, ##args)
+#define r(format, args...)
+
+bool logFileEnabled = false;
+
+/// A record of the ring.
+typedef struct
+{
+	u32 sequence;					///< The index of the record + 1 once written (0 while written)
+	u32 level;						///< The level of the record
+	u64 tick;						///< The time of the record (ticks)
+	char text[LOG_RECORD_LENGTH];	///< The text of the record
+} logRecord;
+
+/// The ring of the records, the oldest overwritten first.
+static logRecord records[LOG_CAPACITY];
+static u32 writeIndex = 0;		// The count of the records reserved.
+static u64 startTick = 0;		// The time of the first record.
+
+/// The console sink (main thread).
+static u32 consoleIndex = 0;	// The next record printed.
+static bool isViewing = false;	// Whether the viewer holds the flushes.
+
+/// The file sink (its thread).
+static u32 fileIndex = 0;		// The next record written.
+static u32 fileDropped = 0;		// The records overwritten before written.
+static bool atLineStart = true;	// Whether the next record starts a line of the file.
+static bool isStopping = false;
+static Handle wakeSemaphore = 0;
+static Thread thread = NULL;
+static Handle fileHandle = 0;
+static u64 fileOffset = 0;
+static Result writeRet = 0;
+static const FS_Archive* sdmcArchive = NULL;
+static char fileBuffer[LOG_FILE_BUFFER_SIZE];
+
+void logWriteV(u32 level, const char* format, va_list args)
+{
+	u64 tick = svcGetSystemTick();
+	u32 index = __atomic_fetch_add(&writeIndex, 1, __ATOMIC_RELAXED);
+	if (index == 0) startTick = tick;
+
+	// A seqlock: the readers skip the record while its sequence is not index + 1.
+	logRecord* record = &records[index % LOG_CAPACITY];
+	__atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	record->level = level;
+	record->tick = tick;
+	vsnprintf(record->text, LOG_RECORD_LENGTH, format, args);
+
+	__atomic_store_n(&record->sequence, index + 1, __ATOMIC_RELEASE);
+
+	// The file thread is woken before its records are overwritten.
+	if (logFileEnabled && index + 1 - fileIndex >= LOG_CAPACITY / 2)
+	{
+		s32 count;
+		svcReleaseSemaphore(&count, wakeSemaphore, 1);
+	}
+
+	// The main thread prints its records by batches, so the long operations still show their progress.
+	if (!threadGetCurrent() && !isViewing && index + 1 - consoleIndex >= LOG_FLUSH_RECORDS) logFlush();
+}
+
+void logWrite(u32 level, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	logWriteV(level, format, args);
+	va_end(args);
+}
+
+/**
+ * @brief Copies a record of the ring.
+ * @param index The index of the record.
+ * @param[out] copy The copy of the record.
+ * @param[out] overwritten Whether the record was overwritten by a newer one.
+ * @return Whether the record was copied (else not yet written or overwritten).
+ */
+static bool logRead(u32 index, logRecord* copy, bool* overwritten)
+{
+	const logRecord* record = &records[index % LOG_CAPACITY];
+	*overwritten = false;
+
+	u32 sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+	if (sequence == index + 1)
+	{
+		memcpy(copy, record, sizeof(logRecord));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == sequence) return true;
+		sequence = __atomic_load_n(&record->sequence, __ATOMIC_RELAXED);
+	}
+
+	*overwritten = (sequence != 0 && (s32) (sequence - (index + 1)) > 0);
+	return false;
+}
+
+/**
+ * @brief Moves a reader to the oldest record still in the ring.
+ * @param[in/out] index The next record of the reader.
+ * @param end The count of the records reserved.
+ * @return The count of the records skipped.
+ */
+static u32 logCatchUp(u32* index, u32 end)
+{
+	if (end - *index <= LOG_CAPACITY) return 0;
+
+	u32 skipped = end - *index - LOG_CAPACITY;
+	*index = end - LOG_CAPACITY;
+	return skipped;
+}
+
+/**
+ * @brief Prints a record to the log console, colored by its level.
+ */
+static void logPrint(const logRecord* record)
+{
+	if (record->level >= LOG_ERROR) consoleForegroundColor(RED);
+	else if (record->level == LOG_WARN) consoleForegroundColor(YELLOW);
+	else if (record->level == LOG_DEBUG) consoleForegroundColor(GRAY);
+
+	fputs(record->text, stdout);
+
+	if (record->level != LOG_INFO) consoleResetColor();
+}
+
+void logFlush(void)
+{
+	if (isViewing) return;
+
+	u32 end = __atomic_load_n(&writeIndex, __ATOMIC_ACQUIRE);
+	if (consoleIndex == end) return;
+
+	logRecord record;
+	bool overwritten;
+	u32 skipped = logCatchUp(&consoleIndex, end);
+
+	consoleSelect(&logConsole);
+
+	if (skipped > 0) printf("(%lu record(s) skipped)\n", skipped);
+
+	for (; consoleIndex != end; consoleIndex++)
+	{
+		if (logRead(consoleIndex, &record, &overwritten)) logPrint(&record);
+		else if (!overwritten) break; // Still written, printed by the next flush.
+	}
+
+	consoleSelectDefault();
+}
+
+/**
+ * @brief Opens the file, appended (with sdmcArchive).
+ */
+static Result logFileOpen(void)
+{
+	Result ret = FSUSER_OpenFile(&fileHandle, *sdmcArchive, fsMakePath(PATH_ASCII, LOG_PATH), FS_OPEN_WRITE | FS_OPEN_CREATE, FS_ATTRIBUTE_NONE);
+	r(" > FSUSER_OpenFile: %lx\n", ret);
+	if (R_FAILED(ret))
+	{
+		fileHandle = 0;
+		return ret;
+	}
+
+	ret = FSFILE_GetSize(fileHandle, &fileOffset);
+	if (R_FAILED(ret))
+	{
+		FSFILE_Close(fileHandle);
+		fileHandle = 0;
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Moves the full file to LOG_OLD_PATH (the previous one is deleted), then opens a new one.
+ */
+static Result logFileRotate(void)
+{
+	Result ret = FSFILE_Close(fileHandle);
+	fileHandle = 0;
+
+	FSUSER_DeleteFile(*sdmcArchive, fsMakePath(PATH_ASCII, LOG_OLD_PATH));
+	if (R_SUCCEEDED(ret)) ret = FSUSER_RenameFile(*sdmcArchive, fsMakePath(PATH_ASCII, LOG_PATH), *sdmcArchive, fsMakePath(PATH_ASCII, LOG_OLD_PATH));
+	r(" > FSUSER_RenameFile: %lx\n", ret);
+
+	Result openRet = logFileOpen();
+	return (R_FAILED(ret) ? ret : openRet);
+}
+
+/**
+ * @brief Writes the buffered text to the file, rotated when full.
+ */
+static void logFileWriteBuffer(u32 length)
+{
+	if (length == 0 || !fileHandle) return;
+
+	u32 bytesWritten = 0;
+	Result ret = FSFILE_Write(fileHandle, &bytesWritten, fileOffset, fileBuffer, length, 0);
+	r(" > FSFILE_Write: %lx\n", ret);
+	if (R_SUCCEEDED(ret) && bytesWritten != length) ret = -3;
+	fileOffset += bytesWritten;
+
+	if (R_SUCCEEDED(ret) && fileOffset >= LOG_FILE_MAX_SIZE) ret = logFileRotate();
+	if (R_FAILED(ret) && R_SUCCEEDED(writeRet)) writeRet = ret;
+}
+
+/**
+ * @brief Writes the pending records to the file, each line prefixed with its time and level.
+ */
+static void logFileWrite(void)
+{
+	static const char levels[] = { 'D', 'I', 'W', 'E' };
+
+	u32 end = __atomic_load_n(&writeIndex, __ATOMIC_ACQUIRE);
+	fileDropped += logCatchUp(&fileIndex, end);
+
+	logRecord record;
+	bool overwritten;
+	u32 length = 0;
+
+	for (; fileIndex != end; fileIndex++)
+	{
+		if (!logRead(fileIndex, &record, &overwritten))
+		{
+			if (!overwritten) break;
+			fileDropped++;
+			continue;
+		}
+
+		if (length + LOG_RECORD_LENGTH + 32 > LOG_FILE_BUFFER_SIZE) // with its prefix
+		{
+			logFileWriteBuffer(length);
+			length = 0;
+		}
+
+		if (atLineStart)
+		{
+			u64 ms = (record.tick - startTick) * 1000 / SYSCLOCK_ARM11;
+			length += sprintf(fileBuffer + length, "%6llu.%03llu %c ", ms / 1000, ms % 1000, levels[record.level & 3]);
+		}
+
+		u32 textLength = strlen(record.text);
+		memcpy(fileBuffer + length, record.text, textLength);
+		length += textLength;
+		atLineStart = (textLength > 0 && record.text[textLength - 1] == '\n');
+	}
+
+	logFileWriteBuffer(length);
+}
+
+/**
+ * @brief Writes the records periodically, or once woken, until the stop.
+ */
+static void logFileThread(void* arg)
+{
+	(void) arg;
+
+	while (true)
+	{
+		svcWaitSynchronization(wakeSemaphore, LOG_FILE_PERIOD);
+
+		bool stopping = __atomic_load_n(&isStopping, __ATOMIC_ACQUIRE);
+		logFileWrite();
+
+		if (stopping) break;
+	}
+}
+
+/**
+ * @brief Frees the file sink, after its thread.
+ */
+static void logFileFree(void)
+{
+	if (fileHandle)
+	{
+		FSFILE_Close(fileHandle);
+		fileHandle = 0;
+	}
+
+	if (wakeSemaphore)
+	{
+		svcCloseHandle(wakeSemaphore);
+		wakeSemaphore = 0;
+	}
+
+	if (sdmcArchive)
+	{
+		FS_ReleaseArchive(sdmcArchive);
+		sdmcArchive = NULL;
+	}
+}
+
+Result logFileStart(void)
+{
+	if (logFileEnabled) return 0;
+
+	Result ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret))
+	{
+		sdmcArchive = NULL;
+		return ret;
+	}
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	ret = logFileOpen();
+	if (R_FAILED(ret))
+	{
+		logFileFree();
+		return ret;
+	}
+
+	// The history first.
+	u32 end = __atomic_load_n(&writeIndex, __ATOMIC_ACQUIRE);
+	fileIndex = (end > LOG_CAPACITY ? end - LOG_CAPACITY : 0);
+	fileDropped = 0;
+	atLineStart = true;
+	writeRet = 0;
+	isStopping = false;
+
+	svcCreateSemaphore(&wakeSemaphore, 0, 1);
+
+	thread = threadCreate(logFileThread, NULL, LOG_STACK_SIZE, LOG_THREAD_PRIORITY, -2, false);
+	if (!thread)
+	{
+		logFileFree();
+		return -3;
+	}
+
+	logFileEnabled = true;
+
+	return 0;
+}
+
+Result logFileStop(void)
+{
+	if (!logFileEnabled) return -1;
+
+	logFileEnabled = false;
+	__atomic_store_n(&isStopping, true, __ATOMIC_RELEASE);
+
+	s32 count;
+	svcReleaseSemaphore(&count, wakeSemaphore, 1);
+
+	threadJoin(thread, U64_MAX);
+	threadFree(thread);
+	thread = NULL;
+
+	Result ret = writeRet;
+	if (R_SUCCEEDED(ret) && fileHandle) ret = FSFILE_Flush(fileHandle);
+
+	logFileFree();
+
+	if (fileDropped > 0) logWarn("Log: %lu record(s) dropped\n", fileDropped);
+
+	return ret;
+}
+
+u32 logViewPrint(u32 offset)
+{
+	u32 end = __atomic_load_n(&writeIndex, __ATOMIC_ACQUIRE);
+	u32 count = (end > LOG_CAPACITY ? LOG_CAPACITY : end);
+	u32 first = end - count;
+
+	if (offset + LOG_VIEW_RECORDS > count) offset = (count > LOG_VIEW_RECORDS ? count - LOG_VIEW_RECORDS : 0);
+
+	u32 last = end - offset;
+	u32 shown = (count - offset < LOG_VIEW_RECORDS ? count - offset : LOG_VIEW_RECORDS);
+
+	isViewing = true;
+
+	consoleSelect(&logConsole);
+	consoleClear();
+
+	printf("Log: %lu-%lu of %lu\n", last - shown - first + (shown > 0), last - first, count);
+
+	logRecord record;
+	bool overwritten;
+
+	for (u32 i = last - shown; i != last; i++)
+	{
+		if (logRead(i, &record, &overwritten)) logPrint(&record);
+	}
+
+	consoleSelectDefault();
+
+	return offset;
+}
+
+void logViewClose(void)
+{
+	isViewing = false;
+}
+
+void logExit(void)
+{
+	if (logFileEnabled) logFileStop();
+
+	isViewing = false;
+	logFlush();
+}
@@ -3,14 +3,26 @@
 #include <string.h>
 
 #include "fs.h"
+#include "fsbuf.h"
+#include "fstune.h"
 #include "fsdir.h"
+#include "fsbatch.h"
+#include "fsbench.h"
+#include "fsstats.h"
+#include "fscapture.h"
+#include "mem.h"
+#include "trace.h"
+#include "frame.h"
+#include "input.h"
 
 #include "key.h"
 #include "save.h"
 #include "console.h"
+#include "log.h"
 
 #define HELD_TICK (16000000)
 #define NO_HELD_TICK
+// #define AUTO_BACKUP
 
 typedef enum {
 	STATE_START,		///< Start
@@ -19,6 +31,7 @@ typedef enum {
 	STATE_BROWSE,		///< Browse
 	STATE_BACKUP,		///< Backup
 	STATE_BACKUP_KEY,	///< Backup Rename
+	STATE_BENCHMARK,	///< Benchmark
 } State;
 
 static State state;
@@ -26,6 +39,8 @@ static u64 titleid;
 
 void drawHelp(void)
 {
+	u64 renderStart = frameRenderBegin();
+
 	consoleSelect(&logConsole);
 	consoleClear();
 
@@ -40,21 +55,48 @@ void drawHelp(void)
 			printf("> [L/R] Swap between Save/Sdmc folder\n");
 			printf("> [A] Navigate inside a folder\n");
 			printf("> [B] Return to the parent folder\n");
+			printf("> [Select]+[A] Show the I/O calibration\n");
+			printf("> [Select]+[B] Swap between Save/Extdata\n");
 			printf("> [X] Delete the current file/folder\n");
-			printf("> [Y] Copy the current file/folder\n");
+			printf("> [Y] Copy and verify the current file/folder\n");
+			printf("> [Select]+[Y] Mirror the current folder\n");
+			printf("> [Select]+[X] Mirror and delete the extras\n");
 			break;
 		}
 		case STATE_BACKUP:
 		{
 			printf("> [Up/Down] Select backup\n");
-			printf("> [A] Inject the selected backup back\n");
+			printf("> [A] Inject the changes of the selected backup\n");
+			printf("> [Select]+[A] Inject the whole selected backup\n");
 			printf("> [X] Delete the selected backup\n");
-			printf("> [Y] Create a new backup\n");
+			printf("> [Y] Create a new backup (if the save changed)\n");
+			printf("> [Select]+[Y] Create a new backup anyway\n");
+			printf("> [Right] Verify the selected backup\n");
+			printf("> [Left] Back up all the installed titles\n");
+			printf("> [Select]+[B] Swap between Save/Extdata\n");
+			break;
+		}
+		case STATE_BENCHMARK:
+		{
+			printf("> [A] Benchmark the Save and Sdmc archives\n");
+			printf("  (results also written to /tvds/bench)\n");
+			printf("> [Y] Start/Stop tracing the FS and UI work\n");
+			printf("> [X] Dump the trace to /tvds/trace.json\n");
+			printf("> [B] Start/Stop capturing the FS calls\n");
+			printf("  to /tvds/fs.cap (see tvds-fsreplay)\n");
+			printf("  Title line: input/logic/render/flush (ms)\n");
+			printf("  and vblanks missed, per %u frames\n", FRAME_WINDOW);
+			printf("  Hold [L] at launch to record the session,\n");
+			printf("  [R] to replay it (timings in /tvds/replay)\n");
+			printf("> [Up] Start/Stop the log file /tvds/log.txt\n");
 			break;
 		}
 		default: break;
 	}
 
+	printf("> [Select]+[L] Show/Hide the FS statistics\n");
+	printf("> [Select]+[R] Reset the FS and heap statistics\n");
+	printf("> [Select]+[Up] Show the log history\n");
 	printf("> [Select] Print these instructions\n");
 	printf("> [Start] Exit tvds\n");
 	printf("\n");
@@ -67,6 +109,8 @@ void drawHelp(void)
 	printf("Title id: 0x%016llx", titleid);
 
 	consoleSelectDefault();
+
+	frameRenderEnd("drawHelp", renderStart);
 }
 
 void drawBrowse(void)
@@ -83,13 +127,20 @@ void drawBackup(void)
 	drawHelp();
 }
 
+void drawBenchmark(void)
+{
+	fsBenchPrint();
+	drawHelp();
+}
+
 void switchState(State* state)
 {
 	switch (*state)
 	{
 		case STATE_START:
-		case STATE_BACKUP: *state = STATE_BROWSE; drawBrowse(); break;
+		case STATE_BENCHMARK: *state = STATE_BROWSE; drawBrowse(); break;
 		case STATE_BROWSE: *state = STATE_BACKUP; drawBackup(); break;
+		case STATE_BACKUP: *state = STATE_BENCHMARK; drawBenchmark(); break;
 		default: break;
 	}
 }
@@ -102,19 +153,23 @@ int main(void)
 	Result ret;
 	state = STATE_START;
 
+	fsStatsInit();
 	ret = FS_Init();
 	if (R_FAILED(ret))
 	{
-		consoleLog("\nCouldn't initialize the FS module!\n");
+		logError("\nCouldn't initialize the FS module!\n");
 		consoleLog("Have you selected a title?\n");
 		consoleLog("Error code: 0x%lx\n", ret);
 		// state = STATE_ERROR; // TODO: Remove out of Citra
 	}
 
+	fsBufferInit();
+	fsTuneInit();
+
 	ret = saveInit();
 	if (R_FAILED(ret))
 	{
-		consoleLog("\nCouldn't initialize the Save module!\n");
+		logError("\nCouldn't initialize the Save module!\n");
 		consoleLog("Error code: 0x%lx\n", ret);
 		// state = STATE_ERROR; // TODO: Remove out of Citra
 	}
@@ -122,28 +177,69 @@ int main(void)
 	ret = saveGetTitleId(&titleid);
 	if (R_FAILED(ret))
 	{
-		consoleLog("\nCouldn't get the title id of the game!\n");
+		logError("\nCouldn't get the title id of the game!\n");
 		consoleLog("Error code: 0x%lx\n", ret);
 		// state = STATE_ERROR; // TODO: Remove out of Citra
 	}
 
-	fsDirInit();
+	fsDirInit(titleid);
 	fsBackInit(titleid);
+	inputInit();
+
+#ifdef AUTO_BACKUP
+	// Only written if the save changed since the latest backup.
+	ret = fsBackExport(true, false);
+	consoleLog("  > fsBackExport: %lx\n", ret);
+#endif
 	switchState(&state);
-	consoleSelectNew(&consoleLog);
+	consoleSelectNew(&logConsole);
 
 	drawHelp();
 
 	u64 heldUp = 0;
 	u64 heldDown = 0;
 	u32 kDown, kHeld;
+	u32 frameCount = 0;
+	u32 pollCount = 0;
+	bool showStats = false;
+	bool showLog = false;
+	u32 logOffset = 0;
 	while (aptMainLoop())
 	{
 		gspWaitForVBlank();
-		hidScanInput();
+		frameBegin();
+		inputScan();
 
-		kDown = hidKeysDown();
-		kHeld = hidKeysHeld();
+		kDown = inputKeysDown();
+		kHeld = inputKeysHeld();
+		frameMark(FRAME_INPUT);
+
+		// The log history, over the help: its keys aren't passed to the state.
+		if (!showLog && kDown & KEY_UP && kHeld & KEY_SELECT)
+		{
+			showLog = true;
+			logOffset = logViewPrint(0);
+			kDown &= KEY_START;
+		}
+		else if (showLog)
+		{
+			if (kDown & (KEY_B | KEY_SELECT))
+			{
+				showLog = false;
+				logViewClose();
+				drawHelp();
+			}
+			else if (kDown & (KEY_UP | KEY_DOWN | KEY_L | KEY_R))
+			{
+				if (kDown & KEY_UP) logOffset++;
+				if (kDown & KEY_DOWN && logOffset > 0) logOffset--;
+				if (kDown & KEY_L) logOffset += LOG_VIEW_RECORDS;
+				if (kDown & KEY_R) logOffset = (logOffset > LOG_VIEW_RECORDS ? logOffset - LOG_VIEW_RECORDS : 0);
+				logOffset = logViewPrint(logOffset);
+			}
+
+			kDown &= KEY_START;
+		}
 
 		switch (state)
 		{
@@ -206,33 +302,57 @@ int main(void)
 				}
 #endif
 
-				if (kDown & KEY_A)
+				if (kDown & KEY_A && kHeld & KEY_SELECT)
+				{
+					fsTunePrint();
+				}
+				else if (kDown & KEY_A)
 				{
 					ret = fsDirGotoSubDir();
-					consoleLog("   > fsDirGotoSubDir: %lx\n", ret);
+					logDebug("   > fsDirGotoSubDir: %lx\n", ret);
 					fsDirPrintCurrent();
 				}
 
-				if (kDown & KEY_B)
+				if (kDown & KEY_B && kHeld & KEY_SELECT)
 				{
-					ret = fsDirGotoParentDir();
-					consoleLog("   > fsDirGotoParentDir: %lx\n", ret);
-					fsDirPrintCurrent();
-				}
+					ret = fsDirSwitchData();
+					consoleLog("   > fsDirSwitchData: %lx\n", ret);
 
-				if (kDown & KEY_X)
+					// The backups of the other archive.
+					fsBackExit();
+					fsBackInit(titleid);
+					fsDirPrintSave();
+					fsDirPrintSdmc();
+				}
+				else if (kDown & KEY_B)
 				{
-					ret = fsDirDeleteCurrentEntry();
-					consoleLog("   > fsDirDeleteCurrentEntry: %lx\n", ret);
+					ret = fsDirGotoParentDir();
+					logDebug("   > fsDirGotoParentDir: %lx\n", ret);
 					fsDirPrintCurrent();
 				}
 
-				if (kDown & KEY_Y)
+				if (kDown & (KEY_X | KEY_Y) && kHeld & KEY_SELECT)
 				{
-					ret = fsDirCopyCurrentEntry(false);
-					consoleLog("   > fsDirCopyCurrentEntry: %lx\n", ret);
+					ret = fsDirMirrorCurrentFolder(kDown & KEY_X);
+					consoleLog("   > fsDirMirrorCurrentFolder: %lx\n", ret);
 					fsDirPrintDick();
 				}
+				else
+				{
+					if (kDown & KEY_X)
+					{
+						ret = fsDirDeleteCurrentEntry();
+						consoleLog("   > fsDirDeleteCurrentEntry: %lx\n", ret);
+						fsDirPrintCurrent();
+					}
+
+					if (kDown & KEY_Y)
+					{
+						ret = fsDirCopyCurrentEntry(false, true);
+						consoleLog("   > fsDirCopyCurrentEntry: %lx\n", ret);
+						fsDirPrintDick();
+					}
+				}
 
 				break;
 			}
@@ -240,12 +360,23 @@ int main(void)
 			{
 				if (kDown & KEY_A)
 				{
-					ret = fsBackImport();
+					ret = fsBackImport(!(kHeld & KEY_SELECT));
 					consoleLog("  > fsBackImport: %lx\n", ret);
 					fsBackPrintSave();
 				}
 
-				if (kDown & KEY_B)
+				if (kDown & KEY_B && kHeld & KEY_SELECT)
+				{
+					ret = fsDirSwitchData();
+					consoleLog("  > fsDirSwitchData: %lx\n", ret);
+
+					// The backups of the other archive.
+					fsBackExit();
+					fsBackInit(titleid);
+					fsBackPrintSave();
+					fsBackPrintBackup();
+				}
+				else if (kDown & KEY_B)
 				{
 					state = STATE_BACKUP_KEY;
 
@@ -263,11 +394,29 @@ int main(void)
 
 				if (kDown & KEY_Y)
 				{
-					ret = fsBackExport();
+					ret = fsBackExport(true, kHeld & KEY_SELECT);
 					consoleLog("  > fsBackExport: %lx\n", ret);
 					fsBackPrintBackup();
 				}
 
+				if (kDown & KEY_RIGHT)
+				{
+					ret = fsBackVerify();
+					consoleLog("  > fsBackVerify: %lx\n", ret);
+				}
+
+				if (kDown & KEY_LEFT)
+				{
+					ret = fsBatchExportAll();
+					consoleLog("  > fsBatchExportAll: %lx\n", ret);
+					fsBufferLogUsage();
+
+					// Reload the backups of the title, the batch may have added one.
+					fsBackExit();
+					fsBackInit(titleid);
+					fsBackPrintBackup();
+				}
+
 				if (kDown & KEY_UP)
 				{
 					fsBackMove(-1);
@@ -306,6 +455,65 @@ int main(void)
 
 				break;
 			}
+			case STATE_BENCHMARK:
+			{
+				if (kDown & KEY_A)
+				{
+					ret = fsBenchRun();
+					consoleLog("  > fsBenchRun: %lx\n", ret);
+					fsBenchPrint();
+				}
+
+				if (kDown & KEY_Y)
+				{
+					if (traceEnabled)
+					{
+						traceStop();
+						consoleLog("Tracing stopped, %lu span(s)\n", traceGetCount());
+					}
+					else
+					{
+						ret = traceStart();
+						consoleLog("  > traceStart: %lx\n", ret);
+					}
+				}
+
+				if (kDown & KEY_X)
+				{
+					ret = traceDump();
+					consoleLog("  > traceDump: %lx (%lu span(s))\n", ret, traceGetCount());
+				}
+
+				if (kDown & KEY_UP)
+				{
+					if (logFileEnabled)
+					{
+						ret = logFileStop();
+						consoleLog("  > logFileStop: %lx\n", ret);
+					}
+					else
+					{
+						ret = logFileStart();
+						consoleLog("  > logFileStart: %lx\n", ret);
+					}
+				}
+
+				if (kDown & KEY_B)
+				{
+					if (fsCaptureEnabled)
+					{
+						ret = fsCaptureStop();
+						consoleLog("  > fsCaptureStop: %lx\n", ret);
+					}
+					else
+					{
+						ret = fsCaptureStart();
+						consoleLog("  > fsCaptureStart: %lx\n", ret);
+					}
+				}
+
+				break;
+			}
 			case STATE_BACKUP_KEY:
 			{
 				// TODO: updateKeyboard
@@ -339,13 +547,25 @@ int main(void)
 		}
 
 		{
-			if (kDown & KEY_L)
+			if (kDown & KEY_L && kHeld & KEY_SELECT)
+			{
+				showStats = !showStats;
+				if (showStats) fsStatsPrint();
+				else drawHelp();
+			}
+			else if (kDown & KEY_L)
 			{
 				// TODO: Prev
 				switchState(&state);
 			}
 
-			if (kDown & KEY_R)
+			if (kDown & KEY_R && kHeld & KEY_SELECT)
+			{
+				fsStatsReset();
+				memResetPeak();
+				if (showStats) fsStatsPrint();
+			}
+			else if (kDown & KEY_R)
 			{
 				// TODO: Next
 				switchState(&state);
@@ -353,19 +573,42 @@ int main(void)
 
 			if (kDown & KEY_SELECT)
 			{
+				showStats = false;
 				drawHelp();
 			}
+
+			// The live statistics, refreshed every second.
+			if (showStats && !showLog && ++frameCount % 60 == 0) fsStatsPrint();
 		}
 
+		// The memory pressure, polled every second.
+		if (++pollCount % 60 == 0) memPoll();
+
+		frameMark(FRAME_LOGIC);
+
+		u64 renderStart = frameRenderBegin();
+		logFlush();
+		frameRenderEnd("logFlush", renderStart);
+
 		if (kDown & KEY_START)
 			break;
 
 		gfxFlushBuffers();
 		gfxSwapBuffers();
+		frameMark(FRAME_FLUSH);
+		frameEnd();
 	}
 
+	frameLog();
+	inputExit();
+	if (fsCaptureEnabled) fsCaptureStop();
+
 	fsDirExit();
 	fsBackExit();
+	fsTuneExit();
+	fsBufferExit();
+	traceExit();
+	logExit();
 	FS_Exit();
 	{
 		hidScanInput();
@@ -0,0 +1,362 @@
+#include "mem.h"
+#include "console.h"
+
+#include <3ds/os.h>
+#include <3ds/synchronization.h>
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// The header of a block, right before it.
+typedef struct memBlock
+{
+	struct memBlock* prev;	///< The previous outstanding block
+	struct memBlock* next;	///< The next outstanding block
+	void* base;				///< The start of the allocation (before the header if aligned)
+	u32 size;				///< The size of the block
+	u32 tag;				///< The index of the tag
+} memBlock;
+
+_Static_assert(sizeof(memBlock) <= MEM_HEADER_SIZE, "MEM_HEADER_SIZE is too small");
+
+static memTagStats tags[MEM_MAX_TAGS];
+static u32 tagCount = 0;
+static memBlock* firstBlock = NULL;
+static u32 liveBytes = 0;
+static u32 peakBytes = 0;
+static LightLock memLock;
+static bool isInit = false;
+
+/// A consumer of the spare memory.
+typedef struct
+{
+	const char* name;		///< The consumer (a static string)
+	memAdaptFunc adapt;		///< Its adapt callback
+} memConsumer;
+
+static memConsumer consumers[MEM_MAX_CONSUMERS];
+static u32 consumerCount = 0;
+static memPressure pressure = MEM_PRESSURE_NONE;	// The pressure of the latest poll.
+
+/**
+ * @brief Gets the index of a tag, added if new (with memLock).
+ * The tags over MEM_MAX_TAGS share the last one.
+ */
+static u32 memFindTag(const char* tag)
+{
+	if (!tag) tag = "untagged";
+
+	for (u32 i = 0; i < tagCount; i++)
+	{
+		if (tags[i].tag == tag || strcmp(tags[i].tag, tag) == 0) return i;
+	}
+
+	if (tagCount == MEM_MAX_TAGS) return MEM_MAX_TAGS - 1;
+
+	memset(&tags[tagCount], 0, sizeof(memTagStats));
+	tags[tagCount].tag = tag;
+	return tagCount++;
+}
+
+/**
+ * @brief Adds a block to the outstanding ones (with memLock).
+ */
+static void memLink(memBlock* block)
+{
+	block->prev = NULL;
+	block->next = firstBlock;
+	if (firstBlock) firstBlock->prev = block;
+	firstBlock = block;
+
+	memTagStats* stats = &tags[block->tag];
+	stats->liveCount++;
+	stats->liveBytes += block->size;
+	stats->allocCount++;
+	if (stats->liveBytes > stats->peakBytes) stats->peakBytes = stats->liveBytes;
+
+	liveBytes += block->size;
+	if (liveBytes > peakBytes) peakBytes = liveBytes;
+}
+
+/**
+ * @brief Removes a block from the outstanding ones (with memLock).
+ */
+static void memUnlink(memBlock* block)
+{
+	if (block->prev) block->prev->next = block->next;
+	else firstBlock = block->next;
+	if (block->next) block->next->prev = block->prev;
+
+	memTagStats* stats = &tags[block->tag];
+	stats->liveCount--;
+	stats->liveBytes -= block->size;
+
+	liveBytes -= block->size;
+}
+
+/**
+ * @brief Initializes the lock, on the first allocation (from the main thread).
+ */
+static inline void memInit(void)
+{
+	if (isInit) return;
+
+	LightLock_Init(&memLock);
+	isInit = true;
+}
+
+/**
+ * @brief Tracks a new allocation.
+ * @return The block, after its header.
+ */
+static void* memTrack(const char* tag, void* base, u8* header, size_t size)
+{
+	memBlock* block = (memBlock*) header;
+	block->base = base;
+	block->size = size;
+
+	LightLock_Lock(&memLock);
+	block->tag = memFindTag(tag);
+	memLink(block);
+	LightLock_Unlock(&memLock);
+
+	return header + MEM_HEADER_SIZE;
+}
+
+void* memAlloc(const char* tag, size_t size)
+{
+	memInit();
+
+	u8* base = (u8*) malloc(MEM_HEADER_SIZE + size);
+	if (!base) return NULL;
+
+	return memTrack(tag, base, base, size);
+}
+
+void* memAlign(const char* tag, size_t alignment, size_t size)
+{
+	memInit();
+
+	// The header at the end of the padding.
+	size_t offset = (MEM_HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+
+	u8* base = (u8*) memalign(alignment, offset + size);
+	if (!base) return NULL;
+
+	return memTrack(tag, base, base + offset - MEM_HEADER_SIZE, size);
+}
+
+void* memRealloc(const char* tag, void* ptr, size_t size)
+{
+	if (!ptr) return memAlloc(tag, size);
+
+	memBlock* block = (memBlock*) ((u8*) ptr - MEM_HEADER_SIZE);
+
+	LightLock_Lock(&memLock);
+
+	memUnlink(block);
+
+	memBlock* resized = (memBlock*) realloc(block->base, MEM_HEADER_SIZE + size);
+	if (resized)
+	{
+		resized->base = resized;
+		resized->size = size;
+		block = resized;
+	}
+
+	memLink(block);
+
+	LightLock_Unlock(&memLock);
+
+	return (resized ? (u8*) resized + MEM_HEADER_SIZE : NULL);
+}
+
+void memFree(void* ptr)
+{
+	if (!ptr) return;
+
+	memBlock* block = (memBlock*) ((u8*) ptr - MEM_HEADER_SIZE);
+
+	LightLock_Lock(&memLock);
+	memUnlink(block);
+	LightLock_Unlock(&memLock);
+
+	free(block->base);
+}
+
+u32 memGetStats(memTagStats* stats)
+{
+	if (!isInit) return 0;
+
+	LightLock_Lock(&memLock);
+	u32 count = tagCount;
+	if (stats) memcpy(stats, tags, count * sizeof(memTagStats));
+	LightLock_Unlock(&memLock);
+
+	return count;
+}
+
+u32 memGetLiveBytes(u32* peak)
+{
+	if (peak) *peak = peakBytes;
+	return liveBytes;
+}
+
+void memResetPeak(void)
+{
+	if (!isInit) return;
+
+	LightLock_Lock(&memLock);
+
+	for (u32 i = 0; i < tagCount; i++)
+	{
+		tags[i].peakBytes = tags[i].liveBytes;
+		tags[i].allocCount = 0;
+	}
+
+	peakBytes = liveBytes;
+
+	LightLock_Unlock(&memLock);
+}
+
+void memDump(const char* context)
+{
+	if (!isInit) return;
+
+	LightLock_Lock(&memLock);
+
+	consoleLog("%s: %lu KB live, %lu KB peak\n", context, (liveBytes + 1023) / 1024, (peakBytes + 1023) / 1024);
+
+	for (u32 i = 0; i < tagCount; i++)
+	{
+		const memTagStats* stats = &tags[i];
+		if (stats->liveCount == 0) continue;
+
+		consoleLog("  %-16.16s %5lu blk %7lu B (peak %lu B, %lu alloc)\n", stats->tag, stats->liveCount, stats->liveBytes, stats->peakBytes, stats->allocCount);
+
+		// The most recent outstanding blocks first.
+		u32 listed = 0;
+		for (const memBlock* block = firstBlock; block && listed < MEM_DUMP_BLOCKS; block = block->next)
+		{
+			if (block->tag != i) continue;
+
+			consoleLog("    %p %lu B\n", (const u8*) block + MEM_HEADER_SIZE, block->size);
+			listed++;
+		}
+	}
+
+	LightLock_Unlock(&memLock);
+}
+
+void memRegister(const char* name, memAdaptFunc adapt)
+{
+	if (!adapt) return;
+
+	memInit();
+	LightLock_Lock(&memLock);
+
+	bool found = false;
+	for (u32 i = 0; i < consumerCount && !found; i++)
+		found = (consumers[i].adapt == adapt);
+
+	if (!found && consumerCount < MEM_MAX_CONSUMERS)
+	{
+		consumers[consumerCount].name = name;
+		consumers[consumerCount].adapt = adapt;
+		consumerCount++;
+	}
+
+	LightLock_Unlock(&memLock);
+}
+
+/**
+ * @brief Adapts all the consumers to a pressure, without memLock (their callbacks free memory).
+ * @return The bytes released.
+ */
+static u32 memAdapt(memPressure level)
+{
+	memConsumer list[MEM_MAX_CONSUMERS];
+
+	LightLock_Lock(&memLock);
+	u32 count = consumerCount;
+	memcpy(list, consumers, count * sizeof(memConsumer));
+	LightLock_Unlock(&memLock);
+
+	u32 released = 0;
+	for (u32 i = 0; i < count; i++)
+		released += list[i].adapt(level);
+
+	return released;
+}
+
+/**
+ * @brief Gets the free bytes of the heap: the unused part of the newlib heap (mapped at launch
+ * from the application region, __ctru_heap_size bytes), and the rest of the region.
+ */
+static s64 memGetFree(void)
+{
+	extern u32 __ctru_heap_size;
+
+	struct mallinfo info = mallinfo();
+	s64 available = osGetMemRegionFree(MEMREGION_APPLICATION);
+	if (__ctru_heap_size > info.arena) available += __ctru_heap_size - info.arena;
+	available += info.fordblks;
+
+	return available;
+}
+
+memPressure memGetPressure(u32* freeBytes)
+{
+	s64 available = memGetFree();
+	if (available < 0) available = 0;
+	if (freeBytes) *freeBytes = (available > UINT32_MAX ? UINT32_MAX : (u32) available);
+
+	if (available <= MEM_PRESSURE_HIGH_FREE) return MEM_PRESSURE_HIGH;
+	if (available <= MEM_PRESSURE_LOW_FREE) return MEM_PRESSURE_LOW;
+	return MEM_PRESSURE_NONE;
+}
+
+memPressure memPoll(void)
+{
+	static const char* names[] = { "none", "low", "high" };
+
+	if (!isInit) return MEM_PRESSURE_NONE;
+
+	u32 freeBytes;
+	memPressure current = memGetPressure(&freeBytes);
+	if (current == pressure) return current;
+
+	consoleLog("Memory pressure: %s (%lu KB free)\n", names[current], freeBytes / 1024);
+	pressure = current;
+
+	u32 released = memAdapt(current);
+	if (released > 0) consoleLog("  %lu KB released\n", released / 1024);
+
+	return current;
+}
+
+bool memReclaim(void)
+{
+	if (!isInit) return false;
+
+	u32 released = memAdapt(MEM_PRESSURE_HIGH);
+	if (released == 0) return false;
+
+	// The consumers grow back on the next poll, once the pressure is gone.
+	pressure = MEM_PRESSURE_HIGH;
+	return true;
+}
+
+u32 memGetBudget(u32 held, u32 shift, u32 min, u32 max)
+{
+	u32 freeBytes;
+	memPressure current = memGetPressure(&freeBytes);
+
+	u64 budget = ((u64) freeBytes + held) >> shift;
+	if (budget < min && current != MEM_PRESSURE_HIGH) budget = min;
+	if (budget > max) budget = max;
+
+	return (u32) budget;
+}
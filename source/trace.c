@@ -0,0 +1,166 @@
+#include "trace.h"
+#include "fsls.h"
+#include "fs.h"
+#include "mem.h"
+
+#include <3ds/os.h>
+#include <3ds/thread.h>
+#include <3ds/result.h>
+#include <3ds/synchronization.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool traceEnabled = false;
+
+/// The ring buffer of the spans, the oldest overwritten first.
+static traceSpan* spans = NULL;
+static u32 spanHead = 0;	// The next span written.
+static u32 spanCount = 0;	// The count of the spans, TRACE_CAPACITY at most.
+static LightLock spanLock;
+
+void traceRecord(const char* name, u64 start)
+{
+	u64 end = svcGetSystemTick();
+	Thread thread = threadGetCurrent();
+
+	LightLock_Lock(&spanLock);
+
+	if (spans)
+	{
+		traceSpan* span = &spans[spanHead];
+		span->name = name;
+		span->start = start;
+		span->duration = (end - start > UINT32_MAX ? UINT32_MAX : (u32) (end - start));
+		span->thread = (u32) (uintptr_t) thread;
+
+		spanHead = (spanHead + 1) % TRACE_CAPACITY;
+		if (spanCount < TRACE_CAPACITY) spanCount++;
+	}
+
+	LightLock_Unlock(&spanLock);
+}
+
+/**
+ * @brief Adapts the trace to the memory pressure (see memAdaptFunc):
+ * the spans of a stopped trace are dropped under high pressure, not dumped.
+ */
+static u32 traceAdapt(memPressure pressure)
+{
+	if (pressure != MEM_PRESSURE_HIGH || traceEnabled || !spans) return 0;
+
+	traceExit();
+	return TRACE_CAPACITY * sizeof(traceSpan);
+}
+
+Result traceStart(void)
+{
+	static bool isInit = false;
+	if (!isInit)
+	{
+		LightLock_Init(&spanLock);
+		memRegister("trace", traceAdapt);
+		isInit = true;
+	}
+
+	LightLock_Lock(&spanLock);
+
+	if (!spans) spans = (traceSpan*) memAlloc("traceStart", TRACE_CAPACITY * sizeof(traceSpan));
+	spanHead = 0;
+	spanCount = 0;
+
+	LightLock_Unlock(&spanLock);
+
+	if (!spans) return -2;
+
+	traceEnabled = true;
+	return 0;
+}
+
+void traceStop(void)
+{
+	traceEnabled = false;
+}
+
+void traceExit(void)
+{
+	traceEnabled = false;
+	if (!spans) return;
+
+	LightLock_Lock(&spanLock);
+	memFree(spans);
+	spans = NULL;
+	spanHead = 0;
+	spanCount = 0;
+	LightLock_Unlock(&spanLock);
+}
+
+u32 traceGetCount(void)
+{
+	return spanCount;
+}
+
+/**
+ * @brief Converts system ticks to microseconds.
+ */
+static inline double traceMicros(u64 ticks)
+{
+	return (double) ticks * 1000000.0 / SYSCLOCK_ARM11;
+}
+
+Result traceDump(void)
+{
+	if (!spans) return -1;
+
+	Result ret;
+	const FS_Archive* sdmcArchive = NULL;
+
+	// The dump itself is not traced.
+	bool enabled = traceEnabled;
+	traceEnabled = false;
+
+	ret = FS_AcquireArchive(&sdmcArchiveDesc, &sdmcArchive);
+	if (R_FAILED(ret))
+	{
+		traceEnabled = enabled;
+		return ret;
+	}
+
+	FS_CreateDirectory("/tvds/", sdmcArchive);
+
+	FS_Stream stream;
+	ret = FS_StreamOpen(&stream, fsMakePath(PATH_ASCII, TRACE_PATH), sdmcArchive, FS_OPEN_WRITE | FS_OPEN_CREATE, FS_TEXT_BUFFER_SIZE, FS_FLUSH_CLOSE);
+	if (R_SUCCEEDED(ret))
+	{
+		char line[TRACE_LINE_LENGTH];
+		u32 first = (spanCount < TRACE_CAPACITY ? 0 : spanHead);
+		u64 base = (spanCount > 0 ? spans[first].start : 0);
+
+		static const char header[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main\"}}";
+		ret = FS_StreamWrite(&stream, header, strlen(header));
+
+		// The complete events, oldest first, in microseconds since the oldest.
+		for (u32 i = 0; i < spanCount && R_SUCCEEDED(ret); i++)
+		{
+			const traceSpan* span = &spans[(first + i) % TRACE_CAPACITY];
+			int len = snprintf(line, TRACE_LINE_LENGTH, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+				span->name, span->thread, traceMicros(span->start - base), traceMicros(span->duration));
+
+			ret = FS_StreamWrite(&stream, line, len);
+		}
+
+		if (R_SUCCEEDED(ret)) ret = FS_StreamWrite(&stream, "\n]}\n", 4);
+		if (R_SUCCEEDED(ret)) ret = FS_StreamTruncate(&stream);
+
+		Result closeRet = FS_StreamClose(&stream);
+		if (R_SUCCEEDED(ret)) ret = closeRet;
+	}
+
+	FS_ReleaseArchive(sdmcArchive);
+
+	traceEnabled = enabled;
+	return ret;
+}